@@ -0,0 +1,396 @@
+#include "xcgd_capi.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "analysis.h"
+#include "apps/helmholtz_filter.h"
+#include "elements/gd_mesh.h"
+#include "elements/gd_vandermonde.h"
+#include "multigrid.h"
+#include "physics/linear_elasticity.h"
+#include "physics/poisson.h"
+#include "sparse_utils/sparse_utils.h"
+#include "utils/linalg.h"
+#include "utils/misc.h"
+
+static thread_local std::string capi_last_error;
+
+// Translate exceptions to error codes, nothing may propagate through the C ABI
+template <class Func>
+static int capi_call(const Func& f) {
+  try {
+    f();
+    return XCGD_OK;
+  } catch (const std::invalid_argument& e) {
+    capi_last_error = e.what();
+    return XCGD_ERROR_INVALID_ARGUMENT;
+  } catch (const std::exception& e) {
+    capi_last_error = e.what();
+    return XCGD_ERROR_RUNTIME;
+  } catch (...) {
+    capi_last_error = "unknown error";
+    return XCGD_ERROR_UNKNOWN;
+  }
+}
+
+static void capi_check(bool cond, const char* msg) {
+  if (!cond) throw std::invalid_argument(msg);
+}
+
+static void capi_check_Np_1d(int Np_1d) {
+  if (!(Np_1d == 2 or Np_1d == 4 or Np_1d == 6 or Np_1d == 8)) {
+    char msg[256];
+    std::snprintf(msg, 256, "Np_1d must be 2, 4, 6 or 8, got %d", Np_1d);
+    throw std::invalid_argument(msg);
+  }
+}
+
+class CapiProblemBase {
+ public:
+  virtual ~CapiProblemBase() = default;
+  virtual void update_lsf(const double* lsf) = 0;
+  virtual void get_sizes(int* nverts, int* nnodes, int* ndof,
+                         int* nnz) const = 0;
+  virtual void get_node_verts(int* node_verts) const = 0;
+  virtual void residual(const double* dof, double* res) const = 0;
+  virtual void jacobian_csr(int* rowp, int* cols, double* vals) const = 0;
+  virtual void solve(double* sol) const = 0;
+  virtual void lsf_adjoint_product(const double* dof, const double* psi,
+                                   double* dfdphi) const = 0;
+};
+
+class CapiFilterBase {
+ public:
+  virtual ~CapiFilterBase() = default;
+  virtual void apply(const double* x, double* phi) = 0;
+  virtual void apply_gradient(const double* x, const double* dfdphi,
+                              double* dfdx) = 0;
+};
+
+/**
+ * @brief Cut-cell problem with spatially constant source and boundary values,
+ * the Dirichlet boundary conditions are imposed via Nitsche's method, see
+ * also examples/nitsche_accuracy
+ */
+template <int Np_1d, int physics>
+class CapiProblem final : public CapiProblemBase {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using QuadratureBulk = GDLSFQuadrature2D<T, Np_1d, QuadPtType::INNER>;
+  using QuadratureBCs = GDLSFQuadrature2D<T, Np_1d, QuadPtType::SURFACE>;
+  using Basis = GDBasis2D<T, Mesh>;
+
+  static constexpr int spatial_dim = Basis::spatial_dim;
+  static constexpr bool is_poisson = physics == XCGD_PHYSICS_POISSON;
+
+  struct ScalarFun {
+    T val;
+    T operator()(const A2D::Vec<T, spatial_dim>& xloc) const { return val; }
+  };
+
+  struct VecFun {
+    T val[spatial_dim];
+    A2D::Vec<T, spatial_dim> operator()(
+        const A2D::Vec<T, spatial_dim>& xloc) const {
+      return A2D::Vec<T, spatial_dim>(val);
+    }
+  };
+
+  using PhysicsBulk = typename std::conditional<
+      is_poisson, PoissonPhysics<T, spatial_dim, ScalarFun>,
+      LinearElasticity<T, spatial_dim, VecFun>>::type;
+  using PhysicsBCs = typename std::conditional<
+      is_poisson, PoissonCutDirichlet<T, spatial_dim, ScalarFun>,
+      LinearElasticityCutDirichlet<T, spatial_dim, spatial_dim,
+                                   VecFun>>::type;
+  using AnalysisBulk =
+      GalerkinAnalysis<T, Mesh, QuadratureBulk, Basis, PhysicsBulk>;
+  using AnalysisBCs =
+      GalerkinAnalysis<T, Mesh, QuadratureBCs, Basis, PhysicsBCs>;
+
+  static constexpr int dof_per_node = PhysicsBulk::dof_per_node;
+  using BSRMat = GalerkinBSRMat<T, dof_per_node>;
+  using CSCMat = SparseUtils::CSCMat<T>;
+
+ public:
+  static constexpr int num_params = is_poisson ? 3 : 7;
+
+  CapiProblem(const int* nxy, const T* lxy, const T* lsf, const T* params)
+      : grid(nxy, lxy),
+        mesh(grid),
+        quadrature_bulk(mesh),
+        quadrature_bcs(mesh),
+        basis(mesh),
+        physics_bulk(create_physics_bulk(params)),
+        physics_bcs(create_physics_bcs(params)),
+        analysis_bulk(mesh, quadrature_bulk, basis, physics_bulk),
+        analysis_bcs(mesh, quadrature_bcs, basis, physics_bcs) {
+    update_lsf(lsf);
+  }
+
+  void update_lsf(const T* lsf) {
+    std::vector<T>& lsf_dof = mesh.get_lsf_dof();
+    std::copy(lsf, lsf + lsf_dof.size(), lsf_dof.begin());
+    mesh.update_mesh();
+
+    // The problems are linear, the Jacobian only depends on the mesh
+    int *rowp = nullptr, *cols = nullptr;
+    SparseUtils::CSRFromConnectivityFunctor(
+        mesh.get_num_nodes(), mesh.get_num_elements(),
+        mesh.max_nnodes_per_element,
+        [this](int elem, int* nodes) -> int {
+          return mesh.get_elem_dof_nodes(elem, nodes);
+        },
+        &rowp, &cols);
+    int nnz = rowp[mesh.get_num_nodes()];
+    jac = std::make_shared<BSRMat>(mesh.get_num_nodes(), nnz, rowp, cols);
+    if (rowp) delete rowp;
+    if (cols) delete cols;
+
+    std::vector<T> zeros(dof_per_node * mesh.get_num_nodes(), T(0.0));
+    analysis_bulk.jacobian(nullptr, zeros.data(), jac.get());
+    analysis_bcs.jacobian(nullptr, zeros.data(), jac.get(), false);
+  }
+
+  void get_sizes(int* nverts, int* nnodes, int* ndof, int* nnz) const {
+    if (nverts) *nverts = mesh.get_lsf_dof().size();
+    if (nnodes) *nnodes = mesh.get_num_nodes();
+    if (ndof) *ndof = dof_per_node * mesh.get_num_nodes();
+    if (nnz) *nnz = dof_per_node * dof_per_node * jac->nnz;
+  }
+
+  void get_node_verts(int* node_verts) const {
+    for (int i = 0; i < mesh.get_num_nodes(); i++) {
+      node_verts[i] = mesh.get_node_vert(i);
+    }
+  }
+
+  void residual(const T* dof, T* res) const {
+    std::fill(res, res + dof_per_node * mesh.get_num_nodes(), T(0.0));
+    analysis_bulk.residual(nullptr, dof, res);
+    analysis_bcs.residual(nullptr, dof, res);
+  }
+
+  void jacobian_csr(int* rowp, int* cols, T* vals) const {
+    SparseUtils::CSRMat<T>* A = bsr_to_csr(jac.get());
+    std::copy(A->rowp, A->rowp + A->nrows + 1, rowp);
+    std::copy(A->cols, A->cols + A->rowp[A->nrows], cols);
+    std::copy(A->vals, A->vals + A->rowp[A->nrows], vals);
+    delete A;
+  }
+
+  void solve(T* sol) const {
+    // R(u) = K * u + R(0), hence u = -K^{-1} * R(0)
+    int ndof = dof_per_node * mesh.get_num_nodes();
+    std::vector<T> zeros(ndof, T(0.0));
+    residual(zeros.data(), sol);
+    for (int i = 0; i < ndof; i++) sol[i] *= -1.0;
+
+    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac.get());
+    SparseUtils::SparseCholesky<T> chol(jac_csc);
+    chol.factor();
+    chol.solve(sol);
+    if (jac_csc) delete jac_csc;
+  }
+
+  void lsf_adjoint_product(const T* dof, const T* psi, T* dfdphi) const {
+    analysis_bulk.LSF_jacobian_adjoint_product(dof, psi, dfdphi);
+    analysis_bcs.LSF_jacobian_adjoint_product(dof, psi, dfdphi);
+  }
+
+ private:
+  static PhysicsBulk create_physics_bulk(const T* p) {
+    if constexpr (is_poisson) {
+      return PhysicsBulk(ScalarFun{p[0]});
+    } else {
+      return PhysicsBulk(p[0], p[1], VecFun{{p[2], p[3]}});
+    }
+  }
+
+  static PhysicsBCs create_physics_bcs(const T* p) {
+    if constexpr (is_poisson) {
+      return PhysicsBCs(p[2], ScalarFun{p[1]});
+    } else {
+      return PhysicsBCs(p[6], VecFun{{p[4], p[5]}});
+    }
+  }
+
+  Grid grid;
+  Mesh mesh;
+  QuadratureBulk quadrature_bulk;
+  QuadratureBCs quadrature_bcs;
+  Basis basis;
+  PhysicsBulk physics_bulk;
+  PhysicsBCs physics_bcs;
+  AnalysisBulk analysis_bulk;
+  AnalysisBCs analysis_bcs;
+  std::shared_ptr<BSRMat> jac;
+};
+
+template <int Np_1d>
+class CapiFilter final : public CapiFilterBase {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+
+ public:
+  CapiFilter(const int* nxy, const T* lxy, T r0)
+      : grid(nxy, lxy), filter(r0, grid) {}
+
+  void apply(const T* x, T* phi) { filter.apply(x, phi); }
+
+  void apply_gradient(const T* x, const T* dfdphi, T* dfdx) {
+    filter.applyGradient(x, dfdphi, dfdx);
+  }
+
+ private:
+  Grid grid;
+  HelmholtzFilter<T, Np_1d, Grid> filter;
+};
+
+struct xcgd_problem {
+  std::unique_ptr<CapiProblemBase> impl;
+};
+
+struct xcgd_filter {
+  std::unique_ptr<CapiFilterBase> impl;
+};
+
+extern "C" {
+
+const char* xcgd_get_last_error(void) { return capi_last_error.c_str(); }
+
+int xcgd_problem_create(int physics, int Np_1d, int nx, int ny, double lx,
+                        double ly, const double* lsf, const double* params,
+                        int nparams, xcgd_problem** problem) {
+  return capi_call([&]() {
+    capi_check(problem, "problem is null");
+    capi_check(lsf and params, "null argument");
+    capi_check(nx > 0 and ny > 0 and lx > 0.0 and ly > 0.0,
+               "grid dimensions must be positive");
+    capi_check(physics == XCGD_PHYSICS_POISSON or
+                   physics == XCGD_PHYSICS_LINEAR_ELASTICITY,
+               "unknown physics");
+    capi_check_Np_1d(Np_1d);
+
+    int nxy[2] = {nx, ny};
+    double lxy[2] = {lx, ly};
+    auto p = std::make_unique<xcgd_problem>();
+    auto create = [&]<int Np_1d_>() {
+      if constexpr (Np_1d_ % 2 == 0 and Np_1d_ >= 2) {
+        if (physics == XCGD_PHYSICS_POISSON) {
+          using Problem = CapiProblem<Np_1d_, XCGD_PHYSICS_POISSON>;
+          capi_check(nparams == Problem::num_params,
+                     "Poisson expects 3 parameters");
+          p->impl = std::make_unique<Problem>(nxy, lxy, lsf, params);
+        } else {
+          using Problem = CapiProblem<Np_1d_, XCGD_PHYSICS_LINEAR_ELASTICITY>;
+          capi_check(nparams == Problem::num_params,
+                     "linear elasticity expects 7 parameters");
+          p->impl = std::make_unique<Problem>(nxy, lxy, lsf, params);
+        }
+      }
+    };
+    switcher<8>::run(create, Np_1d);
+    *problem = p.release();
+  });
+}
+
+void xcgd_problem_destroy(xcgd_problem* problem) { delete problem; }
+
+int xcgd_problem_update_lsf(xcgd_problem* problem, const double* lsf) {
+  return capi_call([&]() {
+    capi_check(problem and lsf, "null argument");
+    problem->impl->update_lsf(lsf);
+  });
+}
+
+int xcgd_problem_get_sizes(const xcgd_problem* problem, int* nverts,
+                           int* nnodes, int* ndof, int* nnz) {
+  return capi_call([&]() {
+    capi_check(problem, "problem is null");
+    problem->impl->get_sizes(nverts, nnodes, ndof, nnz);
+  });
+}
+
+int xcgd_problem_get_node_verts(const xcgd_problem* problem, int* node_verts) {
+  return capi_call([&]() {
+    capi_check(problem and node_verts, "null argument");
+    problem->impl->get_node_verts(node_verts);
+  });
+}
+
+int xcgd_problem_residual(xcgd_problem* problem, const double* dof,
+                          double* res) {
+  return capi_call([&]() {
+    capi_check(problem and dof and res, "null argument");
+    problem->impl->residual(dof, res);
+  });
+}
+
+int xcgd_problem_jacobian_csr(xcgd_problem* problem, int* rowp, int* cols,
+                              double* vals) {
+  return capi_call([&]() {
+    capi_check(problem and rowp and cols and vals, "null argument");
+    problem->impl->jacobian_csr(rowp, cols, vals);
+  });
+}
+
+int xcgd_problem_solve(xcgd_problem* problem, double* sol) {
+  return capi_call([&]() {
+    capi_check(problem and sol, "null argument");
+    problem->impl->solve(sol);
+  });
+}
+
+int xcgd_problem_lsf_adjoint_product(xcgd_problem* problem, const double* dof,
+                                     const double* psi, double* dfdphi) {
+  return capi_call([&]() {
+    capi_check(problem and dof and psi and dfdphi, "null argument");
+    problem->impl->lsf_adjoint_product(dof, psi, dfdphi);
+  });
+}
+
+int xcgd_filter_create(int Np_1d, int nx, int ny, double lx, double ly,
+                       double r0, xcgd_filter** filter) {
+  return capi_call([&]() {
+    capi_check(filter, "filter is null");
+    capi_check(nx > 0 and ny > 0 and lx > 0.0 and ly > 0.0,
+               "grid dimensions must be positive");
+    capi_check_Np_1d(Np_1d);
+
+    int nxy[2] = {nx, ny};
+    double lxy[2] = {lx, ly};
+    auto f = std::make_unique<xcgd_filter>();
+    auto create = [&]<int Np_1d_>() {
+      if constexpr (Np_1d_ % 2 == 0 and Np_1d_ >= 2) {
+        f->impl = std::make_unique<CapiFilter<Np_1d_>>(nxy, lxy, r0);
+      }
+    };
+    switcher<8>::run(create, Np_1d);
+    *filter = f.release();
+  });
+}
+
+void xcgd_filter_destroy(xcgd_filter* filter) { delete filter; }
+
+int xcgd_filter_apply(xcgd_filter* filter, const double* x, double* phi) {
+  return capi_call([&]() {
+    capi_check(filter and x and phi, "null argument");
+    filter->impl->apply(x, phi);
+  });
+}
+
+int xcgd_filter_apply_gradient(xcgd_filter* filter, const double* x,
+                               const double* dfdphi, double* dfdx) {
+  return capi_call([&]() {
+    capi_check(filter and x and dfdphi and dfdx, "null argument");
+    filter->impl->apply_gradient(x, dfdphi, dfdx);
+  });
+}
+
+}  // extern "C"
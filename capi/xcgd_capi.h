@@ -0,0 +1,145 @@
+#ifndef XCGD_CAPI_H
+#define XCGD_CAPI_H
+
+/**
+ * Plain C interface to a few common instantiations of xcgd, intended to be
+ * called from Python via ctypes, see python/xcgd_capi.py.
+ *
+ * Conventions:
+ *   - All functions return XCGD_OK on success, or an error code otherwise, in
+ *     which case xcgd_get_last_error() returns a description of the error.
+ *   - All arrays are provided by the caller and are never retained by the
+ *     library, inputs are read and outputs are written in place without any
+ *     copy on the caller side.
+ *   - Real arrays are double, integer arrays are int, in native byte order.
+ *   - A problem is defined on a structured nx-by-ny grid of [0, lx] x [0, ly],
+ *     the analysis domain is where the level-set function (LSF), given at the
+ *     nverts = (nx + 1) * (ny + 1) grid vertices, is non-positive. The
+ *     unknowns are associated with the nnodes vertices of the active cells, the
+ *     vertex index of each node is returned by xcgd_problem_get_node_verts().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define XCGD_CAPI_EXPORT __declspec(dllexport)
+#else
+#define XCGD_CAPI_EXPORT __attribute__((visibility("default")))
+#endif
+
+enum {
+  XCGD_OK = 0,
+  XCGD_ERROR_INVALID_ARGUMENT = 1,
+  XCGD_ERROR_RUNTIME = 2,
+  XCGD_ERROR_UNKNOWN = 3
+};
+
+enum {
+  XCGD_PHYSICS_POISSON = 0,           // Δu = f, u = g on the LSF boundary
+  XCGD_PHYSICS_LINEAR_ELASTICITY = 1  // plane elasticity, u = g on the
+                                      // LSF boundary
+};
+
+typedef struct xcgd_problem xcgd_problem;
+typedef struct xcgd_filter xcgd_filter;
+
+// Description of the last error on the calling thread
+XCGD_CAPI_EXPORT const char* xcgd_get_last_error(void);
+
+/**
+ * @brief Create a cut-cell problem, the Dirichlet boundary conditions on the
+ * zero level set are weakly imposed via Nitsche's method
+ *
+ * @param physics XCGD_PHYSICS_POISSON or XCGD_PHYSICS_LINEAR_ELASTICITY
+ * @param Np_1d number of nodes per dimension of the GD stencil: 2, 4, 6 or 8
+ * @param nx, ny number of grid cells in each direction
+ * @param lx, ly dimensions of the grid
+ * @param lsf LSF values at the grid vertices, length nverts
+ * @param params physics parameters:
+ *   Poisson: {source f, boundary value g, Nitsche eta}
+ *   elasticity: {E, nu, body force fx, fy, boundary value gx, gy, Nitsche eta}
+ * @param nparams length of params, 3 for Poisson, 7 for elasticity
+ * @param problem the created problem
+ */
+XCGD_CAPI_EXPORT int xcgd_problem_create(int physics, int Np_1d, int nx,
+                                         int ny, double lx, double ly,
+                                         const double* lsf,
+                                         const double* params, int nparams,
+                                         xcgd_problem** problem);
+
+XCGD_CAPI_EXPORT void xcgd_problem_destroy(xcgd_problem* problem);
+
+// Update the LSF values at the grid vertices and recut the mesh, the number of
+// nodes may change
+XCGD_CAPI_EXPORT int xcgd_problem_update_lsf(xcgd_problem* problem,
+                                             const double* lsf);
+
+/**
+ * @param nverts number of grid vertices, i.e. length of the LSF
+ * @param nnodes number of active nodes
+ * @param ndof number of unknowns, nnodes * dof_per_node
+ * @param nnz number of non-zeros of the Jacobian in CSR format
+ */
+XCGD_CAPI_EXPORT int xcgd_problem_get_sizes(const xcgd_problem* problem,
+                                            int* nverts, int* nnodes,
+                                            int* ndof, int* nnz);
+
+// Grid vertex index of each node, length nnodes
+XCGD_CAPI_EXPORT int xcgd_problem_get_node_verts(const xcgd_problem* problem,
+                                                 int* node_verts);
+
+// res = R(dof), length ndof
+XCGD_CAPI_EXPORT int xcgd_problem_residual(xcgd_problem* problem,
+                                           const double* dof, double* res);
+
+/**
+ * @brief Jacobian dR/du in CSR format with sorted column indices, the problems
+ * are linear so the Jacobian doesn't depend on the dof
+ *
+ * @param rowp row pointers, length ndof + 1
+ * @param cols column indices, length nnz
+ * @param vals values, length nnz
+ */
+XCGD_CAPI_EXPORT int xcgd_problem_jacobian_csr(xcgd_problem* problem,
+                                               int* rowp, int* cols,
+                                               double* vals);
+
+// Solve R(u) = 0 with a sparse Cholesky factorization, length ndof
+XCGD_CAPI_EXPORT int xcgd_problem_solve(xcgd_problem* problem, double* sol);
+
+// dfdphi += psi^T dR/dphi evaluated at dof, where phi is the LSF, length
+// nverts
+XCGD_CAPI_EXPORT int xcgd_problem_lsf_adjoint_product(xcgd_problem* problem,
+                                                      const double* dof,
+                                                      const double* psi,
+                                                      double* dfdphi);
+
+/**
+ * @brief Create a Helmholtz filter on a structured nx-by-ny grid
+ *
+ * @param Np_1d number of nodes per dimension of the GD stencil: 2, 4, 6 or 8
+ * @param r0 filter radius
+ */
+XCGD_CAPI_EXPORT int xcgd_filter_create(int Np_1d, int nx, int ny, double lx,
+                                        double ly, double r0,
+                                        xcgd_filter** filter);
+
+XCGD_CAPI_EXPORT void xcgd_filter_destroy(xcgd_filter* filter);
+
+// phi = filter(x), both of length nverts
+XCGD_CAPI_EXPORT int xcgd_filter_apply(xcgd_filter* filter, const double* x,
+                                       double* phi);
+
+// dfdx = (dphi/dx)^T dfdphi, all of length nverts
+XCGD_CAPI_EXPORT int xcgd_filter_apply_gradient(xcgd_filter* filter,
+                                                const double* x,
+                                                const double* dfdphi,
+                                                double* dfdx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // XCGD_CAPI_H
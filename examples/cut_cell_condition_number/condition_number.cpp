@@ -6,11 +6,20 @@
 #include "elements/gd_vandermonde.h"
 #include "sparse_utils/sparse_utils.h"
 #include "utils/argparser.h"
+#include "utils/json.h"
+#include "utils/lanczos.h"
+#include "utils/misc.h"
+#include "utils/sweep.h"
 #include "utils/vtk.h"
 
+// Returns the eigenvalue estimates. The matrix, quadratures and mesh are only
+// written to prefix if write_outputs is true. The grid is taken from cache if
+// given
 template <int Np_1d>
-void generate_stiffness_matrix(int n, int l, double x0, double y0, double r,
-                               std::string prefix) {
+json generate_stiffness_matrix(int n, int l, double x0, double y0, double r,
+                               bool write_mtx, std::string prefix,
+                               bool write_outputs = true,
+                               SweepCache* cache = nullptr) {
   using T = double;
   using Grid = StructuredGrid2D<T>;
   using Mesh = CutMesh<T, Np_1d>;
@@ -24,13 +33,21 @@ void generate_stiffness_matrix(int n, int l, double x0, double y0, double r,
   using CSCMat = SparseUtils::CSCMat<T>;
   using Interpolator = Interpolator<T, Quadrature, Basis>;
 
-  int nxy[2];
-  nxy[0] = n;
-  nxy[1] = n;
-  T lxy[2];
-  lxy[0] = l;
-  lxy[1] = l;
-  Grid grid(nxy, lxy);
+  // The grid only depends on n and l, so it is shared by the cases of a sweep
+  auto make_grid = [n, l]() {
+    int nxy[2];
+    nxy[0] = n;
+    nxy[1] = n;
+    T lxy[2];
+    lxy[0] = l;
+    lxy[1] = l;
+    return std::make_shared<Grid>(nxy, lxy);
+  };
+  std::shared_ptr<Grid> grid_ptr =
+      cache ? cache->get<Grid>(std::to_string(n) + ":" + std::to_string(l),
+                               make_grid)
+            : make_grid();
+  Grid& grid = *grid_ptr;
 
   // Create the mesh with a hole
   Mesh mesh(grid, [&r, &x0, &y0](T* xloc) {
@@ -54,8 +71,31 @@ void generate_stiffness_matrix(int n, int l, double x0, double y0, double r,
   bsr_mat->zero_rows(bc_dof.size(), bc_dof.data());
   CSCMat* csc_mat = SparseUtils::bsr_to_csc(bsr_mat);
   csc_mat->zero_columns(bc_dof.size(), bc_dof.data());
-  csc_mat->write_mtx(std::filesystem::path(prefix) /
-                     std::filesystem::path("stiffness_matrix.mtx"));
+  if (write_outputs and write_mtx) {
+    csc_mat->write_mtx(std::filesystem::path(prefix) /
+                       std::filesystem::path("stiffness_matrix.mtx"));
+  }
+
+  // Estimate the extremal eigenvalues, the smallest one by shift-invert
+  // Lanczos with the Cholesky factorization
+  SparseUtils::SparseCholesky<T> chol(csc_mat);
+  chol.factor();
+  EigenEstimate est = estimate_eigenvalues(
+      bsr_mat, bc_dof, [&chol](T* x) { chol.solve(x); });
+  json j = est.to_json();
+  j["ndof"] = 2 * mesh.get_num_nodes();
+
+  if (bsr_mat) delete bsr_mat;
+  if (csc_mat) delete csc_mat;
+
+  if (!write_outputs) return j;
+
+  std::printf("lambda_min: %20.10e\n", est.lambda_min);
+  std::printf("lambda_max: %20.10e\n", est.lambda_max);
+  std::printf("condition number: %20.10e\n", est.cond);
+  write_json(std::filesystem::path(prefix) /
+                 std::filesystem::path("condition_number.json"),
+             j);
 
   // Export quadratures and mesh
   Interpolator interp(mesh, quadrature, basis);
@@ -71,8 +111,25 @@ void generate_stiffness_matrix(int n, int l, double x0, double y0, double r,
   }
   vtk.write_vec("bcs", bcs.data());
 
-  if (bsr_mat) delete bsr_mat;
-  if (csc_mat) delete csc_mat;
+  return j;
+}
+
+json run_condition_number(int Np_1d, int n, int l, double x0, double y0,
+                          double r, bool write_mtx, std::string prefix,
+                          bool write_outputs, SweepCache* cache = nullptr) {
+  json j;
+  auto run = [&]<int Np_1d_>() {
+    if constexpr (Np_1d_ % 2 == 0 and Np_1d_ >= 2) {
+      j = generate_stiffness_matrix<Np_1d_>(n, l, x0, y0, r, write_mtx, prefix,
+                                            write_outputs, cache);
+    } else {
+      char msg[256];
+      std::snprintf(msg, 256, "Unsupported Np_1d (%d)", Np_1d_);
+      throw std::runtime_error(msg);
+    }
+  };
+  switcher<8>::run(run, Np_1d);
+  return j;
 }
 
 int main(int argc, char* argv[]) {
@@ -83,7 +140,10 @@ int main(int argc, char* argv[]) {
   p.add_argument<double>("--x0", 0.45);
   p.add_argument<double>("--y0", 0.42);
   p.add_argument<double>("--r", 0.35);
+  p.add_argument<int>("--write_mtx", 0);
   p.add_argument<std::string>("--prefix", {});
+  p.add_argument<std::string>("--sweep", {});
+  p.add_argument<int>("--sweep_workers", 0);
   p.parse_args(argc, argv);
 
   std::string prefix = p.get<std::string>("prefix");
@@ -100,24 +160,43 @@ int main(int argc, char* argv[]) {
   double x0 = p.get<double>("x0");
   double y0 = p.get<double>("y0");
   double r = p.get<double>("r");
+  bool write_mtx = p.get<int>("write_mtx");
 
-  switch (Np_1d) {
-    case 2:
-      generate_stiffness_matrix<2>(n, l, x0, y0, r, prefix);
-      break;
-    case 4:
-      generate_stiffness_matrix<4>(n, l, x0, y0, r, prefix);
-      break;
-    case 6:
-      generate_stiffness_matrix<6>(n, l, x0, y0, r, prefix);
-      break;
-    case 8:
-      generate_stiffness_matrix<8>(n, l, x0, y0, r, prefix);
-      break;
-    default:
-      printf("Unsupported Np_1d (%d), exiting...\n", Np_1d);
-      exit(-1);
+  std::string sweep_spec = p.get<std::string>("sweep");
+  if (sweep_spec.empty()) {
+    run_condition_number(Np_1d, n, l, x0, y0, r, write_mtx, prefix, true);
+    return 0;
   }
 
+  // Run all cases of the sweep in this process, parameters not in the sweep
+  // spec take the values from the command line. No per-case outputs are
+  // written. Cases with the same mesh size share the grid
+  std::vector<SweepCase> cases = SweepSpec(sweep_spec).get_cases();
+  SweepCache cache;
+  SweepTable table = run_sweep(
+      cases, p.get<int>("sweep_workers"), [&](const SweepCase& c) {
+        json j = run_condition_number(
+            c.get<int>("Np_1d", Np_1d), c.get<int>("n", n),
+            c.get<double>("l", l), c.get<double>("x0", x0),
+            c.get<double>("y0", y0), c.get<double>("r", r), false, prefix,
+            false, &cache);
+
+        std::map<std::string, double> results;
+        for (const auto& item : j.items()) {
+          if (item.value().is_number()) {
+            results[item.key()] = item.value();
+          } else if (item.value().is_boolean()) {
+            results[item.key()] = item.value().get<bool>();
+          }
+        }
+        return results;
+      });
+
+  std::string csv_path =
+      std::filesystem::path(prefix) / std::filesystem::path("sweep.csv");
+  table.write_csv(csv_path);
+  std::printf("%d cases (%d failed) written to %s\n", int(cases.size()),
+              table.get_num_failed(), csv_path.c_str());
+
   return 0;
 }
@@ -1,9 +1,9 @@
 import subprocess
 import numpy as np
-from tqdm import tqdm
+import pandas as pd
 import matplotlib.pyplot as plt
-from scipy.io import mmread
-from os import path
+from os import makedirs
+from os.path import join
 import niceplots
 
 plt.style.use(niceplots.get_style())
@@ -15,28 +15,35 @@ def sweep(ax, Np_1d=2, exp_max=-1.0, exp_min=-5.0, num_pts=10, n=33):
     r0_max = h * 2.0**0.5
     p = Np_1d - 1
 
-    delta = []
-    cond = []
-
-    for i, d in enumerate(tqdm(np.logspace(exp_max, exp_min, num_pts))):
-        r = r0_max - d * h
-        prefix = "cond_study_p_%d_%d" % (p, i)
-        cmd = [
-            "./condition_number",
-            "--Np_1d=%d" % Np_1d,
-            "--l=%.1f" % l,
-            "--n=%d" % n,
-            "--x0=%.1f" % l,
-            "--y0=0.0",
-            "--r=%.10f" % r,
-            "--prefix=%s" % prefix,
-        ]
-        output = subprocess.run(cmd, capture_output=True)
-
-        delta.append(d)
-        cond.append(
-            np.linalg.cond(mmread(path.join(prefix, "stiffness_matrix.mtx")).todense())
-        )
+    delta = np.logspace(exp_max, exp_min, num_pts)
+
+    # All radii run in a single process, see --sweep of condition_number
+    prefix = "cond_study_p_%d" % p
+    makedirs(prefix, exist_ok=True)
+    spec_path = join(prefix, "sweep.spec")
+    with open(spec_path, "w") as f:
+        r = ["%.10f" % (r0_max - d * h) for d in delta]
+        f.write("r = " + " ".join(r) + "\n")
+    cmd = [
+        "./condition_number",
+        "--Np_1d=%d" % Np_1d,
+        "--l=%.1f" % l,
+        "--n=%d" % n,
+        "--x0=%.1f" % l,
+        "--y0=0.0",
+        "--sweep=%s" % spec_path,
+        "--prefix=%s" % prefix,
+    ]
+    subprocess.run(cmd, check=True)
+
+    # Rows are in the order of the cases, i.e. the order of delta
+    df = pd.read_csv(join(prefix, "sweep.csv"))
+    ok = (df["status"] == "ok").to_numpy()
+    if not ok.all():
+        print("execution of the following cases has failed:")
+        print(df[~ok][["r"]])
+    delta = delta[ok]
+    cond = df["cond"].to_numpy()[ok]
 
     ax.loglog(delta, cond, "-o", label=("p=%d" % p), clip_on=False, zorder=100)
 
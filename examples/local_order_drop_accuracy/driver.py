@@ -4,8 +4,8 @@ import numpy as np
 from matplotlib import cm
 import matplotlib.patches as patches
 import matplotlib.pyplot as plt
-import json
 import pandas as pd
+from os import makedirs
 from os.path import join
 import argparse
 from time import time
@@ -19,24 +19,6 @@ def print_and_log(logpath, string):
     print(string)
 
 
-def get_l2_error(prefix, cmd):
-    try:
-        subprocess.run(cmd, capture_output=True)
-    # except subprocess.CalledProcessError as e:
-    except Exception as e:
-        print("execution of the following command has failed:")
-        print(" ".join(cmd))
-        print("Below is the error info")
-        print(e)
-
-    with open(join(prefix, "sol.json")) as f:
-        j = json.load(f)
-
-    err_l2norm = j["err_l2norm"]
-    err_l2norm_nrmed = j["err_l2norm"] / j["l2norm"]
-    return err_l2norm, err_l2norm_nrmed
-
-
 def annotate_slope(
     ax, pt0, pt1, slide=0.15, scale=0.7, hoffset=0.0, voffset=-0.1, voffset_text=-0.35
 ):
@@ -103,55 +85,60 @@ def run_experiments(
     Np_1d_list=[2, 4, 6, 8],
     max_order_drop=2,
     nxy_list=[8, 16, 32, 64, 128],
+    nworkers=0,
 ):
     logpath = f"{run_name}.log"
     open(logpath, "w").close()  # erase existing file
 
-    order = [
-        (Np_1d, Np_bc)
-        for Np_1d in Np_1d_list
-        for Np_bc in reversed(range(max(2, Np_1d - max_order_drop), Np_1d + 1))
-    ]
-
-    df_data = {
-        "Np_1d": [],
-        "Np_bc": [],
-        "nxy": [],
-        "h": [],
-        "err_l2norm": [],
-        "err_l2norm_nrmed": [],
-    }
-
-    for Np_1d, Np_bc in order:
-        for nxy in nxy_list:
-            prefix = f"outputs_{physics_type}_Np1d_{Np_1d}_Npbc_{Np_bc}_nxy_{nxy}"
-            cmd = [
-                "./order_drop_study",
-                f"--physics_type={physics_type}",
-                "--save-degenerate-stencils=0",
-                f"--Np_1d={Np_1d}",
-                f"--Np_bc={Np_bc}",
-                f"--nxy={nxy}",
-                f"--prefix={prefix}",
-            ]
-
-            t1 = time()
-            err_l2norm, err_l2norm_nrmed = get_l2_error(prefix, cmd)
-            t2 = time()
-
+    # The admissible Np_bc depend on Np_1d, so the cases of each Np_1d are run
+    # as a sweep in a single process, see --sweep of order_drop_study
+    dfs = []
+    for Np_1d in Np_1d_list:
+        Np_bc_list = list(reversed(range(max(2, Np_1d - max_order_drop), Np_1d + 1)))
+
+        prefix = f"outputs_{physics_type}_Np1d_{Np_1d}_sweep"
+        makedirs(prefix, exist_ok=True)
+        spec_path = join(prefix, "sweep.spec")
+        with open(spec_path, "w") as f:
+            f.write(f"Np_1d = {Np_1d}\n")
+            f.write("Np_bc = " + " ".join(str(v) for v in Np_bc_list) + "\n")
+            f.write("nxy = " + " ".join(str(v) for v in nxy_list) + "\n")
+
+        cmd = [
+            "./order_drop_study",
+            f"--physics_type={physics_type}",
+            "--save-degenerate-stencils=0",
+            f"--prefix={prefix}",
+            f"--sweep={spec_path}",
+            f"--sweep_workers={nworkers}",
+        ]
+
+        t1 = time()
+        subprocess.run(cmd, check=True)
+        t2 = time()
+
+        df = pd.read_csv(join(prefix, "sweep.csv"))
+        for _, row in df.iterrows():
             print_and_log(
                 logpath,
-                f"Np_1d: {Np_1d:2d}, Np_bc: {Np_bc:2d}, nxy: {nxy:4d}, execution time: {t2 - t1:.2f} s",
+                f"Np_1d: {row['Np_1d']:2d}, Np_bc: {row['Np_bc']:2d}, nxy: {row['nxy']:4d}, "
+                + f"execution time: {row['time']:.2f} s, status: {row['status']}",
             )
+        print_and_log(
+            logpath, f"Np_1d: {Np_1d:2d}, total execution time: {t2 - t1:.2f} s"
+        )
+
+        failed = df[df["status"] != "ok"]
+        if len(failed):
+            print("execution of the following cases has failed:")
+            print(failed[["Np_1d", "Np_bc", "nxy"]])
+        dfs.append(df[df["status"] == "ok"])
 
-            df_data["Np_1d"].append(Np_1d)
-            df_data["Np_bc"].append(Np_bc)
-            df_data["nxy"].append(nxy)
-            df_data["h"].append(2.0 / nxy)
-            df_data["err_l2norm"].append(err_l2norm)
-            df_data["err_l2norm_nrmed"].append(err_l2norm_nrmed)
+    df = pd.concat(dfs, ignore_index=True)
+    df["h"] = 2.0 / df["nxy"]
+    df["err_l2norm_nrmed"] = df["err_l2norm"] / df["l2norm"]
 
-    return pd.DataFrame(df_data)
+    return df[["Np_1d", "Np_bc", "nxy", "h", "err_l2norm", "err_l2norm_nrmed"]]
 
 
 def adjust_plot_lim(ax, left=0.0, right=0.2, bottom=0.3, up=0.0):
@@ -281,6 +268,12 @@ if __name__ == "__main__":
         type=int,
         help="list of number of mesh elements per dimension",
     )
+    p.add_argument(
+        "--nworkers",
+        default=0,
+        type=int,
+        help="number of cases run concurrently, 0 to use all cores",
+    )
     p.add_argument("--normalize-l2error", action="store_true")
     p.add_argument("--voffset", default=-0.1, type=float)
     p.add_argument("--voffset_text", default=-0.1, type=float)
@@ -298,6 +291,7 @@ if __name__ == "__main__":
             Np_1d_list=args.Np_1d,
             max_order_drop=args.max_order_drop,
             nxy_list=args.nxy,
+            nworkers=args.nworkers,
         )
     else:
         df = pd.read_csv(args.csv)
@@ -10,6 +10,7 @@
 #include "utils/json.h"
 #include "utils/loggers.h"
 #include "utils/misc.h"
+#include "utils/sweep.h"
 #include "utils/vtk.h"
 
 #define PI 3.14159265358979323846
@@ -270,10 +271,14 @@ void test_consistency_elasticity(T E, T nu, const BcFun& bc_fun,
   }
 }
 
-// Get the l2 error of the numerical Poisson solution
+// Get the l2 error of the numerical Poisson solution, the solution and
+// stencils are written to prefix if write_outputs is true. The grid and the
+// mesh are taken from cache if given
 template <int Np_1d, PhysicsType physics_type>
-void execute_accuracy_study(std::string prefix, int nxy, int Np_bc,
-                            bool save_stencils, bool consistency_check) {
+json execute_accuracy_study(std::string prefix, int nxy, int Np_bc,
+                            bool save_stencils, bool consistency_check,
+                            bool write_outputs = true,
+                            SweepCache* cache = nullptr) {
   using T = double;
   using Grid = StructuredGrid2D<T>;
   using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
@@ -383,13 +388,26 @@ void execute_accuracy_study(std::string prefix, int nxy, int Np_bc,
       StaticElastic<T, Mesh, Quadrature, Basis,
                     typeof(elasticity_int_fun)>>::type;
 
-  DegenerateStencilLogger::enable();
+  if (write_outputs) DegenerateStencilLogger::enable();
 
-  int nx_ny[2] = {nxy, nxy};
-  T lxy[2] = {2.0, 2.0};
-  T xy0[2] = {-1.0, -1.0};
-  Grid grid(nx_ny, lxy, xy0);
-  Mesh mesh(grid, Np_bc);
+  // The grid only depends on the mesh size, and the mesh on the order drop,
+  // so they are shared by the cases of a sweep
+  auto make_grid = [nxy]() {
+    int nx_ny[2] = {nxy, nxy};
+    T lxy[2] = {2.0, 2.0};
+    T xy0[2] = {-1.0, -1.0};
+    return std::make_shared<Grid>(nx_ny, lxy, xy0);
+  };
+  std::shared_ptr<Grid> grid =
+      cache ? cache->get<Grid>(std::to_string(nxy), make_grid) : make_grid();
+  auto make_mesh = [&grid, Np_bc]() {
+    return std::make_shared<Mesh>(*grid, Np_bc);
+  };
+  std::shared_ptr<Mesh> mesh_ptr =
+      cache ? cache->get<Mesh>(
+                  std::to_string(nxy) + ":" + std::to_string(Np_bc), make_mesh)
+            : make_mesh();
+  Mesh& mesh = *mesh_ptr;
   Quadrature quadrature(mesh);
   Basis basis(mesh);
 
@@ -480,12 +498,41 @@ void execute_accuracy_study(std::string prefix, int nxy, int Np_bc,
             {"l2norm", l2norm},
             {"area", area}};
 
-  char json_name[256];
-  write_json(std::filesystem::path(prefix) / std::filesystem::path("sol.json"),
-             j);
-  write_vtk<T>(
-      std::filesystem::path(prefix) / std::filesystem::path("solution.vtk"),
-      mesh, sol, sol_exact, source, save_stencils, physics_type);
+  if (write_outputs) {
+    write_json(
+        std::filesystem::path(prefix) / std::filesystem::path("sol.json"), j);
+    write_vtk<T>(
+        std::filesystem::path(prefix) / std::filesystem::path("solution.vtk"),
+        mesh, sol, sol_exact, source, save_stencils, physics_type);
+  }
+
+  return j;
+}
+
+json run_accuracy_study(PhysicsType physics_type, int Np_1d, std::string prefix,
+                        int nxy, int Np_bc, bool save_stencils,
+                        bool consistency_check, bool write_outputs,
+                        SweepCache* cache = nullptr) {
+  json j;
+  auto run = [&]<int Np_1d_>() {
+    if constexpr (Np_1d_ % 2 == 0 and Np_1d_ >= 2) {
+      if (physics_type == PhysicsType::Poisson) {
+        j = execute_accuracy_study<Np_1d_, PhysicsType::Poisson>(
+            prefix, nxy, Np_bc, save_stencils, consistency_check,
+            write_outputs, cache);
+      } else {
+        j = execute_accuracy_study<Np_1d_, PhysicsType::LinearElasticity>(
+            prefix, nxy, Np_bc, save_stencils, consistency_check,
+            write_outputs, cache);
+      }
+    } else {
+      char msg[256];
+      std::snprintf(msg, 256, "Unsupported Np_1d (%d)", Np_1d_);
+      throw std::runtime_error(msg);
+    }
+  };
+  switcher<10>::run(run, Np_1d);
+  return j;
 }
 
 int main(int argc, char* argv[]) {
@@ -498,6 +545,8 @@ int main(int argc, char* argv[]) {
   p.add_argument<std::string>("--prefix", {});
   p.add_argument<std::string>("--physics_type", "poisson",
                               {"poisson", "linear_elasticity"});
+  p.add_argument<std::string>("--sweep", {});
+  p.add_argument<int>("--sweep_workers", 0);
   p.parse_args(argc, argv);
 
   bool consistency_check = p.get<int>("consistency-check");
@@ -514,68 +563,45 @@ int main(int argc, char* argv[]) {
   int Np_1d = p.get<int>("Np_1d");
   int Np_bc = p.get<int>("Np_bc");
   int nxy = p.get<int>("nxy");
-  PhysicsType physics_type =
-      std::map<std::string, PhysicsType>{
-          {"poisson", PhysicsType::Poisson},
-          {"linear_elasticity", PhysicsType::LinearElasticity}}
-          .at(p.get<std::string>("physics_type"));
-
-  if (physics_type == PhysicsType::Poisson) {
-    switch (Np_1d) {
-      case 2:
-        execute_accuracy_study<2, PhysicsType::Poisson>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 4:
-        execute_accuracy_study<4, PhysicsType::Poisson>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 6:
-        execute_accuracy_study<6, PhysicsType::Poisson>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 8:
-        execute_accuracy_study<8, PhysicsType::Poisson>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 10:
-        execute_accuracy_study<10, PhysicsType::Poisson>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      default:
-        printf("Unsupported Np_1d (%d), exiting...\n", Np_1d);
-        exit(-1);
-        break;
-    }
-  } else {  // LinearElasticity
-
-    switch (Np_1d) {
-      case 2:
-        execute_accuracy_study<2, PhysicsType::LinearElasticity>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 4:
-        execute_accuracy_study<4, PhysicsType::LinearElasticity>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 6:
-        execute_accuracy_study<6, PhysicsType::LinearElasticity>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 8:
-        execute_accuracy_study<8, PhysicsType::LinearElasticity>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      case 10:
-        execute_accuracy_study<10, PhysicsType::LinearElasticity>(
-            prefix, nxy, Np_bc, save_stencils, consistency_check);
-        break;
-      default:
-        printf("Unsupported Np_1d (%d), exiting...\n", Np_1d);
-        exit(-1);
-        break;
-    }
+  std::map<std::string, PhysicsType> physics_type_map = {
+      {"poisson", PhysicsType::Poisson},
+      {"linear_elasticity", PhysicsType::LinearElasticity}};
+  std::string physics_type_name = p.get<std::string>("physics_type");
+
+  std::string sweep_spec = p.get<std::string>("sweep");
+  if (sweep_spec.empty()) {
+    run_accuracy_study(physics_type_map.at(physics_type_name), Np_1d, prefix,
+                       nxy, Np_bc, save_stencils, consistency_check, true);
+    return 0;
   }
 
+  // Run all cases of the sweep in this process, parameters not in the sweep
+  // spec take the values from the command line. The logged stencils are
+  // global, so no per-case outputs are written when cases run concurrently.
+  // Cases with the same mesh size share the grid, and the mesh if they also
+  // share Np_bc
+  DegenerateStencilLogger::disable();
+  std::vector<SweepCase> cases = SweepSpec(sweep_spec).get_cases();
+  SweepCache cache;
+  SweepTable table = run_sweep(
+      cases, p.get<int>("sweep_workers"), [&](const SweepCase& c) {
+        json j = run_accuracy_study(
+            physics_type_map.at(
+                c.get<std::string>("physics_type", physics_type_name)),
+            c.get<int>("Np_1d", Np_1d), prefix, c.get<int>("nxy", nxy),
+            c.get<int>("Np_bc", Np_bc), false, consistency_check, false,
+            &cache);
+
+        std::map<std::string, double> results;
+        for (const auto& item : j.items()) results[item.key()] = item.value();
+        return results;
+      });
+
+  std::string csv_path =
+      std::filesystem::path(prefix) / std::filesystem::path("sweep.csv");
+  table.write_csv(csv_path);
+  std::printf("%d cases (%d failed) written to %s\n", int(cases.size()),
+              table.get_num_failed(), csv_path.c_str());
+
   return 0;
 }
@@ -129,80 +129,82 @@ def annotate_slope(
 
 
 def run_experiments(
-    run_name, instance, image_path, Np_1d_list, nxy_list, nitsche_eta_list
+    run_name, instance, image_path, Np_1d_list, nxy_list, nitsche_eta_list, nworkers
 ):
-    df_data = {
-        "Np_1d": [],
-        "nxy": [],
-        "h": [],
-        "nitsche_eta": [],
-        "err_l2norm_bulk": [],
-        "err_l2norm_bcs": [],
-        "err_l2norm_bulk_nrmed": [],
-        "err_l2norm_bcs_nrmed": [],
-    }
-
     logpath = f"{run_name}.log"
     open(logpath, "w").close()  # erase existing file
 
-    for nxy in nxy_list:
-        image_json_path = ""
-        instance_name = instance
-        if instance == "image":
-            image_name = Path(image_path).stem
-            image_json_path = f"./{run_name}/lsf_{image_name}_nxy_{nxy}.json"
-            instance_name += f"_{image_name}"
+    image_json_path = ""
+    if instance == "image":
+        image_name = Path(image_path).stem
+        image_json_path = f"./{run_name}/lsf_{image_name}_nxy_{{nxy}}.json"
 
-            print(f"Extracting lsf from the image {image_name}...")
+        for nxy in nxy_list:
+            print(f"Extracting lsf from the image {image_name} for nxy={nxy}...")
             t1 = time()
             extract_lsf_from_image(
-                nxy=nxy, imgfile=image_path, plot=False, json_name=image_json_path
+                nxy=nxy,
+                imgfile=image_path,
+                plot=False,
+                json_name=image_json_path.format(nxy=nxy),
             )
             t2 = time()
             print(
                 f"Done extracting lsf from the image {image_name} ({t2 - t1:.2f} seconds)"
             )
 
-        for Np_1d in Np_1d_list:
-            for nitsche_eta in nitsche_eta_list:
-                prefix = f"{run_name}/outputs_instance_{instance_name}_Np_{Np_1d}_nxy_{nxy}_nitsche_{nitsche_eta:.1e}"
-                cmd = [
-                    "./nitsche_accuracy",
-                    f"--instance={instance}",
-                    "--save-degenerate-stencils=1",
-                    f"--Np_1d={Np_1d}",
-                    f"--nxy={nxy}",
-                    f"--prefix={prefix}",
-                    f"--image_json={image_json_path}",
-                    f"--nitsche_eta={nitsche_eta}",
-                ]
-
-                t1 = time()
-                (
-                    err_l2norm_bulk,
-                    err_l2norm_bcs,
-                    err_l2norm_bulk_nrmed,
-                    err_l2norm_bcs_nrmed,
-                ) = get_poisson_l2_error(prefix, cmd)
-
-                t2 = time()
-
-                print_and_log(
-                    logpath,
-                    f"Np_1d: {Np_1d:2d}, nxy: {nxy:4d}, nitsche_eta: {nitsche_eta:.2e}, execution time: {t2 - t1:.2f} s",
-                )
+    # All cases run in a single process, see --sweep of nitsche_accuracy
+    spec_path = join(run_name, "sweep.spec")
+    with open(spec_path, "w") as f:
+        f.write("nxy = " + " ".join(str(v) for v in nxy_list) + "\n")
+        f.write("Np_1d = " + " ".join(str(v) for v in Np_1d_list) + "\n")
+        f.write("nitsche_eta = " + " ".join(str(v) for v in nitsche_eta_list) + "\n")
+
+    prefix = join(run_name, "outputs_sweep")
+    cmd = [
+        "./nitsche_accuracy",
+        f"--instance={instance}",
+        f"--prefix={prefix}",
+        f"--image_json={image_json_path}",
+        f"--sweep={spec_path}",
+        f"--sweep_workers={nworkers}",
+    ]
+
+    t1 = time()
+    subprocess.run(cmd, check=True)
+    t2 = time()
+
+    df = pd.read_csv(join(prefix, "sweep.csv"))
+    for _, row in df.iterrows():
+        print_and_log(
+            logpath,
+            f"Np_1d: {row['Np_1d']:2d}, nxy: {row['nxy']:4d}, nitsche_eta: {row['nitsche_eta']:.2e}, "
+            + f"execution time: {row['time']:.2f} s, status: {row['status']}",
+        )
+    print_and_log(logpath, f"Total execution time: {t2 - t1:.2f} s")
 
-                df_data["Np_1d"].append(Np_1d)
-                df_data["nxy"].append(nxy)
-                df_data["h"].append(2.0 / nxy)
-                df_data["nitsche_eta"].append(nitsche_eta)
+    failed = df[df["status"] != "ok"]
+    if len(failed):
+        print("execution of the following cases has failed:")
+        print(failed[["Np_1d", "nxy", "nitsche_eta"]])
+    df = df[df["status"] == "ok"].reset_index(drop=True)
 
-                df_data["err_l2norm_bulk"].append(err_l2norm_bulk)
-                df_data["err_l2norm_bcs"].append(err_l2norm_bcs)
-                df_data["err_l2norm_bulk_nrmed"].append(err_l2norm_bulk_nrmed)
-                df_data["err_l2norm_bcs_nrmed"].append(err_l2norm_bcs_nrmed)
+    df["h"] = 2.0 / df["nxy"]
+    df["err_l2norm_bulk_nrmed"] = df["err_l2norm_bulk"] / df["l2norm_bulk"]
+    df["err_l2norm_bcs_nrmed"] = df["err_l2norm_bcs"] / df["l2norm_bcs"]
 
-    return pd.DataFrame(df_data)
+    return df[
+        [
+            "Np_1d",
+            "nxy",
+            "h",
+            "nitsche_eta",
+            "err_l2norm_bulk",
+            "err_l2norm_bcs",
+            "err_l2norm_bulk_nrmed",
+            "err_l2norm_bcs_nrmed",
+        ]
+    ].sort_values(["Np_1d", "nxy"], ascending=[True, True], ignore_index=True)
 
 
 def adjust_plot_lim(ax, left=0.0, right=0.2, bottom=0.3, up=0.0):
@@ -318,6 +320,13 @@ if __name__ == "__main__":
         help="list of Nitsche parameter",
     )
 
+    p.add_argument(
+        "--nworkers",
+        default=0,
+        type=int,
+        help="number of cases run concurrently, 0 to use all cores",
+    )
+
     p.add_argument(
         "--xname",
         default="h",
@@ -349,6 +358,7 @@ if __name__ == "__main__":
             Np_1d_list=args.Np_1d,
             nxy_list=args.nxy,
             nitsche_eta_list=args.nitsche_eta,
+            nworkers=args.nworkers,
         )
     else:
         df = pd.read_csv(args.csv)
@@ -14,6 +14,7 @@
 #include "utils/json.h"
 #include "utils/loggers.h"
 #include "utils/misc.h"
+#include "utils/sweep.h"
 #include "utils/vtk.h"
 
 #define PI 3.14159265358979323846
@@ -240,11 +241,15 @@ enum class ProbInstance { Circle, Wedge, Image };
 
 // Solve the physical problem using Galerkin difference method with Nitsche's
 // method
+// Returns the error norms, the matrices, solution and stencils are written to
+// prefix if write_outputs is true. The grid and the mesh are taken from cache
+// if given
 template <int Np_1d, PhysicsType physics_type>
-void execute_accuracy_study(std::string prefix, ProbInstance instance,
+json execute_accuracy_study(std::string prefix, ProbInstance instance,
                             std::string image_json, int nxy_val,
                             bool save_stencils, double nitsche_eta,
-                            bool consistency_check) {
+                            bool consistency_check, bool write_outputs = true,
+                            SweepCache* cache = nullptr) {
   using T = double;
   using Grid = StructuredGrid2D<T>;
   using QuadratureBulk = GDLSFQuadrature2D<T, Np_1d, QuadPtType::INNER>;
@@ -375,69 +380,82 @@ void execute_accuracy_study(std::string prefix, ProbInstance instance,
   using BSRMat = GalerkinBSRMat<T, PhysicsBulk::dof_per_node>;
   using CSCMat = SparseUtils::CSCMat<T>;
 
+  // The grid and the mesh only depend on the mesh size and the instance, so
+  // they are shared by the cases of a sweep
   std::shared_ptr<Grid> grid;
-  std::shared_ptr<Mesh> mesh;
-
-  switch (instance) {
-    case ProbInstance::Circle: {
+  auto make_grid = [&grid, cache](int nxy_val) {
+    auto make = [nxy_val]() {
       int nxy[2] = {nxy_val, nxy_val};
-      double R = 0.49;
       double lxy[2] = {1.0, 1.0};
-      grid = std::make_shared<Grid>(nxy, lxy);
-      mesh = std::make_shared<Mesh>(*grid, [R](double x[]) {
-        return (x[0] - 0.5) * (x[0] - 0.5) + (x[1] - 0.5) * (x[1] - 0.5) -
-               R * R;  // <= 0
-      });
-      break;
-    }
+      return std::make_shared<Grid>(nxy, lxy);
+    };
+    grid = cache ? cache->get<Grid>(std::to_string(nxy_val), make) : make();
+  };
 
-    case ProbInstance::Wedge: {
-      int nxy[2] = {nxy_val, nxy_val};
-      double lxy[2] = {1.0, 1.0};
-      double angle = PI / 6.0;
-      grid = std::make_shared<Grid>(nxy, lxy);
-      mesh = std::make_shared<Mesh>(*grid, [angle](double x[]) {
-        T region1 = sin(angle) * (x[0] - 1.0) + cos(angle) * x[1];  // <= 0
-        T region2 = 1e-6 - x[0];
-        T region3 = 1e-6 - x[1];
-        return hard_max<T>({region1, region2, region3});
-      });
-      break;
-    }
+  auto make_mesh = [&]() -> std::shared_ptr<Mesh> {
+    std::shared_ptr<Mesh> mesh;
+    switch (instance) {
+      case ProbInstance::Circle: {
+        double R = 0.49;
+        make_grid(nxy_val);
+        mesh = std::make_shared<Mesh>(*grid, [R](double x[]) {
+          return (x[0] - 0.5) * (x[0] - 0.5) + (x[1] - 0.5) * (x[1] - 0.5) -
+                 R * R;  // <= 0
+        });
+        break;
+      }
 
-    case ProbInstance::Image: {
-      json j;
-      try {
-        j = read_json(image_json);
-      } catch (const std::exception& e) {
-        std::cout << "failed to load the json file \"" + image_json +
-                         "\" with the following exception message:\n";
-        std::cout << std::string(e.what()) << "\n";
+      case ProbInstance::Wedge: {
+        double angle = PI / 6.0;
+        make_grid(nxy_val);
+        mesh = std::make_shared<Mesh>(*grid, [angle](double x[]) {
+          T region1 = sin(angle) * (x[0] - 1.0) + cos(angle) * x[1];  // <= 0
+          T region2 = 1e-6 - x[0];
+          T region3 = 1e-6 - x[1];
+          return hard_max<T>({region1, region2, region3});
+        });
+        break;
       }
-      std::vector<double> lsf_dof = j["lsf_dof"];
-      int nxy[2] = {j["nxy"], j["nxy"]};
-      double lxy[2] = {1.0, 1.0};
-      grid = std::make_shared<Grid>(nxy, lxy);
-      mesh = std::make_shared<Mesh>(*grid);
-      if (mesh->get_lsf_dof().size() != lsf_dof.size()) {
-        std::string msg =
-            "Attempting to populate the LSF dof from input image, but the "
-            "dimensions don't match, the mesh has " +
-            std::to_string(mesh->get_lsf_dof().size()) +
-            " LSF nodes, but the input json has " +
-            std::to_string(lsf_dof.size()) + " entries.";
-        throw std::runtime_error(msg.c_str());
+
+      case ProbInstance::Image: {
+        json j;
+        try {
+          j = read_json(image_json);
+        } catch (const std::exception& e) {
+          std::cout << "failed to load the json file \"" + image_json +
+                           "\" with the following exception message:\n";
+          std::cout << std::string(e.what()) << "\n";
+        }
+        std::vector<double> lsf_dof = j["lsf_dof"];
+        make_grid(j["nxy"]);
+        mesh = std::make_shared<Mesh>(*grid);
+        if (mesh->get_lsf_dof().size() != lsf_dof.size()) {
+          std::string msg =
+              "Attempting to populate the LSF dof from input image, but the "
+              "dimensions don't match, the mesh has " +
+              std::to_string(mesh->get_lsf_dof().size()) +
+              " LSF nodes, but the input json has " +
+              std::to_string(lsf_dof.size()) + " entries.";
+          throw std::runtime_error(msg.c_str());
+        }
+        mesh->get_lsf_dof() = lsf_dof;
+        mesh->update_mesh();
+        break;
       }
-      mesh->get_lsf_dof() = lsf_dof;
-      mesh->update_mesh();
-      break;
-    }
 
-    default: {
-      throw std::runtime_error("Unknown instance");
-      break;
+      default: {
+        throw std::runtime_error("Unknown instance");
+        break;
+      }
     }
-  }
+    return mesh;
+  };
+
+  std::shared_ptr<Mesh> mesh =
+      cache ? cache->get<Mesh>(std::to_string(int(instance)) + ":" +
+                                   std::to_string(nxy_val) + ":" + image_json,
+                               make_mesh)
+            : make_mesh();
 
   std::shared_ptr<PhysicsBulk> physics_bulk;
   std::shared_ptr<PhysicsBCs> physics_bcs;
@@ -474,12 +492,16 @@ void execute_accuracy_study(std::string prefix, ProbInstance instance,
   BSRMat* jac_bsr = new BSRMat(nnodes, nnz, rowp, cols);
   std::vector<T> zeros(ndof, 0.0);
   analysis_bulk.jacobian(nullptr, zeros.data(), jac_bsr);
-  jac_bsr->write_mtx(std::filesystem::path(prefix) /
-                     std::filesystem::path("poisson_jac.mtx"));
+  if (write_outputs) {
+    jac_bsr->write_mtx(std::filesystem::path(prefix) /
+                       std::filesystem::path("poisson_jac.mtx"));
+  }
   analysis_bcs.jacobian(nullptr, zeros.data(), jac_bsr,
                         false);  // Add bcs contribution
-  jac_bsr->write_mtx(std::filesystem::path(prefix) /
-                     std::filesystem::path("poisson_jac_with_nitsche.mtx"));
+  if (write_outputs) {
+    jac_bsr->write_mtx(std::filesystem::path(prefix) /
+                       std::filesystem::path("poisson_jac_with_nitsche.mtx"));
+  }
   CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
 
   // Set up the right hand side
@@ -499,6 +521,12 @@ void execute_accuracy_study(std::string prefix, ProbInstance instance,
   std::vector<T> sol = rhs;
   chol->solve(sol.data());
 
+  if (rowp) delete rowp;
+  if (cols) delete cols;
+  if (jac_bsr) delete jac_bsr;
+  if (jac_csc) delete jac_csc;
+  if (chol) delete chol;
+
   // Get exact solution and source
   std::vector<T> sol_exact(ndof, 0.0), source(ndof, 0.0);
   for (int i = 0; i < nnodes; i++) {
@@ -559,13 +587,14 @@ void execute_accuracy_study(std::string prefix, ProbInstance instance,
             {"area", area},
             {"perimeter", perimeter}};
 
-  char json_name[256];
-  write_json(std::filesystem::path(prefix) / std::filesystem::path("sol.json"),
-             j);
+  if (write_outputs) {
+    write_json(
+        std::filesystem::path(prefix) / std::filesystem::path("sol.json"), j);
 
-  write_vtk<T>(
-      std::filesystem::path(prefix) / std::filesystem::path("solution.vtk"),
-      physics_type, *mesh, sol, sol_exact, source, save_stencils);
+    write_vtk<T>(
+        std::filesystem::path(prefix) / std::filesystem::path("solution.vtk"),
+        physics_type, *mesh, sol, sol_exact, source, save_stencils);
+  }
 
   // write_field_vtk<T>(std::filesystem::path(prefix) /
   //                        std::filesystem::path("field_solution_bulk.vtk"),
@@ -574,6 +603,35 @@ void execute_accuracy_study(std::string prefix, ProbInstance instance,
   // write_field_vtk<T>(std::filesystem::path(prefix) /
   //                        std::filesystem::path("field_solution_bcs.vtk"),
   //                    physics_type, *mesh, analysis_bcs, sol);
+
+  return j;
+}
+
+json run_accuracy_study(PhysicsType physics_type, int Np_1d, std::string prefix,
+                        ProbInstance instance, std::string image_json,
+                        int nxy_val, bool save_stencils, double nitsche_eta,
+                        bool consistency_check, bool write_outputs,
+                        SweepCache* cache = nullptr) {
+  json j;
+  auto run = [&]<int Np_1d_>() {
+    if constexpr (Np_1d_ % 2 == 0 and Np_1d_ >= 2) {
+      if (physics_type == PhysicsType::Poisson) {
+        j = execute_accuracy_study<Np_1d_, PhysicsType::Poisson>(
+            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
+            consistency_check, write_outputs, cache);
+      } else {
+        j = execute_accuracy_study<Np_1d_, PhysicsType::LinearElasticity>(
+            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
+            consistency_check, write_outputs, cache);
+      }
+    } else {
+      char msg[256];
+      std::snprintf(msg, 256, "Unsupported Np_1d (%d)", Np_1d_);
+      throw std::runtime_error(msg);
+    }
+  };
+  switcher<10>::run(run, Np_1d);
+  return j;
 }
 
 int main(int argc, char* argv[]) {
@@ -591,6 +649,8 @@ int main(int argc, char* argv[]) {
   p.add_argument<std::string>("--instance", "circle",
                               {"circle", "wedge", "image"});
   p.add_argument<std::string>("--image_json", "image.json");
+  p.add_argument<std::string>("--sweep", {});
+  p.add_argument<int>("--sweep_workers", 0);
   p.parse_args(argc, argv);
 
   bool consistency_check = p.get<int>("consistency-check");
@@ -607,84 +667,65 @@ int main(int argc, char* argv[]) {
   int Np_1d = p.get<int>("Np_1d");
   int nxy_val = p.get<int>("nxy");
   double nitsche_eta = p.get<double>("nitsche_eta");
-  PhysicsType physics_type =
-      std::map<std::string, PhysicsType>{
-          {"poisson", PhysicsType::Poisson},
-          {"linear_elasticity", PhysicsType::LinearElasticity}}
-          .at(p.get<std::string>("physics_type"));
+  std::map<std::string, PhysicsType> physics_type_map = {
+      {"poisson", PhysicsType::Poisson},
+      {"linear_elasticity", PhysicsType::LinearElasticity}};
+  std::string physics_type_name = p.get<std::string>("physics_type");
+  PhysicsType physics_type = physics_type_map.at(physics_type_name);
 
-  ProbInstance instance = std::map<std::string, ProbInstance>{
+  std::map<std::string, ProbInstance> instance_map = {
       {"circle", ProbInstance::Circle},
       {"wedge", ProbInstance::Wedge},
-      {"image",
-       ProbInstance::Image}}.at(p.get<std::string>("instance"));
+      {"image", ProbInstance::Image}};
+  std::string instance_name = p.get<std::string>("instance");
+  ProbInstance instance = instance_map.at(instance_name);
   std::string image_json = p.get<std::string>("image_json");
 
-  if (physics_type == PhysicsType::Poisson) {
-    switch (Np_1d) {
-      case 2:
-        execute_accuracy_study<2, PhysicsType::Poisson>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 4:
-        execute_accuracy_study<4, PhysicsType::Poisson>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 6:
-        execute_accuracy_study<6, PhysicsType::Poisson>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 8:
-        execute_accuracy_study<8, PhysicsType::Poisson>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 10:
-        execute_accuracy_study<10, PhysicsType::Poisson>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      default:
-        printf("Unsupported Np_1d (%d), exiting...\n", Np_1d);
-        exit(-1);
-        break;
-    }
-  } else {  // Elasticity
-    switch (Np_1d) {
-      case 2:
-        execute_accuracy_study<2, PhysicsType::LinearElasticity>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 4:
-        execute_accuracy_study<4, PhysicsType::LinearElasticity>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 6:
-        execute_accuracy_study<6, PhysicsType::LinearElasticity>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 8:
-        execute_accuracy_study<8, PhysicsType::LinearElasticity>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      case 10:
-        execute_accuracy_study<10, PhysicsType::LinearElasticity>(
-            prefix, instance, image_json, nxy_val, save_stencils, nitsche_eta,
-            consistency_check);
-        break;
-      default:
-        printf("Unsupported Np_1d (%d), exiting...\n", Np_1d);
-        exit(-1);
-        break;
-    }
+  std::string sweep_spec = p.get<std::string>("sweep");
+  if (sweep_spec.empty()) {
+    run_accuracy_study(physics_type, Np_1d, prefix, instance, image_json,
+                       nxy_val, save_stencils, nitsche_eta, consistency_check,
+                       true);
+    return 0;
   }
 
+  // Run all cases of the sweep in this process, parameters not in the sweep
+  // spec take the values from the command line. {nxy} in image_json is
+  // replaced by the mesh size of the case. The logged stencils are global,
+  // so no per-case outputs are written when cases run concurrently. Cases
+  // with the same mesh size share the grid and the mesh
+  DegenerateStencilLogger::disable();
+  std::vector<SweepCase> cases = SweepSpec(sweep_spec).get_cases();
+  SweepCache cache;
+  SweepTable table = run_sweep(
+      cases, p.get<int>("sweep_workers"), [&](const SweepCase& c) {
+        int nxy = c.get<int>("nxy", nxy_val);
+        std::string case_image_json =
+            c.get<std::string>("image_json", image_json);
+        std::size_t pos = case_image_json.find("{nxy}");
+        if (pos != std::string::npos) {
+          case_image_json.replace(pos, 5, std::to_string(nxy));
+        }
+
+        json j = run_accuracy_study(
+            physics_type_map.at(
+                c.get<std::string>("physics_type", physics_type_name)),
+            c.get<int>("Np_1d", Np_1d), prefix,
+            instance_map.at(c.get<std::string>("instance", instance_name)),
+            case_image_json, nxy, false,
+            c.get<double>("nitsche_eta", nitsche_eta), consistency_check,
+            false, &cache);
+
+        std::map<std::string, double> results;
+        for (const auto& item : j.items()) results[item.key()] = item.value();
+        return results;
+      });
+
+  std::string csv_path =
+      std::filesystem::path(prefix) / std::filesystem::path("sweep.csv");
+  table.write_csv(csv_path);
+  std::printf("%d cases (%d failed) written to %s\n", int(cases.size()),
+              table.get_num_failed(), csv_path.c_str());
+
   return 0;
 }
@@ -1,7 +1,9 @@
 import subprocess
 import numpy as np
-from tqdm import tqdm
+import pandas as pd
 import matplotlib.pyplot as plt
+from os import makedirs
+from os.path import join
 
 if __name__ == "__main__":
 
@@ -9,60 +11,46 @@ if __name__ == "__main__":
     n = np.logspace(np.log10(10), np.log10(3000), 30).astype(int)
     # n = np.logspace(np.log10(10), np.log10(1000), 20).astype(int)
 
+    # All cases run in a single process, see --sweep of pi_study
+    prefix = "pi_study_sweep"
+    makedirs(prefix, exist_ok=True)
+    spec_path = join(prefix, "sweep.spec")
+    with open(spec_path, "w") as f:
+        f.write("q = " + " ".join(str(v) for v in q) + "\n")
+        f.write("n = " + " ".join(str(v) for v in n) + "\n")
+    subprocess.run(
+        ["./pi_study", f"--sweep={spec_path}", f"--prefix={prefix}"], check=True
+    )
+
+    df = pd.read_csv(join(prefix, "sweep.csv"))
+    failed = df[df["status"] != "ok"]
+    if len(failed):
+        print("execution of the following cases has failed:")
+        print(failed[["q", "n"]])
+    df = df[df["status"] == "ok"]
+
     fig, axs = plt.subplots(ncols=3, figsize=(15, 5), constrained_layout=True)
     for q_ in q:
-        h_native_list = []
-        h_algoim_list = []
-
-        err_native_list = []
-        err_algoim_list = []
-
-        nquads_native_list = []
-        nquads_algoim_list = []
-        n_list = []
-
-        for n_ in tqdm(n):
-            cmd = ["./pi_study", "%d" % n_, "%d" % q_]
-            output = subprocess.run(cmd, capture_output=True)
-
-            h, err_native, nquads_native, err_algoim, nquads_algoim = (
-                output.stdout.decode().strip().split(",")
-            )
-
-            h = float(h)
-            err_native = float(err_native)
-            nquads_native = int(nquads_native)
-            err_algoim = float(err_algoim)
-            nquads_algoim = int(nquads_algoim)
-
-            h_native_list.append(h)
-            h_algoim_list.append(h)
-
-            err_native_list.append(err_native)
-            err_algoim_list.append(err_algoim)
-
-            nquads_native_list.append(nquads_native)
-            nquads_algoim_list.append(nquads_algoim)
-            n_list.append(n_)
+        df_q = df[df["q"] == q_]
 
         axs[0].loglog(
-            np.array(h_native_list) ** 2,
-            err_native_list,
+            df_q["h"] ** 2,
+            df_q["err_native"],
             "-o",
             label="q=%d" % q_,
             alpha=0.5,
         )
         axs[1].loglog(
-            np.array(h_algoim_list) ** 2,
-            err_algoim_list,
+            df_q["h"] ** 2,
+            df_q["err_algoim"],
             "-o",
             label="q=%d" % q_,
             alpha=0.5,
         )
 
         axs[2].semilogx(
-            n_list,
-            np.array(nquads_algoim_list) / np.array(nquads_native_list),
+            df_q["n"],
+            df_q["nquads_algoim"] / df_q["nquads_native"],
             "-o",
             label="q=%d" % q_,
             alpha=0.5,
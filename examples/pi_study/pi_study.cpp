@@ -1,11 +1,14 @@
 #include <omp.h>
 
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <vector>
 
 #include "quadrature_general.hpp"
+#include "utils/argparser.h"
+#include "utils/sweep.h"
 #include "utils/timer.h"
 
 template <int N>
@@ -115,16 +118,22 @@ struct Circle {
   }
 };
 
-double compute_pi(double xmin = -1.0, double xmax = 1.0, int nelems_x = 100,
-                  int node_count = 2, int* nquads = nullptr) {
-  double pi = 0.0;
+// Lower coordinates of the cells of a uniform 1d grid
+std::vector<double> grid_coords(double xmin, double xmax, int nelems_x) {
   double h = (xmax - xmin) / nelems_x;
-  double detJ = h * h;
-
   std::vector<double> X(nelems_x);
   for (int i = 0; i < nelems_x; i++) {
     X[i] = xmin + i * h;
   }
+  return X;
+}
+
+// X: lower coordinates of the cells in each direction, see grid_coords()
+double compute_pi(const std::vector<double>& X, double h, int node_count = 2,
+                  int* nquads = nullptr) {
+  double pi = 0.0;
+  int nelems_x = X.size();
+  double detJ = h * h;
 
   std::vector<double> qpts(node_count);
   std::vector<double> wts(node_count);
@@ -156,19 +165,13 @@ double compute_pi(double xmin = -1.0, double xmax = 1.0, int nelems_x = 100,
   return pi;
 }
 
-double compute_pi_algoim(double xmin = -1.0, double xmax = 1.0,
-                         int nelems_x = 100, int node_count = 2,
-                         int* nquads = nullptr) {
+double compute_pi_algoim(const std::vector<double>& X, double h,
+                         int node_count = 2, int* nquads = nullptr) {
   if (nquads) {
     *nquads = 0;
   }
   double pi = 0.0;
-  double h = (xmax - xmin) / nelems_x;
-
-  std::vector<double> X(nelems_x);
-  for (int i = 0; i < nelems_x; i++) {
-    X[i] = xmin + i * h;
-  }
+  int nelems_x = X.size();
 
   Circle phi;
   auto lam = [](const auto& x) { return 1.0; };
@@ -219,14 +222,15 @@ void test_algoim() {
     for (int q : q_vec) {
       double h = (xmax - xmin) / n;
 
+      std::vector<double> X = grid_coords(xmin, xmax, n);
       double t1 = watch.lap();
-      double pi = compute_pi(xmin, xmax, n, q);
+      double pi = compute_pi(X, h, q);
       double t2 = watch.lap();
       double err = abs(pi - pi_exact);
       printf("[native]q: %d, n: %4d, pi: %.10f, h: %9.2e, err: %.5e (%.3f s)\n",
              q, n, pi, h, err, t2 - t1);
 
-      double pi2 = compute_pi_algoim(-1.0, 1.0, n, q);
+      double pi2 = compute_pi_algoim(X, h, q);
       double err2 = abs(pi2 - pi_exact);
       double t3 = watch.lap();
       printf("[algoim]q: %d, n: %4d, pi: %.10f, h: %9.2e, err: %.5e (%.3f s)\n",
@@ -235,29 +239,74 @@ void test_algoim() {
   }
 }
 
+// Errors of pi and the numbers of quadrature points of both methods
+std::map<std::string, double> run_pi_case(const std::vector<double>& X,
+                                          double h, int q) {
+  double pi_exact = 3.14159265358979323846;
+
+  int nquads_native = 0, nquads_algoim = 0;
+  double err_native = abs(compute_pi(X, h, q, &nquads_native) - pi_exact);
+  double err_algoim =
+      abs(compute_pi_algoim(X, h, q, &nquads_algoim) - pi_exact);
+  return {{"h", h},
+          {"err_native", err_native},
+          {"nquads_native", nquads_native},
+          {"err_algoim", err_algoim},
+          {"nquads_algoim", nquads_algoim}};
+}
+
 int main(int argc, char* argv[]) {
+  double xmin = -1.0;
+  double xmax = 1.0;
+
   if (argc == 1) {
     test_algoim();
   }
 
+  // Run all (n, q) cases of a sweep spec in this process, the cases with the
+  // same n share the grid
+  else if (std::string(argv[1]).rfind("--", 0) == 0) {
+    ArgParser p;
+    p.add_argument<std::string>("--sweep", {});
+    p.add_argument<int>("--sweep_workers", 0);
+    p.add_argument<std::string>("--prefix", ".");
+    p.parse_args(argc, argv);
+
+    std::string sweep_spec = p.get<std::string>("sweep");
+    if (sweep_spec.empty()) {
+      throw std::runtime_error("usage: pi_study [<n> <q> | --sweep=<spec>]");
+    }
+    std::string prefix = p.get<std::string>("prefix");
+    std::filesystem::create_directories(prefix);
+
+    std::vector<SweepCase> cases = SweepSpec(sweep_spec).get_cases();
+    SweepCache cache;
+    SweepTable table = run_sweep(
+        cases, p.get<int>("sweep_workers"), [&](const SweepCase& c) {
+          int n = c.get<int>("n");
+          std::shared_ptr<std::vector<double>> X =
+              cache.get<std::vector<double>>(std::to_string(n), [&]() {
+                return std::make_shared<std::vector<double>>(
+                    grid_coords(xmin, xmax, n));
+              });
+          return run_pi_case(*X, (xmax - xmin) / n, c.get<int>("q"));
+        });
+
+    std::string csv_path =
+        std::filesystem::path(prefix) / std::filesystem::path("sweep.csv");
+    table.write_csv(csv_path);
+    std::printf("%d cases (%d failed) written to %s\n", int(cases.size()),
+                table.get_num_failed(), csv_path.c_str());
+  }
+
   else {
     int n = atoi(argv[1]);
     int q = atoi(argv[2]);
 
-    double xmin = -1.0;
-    double xmax = 1.0;
-    double h = (xmax - xmin) / n;
-
-    double pi_exact = 3.14159265358979323846;
-
-    int nquads_native = 0, nquads_algoim = 0;
-    double err_native =
-        abs(compute_pi(xmin, xmax, n, q, &nquads_native) - pi_exact);
-    double err_algoim =
-        abs(compute_pi_algoim(xmin, xmax, n, q, &nquads_algoim) - pi_exact);
-    printf("%.2e, %.10e, %d, %.10e, %d\n", h, err_native, nquads_native,
-           err_algoim, nquads_algoim);
+    auto r = run_pi_case(grid_coords(xmin, xmax, n), (xmax - xmin) / n, q);
+    printf("%.2e, %.10e, %d, %.10e, %d\n", r["h"], r["err_native"],
+           int(r["nquads_native"]), r["err_algoim"], int(r["nquads_algoim"]));
   }
 
   return 0;
-}
\ No newline at end of file
+}
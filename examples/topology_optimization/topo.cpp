@@ -1,11 +1,20 @@
 #include <mpi.h>
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <set>
 #include <string>
+#include <thread>
 #include <variant>
 
 #include "ParOptOptimizer.h"
@@ -19,10 +28,13 @@
 #include "physics/stress.h"
 #include "physics/volume.h"
 #include "utils/argparser.h"
+#include "utils/async_writer.h"
+#include "utils/checkpoint.h"
 #include "utils/exceptions.h"
 #include "utils/json.h"
 #include "utils/loggers.h"
 #include "utils/misc.h"
+#include "utils/mma.h"
 #include "utils/timer.h"
 #include "utils/vtk.h"
 
@@ -30,6 +42,22 @@
 
 using fspath = std::filesystem::path;
 
+// Format of the optimization snapshots, see option vtk_format
+enum class VTKFormat { VTK, VTU, VTU_LZ4 };
+
+VTKFormat parse_vtk_format(const std::string& vtk_format) {
+  if (vtk_format == "vtk") return VTKFormat::VTK;
+  if (vtk_format == "vtu") return VTKFormat::VTU;
+  if (vtk_format == "vtu_lz4") return VTKFormat::VTU_LZ4;
+  throw std::runtime_error("vtk_format must be vtk, vtu or vtu_lz4, got " +
+                           vtk_format);
+}
+
+VTUCompression get_vtu_compression(VTKFormat format) {
+  return format == VTKFormat::VTU_LZ4 ? VTUCompression::LZ4
+                                      : VTUCompression::NONE;
+}
+
 template <typename T, int Np_1d, class Grid_>
 class ProbMeshBase {
  public:
@@ -360,19 +388,19 @@ class LbracketGridMesh final
 };
 
 template <typename T, int Np_1d, int Np_1d_filter, bool use_ersatz_,
-          class Grid_>
+          class Grid_, class Factor_ = SparseUtils::SparseCholesky<T>>
 class TopoAnalysis {
  public:
   static constexpr bool use_ersatz = use_ersatz_;
   static constexpr int get_spatial_dim() { return Grid_::spatial_dim; }
+  using ProbMesh = ProbMeshBase<T, Np_1d, Grid_>;
 
  private:
-  using ProbMesh = ProbMeshBase<T, Np_1d, Grid_>;
   using Grid = typename ProbMesh::Grid;
   using Mesh = typename ProbMesh::Mesh;
   using Quadrature = GDLSFQuadrature2D<T, Np_1d, QuadPtType::INNER, Grid>;
   using Basis = GDBasis2D<T, Mesh>;
-  using Filter = HelmholtzFilter<T, Np_1d_filter, Grid>;
+  using Filter = HelmholtzFilter<T, Np_1d_filter, Grid, Factor_>;
 
   constexpr static auto int_func =
       [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
@@ -387,8 +415,11 @@ class TopoAnalysis {
 
   using Elastic = typename std::conditional<
       use_ersatz,
-      StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_func), Grid>,
-      StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_func)>>::type;
+      StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_func), Grid,
+                          Factor_>,
+      StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_func),
+                    Factor_>>::type;
+  using Factor = Factor_;
   using Volume = VolumePhysics<T, Basis::spatial_dim>;
   using Penalization = GradPenalization<T, Basis::spatial_dim>;
   using Stress = LinearElasticity2DVonMisesStress<T>;
@@ -397,7 +428,8 @@ class TopoAnalysis {
   using PenalizationAnalysis =
       GalerkinAnalysis<T, typename Filter::Mesh, typename Filter::Quadrature,
                        typename Filter::Basis, Penalization>;
-  using StressAnalysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Stress>;
+  using StressAnalysis =
+      GalerkinAnalysis<T, Mesh, Quadrature, Basis, Stress, use_ersatz>;
   using StressKSAnalysis =
       GalerkinAnalysis<T, Mesh, Quadrature, Basis, StressKS, use_ersatz>;
 
@@ -431,7 +463,10 @@ class TopoAnalysis {
         stress_ks_analysis(mesh, quadrature, basis, stress_ks),
         phi(mesh.get_lsf_dof()),
         prefix(prefix),
-        cache({{"x", {}}, {"sol", {}}, {"chol", nullptr}}),
+        cache({{"x", {}},
+               {"sol", {}},
+               {"chol", nullptr},
+               {"psi_stress", std::vector<T>{}}}),
         compliance_scalar(compliance_scalar) {
     // Get loaded cells
     loaded_cells = prob_mesh.get_loaded_cells();
@@ -491,14 +526,12 @@ class TopoAnalysis {
     filter.apply(x.data(), phi.data());
     mesh.update_mesh();
 
+    // All analyses below share the cut-cell quadrature, and the gradient
+    // evaluation needs the quadrature sensitivities, compute them all at once
+    quadrature.precompute(true);
+
     if constexpr (use_ersatz) {
-      int nverts = grid.get_num_verts();
-      auto& lsf_mesh = elastic.get_mesh_ersatz();
-      auto& lsf_ersatz = lsf_mesh.get_lsf_dof();
-      for (int i = 0; i < nverts; i++) {
-        lsf_ersatz[i] = -phi[i];
-      }
-      lsf_mesh.update_mesh();
+      elastic.update_mesh_ersatz();
     }
 
     const std::unordered_map<int, int>& vert_nodes = mesh.get_vert_nodes();
@@ -523,14 +556,17 @@ class TopoAnalysis {
   }
 
   std::vector<T> update_mesh_and_solve(
-      const std::vector<T>& x,
-      std::shared_ptr<SparseUtils::SparseCholesky<T>>* chol = nullptr) {
+      const std::vector<T>& x, std::shared_ptr<Factor>* chol = nullptr) {
     // Solve the static problem
     update_mesh(x);
 
-    VandermondeCondLogger::clear();
-    VandermondeCondLogger::enable();
+    if (log_conds) {
+      VandermondeCondLogger::enable();
+      VandermondeCondLogger::clear();
+    }
+    stiffness_cond = std::numeric_limits<double>::quiet_NaN();
 
+    std::vector<T> sol;
     try {
       LoadPhysics load_physics(load_func);
       std::set<int> load_elements;
@@ -542,11 +578,36 @@ class TopoAnalysis {
       LoadQuadrature load_quadrature(mesh, load_elements);
       LoadAnalysis load_analysis(mesh, load_quadrature, basis, load_physics);
 
-      std::vector<T> sol =
-          elastic.solve(bc_dof, std::vector<T>(bc_dof.size(), T(0.0)),
-                        std::tuple<LoadAnalysis>(load_analysis), chol);
-
-      return sol;
+      if (use_iterative_solver) {
+        sol = elastic.solve_iterative(
+            bc_dof, std::vector<T>(bc_dof.size(), T(0.0)),
+            std::tuple<LoadAnalysis>(load_analysis), iterative_rtol);
+      } else {
+        std::vector<T> bc_vals(bc_dof.size(), T(0.0));
+        if constexpr (use_ersatz) {
+          if (use_reduced_solver()) {
+            sol = elastic.solve_reduced(
+                bc_dof, bc_vals, std::tuple<LoadAnalysis>(load_analysis), chol);
+          }
+        }
+        if (not use_reduced_solver()) {
+          sol = elastic.solve(bc_dof, bc_vals,
+                              std::tuple<LoadAnalysis>(load_analysis), chol);
+          if (log_conds and chol) {
+            // A few digits are enough for monitoring
+            stiffness_cond =
+                elastic.estimate_condition_number(bc_dof, **chol, 1e-3).cond;
+          }
+        }
+        if constexpr (std::is_same_v<Factor, MixedPrecisionCholesky<T>>) {
+          if (chol and (*chol)->get_num_fallbacks()) {
+            std::printf(
+                "[TopoAnalysis] refinement of the single precision factor "
+                "stalled, the stiffness matrix is factored in double "
+                "precision\n");
+          }
+        }
+      }
     } catch (const StencilConstructionFailed& e) {
       std::printf(
           "StencilConstructionFailed error has been caught when calling "
@@ -564,12 +625,27 @@ class TopoAnalysis {
       throw e;
     }
 
-    VandermondeCondLogger::disable();
+    if (log_conds) VandermondeCondLogger::disable();
+    return sol;
   }
 
   auto eval_obj_con(const std::vector<T>& x) {
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol;
-    std::vector<T> sol = update_mesh_and_solve(x, &chol);
+    std::shared_ptr<Factor> chol;
+    std::vector<T> sol, psi_stress;
+    if (warm_start and x == warm_start->x) {
+      update_mesh(x);
+      if (phi == warm_start->phi) {
+        sol = std::move(warm_start->sol);
+        elastic.get_rhs() = std::move(warm_start->rhs);
+        psi_stress = std::move(warm_start->psi_stress);
+      } else {
+        std::printf(
+            "[TopoAnalysis] the filtered design differs from the restored "
+            "one, solving again\n");
+      }
+    }
+    if (sol.empty()) sol = update_mesh_and_solve(x, &chol);
+    warm_start.reset();
 
     T comp = std::inner_product(sol.begin(), sol.end(),
                                 elastic.get_rhs().begin(), T(0.0)) *
@@ -579,11 +655,9 @@ class TopoAnalysis {
     T area = vol_analysis.energy(nullptr, dummy.data());
     T pterm = pen_analysis.energy(nullptr, phi.data());
 
-    auto [xloc_q, stress_q] = eval_stress(sol);
-    T max_stress = *std::max_element(stress_q.begin(), stress_q.end());
+    std::vector<T> xloc_q, stress_q;
+    auto [max_stress, ks_energy] = eval_stress_max_ks(sol, &xloc_q, &stress_q);
     T max_stress_ratio = max_stress / stress_ks.get_yield_stress();
-    stress_ks.set_max_stress_ratio(max_stress_ratio);
-    T ks_energy = stress_ks_analysis.energy(nullptr, sol.data());
     T ks_stress_ratio =
         log(ks_energy) / stress_ks.get_ksrho() + max_stress_ratio;
 
@@ -591,6 +665,7 @@ class TopoAnalysis {
     cache["x"] = x;
     cache["sol"] = sol;
     cache["chol"] = chol;
+    cache["psi_stress"] = psi_stress;
     cache["ks_energy"] = ks_energy;
     cache["area"] = area;
 
@@ -598,28 +673,6 @@ class TopoAnalysis {
                            ks_stress_ratio, sol, xloc_q, stress_q);
   }
 
-  // only useful if ersatz material is used
-  template <int dim>
-  std::vector<T> grid_dof_to_cut_dof(const std::vector<T> u) {
-    if (u.size() != mesh.get_grid().get_num_verts() * dim) {
-      throw std::runtime_error(
-          "grid_dof_to_cut_dof() only takes dof vectors of size nverts * dim "
-          "(" +
-          std::to_string(mesh.get_grid().get_num_verts() * dim) + "), got " +
-          std::to_string(u.size()));
-    }
-
-    int nnodes = mesh.get_num_nodes();
-    std::vector<T> u0(dim * nnodes);
-    for (int i = 0; i < nnodes; i++) {
-      int vert = mesh.get_node_vert(i);
-      for (int d = 0; d < dim; d++) {
-        u0[dim * i + d] = u[dim * vert + d];
-      }
-    }
-    return u0;
-  }
-
   template <int dim>
   std::vector<T> cut_dof_to_grid_dof(const std::vector<T> u0) {
     if (u0.size() != mesh.get_num_nodes() * dim) {
@@ -641,31 +694,38 @@ class TopoAnalysis {
     return u;
   }
 
-  std::pair<std::vector<T>, std::vector<T>> eval_stress(
-      const std::vector<T>& u) {
-    if constexpr (use_ersatz) {
-      return stress_analysis.interpolate_energy(
-          grid_dof_to_cut_dof<spatial_dim>(u).data());
-    } else {
-      return stress_analysis.interpolate_energy(u.data());
-    }
+  /**
+   * @brief Evaluate the maximum Von Mises stress and the KS aggregate of the
+   * stress ratio in one pass, and update the maximum stress ratio of the KS
+   * physics accordingly
+   *
+   * @return {max stress, ∫exp(ksrho * (stress ratio - max stress ratio))dΩ}
+   */
+  std::pair<T, T> eval_stress_max_ks(const std::vector<T>& u,
+                                     std::vector<T>* xloc_q = nullptr,
+                                     std::vector<T>* stress_q = nullptr) {
+    T yield_stress = stress_ks.get_yield_stress();
+    auto [max_stress, ks_energy] = stress_analysis.energy_max_ks(
+        u.data(), stress_ks.get_ksrho() / yield_stress, xloc_q, stress_q);
+    stress_ks.set_max_stress_ratio(max_stress / yield_stress);
+    return {max_stress, ks_energy};
   }
 
   void eval_obj_con_gradient(const std::vector<T>& x, std::vector<T>& gcomp,
                              std::vector<T>& garea, std::vector<T>& gpen,
                              std::vector<T>& gstress) {
     T ks_energy = 0.0, area = 0.0;
-    std::vector<T> sol;
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol;
+    std::vector<T> sol, psi_stress;
+    std::shared_ptr<Factor> chol;
     if (x == std::get<std::vector<T>>(cache["x"])) {
       sol = std::get<std::vector<T>>(cache["sol"]);
-      chol = std::get<std::shared_ptr<SparseUtils::SparseCholesky<T>>>(
-          cache["chol"]);
+      chol = std::get<std::shared_ptr<Factor>>(cache["chol"]);
+      psi_stress = std::get<std::vector<T>>(cache["psi_stress"]);
       ks_energy = std::get<T>(cache["ks_energy"]);
       area = std::get<T>(cache["area"]);
     } else {
       sol = update_mesh_and_solve(x, &chol);
-      ks_energy = stress_ks_analysis.energy(nullptr, sol.data());
+      ks_energy = std::get<1>(eval_stress_max_ks(sol));
       std::vector<T> dummy(mesh.get_num_nodes(), 0.0);
       area = vol_analysis.energy(nullptr, dummy.data());
     }
@@ -674,35 +734,61 @@ class TopoAnalysis {
     std::vector<T> psi_comp = sol;
     for (T& p : psi_comp) p *= -1.0;
 
-    // Evaluate the rhs of the adjoint equation for stress
-    // adjoint equation is K * psi = -∂s/∂u
-    std::vector<T> psi_stress(sol.size(), T(0.0));
-    stress_ks_analysis.residual(nullptr, sol.data(), psi_stress.data());
+    // The stress adjoint is only known if it is restored from a checkpoint,
+    // see set_warm_start()
+    if (psi_stress.empty()) {
+      // Evaluate the rhs of the adjoint equation for stress
+      // adjoint equation is K * psi = -∂s/∂u
+      psi_stress.resize(sol.size(), T(0.0));
+      stress_ks_analysis.residual(nullptr, sol.data(), psi_stress.data());
+
+      // Apply boundary conditions to the rhs
+      for (int i : bc_dof) {
+        psi_stress[i] = 0.0;
+      }
 
-    // Apply boundary conditions to the rhs
-    for (int i : bc_dof) {
-      psi_stress[i] = 0.0;
-    }
+      // Compute stress adjoints, the iterative solver reuses the operator of
+      // the primal solve
+      if (use_iterative_solver) {
+        elastic.solve_adjoint_iterative(psi_stress.data(), iterative_rtol);
+      } else if constexpr (use_ersatz) {
+        if (use_reduced_solver()) {
+          elastic.solve_adjoint_reduced(*chol, psi_stress.data());
+        } else {
+          chol->solve(psi_stress.data());
+        }
+      } else {
+        chol->solve(psi_stress.data());
+      }
 
-    // Compute stress adjoints
-    chol->solve(psi_stress.data());
+      // Apply boundary conditions again to the adjoint variables
+      for (int i : bc_dof) {
+        psi_stress[i] = 0.0;
+      }
 
-    // Apply boundary conditions again to the adjoint variables
-    for (int i : bc_dof) {
-      psi_stress[i] = 0.0;
+      for (T& p : psi_stress) p *= -1.0;
+      cache["psi_stress"] = psi_stress;
     }
 
-    std::vector<T> psi_stress_neg = psi_stress;
-    for (T& p : psi_stress) p *= -1.0;
-
     gcomp.resize(x.size());
     std::fill(gcomp.begin(), gcomp.end(), 0.0);
-    elastic.get_analysis().LSF_jacobian_adjoint_product(
-        sol.data(), psi_comp.data(), gcomp.data());
+    gstress.resize(x.size());
+    std::fill(gstress.begin(), gstress.end(), 0.0);
+
+    // Explicit partials of the stress
+    stress_ks_analysis.LSF_energy_derivatives(sol.data(), gstress.data());
+
+    // Implicit derivatives via the adjoint variables, the compliance and
+    // stress adjoints share a single pass over the quadrature derivatives
+    const T* dofs[2] = {sol.data(), sol.data()};
+    const T* psis[2] = {psi_comp.data(), psi_stress.data()};
+    T* dfdphis[2] = {gcomp.data(), gstress.data()};
+    elastic.get_analysis().LSF_jacobian_adjoint_product(2, dofs, psis,
+                                                        dfdphis);
     if constexpr (use_ersatz) {
-      elastic.get_analysis_ersatz().LSF_jacobian_adjoint_product(
-          sol.data(), sol.data() /*this is effectively -psi*/, gcomp.data());
+      elastic.ersatz_LSF_jacobian_adjoint_product(2, dofs, psis, dfdphis);
     }
+
     filter.applyGradient(x.data(), gcomp.data(), gcomp.data());
     std::transform(
         gcomp.begin(), gcomp.end(), gcomp.begin(),
@@ -718,20 +804,6 @@ class TopoAnalysis {
     pen_analysis.residual(nullptr, phi.data(), gpen.data());
     filter.applyGradient(x.data(), gpen.data(), gpen.data());
 
-    gstress.resize(x.size());
-    std::fill(gstress.begin(), gstress.end(), 0.0);
-
-    // Explicit partials
-    stress_ks_analysis.LSF_energy_derivatives(sol.data(), gstress.data());
-
-    // Implicit derivatives via the adjoint variables
-    elastic.get_analysis().LSF_jacobian_adjoint_product(
-        sol.data(), psi_stress.data(), gstress.data());
-    if constexpr (use_ersatz) {
-      elastic.get_analysis_ersatz().LSF_jacobian_adjoint_product(
-          sol.data(), psi_stress_neg.data(), gstress.data());
-    }
-
     filter.applyGradient(x.data(), gstress.data(), gstress.data());
 
     // Now gstress is really just denergy/dx, next, compute dks/dx:
@@ -758,54 +830,65 @@ class TopoAnalysis {
       throw std::runtime_error("sizes don't match");
     }
 
-    ToVTK<T, typename Filter::Mesh> vtk(filter.get_mesh(), vtk_path);
-    vtk.write_mesh();
+    // Legacy ASCII .vtk or binary .vtu depending on the extension
+    using FilterMesh = typename Filter::Mesh;
+    auto write = [&](auto& vtk) {
+      vtk.write_mesh();
 
-    // Node solutions
-    for (auto [name, vals] : node_sols) {
-      if (vals.size() != grid.get_num_verts()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_grid_vtk()]node sol size doesn't match "
-            "number of verts");
+      // Node solutions
+      for (auto [name, vals] : node_sols) {
+        if (vals.size() != grid.get_num_verts()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_grid_vtk()]node sol size doesn't match "
+              "number of verts");
+        }
+        vtk.write_sol(name, vals.data());
       }
-      vtk.write_sol(name, vals.data());
-    }
 
-    vtk.write_sol("x", x.data());
-    vtk.write_sol("phi", phi.data());
+      vtk.write_sol("x", x.data());
+      vtk.write_sol("phi", phi.data());
 
-    // Node vectors
-    for (auto [name, vals] : node_vecs) {
-      if (vals.size() != spatial_dim * grid.get_num_verts()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_grid_vtk()]node vec size doesn't match "
-            "number of verts * spatial_dim");
+      // Node vectors
+      for (auto [name, vals] : node_vecs) {
+        if (vals.size() != spatial_dim * grid.get_num_verts()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_grid_vtk()]node vec size doesn't match "
+              "number of verts * spatial_dim");
+        }
+        vtk.write_vec(name, vals.data());
       }
-      vtk.write_vec(name, vals.data());
-    }
 
-    // Cell solutions
-    for (auto [name, vals] : cell_sols) {
-      if (vals.size() != grid.get_num_cells()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_grid_vtk()]cell sol size doesn't match "
-            "number of cells");
+      // Cell solutions
+      for (auto [name, vals] : cell_sols) {
+        if (vals.size() != grid.get_num_cells()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_grid_vtk()]cell sol size doesn't match "
+              "number of cells");
+        }
+        vtk.write_cell_sol(name, vals.data());
       }
-      vtk.write_cell_sol(name, vals.data());
-    }
 
-    std::vector<T> loaded_cells_v(grid.get_num_cells(), 0.0);
-    for (int c : loaded_cells) loaded_cells_v[c] = 1.0;
-    vtk.write_cell_sol("loaded_cells", loaded_cells_v.data());
+      std::vector<T> loaded_cells_v(grid.get_num_cells(), 0.0);
+      for (int c : loaded_cells) loaded_cells_v[c] = 1.0;
+      vtk.write_cell_sol("loaded_cells", loaded_cells_v.data());
 
-    // Cell vectors
-    for (auto [name, vals] : cell_vecs) {
-      if (vals.size() != spatial_dim * grid.get_num_cells()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_grid_vtk()]cell vec size doesn't match "
-            "number of cells * spatial_dim");
+      // Cell vectors
+      for (auto [name, vals] : cell_vecs) {
+        if (vals.size() != spatial_dim * grid.get_num_cells()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_grid_vtk()]cell vec size doesn't match "
+              "number of cells * spatial_dim");
+        }
+        vtk.write_cell_vec(name, vals.data());
       }
-      vtk.write_cell_vec(name, vals.data());
+    };
+    if (std::get<1>(split_path(vtk_path)) == ".vtu") {
+      ToVTU<T, FilterMesh> vtk(filter.get_mesh(), vtk_path, -1,
+                               vtu_compression, async_writer);
+      write(vtk);
+    } else {
+      ToVTK<T, FilterMesh> vtk(filter.get_mesh(), vtk_path);
+      write(vtk);
     }
   }
 
@@ -822,53 +905,6 @@ class TopoAnalysis {
     }
 
     const Mesh& mesh = elastic.get_mesh();
-    ToVTK<T, Mesh> vtk(mesh, vtk_path);
-    vtk.write_mesh();
-
-    // Node solutions
-    for (auto [name, vals] : node_sols) {
-      if (vals.size() != mesh.get_num_nodes()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_cut_vtk()]node sol size doesn't match "
-            "number of nodes");
-      }
-      vtk.write_sol(name, vals.data());
-    }
-    vtk.write_sol("x", mesh.get_lsf_nodes(x).data());
-    vtk.write_sol("phi", mesh.get_lsf_nodes().data());
-    std::vector<T> bc_nodes_v(mesh.get_num_nodes(), 0.0);
-    const auto& bc_nodes = prob_mesh.get_bc_nodes();
-    for (int n : bc_nodes) {
-      bc_nodes_v[n] = 1.0;
-    }
-    vtk.write_sol("bc_nodes", bc_nodes_v.data());
-
-    // Node vectors
-    for (auto [name, vals] : node_vecs) {
-      if (vals.size() != spatial_dim * mesh.get_num_nodes()) {
-        throw std::runtime_error("[TopoAnalysis::write_cut_vtk()]node vec " +
-                                 name +
-                                 " size doesn't match "
-                                 "number of nodes * spatial_dim");
-      }
-      vtk.write_vec(name, vals.data());
-    }
-
-    // Cell solutions
-    for (auto [name, vals] : cell_sols) {
-      if (vals.size() != mesh.get_num_elements()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_cut_vtk()]cell sol size doesn't match "
-            "number of elements");
-      }
-      vtk.write_cell_sol(name, vals.data());
-    }
-
-    std::vector<double> conds(mesh.get_num_elements());
-    for (int elem = 0; elem < mesh.get_num_elements(); elem++) {
-      conds[elem] = VandermondeCondLogger::get_conds().at(elem);
-    }
-    vtk.write_cell_sol("cond", conds.data());
 
     auto& stencils = mesh.get_elem_nodes();
     std::map<int, std::vector<int>> degenerate_stencils;
@@ -880,25 +916,98 @@ class TopoAnalysis {
         degenerate_stencils[elem] = stencil;
       }
     }
-    vtk.write_cell_sol("nstencils", nstencils.data());
 
-    // Cell vectors
-    for (auto [name, vals] : cell_vecs) {
-      if (vals.size() != mesh.get_num_elements()) {
-        throw std::runtime_error(
-            "[TopoAnalysis::write_cut_vtk()]cell vec size doesn't match "
-            "number of elements * spatial_dim");
+    // Legacy ASCII .vtk or binary .vtu depending on the extension
+    auto write = [&](auto& vtk) {
+      vtk.write_mesh();
+
+      // Node solutions
+      for (auto [name, vals] : node_sols) {
+        if (vals.size() != mesh.get_num_nodes()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_cut_vtk()]node sol size doesn't match "
+              "number of nodes");
+        }
+        vtk.write_sol(name, vals.data());
+      }
+      vtk.write_sol("x", mesh.get_lsf_nodes(x).data());
+      vtk.write_sol("phi", mesh.get_lsf_nodes().data());
+      std::vector<T> bc_nodes_v(mesh.get_num_nodes(), 0.0);
+      const auto& bc_nodes = prob_mesh.get_bc_nodes();
+      for (int n : bc_nodes) {
+        bc_nodes_v[n] = 1.0;
+      }
+      vtk.write_sol("bc_nodes", bc_nodes_v.data());
+
+      // Node vectors
+      for (auto [name, vals] : node_vecs) {
+        if (vals.size() != spatial_dim * mesh.get_num_nodes()) {
+          throw std::runtime_error("[TopoAnalysis::write_cut_vtk()]node vec " +
+                                   name +
+                                   " size doesn't match "
+                                   "number of nodes * spatial_dim");
+        }
+        vtk.write_vec(name, vals.data());
       }
-      vtk.write_cell_vec(name, vals.data());
-    }
 
-    // Save stencils and degenerate stencils
-    auto [base, suffix] = split_path(vtk_path);
-    StencilToVTK<T, Mesh> stencil_vtk(mesh, base + "_stencils" + suffix);
-    stencil_vtk.write_stencils(stencils);
-    StencilToVTK<T, Mesh> degen_stencil_vtk(mesh,
-                                            base + "_degen_stencils" + suffix);
-    degen_stencil_vtk.write_stencils(degenerate_stencils);
+      // Cell solutions
+      for (auto [name, vals] : cell_sols) {
+        if (vals.size() != mesh.get_num_elements()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_cut_vtk()]cell sol size doesn't match "
+              "number of elements");
+        }
+        vtk.write_cell_sol(name, vals.data());
+      }
+
+      // NaN for the elements without a logged condition number, e.g. if
+      // log_conds is off
+      std::vector<double> conds(mesh.get_num_elements());
+      std::map<int, double> logged_conds = VandermondeCondLogger::get_conds();
+      for (int elem = 0; elem < mesh.get_num_elements(); elem++) {
+        auto it = logged_conds.find(elem);
+        conds[elem] = it == logged_conds.end()
+                          ? std::numeric_limits<double>::quiet_NaN()
+                          : it->second;
+      }
+      vtk.write_cell_sol("cond", conds.data());
+
+      vtk.write_cell_sol("nstencils", nstencils.data());
+
+      // Cell vectors
+      for (auto [name, vals] : cell_vecs) {
+        if (vals.size() != mesh.get_num_elements()) {
+          throw std::runtime_error(
+              "[TopoAnalysis::write_cut_vtk()]cell vec size doesn't match "
+              "number of elements * spatial_dim");
+        }
+        vtk.write_cell_vec(name, vals.data());
+      }
+    };
+    if (std::get<1>(split_path(vtk_path)) == ".vtu") {
+      ToVTU<T, Mesh> vtk(mesh, vtk_path, -1, vtu_compression, async_writer);
+      write(vtk);
+    } else {
+      ToVTK<T, Mesh> vtk(mesh, vtk_path);
+      write(vtk);
+    }
+
+    // Save stencils and degenerate stencils in the same format
+    auto [base, ext] = split_path(vtk_path);
+    if (ext == ".vtu") {
+      StencilToVTU<T, Mesh>(mesh, base + "_stencils.vtu", vtu_compression,
+                            async_writer)
+          .write_stencils(stencils);
+      StencilToVTU<T, Mesh>(mesh, base + "_degen_stencils.vtu",
+                            vtu_compression, async_writer)
+          .write_stencils(degenerate_stencils);
+    } else {
+      StencilToVTK<T, Mesh> stencil_vtk(mesh, base + "_stencils.vtk");
+      stencil_vtk.write_stencils(stencils);
+      StencilToVTK<T, Mesh> degen_stencil_vtk(mesh,
+                                              base + "_degen_stencils.vtk");
+      degen_stencil_vtk.write_stencils(degenerate_stencils);
+    }
   }
 
   void write_prob_json(const std::string json_path, const ConfigParser& parser,
@@ -909,11 +1018,81 @@ class TopoAnalysis {
     j["bc_dof"] = bc_dof;
     j["loaded_cells"] = loaded_cells;
     j["dvs"] = x;
-    write_json(json_path, j);
+    if (async_writer) {
+      auto jp = std::make_shared<json>(std::move(j));
+      async_writer->submit([jp, json_path]() { write_json(json_path, *jp); });
+    } else {
+      write_json(json_path, j);
+    }
   }
 
   std::vector<T>& get_phi() { return phi; }
   std::vector<T>& get_rhs() { return elastic.get_rhs(); }
+
+  // Solution and stress adjoint of the last evaluated design, the adjoint is
+  // empty until the gradient is evaluated
+  const std::vector<T>& get_sol() {
+    return std::get<std::vector<T>>(cache["sol"]);
+  }
+  const std::vector<T>& get_stress_adjoint() {
+    return std::get<std::vector<T>>(cache["psi_stress"]);
+  }
+
+  /**
+   * @brief Restore the solves of design x, e.g. from a checkpoint, so that
+   * the next evaluation of x skips the primal and the adjoint solves
+   *
+   * The restored vectors are only used if the next evaluated design is x and
+   * its filtered design matches phi. The iterative solver loses its recycled
+   * subspace, so its next solve starts without deflation.
+   */
+  void set_warm_start(std::vector<T> x, std::vector<T> phi,
+                      std::vector<T> sol, std::vector<T> rhs,
+                      std::vector<T> psi_stress) {
+    warm_start = WarmStart{std::move(x), std::move(phi), std::move(sol),
+                           std::move(rhs), std::move(psi_stress)};
+  }
+
+  Elastic& get_elastic() { return elastic; }
+
+  // Solve the elastic problems by recycled multigrid-preconditioned CG
+  // instead of Cholesky factorizations
+  void set_iterative_solver(bool use, double rtol = 1e-10) {
+    use_iterative_solver = use;
+    iterative_rtol = rtol;
+  }
+
+  // The ersatz problem with a band of ersatz material is solved on the free
+  // dof only, i.e. the void dof beyond the band and the Dirichlet dof are
+  // eliminated, by the direct solver
+  bool use_reduced_solver() const {
+    if constexpr (use_ersatz) {
+      return elastic.get_ersatz_band() >= 0;
+    } else {
+      return false;
+    }
+  }
+
+  // Record the condition numbers of the Vandermonde matrices of the solves,
+  // written by write_cut_vtk(), and estimate the condition number of the
+  // stiffness matrix of the direct solves, see get_stiffness_cond(). The
+  // logger is process-global, so this must be off for analyses that run
+  // concurrently, see TopoEnsemble.
+  void set_log_conds(bool log) { log_conds = log; }
+
+  // Estimated condition number of the stiffness matrix of the last solve, NaN
+  // if log_conds is off or the solve is iterative or reduced
+  double get_stiffness_cond() const { return stiffness_cond; }
+
+  // Compression of the .vtu outputs of write_grid_vtk() and write_cut_vtk()
+  void set_vtu_compression(VTUCompression compression) {
+    vtu_compression = compression;
+  }
+
+  // If set, .vtu (including the stencils) and json outputs are written by the
+  // writer thread, legacy .vtk outputs are always written synchronously
+  void set_async_writer(AsyncWriter* writer) { async_writer = writer; }
+
   ProbMesh& get_prob_mesh() { return prob_mesh; }
 
  private:
@@ -943,16 +1122,164 @@ class TopoAnalysis {
   std::set<int> loaded_cells;
 
   std::map<std::string,
-           std::variant<T, std::vector<T>,
-                        std::shared_ptr<SparseUtils::SparseCholesky<T>>>>
+           std::variant<T, std::vector<T>, std::shared_ptr<Factor>>>
       cache;
+
+  struct WarmStart {
+    std::vector<T> x, phi, sol, rhs, psi_stress;
+  };
+  std::optional<WarmStart> warm_start;
   double compliance_scalar;
+
+  bool use_iterative_solver = false;
+  double iterative_rtol = 1e-10;
+  bool log_conds = true;
+  double stiffness_cond = std::numeric_limits<double>::quiet_NaN();
+  VTUCompression vtu_compression = VTUCompression::NONE;
+  AsyncWriter* async_writer = nullptr;
+};
+
+/**
+ * @brief Evaluates batches of independent designs concurrently
+ *
+ * Each worker owns a complete workspace, i.e. a ProbMesh (grid, cut mesh) and
+ * a TopoAnalysis (filter, quadrature, solver, cache), so designs evaluated at
+ * the same time share no mutable state. The workers don't log the Vandermonde
+ * condition numbers, the logger is process-global. Designs are handed out to
+ * the workers dynamically, and the OpenMP threads are split evenly among the
+ * workers so that the machine is not oversubscribed.
+ *
+ * This is useful for the finite difference checks, step size studies and
+ * multi-start studies, where many designs are evaluated independently.
+ */
+template <typename T, class TopoAnalysis>
+class TopoEnsemble {
+ public:
+  using ProbMesh = typename TopoAnalysis::ProbMesh;
+
+  struct Result {
+    T comp, area, pterm, max_stress, max_stress_ratio, ks_stress_ratio;
+    std::vector<T> gcomp, garea, gpen, gstress;  // empty without gradient
+  };
+
+  /**
+   * @param nworkers number of designs evaluated concurrently
+   * @param create_prob_mesh creates a new ProbMesh
+   * @param create_topo creates a new TopoAnalysis for the given ProbMesh,
+   * the second argument is the output directory of the worker
+   * @param prefix output directory, worker w writes its debug outputs to
+   * <prefix>/ensemble_w<w>
+   */
+  TopoEnsemble(
+      int nworkers, std::function<std::shared_ptr<ProbMesh>()> create_prob_mesh,
+      std::function<std::shared_ptr<TopoAnalysis>(ProbMesh&, std::string)>
+          create_topo,
+      std::string prefix) {
+    if (nworkers < 1) {
+      throw std::runtime_error("TopoEnsemble: nworkers must be positive, got " +
+                               std::to_string(nworkers));
+    }
+    for (int w = 0; w < nworkers; w++) {
+      std::string worker_prefix =
+          fspath(prefix) / fspath("ensemble_w" + std::to_string(w));
+      if (!std::filesystem::is_directory(worker_prefix)) {
+        std::filesystem::create_directories(worker_prefix);
+      }
+      prob_meshes.push_back(create_prob_mesh());
+      topos.push_back(create_topo(*prob_meshes.back(), worker_prefix));
+
+      // The workers would mix their entries in the global logger
+      topos.back()->set_log_conds(false);
+    }
+  }
+
+  int get_num_workers() const { return topos.size(); }
+
+  /**
+   * @brief Evaluate the functionals, and optionally their gradients, of all
+   * designs
+   *
+   * @param xs designs, each of size nverts
+   * @param eval_gradient evaluate the gradients as well
+   * @return results in the same order as xs
+   */
+  std::vector<Result> evaluate(const std::vector<std::vector<T>>& xs,
+                               bool eval_gradient = true) {
+    return evaluate(xs, std::vector<bool>(xs.size(), eval_gradient));
+  }
+
+  // Same as above, but the gradients are only evaluated for the designs
+  // flagged by eval_gradient
+  std::vector<Result> evaluate(const std::vector<std::vector<T>>& xs,
+                               const std::vector<bool>& eval_gradient) {
+    if (eval_gradient.size() != xs.size()) {
+      throw std::runtime_error("TopoEnsemble: sizes don't match");
+    }
+    int ndesigns = xs.size();
+    int nworkers = std::min<int>(topos.size(), ndesigns);
+    std::vector<Result> results(ndesigns);
+
+#ifdef _OPENMP
+    int nthreads = std::max(1, omp_get_max_threads() / std::max(nworkers, 1));
+#endif
+
+    std::atomic<int> next{0};
+    std::exception_ptr error;
+    std::mutex error_mtx;
+
+    auto work = [&](int w) {
+#ifdef _OPENMP
+      // Sets the thread count of the OpenMP teams spawned by this worker
+      omp_set_num_threads(nthreads);
+#endif
+      for (int i = next++; i < ndesigns; i = next++) {
+        try {
+          results[i] = evaluate_design(*topos[w], xs[i], eval_gradient[i]);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mtx);
+          if (!error) error = std::current_exception();
+          next = ndesigns;
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < nworkers; w++) {
+      threads.emplace_back(work, w);
+    }
+    for (auto& t : threads) t.join();
+
+    if (error) std::rethrow_exception(error);
+    return results;
+  }
+
+ private:
+  static Result evaluate_design(TopoAnalysis& topo, const std::vector<T>& x,
+                                bool eval_gradient) {
+    Result r;
+    auto [comp, area, pterm, max_stress, max_stress_ratio, ks_stress_ratio,
+          sol, xloc_q, stress_q] = topo.eval_obj_con(x);
+    r.comp = comp;
+    r.area = area;
+    r.pterm = pterm;
+    r.max_stress = max_stress;
+    r.max_stress_ratio = max_stress_ratio;
+    r.ks_stress_ratio = ks_stress_ratio;
+    if (eval_gradient) {
+      topo.eval_obj_con_gradient(x, r.gcomp, r.garea, r.gpen, r.gstress);
+    }
+    return r;
+  }
+
+  std::vector<std::shared_ptr<ProbMesh>> prob_meshes;
+  std::vector<std::shared_ptr<TopoAnalysis>> topos;
 };
 
 template <typename T, class TopoAnalysis>
 class TopoProb : public ParOptProblem {
  public:
-  TopoProb(TopoAnalysis& topo, std::string prefix, const ConfigParser& parser)
+  TopoProb(TopoAnalysis& topo, std::string prefix, const ConfigParser& parser,
+           VTKFormat vtk_format)
       : ParOptProblem(MPI_COMM_SELF),
         topo(topo),
         prefix(prefix),
@@ -968,7 +1295,19 @@ class TopoProb : public ParOptProblem {
             parser.get_double_option("stress_objective_theta")),
         nvars(topo.get_prob_mesh().get_nvars()),
         ncon(has_stress_constraint ? 2 : 1),
-        nineq(ncon) {
+        nineq(ncon),
+        use_vtu(vtk_format != VTKFormat::VTK),
+        vtk_ext(use_vtu ? ".vtu" : ".vtk"),
+        vtu_compression(get_vtu_compression(vtk_format)),
+        grid_pvd(fspath(prefix) / fspath("grid.pvd")),
+        cut_pvd(fspath(prefix) / fspath("cut.pvd")),
+        quad_pvd(fspath(prefix) / fspath("quad.pvd")),
+        use_mma(parser.get_str_option("optimizer") == "mma"),
+        checkpoint_every(parser.get_int_option("checkpoint_every")),
+        restart_path(parser.get_str_option("restart_from_checkpoint")),
+        async_writer(parser.get_bool_option("async_output")
+                         ? parser.get_int_option("async_output_queue_size")
+                         : 0) {
     setProblemSizes(nvars, ncon, 0);
     setNumInequalities(nineq, 0);
 
@@ -976,9 +1315,45 @@ class TopoProb : public ParOptProblem {
       std::filesystem::create_directory(prefix);
     }
 
+    topo.set_async_writer(&async_writer);
+
+    std::string optimizer = parser.get_str_option("optimizer");
+    if (optimizer != "mma" and optimizer != "paropt") {
+      throw std::runtime_error("optimizer must be mma or paropt, got " +
+                               optimizer);
+    }
+    if (!use_mma and (checkpoint_every > 0 or !restart_path.empty())) {
+      throw std::runtime_error(
+          "checkpoint_every and restart_from_checkpoint need optimizer = mma, "
+          "the state of ParOpt's MMA can't be checkpointed");
+    }
+
+    // The first evaluation of a restarted run re-evaluates the checkpointed
+    // design, so it keeps the iteration number of the checkpoint
+    if (!restart_path.empty()) {
+      CheckpointReader ckpt(restart_path);
+      start_counter = ckpt.get_scalar<std::int64_t>("iter");
+      std::printf("restarting from iteration %d, checkpoint objective %.10e\n",
+                  start_counter, ckpt.get_scalar<T>("fobj"));
+    }
+
     reset_counter();
   }
 
+  ~TopoProb() { topo.set_async_writer(nullptr); }
+
+  // Wait for all pending outputs to be written
+  void flush_output() { async_writer.flush(); }
+
+  // Add a snapshot of the current iteration to a .pvd series. The index is
+  // updated by the writer thread, which executes the tasks in submission
+  // order, so the snapshot exists by the time it is indexed
+  void add_to_pvd(PVDWriter& pvd, const std::string& vtu_path) {
+    async_writer.submit([&pvd, time = counter, vtu_path]() {
+      pvd.add_dataset(time, vtu_path);
+    });
+  }
+
   void print_progress(T obj, T comp, T pterm, T vol_frac, T max_stress,
                       T max_stress_ratio, T ks_stress_ratio,
                       int header_every = 10) {
@@ -989,21 +1364,22 @@ class TopoProb : public ParOptProblem {
       std::snprintf(phead, 20, "pen(c:%8.1e)",
                     parser.get_double_option("grad_penalty_coeff"));
       char line[2048];
-      std::snprintf(line, 2048, "\n%5s%20s%20s%20s%15s%20s%20s%20s%15s%15s\n",
-                    "iter", "obj", "comp", phead, "vol (\%)", "stress_max",
+      std::snprintf(line, 2048,
+                    "\n%5s%20s%20s%20s%15s%20s%20s%20s%15s%15s%15s\n", "iter",
+                    "obj", "comp", phead, "vol (\%)", "stress_max",
                     "stress_ratio_max", "stress_ratio_ks", "ks relerr(\%)",
-                    "uptime(H:M:S)");
+                    "cond(K)", "uptime(H:M:S)");
       std::cout << line;
       progress_file << line;
     }
     char line[2048];
     std::snprintf(
         line, 2048,
-        "%5d%20.10e%20.10e%20.10e%15.5f%20.10e%20.10e%20.10e%15.5f%15s\n",
+        "%5d%20.10e%20.10e%20.10e%15.5f%20.10e%20.10e%20.10e%15.5f%15.5e%15s\n",
         counter, obj, comp, pterm, 100.0 * vol_frac, max_stress,
         max_stress_ratio, ks_stress_ratio,
         (ks_stress_ratio - max_stress_ratio) / max_stress_ratio * 100.0,
-        watch.format_time(watch.lap()).c_str());
+        topo.get_stiffness_cond(), watch.format_time(watch.lap()).c_str());
     std::cout << line;
     progress_file << line;
     progress_file.close();
@@ -1017,19 +1393,57 @@ class TopoProb : public ParOptProblem {
     VandermondeCondLogger::clear();
   }
 
-  void reset_counter() { counter = 0; }
-
-  void getVarsAndBounds(ParOptVec* xvec, ParOptVec* lbvec, ParOptVec* ubvec) {
-    T *xr, *lb, *ub;
-    xvec->getArray(&xr);
-    lbvec->getArray(&lb);
-    ubvec->getArray(&ub);
+  void reset_counter() { counter = start_counter; }
+
+  /**
+   * @brief Snapshot iteration iter to <prefix>/checkpoint.xcgd
+   *
+   * The checkpoint holds the evaluated design, its filtered LSF, solution,
+   * right hand side and stress adjoint, the functionals, and the MMA state
+   * before the step to the next design. Only the latest checkpoint is kept,
+   * it is replaced atomically so a crash during the write leaves the previous
+   * one intact.
+   */
+  void write_checkpoint(int iter, const std::vector<T>& xr, T fobj,
+                        const T* cons, const MMAOptimizer& mma) {
+    auto ckpt = std::make_shared<CheckpointWriter>();
+    ckpt->add_string("cfg", json(parser.get_options()).dump());
+    ckpt->add_scalar<std::int64_t>("iter", iter);
+    ckpt->add("dvs", xr);
+    ckpt->add("phi", topo.get_phi());
+    ckpt->add("u", topo.get_sol());
+    ckpt->add("rhs", topo.get_rhs());
+    ckpt->add("psi_stress", topo.get_stress_adjoint());
+    ckpt->add_scalar("fobj", fobj);
+    ckpt->add("cons", cons, ncon);
+    mma.save(*ckpt);
+
+    std::string path = fspath(prefix) / fspath("checkpoint.xcgd");
+    async_writer.submit([ckpt, path]() { ckpt->write(path); });
+  }
 
-    // Set initial design
+  // Initial design of size nverts, from the checkpoint, the json file or the
+  // periodic holes, depending on the options
+  std::vector<T> get_initial_design() {
     std::vector<T> x0;
     std::string init_topo_json_path =
         parser.get_str_option("init_topology_from_json");
-    if (!init_topo_json_path.empty()) {
+    if (!restart_path.empty()) {
+      CheckpointReader ckpt(restart_path);
+      json j = json::parse(ckpt.get_string("cfg"));
+      json j_this(parser.get_options());
+      for (std::string key :
+           std::vector<std::string>{"instance", "nx", "ny", "lx", "ly"}) {
+        xcgd_assert(j[key] == j_this[key], key + "mismatch");
+      }
+
+      std::vector<T> xr0 = ckpt.get<T>("dvs");
+      xcgd_assert(xr0.size() == nvars,
+                  "design variable dimension mismatch, expect " +
+                      std::to_string(nvars) + ", got " +
+                      std::to_string(xr0.size()));
+      x0 = topo.get_prob_mesh().expand(xr0);
+    } else if (!init_topo_json_path.empty()) {
       json j = read_json(init_topo_json_path);
       json j_this(parser.get_options());
 
@@ -1056,16 +1470,14 @@ class TopoProb : public ParOptProblem {
           parser.get_double_option("init_topology_r"),
           parser.get_bool_option("init_topology_cell_center"));
     }
+    return x0;
+  }
 
-    std::vector<T> x0r = topo.get_prob_mesh().reduce(x0);
-
-    // update mesh and bc dof, but don't perform the linear solve
-    topo.update_mesh(topo.get_prob_mesh().expand(x0));
-
+  // Bounds of the reduced design variables
+  void get_bounds(T* lb, T* ub) {
     double ubval = parser.get_double_option("opt_x_ub");
     double lbval = parser.get_double_option("opt_x_lb");
     for (int i = 0; i < nvars; i++) {
-      xr[i] = x0r[i];
       ub[i] = ubval;
       lb[i] = lbval;
     }
@@ -1076,10 +1488,46 @@ class TopoProb : public ParOptProblem {
     }
   }
 
+  void getVarsAndBounds(ParOptVec* xvec, ParOptVec* lbvec, ParOptVec* ubvec) {
+    T *xr, *lb, *ub;
+    xvec->getArray(&xr);
+    lbvec->getArray(&lb);
+    ubvec->getArray(&ub);
+
+    // Set initial design
+    std::vector<T> x0 = get_initial_design();
+    std::vector<T> x0r = topo.get_prob_mesh().reduce(x0);
+
+    // update mesh and bc dof, but don't perform the linear solve
+    topo.update_mesh(topo.get_prob_mesh().expand(x0));
+
+    std::copy(x0r.begin(), x0r.end(), xr);
+    get_bounds(lb, ub);
+  }
+
   int evalObjCon(ParOptVec* xvec, T* fobj, T* cons) {
     T* xptr;
     xvec->getArray(&xptr);
-    std::vector<T> xr(xptr, xptr + nvars);
+    eval_obj_con(std::vector<T>(xptr, xptr + nvars), fobj, cons);
+    return 0;
+  }
+
+  int evalObjConGradient(ParOptVec* xvec, ParOptVec* gvec, ParOptVec** Ac) {
+    T* xptr;
+    xvec->getArray(&xptr);
+
+    T* g;
+    gvec->getArray(&g);
+    std::vector<T*> A(ncon);
+    for (int i = 0; i < ncon; i++) Ac[i]->getArray(&A[i]);
+
+    eval_obj_con_gradient(std::vector<T>(xptr, xptr + nvars), g, A.data());
+    return 0;
+  }
+
+  // Objective and constraints (>= 0) of the reduced design xr, the outputs of
+  // the iteration are written
+  void eval_obj_con(const std::vector<T>& xr, T* fobj, T* cons) {
     std::vector<T> x = topo.get_prob_mesh().expand(xr);
 
     // Save the elastic problem instance to json
@@ -1108,32 +1556,47 @@ class TopoProb : public ParOptProblem {
     if (counter % parser.get_int_option("write_vtk_every") == 0) {
       // Write design to vtk
       std::string vtk_path =
-          fspath(prefix) / fspath("grid_" + std::to_string(counter) + ".vtk");
+          fspath(prefix) / fspath("grid_" + std::to_string(counter) + vtk_ext);
       if constexpr (TopoAnalysis::use_ersatz) {
         topo.write_grid_vtk(vtk_path, x, topo.get_phi(), {}, {},
                             {{"displacement", u}, {"rhs", topo.get_rhs()}}, {});
       } else {
         topo.write_grid_vtk(vtk_path, x, topo.get_phi(), {}, {}, {}, {});
       }
+      if (use_vtu) add_to_pvd(grid_pvd, vtk_path);
 
       // Write cut mesh to vtk
       vtk_path =
-          fspath(prefix) / fspath("cut_" + std::to_string(counter) + ".vtk");
+          fspath(prefix) / fspath("cut_" + std::to_string(counter) + vtk_ext);
       if constexpr (TopoAnalysis::use_ersatz) {
         topo.write_cut_vtk(vtk_path, x, topo.get_phi(), {}, {}, {}, {});
       } else {
         topo.write_cut_vtk(vtk_path, x, topo.get_phi(), {}, {},
                            {{"displacement", u}}, {});
       }
+      if (use_vtu) add_to_pvd(cut_pvd, vtk_path);
 
       // Write quadrature-level data
       vtk_path =
-          fspath(prefix) / fspath("quad_" + std::to_string(counter) + ".vtk");
-      FieldToVTKNew<T, TopoAnalysis::get_spatial_dim()> field_vtk(vtk_path);
-      field_vtk.add_mesh(xloc_q);
-      field_vtk.write_mesh();
-      field_vtk.add_sol("VonMises", stress_q);
-      field_vtk.write_sol("VonMises");
+          fspath(prefix) / fspath("quad_" + std::to_string(counter) + vtk_ext);
+      auto write_quad = [&](auto& field_vtk) {
+        field_vtk.add_mesh(xloc_q);
+        field_vtk.write_mesh();
+        field_vtk.add_sol("VonMises", stress_q);
+        field_vtk.write_sol("VonMises");
+      };
+      constexpr int spatial_dim = TopoAnalysis::get_spatial_dim();
+      if (use_vtu) {
+        {
+          FieldToVTU<T, spatial_dim> field_vtk(vtk_path, vtu_compression,
+                                               &async_writer);
+          write_quad(field_vtk);
+        }
+        add_to_pvd(quad_pvd, vtk_path);
+      } else {
+        FieldToVTKNew<T, spatial_dim> field_vtk(vtk_path);
+        write_quad(field_vtk);
+      }
     }
 
     // write quadrature to vtk for gradient check
@@ -1185,27 +1648,13 @@ class TopoProb : public ParOptProblem {
                    max_stress_ratio, ks_stress_ratio);
 
     counter++;
-
-    return 0;
   }
 
-  int evalObjConGradient(ParOptVec* xvec, ParOptVec* gvec, ParOptVec** Ac) {
-    T* xptr;
-    xvec->getArray(&xptr);
-    std::vector<T> xr(xptr, xptr + nvars);
+  // Gradients of the objective and the constraints, Ac holds ncon arrays
+  void eval_obj_con_gradient(const std::vector<T>& xr, T* g, T* const* Ac) {
     std::vector<T> x = topo.get_prob_mesh().expand(xr);
-
-    T *g, *c1, *c2;
-    gvec->getArray(&g);
-    gvec->zeroEntries();
-
-    Ac[0]->getArray(&c1);
-    Ac[0]->zeroEntries();
-
-    if (has_stress_constraint) {
-      Ac[1]->getArray(&c2);
-      Ac[1]->zeroEntries();
-    }
+    T* c1 = Ac[0];
+    T* c2 = has_stress_constraint ? Ac[1] : nullptr;
 
     std::vector<T> gcomp, garea, gpen, gstress;
     topo.eval_obj_con_gradient(x, gcomp, garea, gpen, gstress);
@@ -1240,8 +1689,70 @@ class TopoProb : public ParOptProblem {
         c2[i] = -gstressr[i] / stress_ratio_ub;
       }
     }
+  }
+
+  /**
+   * @brief Optimize by the in-tree MMA, see MMAOptimizer
+   *
+   * Iteration k evaluates design k, writes the checkpoint if it is due and
+   * takes the MMA step to design k + 1, up to iteration max_it - 1. A
+   * restarted run resumes at the checkpointed iteration with the checkpointed
+   * MMA state, so it reproduces the iterates of an uninterrupted run, and the
+   * restored solution and stress adjoint spare the solves of its first
+   * iteration.
+   */
+  void optimize_mma(int max_it) {
+    std::vector<T> xr = topo.get_prob_mesh().reduce(get_initial_design());
+    std::vector<T> lb(nvars), ub(nvars);
+    get_bounds(lb.data(), ub.data());
+
+    MMAOptimizer mma(nvars, ncon, lb, ub,
+                     parser.get_double_option("mma_init_asymptote_offset"),
+                     parser.get_double_option("mma_move_limit"));
+    if (!restart_path.empty()) {
+      CheckpointReader ckpt(restart_path);
+      mma.load(ckpt);
+      topo.set_warm_start(topo.get_prob_mesh().expand(xr), ckpt.get<T>("phi"),
+                          ckpt.get<T>("u"), ckpt.get<T>("rhs"),
+                          ckpt.get<T>("psi_stress"));
+    }
+    reset_counter();
 
-    return 0;
+    T fobj;
+    std::vector<T> cons(ncon), g(nvars), fval(ncon), dfdx(ncon * nvars);
+    std::vector<T*> Ac(ncon);
+    for (int i = 0; i < ncon; i++) Ac[i] = &dfdx[i * nvars];
+
+    std::ofstream mma_log(fspath(prefix) / fspath("mma.log"), std::ios::app);
+    mma_log << "iter kkt_residual
+";
+    while (counter < max_it) {
+      int iter = counter;
+      eval_obj_con(xr, &fobj, cons.data());
+      eval_obj_con_gradient(xr, g.data(), Ac.data());
+
+      // The first iteration of a restart is the checkpointed design itself
+      bool is_restarted_design =
+          !restart_path.empty() and iter == start_counter;
+      if (checkpoint_every > 0 and iter % checkpoint_every == 0 and
+          !is_restarted_design) {
+        write_checkpoint(iter, xr, fobj, cons.data(), mma);
+      }
+
+      // MMA takes the constraints as fi <= 0
+      for (int i = 0; i < ncon; i++) fval[i] = -cons[i];
+      for (T& v : dfdx) v = -v;
+
+      if (mma.get_iter() > 0) {
+        mma_log << iter << " "
+                << mma.kkt_residual(xr.data(), g.data(), fval.data(),
+                                    dfdx.data())
+                << std::endl;
+      }
+
+      if (counter == max_it) break;
+      mma.update(xr.data(), g.data(), fval.data(), dfdx.data());
+    }
   }
 
   // Dummy method
@@ -1265,12 +1776,109 @@ class TopoProb : public ParOptProblem {
   int ncon = -1;
   int nineq = -1;
 
+  // Optimization history outputs, legacy ASCII .vtk or binary .vtu with .pvd
+  // time series indices
+  bool use_vtu = false;
+  std::string vtk_ext;
+  VTUCompression vtu_compression;
+  PVDWriter grid_pvd, cut_pvd, quad_pvd;
+
+  // In-tree MMA or ParOpt
+  bool use_mma = true;
+
+  // Binary checkpoints for restarting an optimization by the in-tree MMA
+  int checkpoint_every = 0;  // 0 disables checkpointing
+  std::string restart_path;
+  int start_counter = 0;
+
   int counter = -1;
   StopWatch watch;
   bool is_gradient_check = false;
+
+  // Background writer of the snapshots and the .pvd indices, declared last so
+  // that it is destroyed, i.e. flushed, before the other members
+  AsyncWriter async_writer;
 };
 
-template <int Np_1d, bool use_ersatz, bool use_lbracket_grid>
+/**
+ * @brief Central difference step size study of the functional gradients
+ *
+ * The design x0 and all perturbed designs x0 ± h * p, for a random direction
+ * p over the design variables, are evaluated in a single batch by the
+ * ensemble. The relative errors of the directional derivatives are printed
+ * and saved to <prefix>/grad_check_step_size_study.csv.
+ */
+template <typename T, class Ensemble, class ProbMesh>
+void grad_check_step_size_study(Ensemble& ensemble, ProbMesh& prob_mesh,
+                                const std::vector<T>& x0,
+                                const std::vector<double>& hs,
+                                std::string prefix) {
+  // Random direction, zero for the non-design verts
+  int nvars = prob_mesh.get_nvars();
+  std::vector<T> pr(nvars);
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  for (T& v : pr) v = dist(gen);
+  std::vector<T> p = prob_mesh.expand(pr);
+  std::vector<T> zero = prob_mesh.expand(std::vector<T>(nvars, T(0.0)));
+  for (int i = 0; i < p.size(); i++) p[i] -= zero[i];
+
+  std::vector<std::vector<T>> xs = {x0};
+  for (double h : hs) {
+    for (double sign : {1.0, -1.0}) {
+      std::vector<T> x = x0;
+      for (int i = 0; i < x.size(); i++) x[i] += sign * h * p[i];
+      xs.push_back(x);
+    }
+  }
+  std::vector<bool> eval_gradient(xs.size(), false);
+  eval_gradient[0] = true;
+
+  StopWatch watch;
+  auto results = ensemble.evaluate(xs, eval_gradient);
+  std::printf(
+      "evaluated %d designs with %d workers in %.2f s, relative errors of "
+      "the directional derivatives:\n",
+      int(xs.size()), ensemble.get_num_workers(), watch.lap());
+
+  using Result = typename Ensemble::Result;
+  std::vector<std::tuple<std::string, T Result::*, std::vector<T> Result::*>>
+      funcs = {{"comp", &Result::comp, &Result::gcomp},
+               {"area", &Result::area, &Result::garea},
+               {"pterm", &Result::pterm, &Result::gpen},
+               {"ks_stress_ratio", &Result::ks_stress_ratio, &Result::gstress}};
+
+  std::ofstream csv(fspath(prefix) / fspath("grad_check_step_size_study.csv"));
+  csv << "h";
+  std::printf("%12s", "h");
+  for (auto& [name, f, g] : funcs) {
+    csv << "," << name << "_fd," << name << "_exact," << name << "_rel_err";
+    std::printf("%20s", name.c_str());
+  }
+  csv << "\n";
+  std::printf("\n");
+
+  csv.precision(16);
+  for (int k = 0; k < hs.size(); k++) {
+    const Result &rp = results[1 + 2 * k], &rm = results[2 + 2 * k];
+    csv << hs[k];
+    std::printf("%12.2e", hs[k]);
+    for (auto& [name, f, g] : funcs) {
+      const std::vector<T>& grad = results[0].*g;
+      T exact = std::inner_product(grad.begin(), grad.end(), p.begin(), T(0.0));
+      T fd = (rp.*f - rm.*f) / (2.0 * hs[k]);
+      // The floor keeps the error finite for a vanishing exact derivative,
+      // e.g. if a functional doesn't depend on the design
+      T rel_err = fabs(fd - exact) / std::max(fabs(exact), T(1e-30));
+      csv << "," << fd << "," << exact << "," << rel_err;
+      std::printf("%20.10e", rel_err);
+    }
+    csv << "\n";
+    std::printf("\n");
+  }
+}
+
+template <int Np_1d, bool use_ersatz, bool use_lbracket_grid, class Factor>
 void execute(int argc, char* argv[]) {
   constexpr int Np_1d_filter = Np_1d > 2 ? 4 : 2;
   MPI_Init(&argc, &argv);
@@ -1278,7 +1886,8 @@ void execute(int argc, char* argv[]) {
   using T = double;
   using Grid = typename std::conditional<use_lbracket_grid, LbracketGrid2D<T>,
                                          StructuredGrid2D<T>>::type;
-  using TopoAnalysis = TopoAnalysis<T, Np_1d, Np_1d_filter, use_ersatz, Grid>;
+  using TopoAnalysis =
+      TopoAnalysis<T, Np_1d, Np_1d_filter, use_ersatz, Grid, Factor>;
 
   bool smoke_test = false;
   if (argc > 2 and "--smoke" == std::string(argv[2])) {
@@ -1330,24 +1939,29 @@ void execute(int argc, char* argv[]) {
         "expect lbracket or cantilever for option instance, got " + instance);
   }
 
-  std::shared_ptr<ProbMeshBase<T, Np_1d, Grid>> prob_mesh;
-  double loaded_frac = parser.get_double_option("loaded_frac");
-  if constexpr (use_lbracket_grid) {
-    double lbracket_frac = parser.get_double_option("lbracket_frac");
-    prob_mesh = std::make_shared<LbracketGridMesh<T, Np_1d>>(
-        nxy, lxy, loaded_frac, lbracket_frac);
-  } else {
-    if (instance == "cantilever") {
-      prob_mesh =
-          std::make_shared<CantileverMesh<T, Np_1d>>(nxy, lxy, loaded_frac);
-    } else if (instance == "lbracket") {
+  using ProbMesh = ProbMeshBase<T, Np_1d, Grid>;
+  auto create_prob_mesh = [&]() {
+    std::shared_ptr<ProbMesh> prob_mesh;
+    double loaded_frac = parser.get_double_option("loaded_frac");
+    if constexpr (use_lbracket_grid) {
       double lbracket_frac = parser.get_double_option("lbracket_frac");
-      prob_mesh = std::make_shared<LbracketMesh<T, Np_1d>>(
+      prob_mesh = std::make_shared<LbracketGridMesh<T, Np_1d>>(
           nxy, lxy, loaded_frac, lbracket_frac);
     } else {
-      throw std::runtime_error("invalid instance " + instance);
+      if (instance == "cantilever") {
+        prob_mesh =
+            std::make_shared<CantileverMesh<T, Np_1d>>(nxy, lxy, loaded_frac);
+      } else if (instance == "lbracket") {
+        double lbracket_frac = parser.get_double_option("lbracket_frac");
+        prob_mesh = std::make_shared<LbracketMesh<T, Np_1d>>(
+            nxy, lxy, loaded_frac, lbracket_frac);
+      } else {
+        throw std::runtime_error("invalid instance " + instance);
+      }
     }
-  }
+    return prob_mesh;
+  };
+  std::shared_ptr<ProbMesh> prob_mesh = create_prob_mesh();
 
   T r0 = parser.get_double_option("helmholtz_r0");
   T E = parser.get_double_option("E");
@@ -1360,27 +1974,58 @@ void execute(int argc, char* argv[]) {
   T yield_stress = parser.get_double_option("yield_stress");
   double compliance_scalar = parser.get_double_option("compliance_scalar");
 
-  TopoAnalysis topo{*prob_mesh,
-                    r0,
-                    E,
-                    nu,
-                    penalty,
-                    stress_ksrho,
-                    yield_stress,
-                    use_robust_projection,
-                    robust_proj_beta,
-                    robust_proj_eta,
-                    prefix,
-                    compliance_scalar};
+  VTKFormat vtk_format = parse_vtk_format(parser.get_str_option("vtk_format"));
+
+  auto create_topo = [&](ProbMesh& prob_mesh, std::string prefix) {
+    auto topo = std::make_shared<TopoAnalysis>(
+        prob_mesh, r0, E, nu, penalty, stress_ksrho, yield_stress,
+        use_robust_projection, robust_proj_beta, robust_proj_eta, prefix,
+        compliance_scalar);
+    if constexpr (use_ersatz) {
+      topo->get_elastic().set_ersatz_band(
+          parser.get_int_option("ersatz_band"));
+    }
+    topo->set_iterative_solver(
+        parser.get_bool_option("use_iterative_solver"),
+        parser.get_double_option("iterative_solver_rtol"));
+    topo->set_vtu_compression(get_vtu_compression(vtk_format));
+    return topo;
+  };
+  std::shared_ptr<TopoAnalysis> topo = create_topo(*prob_mesh, prefix);
 
   TopoProb<T, TopoAnalysis>* prob =
-      new TopoProb<T, TopoAnalysis>(topo, prefix, parser);
+      new TopoProb<T, TopoAnalysis>(*topo, prefix, parser, vtk_format);
   prob->incref();
 
+  // Batched finite difference study, all perturbed designs are evaluated
+  // concurrently by independent workspaces
+  if (parser.get_bool_option("grad_check_step_size_study")) {
+    TopoEnsemble<T, TopoAnalysis> ensemble(
+        parser.get_int_option("ensemble_workers"), create_prob_mesh,
+        create_topo, prefix);
+    std::vector<double> hs;
+    for (int k = 3; k <= 10; k++) hs.push_back(std::pow(10.0, -k));
+    grad_check_step_size_study(ensemble, *prob_mesh,
+                               prob->get_initial_design(), hs, prefix);
+    prob->flush_output();
+    return;
+  }
+
   double dh = parser.get_double_option("grad_check_fd_h");
   prob->check_gradients(dh);
 
   if (parser.get_bool_option("check_grad_and_exit")) {
+    prob->flush_output();
+    return;
+  }
+
+  int max_it = smoke_test ? 10 : parser.get_int_option("max_it");
+
+  if (parser.get_str_option("optimizer") == "mma") {
+    prob->optimize_mma(max_it);
+    prob->flush_output();
+    prob->decref();
+    MPI_Finalize();
     return;
   }
 
@@ -1389,8 +2034,6 @@ void execute(int argc, char* argv[]) {
   options->incref();
   ParOptOptimizer::addDefaultOptions(options);
 
-  int max_it = smoke_test ? 10 : parser.get_int_option("max_it");
-
   options->setOption("algorithm", "mma");
   options->setOption("mma_max_iterations", max_it);
   options->setOption("mma_init_asymptote_offset",
@@ -1422,6 +2065,7 @@ void execute(int argc, char* argv[]) {
   opt->incref();
 
   opt->optimize();
+  prob->flush_output();
 
   prob->decref();
   options->decref();
@@ -1430,9 +2074,29 @@ void execute(int argc, char* argv[]) {
   MPI_Finalize();
 }
 
-int main(int argc, char* argv[]) {
-  VandermondeCondLogger::enable();
+// Instantiate the optimization for the sparse Cholesky factorization of the
+// elastic and filter problems selected by option factor
+template <int Np_1d, bool use_ersatz, bool use_lbracket_grid>
+void execute(int argc, char* argv[]) {
+  using T = double;
+  ConfigParser parser{std::string(argv[1])};
+  std::string factor = parser.get_str_option("factor");
+  if (factor == "sparse_utils") {
+    execute<Np_1d, use_ersatz, use_lbracket_grid,
+            SparseUtils::SparseCholesky<T>>(argc, argv);
+  } else if (factor == "simplicial") {
+    execute<Np_1d, use_ersatz, use_lbracket_grid, SimplicialCholesky<T>>(
+        argc, argv);
+  } else if (factor == "mixed") {
+    execute<Np_1d, use_ersatz, use_lbracket_grid, MixedPrecisionCholesky<T>>(
+        argc, argv);
+  } else {
+    throw std::runtime_error(
+        "factor must be sparse_utils, simplicial or mixed, got " + factor);
+  }
+}
 
+int main(int argc, char* argv[]) {
   if (argc == 1) {
     std::printf("Usage: ./topo level_set.cfg [--smoke]\n");
     exit(0);
@@ -1,6 +1,7 @@
 #ifndef XCGD_ANALYSIS_H
 #define XCGD_ANALYSIS_H
 
+#include <algorithm>
 #include <vector>
 
 #include "a2dcore.h"
@@ -10,7 +11,9 @@
 #include "sparse_utils/sparse_matrix.h"
 #include "utils/exceptions.h"
 #include "utils/linalg.h"
+#include "utils/memory.h"
 #include "utils/misc.h"
+#include "utils/scheduler.h"
 
 /**
  *  ...
@@ -39,11 +42,17 @@ class GalerkinAnalysis final {
       : mesh(mesh), quadrature(quadrature), basis(basis), physics(physics) {}
 
   T energy(const T x[], const T dof[]) const {
-    T total_energy = 0.0;
-    T xq = 0.0;
-    std::vector<T> element_x = std::vector<T>(max_nnodes_per_element);
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    // Element energies are summed in element order afterwards so that the
+    // result does not depend on the number of threads
+    std::vector<T> element_energy(mesh.get_num_elements(), T(0.0));
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
 
-    for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
       int nnodes;
@@ -59,7 +68,7 @@ class GalerkinAnalysis final {
 
       // Get element design variable if needed
       if (x) {
-        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x.data());
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
       }
 
       // Get the element degrees of freedom
@@ -69,8 +78,9 @@ class GalerkinAnalysis final {
       std::vector<T> pts, wts, ns;
       int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
 
-      std::vector<T> N, Nxi;
-      basis.eval_basis_grad(i, pts, N, Nxi);
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
 
       for (int j = 0; j < num_quad_pts; j++) {
         int offset_n = j * max_nnodes_per_element;
@@ -94,8 +104,8 @@ class GalerkinAnalysis final {
 
         // Add the energy contributions
         if (x) {
-          interp_val_grad<T, Basis>(element_x.data(), &N[offset_n], nullptr,
-                                    &xq, nullptr);
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
         }
 
         if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
@@ -104,19 +114,32 @@ class GalerkinAnalysis final {
           }
         }
 
-        total_energy +=
+        element_energy[i] +=
             physics.energy(wts[j], xq, xloc, nrm_ref, J, vals, grad);
       }
-    }
+    });
 
+    T total_energy = 0.0;
+    for (const T& e : element_energy) total_energy += e;
     return total_energy;
   }
 
   void residual(const T x[], const T dof[], T res[]) const {
-    T xq = 0.0;
-    std::vector<T> element_x = std::vector<T>(max_nnodes_per_element);
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    // Element contributions are scattered serially after the parallel loop so
+    // that the result does not depend on the number of threads
+    int num_elements = mesh.get_num_elements();
+    std::vector<int> element_nnodes(num_elements);
+    std::vector<int> element_nodes(num_elements * max_nnodes_per_element);
+    TrackedVector<T> element_res_all(num_elements * max_dof_per_element,
+                                     T(0.0));
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
 
-    for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
       int nnodes;
@@ -125,6 +148,9 @@ class GalerkinAnalysis final {
       } else {
         nnodes = mesh.get_elem_dof_nodes(i, nodes);
       }
+      element_nnodes[i] = nnodes;
+      std::copy(nodes, nodes + nnodes,
+                element_nodes.begin() + i * max_nnodes_per_element);
 
       // Get the element node locations
       T element_xloc[spatial_dim * max_nnodes_per_element];
@@ -136,7 +162,7 @@ class GalerkinAnalysis final {
 
       // Get element design variable if needed
       if (x) {
-        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x.data());
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
       }
 
       // Create the element residual
@@ -148,8 +174,9 @@ class GalerkinAnalysis final {
       std::vector<T> pts, wts, ns;
       int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
 
-      std::vector<T> N, Nxi;
-      basis.eval_basis_grad(i, pts, N, Nxi);
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
 
       for (int j = 0; j < num_quad_pts; j++) {
         int offset_n = j * max_nnodes_per_element;
@@ -168,8 +195,8 @@ class GalerkinAnalysis final {
         interp_val_grad<T, Basis>(element_dof, &N[offset_n], &Nxi[offset_nxi],
                                   &vals, &grad_ref);
         if (x) {
-          interp_val_grad<T, Basis>(element_x.data(), &N[offset_n], nullptr,
-                                    &xq, nullptr);
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
         }
 
         if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
@@ -195,16 +222,34 @@ class GalerkinAnalysis final {
                            coef_grad_ref, element_res);
       }
 
-      add_element_res<T, dof_per_node, Basis>(nnodes, nodes, element_res, res);
+      std::copy(element_res, element_res + max_dof_per_element,
+                element_res_all.begin() + i * max_dof_per_element);
+    });
+
+    for (int i = 0; i < num_elements; i++) {
+      add_element_res<T, dof_per_node, Basis>(
+          element_nnodes[i], element_nodes.data() + i * max_nnodes_per_element,
+          element_res_all.data() + i * max_dof_per_element, res);
     }
   }
 
   void jacobian_product(const T x[], const T dof[], const T direct[],
                         T res[]) const {
-    T xq = 0.0;
-    std::vector<T> element_x = std::vector<T>(max_nnodes_per_element);
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    // Element contributions are scattered serially after the parallel loop so
+    // that the result does not depend on the number of threads
+    int num_elements = mesh.get_num_elements();
+    std::vector<int> element_nnodes(num_elements);
+    std::vector<int> element_nodes(num_elements * max_nnodes_per_element);
+    TrackedVector<T> element_res_all(num_elements * max_dof_per_element,
+                                     T(0.0));
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
 
-    for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
       int nnodes;
@@ -213,6 +258,9 @@ class GalerkinAnalysis final {
       } else {
         nnodes = mesh.get_elem_dof_nodes(i, nodes);
       }
+      element_nnodes[i] = nnodes;
+      std::copy(nodes, nodes + nnodes,
+                element_nodes.begin() + i * max_nnodes_per_element);
 
       // Get the element node locations
       T element_xloc[spatial_dim * max_nnodes_per_element];
@@ -220,7 +268,7 @@ class GalerkinAnalysis final {
 
       // Get element design variable if needed
       if (x) {
-        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x.data());
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
       }
 
       // Get the element degrees of freedom
@@ -241,8 +289,9 @@ class GalerkinAnalysis final {
       std::vector<T> pts, wts, ns;
       int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
 
-      std::vector<T> N, Nxi;
-      basis.eval_basis_grad(i, pts, N, Nxi);
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
 
       for (int j = 0; j < num_quad_pts; j++) {
         int offset_n = j * max_nnodes_per_element;
@@ -276,8 +325,8 @@ class GalerkinAnalysis final {
         transform(J, direct_grad_ref, direct_grad);
 
         if (x) {
-          interp_val_grad<T, Basis>(element_x.data(), &N[offset_n], nullptr,
-                                    &xq, nullptr);
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
         }
 
         if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
@@ -301,7 +350,14 @@ class GalerkinAnalysis final {
                            coef_grad_ref, element_res);
       }
 
-      add_element_res<T, dof_per_node, Basis>(nnodes, nodes, element_res, res);
+      std::copy(element_res, element_res + max_dof_per_element,
+                element_res_all.begin() + i * max_dof_per_element);
+    });
+
+    for (int i = 0; i < num_elements; i++) {
+      add_element_res<T, dof_per_node, Basis>(
+          element_nnodes[i], element_nodes.data() + i * max_nnodes_per_element,
+          element_res_all.data() + i * max_dof_per_element, res);
     }
   }
 
@@ -311,10 +367,21 @@ class GalerkinAnalysis final {
   */
   void jacobian_adjoint_product(const T x[], const T dof[], const T psi[],
                                 T dfdx[]) const {
-    T xq = 0.0;
-    std::vector<T> element_x = std::vector<T>(max_nnodes_per_element);
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    // Element contributions are scattered serially after the parallel loop so
+    // that the result does not depend on the number of threads
+    int num_elements = mesh.get_num_elements();
+    std::vector<int> element_nnodes(num_elements);
+    std::vector<int> element_nodes(num_elements * max_nnodes_per_element);
+    TrackedVector<T> element_dfdx_all(num_elements * max_nnodes_per_element,
+                                      T(0.0));
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
 
-    for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
       int nnodes;
@@ -323,6 +390,9 @@ class GalerkinAnalysis final {
       } else {
         nnodes = mesh.get_elem_dof_nodes(i, nodes);
       }
+      element_nnodes[i] = nnodes;
+      std::copy(nodes, nodes + nnodes,
+                element_nodes.begin() + i * max_nnodes_per_element);
 
       // Get the element node locations
       T element_xloc[spatial_dim * max_nnodes_per_element];
@@ -330,7 +400,7 @@ class GalerkinAnalysis final {
 
       // Get element design variable if needed
       if (x) {
-        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x.data());
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
       }
 
       // Get the element degrees of freedom
@@ -350,8 +420,9 @@ class GalerkinAnalysis final {
       std::vector<T> pts, wts, ns;
       int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
 
-      std::vector<T> N, Nxi;
-      basis.eval_basis_grad(i, pts, N, Nxi);
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
 
       for (int j = 0; j < num_quad_pts; j++) {
         int offset_n = j * max_nnodes_per_element;
@@ -384,8 +455,8 @@ class GalerkinAnalysis final {
         transform(J, psi_grad_ref, psi_grad);
 
         if (x) {
-          interp_val_grad<T, Basis>(element_x.data(), &N[offset_n], nullptr,
-                                    &xq, nullptr);
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
         }
 
         if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
@@ -402,26 +473,37 @@ class GalerkinAnalysis final {
         add_jac_adj_product<T, Basis>(&N[offset_n], dv_val, element_dfdx);
       }
 
-      add_element_dfdx<T, Basis>(nnodes, nodes, element_dfdx, dfdx);
+      std::copy(element_dfdx, element_dfdx + max_nnodes_per_element,
+                element_dfdx_all.begin() + i * max_nnodes_per_element);
+    });
+
+    for (int i = 0; i < num_elements; i++) {
+      add_element_dfdx<T, Basis>(
+          element_nnodes[i], element_nodes.data() + i * max_nnodes_per_element,
+          element_dfdx_all.data() + i * max_nnodes_per_element, dfdx);
     }
   }
 
-  void jacobian(const T x[], const T dof[],
-                GalerkinBSRMat<T, dof_per_node>* mat,
+  // Mat is GalerkinBSRMat<T, dof_per_node> or any other matrix type that
+  // provides zero() and add_block_values(), e.g. ReducedBSRMat
+  template <class Mat>
+  void jacobian(const T x[], const T dof[], Mat* mat,
                 bool zero_jac = true) const {
     if (zero_jac) {
       mat->zero();
     }
 
-    T xq = 0.0;
-    std::vector<T> element_x = std::vector<T>(max_nnodes_per_element);
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
 
-    std::vector<T> element_jac(
+    TrackedVector<T> element_jac(
         mesh.get_num_elements() * max_dof_per_element * max_dof_per_element,
         T(0.0));
 
-#pragma omp parallel for
-    for (int i = 0; i < mesh.get_num_elements(); i++) {
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
+
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
       int nnodes;
@@ -439,7 +521,7 @@ class GalerkinAnalysis final {
 
       // Get element design variable if needed
       if (x) {
-        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x.data());
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
       }
 
       // Get the element degrees of freedom
@@ -449,11 +531,9 @@ class GalerkinAnalysis final {
       std::vector<T> pts, wts, ns;
       int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
 
-      std::vector<T> N, Nxi;
-      // TODO: delete
-
+      BasisCache& cache = caches[t];
       try {
-        basis.eval_basis_grad(i, pts, N, Nxi);
+        eval_basis_grad_cached(i, wc, pts, cache);
       } catch (const LapackFailed& e) {
         std::printf(
             "jacobian() called failed at basis.eval_basis_grad() for element: "
@@ -461,6 +541,7 @@ class GalerkinAnalysis final {
             i);
         throw;
       }
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
 
       for (int j = 0; j < num_quad_pts; j++) {
         int offset_n = j * max_nnodes_per_element;
@@ -479,8 +560,8 @@ class GalerkinAnalysis final {
         interp_val_grad<T, Basis>(element_dof, &N[offset_n], &Nxi[offset_nxi],
                                   &vals, &grad_ref);
         if (x) {
-          interp_val_grad<T, Basis>(element_x.data(), &N[offset_n], nullptr,
-                                    &xq, nullptr);
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
         }
 
         if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
@@ -509,7 +590,7 @@ class GalerkinAnalysis final {
                              jac_mixed_ref, jac_grad_ref,
                              element_jac.data() + element_jac_offset);
       }
-    }
+    });
 
     for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
@@ -527,6 +608,31 @@ class GalerkinAnalysis final {
     }
   }
 
+  /**
+   * @brief Add the diagonal of the Jacobian to diag without assembling the
+   * Jacobian, e.g. for a Jacobi preconditioner
+   *
+   * @param diag size of dof_per_node * number of dof nodes, contributions are
+   * accumulated
+   */
+  void jacobian_diagonal(const T x[], const T dof[], T diag[]) const {
+    jacobian_block_diagonal_impl<true>(x, dof, diag);
+  }
+
+  /**
+   * @brief Add the nodal dof_per_node x dof_per_node diagonal blocks of the
+   * Jacobian to diag_blocks without assembling the Jacobian, e.g. for a
+   * block-Jacobi preconditioner
+   *
+   * @param diag_blocks blocks stored row by row for each dof node, size of
+   * dof_per_node * dof_per_node * number of dof nodes, contributions are
+   * accumulated
+   */
+  void jacobian_block_diagonal(const T x[], const T dof[],
+                               T diag_blocks[]) const {
+    jacobian_block_diagonal_impl<false>(x, dof, diag_blocks);
+  }
+
   /*
     Evaluate the matrix vector product psi^T * dR/dphi, where phi are the
     LSF dof, psi are the adjoint variables
@@ -536,10 +642,27 @@ class GalerkinAnalysis final {
   */
   void LSF_jacobian_adjoint_product(const T dof[], const T psi[],
                                     T dfdphi[]) const {
+    LSF_jacobian_adjoint_product(1, &dof, &psi, &dfdphi);
+  }
+
+  /*
+    Batched version of the above, dfdphis[k] += psis[k]^T * dR/dphi(dofs[k])
+    for k = 0, ..., nrhs - 1, e.g. for the adjoints of several load cases.
+    The quadrature derivatives and the basis are evaluated only once per
+    element for all right-hand sides. The pointers may repeat, e.g. the same
+    dof with different adjoints, or the same output to sum over k.
+  */
+  void LSF_jacobian_adjoint_product(int nrhs, const T* const dofs[],
+                                    const T* const psis[],
+                                    T* const dfdphis[]) const {
     static_assert(Basis::is_gd_basis, "This method only works with GD Basis");
     static_assert(Mesh::is_cut_mesh,
                   "This method requires a level-set-cut mesh");
 
+    std::vector<T> element_dofs(nrhs * max_dof_per_element);
+    std::vector<T> element_psis(nrhs * max_dof_per_element);
+    std::vector<T> element_dfdphis(nrhs * max_nnodes_per_element);
+
     for (int i = 0; i < mesh.get_num_elements(); i++) {
       // Get nodes associated to this element
       int nodes[Mesh::max_nnodes_per_element];
@@ -555,12 +678,15 @@ class GalerkinAnalysis final {
       get_element_xloc<T, Mesh, Basis>(mesh, i, element_xloc);
 
       // Get the element states and adjoints
-      T element_dof[max_dof_per_element], element_psi[max_dof_per_element];
-      get_element_vars<T, dof_per_node, Basis>(nnodes, nodes, dof, element_dof);
-      get_element_vars<T, dof_per_node, Basis>(nnodes, nodes, psi, element_psi);
+      for (int k = 0; k < nrhs; k++) {
+        get_element_vars<T, dof_per_node, Basis>(
+            nnodes, nodes, dofs[k], &element_dofs[k * max_dof_per_element]);
+        get_element_vars<T, dof_per_node, Basis>(
+            nnodes, nodes, psis[k], &element_psis[k * max_dof_per_element]);
+      }
 
       // Create the element dfdphi
-      std::vector<T> element_dfdphi(max_nnodes_per_element, 0.0);
+      std::fill(element_dfdphis.begin(), element_dfdphis.end(), T(0.0));
 
       std::vector<T> pts, wts, ns, pts_grad, wts_grad;
       int num_quad_pts = quadrature.get_quadrature_pts_grad(i, pts, wts, ns,
@@ -586,58 +712,69 @@ class GalerkinAnalysis final {
           }
         }
 
-        // Evaluate the derivative of the dof in the computational coordinates
-        typename Physics::dof_t uq{}, psiq{};           // uq, psiq
-        typename Physics::grad_t ugrad{}, ugrad_ref{};  // (∇_x)uq, (∇_ξ)uq
-        typename Physics::grad_t pgrad{}, pgrad_ref{};  // (∇_x)psiq, (∇_ξ)psiq
-        typename Physics::hess_t uhess_ref{};           //(∇2_ξ)uq
-        typename Physics::hess_t phess_ref{};           //(∇2_ξ)psiq
-
-        // Interpolate the quantities at the quadrature point
-        interp_val_grad<T, Basis>(element_dof, &N[offset_n], &Nxi[offset_nxi],
-                                  &uq, &ugrad_ref);
-        interp_val_grad<T, Basis>(element_psi, &N[offset_n], &Nxi[offset_nxi],
-                                  &psiq, &pgrad_ref);
-        interp_hess<T, Basis>(element_dof, &Nxixi[offset_nxixi], uhess_ref);
-        interp_hess<T, Basis>(element_psi, &Nxixi[offset_nxixi], phess_ref);
-
-        transform(J, ugrad_ref, ugrad);
-        transform(J, pgrad_ref, pgrad);
-
-        typename Physics::dof_t coef_uq{};      // ∂e/∂uq
-        typename Physics::grad_t coef_ugrad{};  // ∂e/∂(∇_x)uq
-        typename Physics::dof_t jp_uq{};        // ∂2e/∂uq2 * psiq
-        typename Physics::grad_t jp_ugrad{};    // ∂2e/∂(∇_x)uq2 * (∇_x)psiq
-
         T detJ;
         A2D::MatDet(J, detJ);
 
-        physics.residual(1.0 / detJ, 0.0, xloc, nrm_ref, J, uq, ugrad, coef_uq,
-                         coef_ugrad);
-        physics.jacobian_product(1.0 / detJ, 0.0, xloc, nrm_ref, J, uq, ugrad,
-                                 psiq, pgrad, jp_uq, jp_ugrad);
-
-        typename Physics::grad_t coef_ugrad_ref{};  // ∂e/∂(∇_ξ)uq
-        typename Physics::grad_t jp_ugrad_ref{};    // ∂2e/∂(∇_ξ)uq2 * (∇_ξ)psiq
-
-        // Transform gradient from physical coordinates back to ref
-        // coordinates
-        rtransform(J, coef_ugrad, coef_ugrad_ref);
-        rtransform(J, jp_ugrad, jp_ugrad_ref);
-
         int offset_wts = j * max_nnodes_per_element;
         int offset_pts = j * max_nnodes_per_element * spatial_dim;
 
-        add_jac_adj_product<T, Basis>(
-            wts[j], detJ, &wts_grad[offset_wts], &pts_grad[offset_pts], psiq,
-            ugrad_ref, pgrad_ref, uhess_ref, phess_ref, coef_uq, coef_ugrad_ref,
-            jp_uq, jp_ugrad_ref, element_dfdphi.data());
+        for (int k = 0; k < nrhs; k++) {
+          const T* element_dof = &element_dofs[k * max_dof_per_element];
+          const T* element_psi = &element_psis[k * max_dof_per_element];
+
+          // Evaluate the derivative of the dof in the computational
+          // coordinates
+          typename Physics::dof_t uq{}, psiq{};           // uq, psiq
+          typename Physics::grad_t ugrad{}, ugrad_ref{};  // (∇_x)uq, (∇_ξ)uq
+          typename Physics::grad_t pgrad{};      // (∇_x)psiq
+          typename Physics::grad_t pgrad_ref{};  // (∇_ξ)psiq
+          typename Physics::hess_t uhess_ref{};  //(∇2_ξ)uq
+          typename Physics::hess_t phess_ref{};  //(∇2_ξ)psiq
+
+          // Interpolate the quantities at the quadrature point
+          interp_val_grad<T, Basis>(element_dof, &N[offset_n],
+                                    &Nxi[offset_nxi], &uq, &ugrad_ref);
+          interp_val_grad<T, Basis>(element_psi, &N[offset_n],
+                                    &Nxi[offset_nxi], &psiq, &pgrad_ref);
+          interp_hess<T, Basis>(element_dof, &Nxixi[offset_nxixi], uhess_ref);
+          interp_hess<T, Basis>(element_psi, &Nxixi[offset_nxixi], phess_ref);
+
+          transform(J, ugrad_ref, ugrad);
+          transform(J, pgrad_ref, pgrad);
+
+          typename Physics::dof_t coef_uq{};      // ∂e/∂uq
+          typename Physics::grad_t coef_ugrad{};  // ∂e/∂(∇_x)uq
+          typename Physics::dof_t jp_uq{};        // ∂2e/∂uq2 * psiq
+          typename Physics::grad_t jp_ugrad{};    // ∂2e/∂(∇_x)uq2 * (∇_x)psiq
+
+          physics.residual(1.0 / detJ, 0.0, xloc, nrm_ref, J, uq, ugrad,
+                           coef_uq, coef_ugrad);
+          physics.jacobian_product(1.0 / detJ, 0.0, xloc, nrm_ref, J, uq,
+                                   ugrad, psiq, pgrad, jp_uq, jp_ugrad);
+
+          typename Physics::grad_t coef_ugrad_ref{};  // ∂e/∂(∇_ξ)uq
+          typename Physics::grad_t jp_ugrad_ref{};  // ∂2e/∂(∇_ξ)uq2 * (∇_ξ)psiq
+
+          // Transform gradient from physical coordinates back to ref
+          // coordinates
+          rtransform(J, coef_ugrad, coef_ugrad_ref);
+          rtransform(J, jp_ugrad, jp_ugrad_ref);
+
+          add_jac_adj_product<T, Basis>(
+              wts[j], detJ, &wts_grad[offset_wts], &pts_grad[offset_pts],
+              psiq, ugrad_ref, pgrad_ref, uhess_ref, phess_ref, coef_uq,
+              coef_ugrad_ref, jp_uq, jp_ugrad_ref,
+              &element_dfdphis[k * max_nnodes_per_element]);
+        }
       }
 
       const auto& lsf_mesh = mesh.get_lsf_mesh();
       int c = mesh.get_elem_cell(i);
-      add_element_dfdphi<T, decltype(lsf_mesh), Basis>(
-          lsf_mesh, c, element_dfdphi.data(), dfdphi);
+      for (int k = 0; k < nrhs; k++) {
+        add_element_dfdphi<T, decltype(lsf_mesh), Basis>(
+            lsf_mesh, c, &element_dfdphis[k * max_nnodes_per_element],
+            dfdphis[k]);
+      }
     }
   }
 
@@ -909,11 +1046,359 @@ class GalerkinAnalysis final {
     return {xloc_q, energy_q};
   }
 
+  /**
+   * @brief Evaluate the maximum and the KS aggregate of the pointwise energy
+   * e in a single pass over the quadrature points
+   *
+   *   ks = ∫exp(ksrho * (e - max(e)))dΩ
+   *
+   * such that max(e) + ln(ks) / ksrho approximates max(e) from above. Each
+   * element keeps a running maximum and rescales its partial sum whenever the
+   * maximum increases, so no exponential overflows. Element results are
+   * combined in element order so the result does not depend on the number of
+   * threads.
+   *
+   * @param dof nodal dof
+   * @param ksrho KS parameter
+   * @param xloc_q if not nullptr, the quadrature point locations
+   * @param energy_q if not nullptr, the pointwise energy values, same as
+   * interpolate_energy()
+   * @return {max(e), ks}
+   */
+  std::pair<T, T> energy_max_ks(const T dof[], double ksrho,
+                                std::vector<T>* xloc_q = nullptr,
+                                std::vector<T>* energy_q = nullptr) const {
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    int num_elements = mesh.get_num_elements();
+    std::vector<T> element_max(num_elements, T(0.0));
+    std::vector<T> element_ks(num_elements, T(0.0));
+    std::vector<int> element_npts(num_elements, 0);
+
+    bool save_field = xloc_q or energy_q;
+    std::vector<std::vector<T>> element_xloc_q, element_energy_q;
+    if (save_field) {
+      element_xloc_q.resize(num_elements);
+      element_energy_q.resize(num_elements);
+    }
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      // Get nodes associated to this element
+      int nodes[Mesh::max_nnodes_per_element];
+      int nnodes;
+      if constexpr (from_to_grid_mesh) {
+        nnodes = mesh.get_cell_dof_verts(mesh.get_elem_cell(i), nodes);
+      } else {
+        nnodes = mesh.get_elem_dof_nodes(i, nodes);
+      }
+
+      // Get the element node locations
+      T element_xloc[spatial_dim * max_nnodes_per_element];
+      get_element_xloc<T, Mesh, Basis>(mesh, i, element_xloc);
+
+      // Get the element degrees of freedom
+      T element_dof[max_dof_per_element];
+      get_element_vars<T, dof_per_node, Basis>(nnodes, nodes, dof, element_dof);
+
+      std::vector<T> pts, wts, ns;
+      int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
+      element_npts[i] = num_quad_pts;
+      if (save_field) {
+        element_xloc_q[i].reserve(spatial_dim * num_quad_pts);
+        element_energy_q[i].reserve(num_quad_pts);
+      }
+
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
+
+      T emax = 0.0, ks = 0.0;
+      for (int j = 0; j < num_quad_pts; j++) {
+        int offset_n = j * max_nnodes_per_element;
+        int offset_nxi = j * max_nnodes_per_element * spatial_dim;
+
+        A2D::Vec<T, spatial_dim> xloc, nrm_ref;
+        A2D::Mat<T, spatial_dim, spatial_dim> J;
+        interp_val_grad<T, Basis, spatial_dim>(element_xloc, &N[offset_n],
+                                               &Nxi[offset_nxi], &xloc, &J);
+
+        typename Physics::dof_t vals{};
+        typename Physics::grad_t grad{}, grad_ref{};
+        interp_val_grad<T, Basis>(element_dof, &N[offset_n], &Nxi[offset_nxi],
+                                  &vals, &grad_ref);
+
+        // Transform gradient from ref coordinates to physical coordinates
+        transform(J, grad_ref, grad);
+
+        if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
+          for (int d = 0; d < spatial_dim; d++) {
+            nrm_ref[d] = ns[spatial_dim * j + d];
+          }
+        }
+
+        T e = physics.energy(1.0, 0.0, xloc, nrm_ref, J, vals, grad);
+
+        T detJ;
+        A2D::MatDet(J, detJ);
+        T w = wts[j] * detJ;
+
+        // Online max-shift
+        if (j == 0) {
+          ks = w;
+          emax = e;
+        } else if (freal(e) > freal(emax)) {
+          ks = ks * exp(ksrho * (emax - e)) + w;
+          emax = e;
+        } else {
+          ks += w * exp(ksrho * (e - emax));
+        }
+
+        if (save_field) {
+          for (int d = 0; d < spatial_dim; d++) {
+            element_xloc_q[i].push_back(xloc(d));
+          }
+          element_energy_q[i].push_back(e);
+        }
+      }
+      element_max[i] = emax;
+      element_ks[i] = ks;
+    });
+
+    T emax = 0.0, ks = 0.0;
+    bool first = true;
+    for (int i = 0; i < num_elements; i++) {
+      if (element_npts[i] == 0) continue;
+      if (first) {
+        ks = element_ks[i];
+        emax = element_max[i];
+        first = false;
+      } else if (freal(element_max[i]) > freal(emax)) {
+        ks = ks * exp(ksrho * (emax - element_max[i])) + element_ks[i];
+        emax = element_max[i];
+      } else {
+        ks += element_ks[i] * exp(ksrho * (element_max[i] - emax));
+      }
+    }
+
+    std::size_t total_npts = 0;
+    for (int npts : element_npts) total_npts += npts;
+    if (xloc_q) {
+      xloc_q->clear();
+      xloc_q->reserve(spatial_dim * total_npts);
+      for (const auto& v : element_xloc_q) {
+        xloc_q->insert(xloc_q->end(), v.begin(), v.end());
+      }
+    }
+    if (energy_q) {
+      energy_q->clear();
+      energy_q->reserve(total_npts);
+      for (const auto& v : element_energy_q) {
+        energy_q->insert(energy_q->end(), v.begin(), v.end());
+      }
+    }
+
+    return {emax, ks};
+  }
+
+  /**
+   * @brief Set the chunk size of the dynamic schedule for a class of elements
+   */
+  void set_chunk_size(WorkClass c, int chunk) {
+    scheduler.set_chunk_size(c, chunk);
+  }
+
+  /**
+   * @brief Per-thread busy/idle times of the last energy(), residual(),
+   * jacobian_product(), jacobian_adjoint_product() or jacobian() call
+   */
+  const SchedulerReport& get_scheduler_report() const {
+    return scheduler.get_report();
+  }
+
+  /**
+   * @brief Sizes of the temporary element buffers of the global operations for
+   * the current mesh, the analysis itself holds no large data. The value
+   * buffers are allocated through TrackingAllocator, so their actual peak can
+   * also be measured by MemoryTracker.
+   *
+   * residual() and jacobian_product() share the same buffers, jacobian()
+   * stores all element matrices before they are added to the global matrix.
+   */
+  MemoryReport memory_report() const {
+    std::size_t ne = mesh.get_num_elements();
+    std::size_t nodes = ne * (max_nnodes_per_element + 1) * sizeof(int);
+    MemoryReport report;
+    report.add_transient("residual",
+                         nodes + ne * max_dof_per_element * sizeof(T));
+    report.add_transient("jacobian_adjoint_product",
+                         nodes + ne * max_nnodes_per_element * sizeof(T));
+    report.add_transient(
+        "jacobian", ne * max_dof_per_element * max_dof_per_element * sizeof(T));
+    return report;
+  }
+
  private:
+  // Per-thread storage of the last basis evaluation
+  struct BasisCache {
+    bool regular = false;
+    std::vector<T> pts, N, Nxi;
+  };
+
+  /**
+   * @brief Evaluate the basis for an element, the kernel path depends on the
+   * work class of the element.
+   *
+   * All REGULAR elements of a GD mesh are evaluated by the same Vandermonde
+   * evaluator, hence their shape functions only depend on the quadrature
+   * points, and the previous evaluation of this thread is reused if the
+   * quadrature points are identical. Other elements are always evaluated.
+   */
+  void eval_basis_grad_cached(int elem, WorkClass wc,
+                              const std::vector<T>& pts,
+                              BasisCache& cache) const {
+    if constexpr (Basis::is_gd_basis) {
+      if (wc == WorkClass::REGULAR and cache.regular and cache.pts == pts) {
+        return;
+      }
+    }
+    basis.eval_basis_grad(elem, pts, cache.N, cache.Nxi);
+    cache.pts = pts;
+    cache.regular = wc == WorkClass::REGULAR;
+  }
+
+  // Shared by jacobian_diagonal() (diag_only = true, dof_per_node entries per
+  // node) and jacobian_block_diagonal() (dof_per_node^2 entries per node)
+  template <bool diag_only>
+  void jacobian_block_diagonal_impl(const T x[], const T dof[],
+                                    T out[]) const {
+    constexpr int block_size = dof_per_node * dof_per_node;
+    constexpr int out_size = diag_only ? dof_per_node : block_size;
+
+    scheduler.classify(mesh);
+    std::vector<BasisCache> caches(ElementScheduler::get_max_threads());
+
+    int num_elements = mesh.get_num_elements();
+    std::vector<int> element_nnodes(num_elements);
+    std::vector<int> element_nodes(num_elements * max_nnodes_per_element);
+    TrackedVector<T> element_out_all(
+        num_elements * max_nnodes_per_element * out_size, T(0.0));
+
+    scheduler.run([&](int i, WorkClass wc, int t) {
+      T xq = 0.0;
+      T element_x[max_nnodes_per_element];
+
+      // Get nodes associated to this element
+      int nodes[Mesh::max_nnodes_per_element];
+      int nnodes;
+      if constexpr (from_to_grid_mesh) {
+        nnodes = mesh.get_cell_dof_verts(mesh.get_elem_cell(i), nodes);
+      } else {
+        nnodes = mesh.get_elem_dof_nodes(i, nodes);
+      }
+      element_nnodes[i] = nnodes;
+      std::copy(nodes, nodes + nnodes,
+                element_nodes.begin() + i * max_nnodes_per_element);
+
+      // Get the element node locations
+      T element_xloc[spatial_dim * max_nnodes_per_element];
+      get_element_xloc<T, Mesh, Basis>(mesh, i, element_xloc);
+
+      // Get element design variable if needed
+      if (x) {
+        get_element_vars<T, 1, Basis>(nnodes, nodes, x, element_x);
+      }
+
+      // Get the element degrees of freedom
+      T element_dof[max_dof_per_element];
+      get_element_vars<T, dof_per_node, Basis>(nnodes, nodes, dof, element_dof);
+
+      std::vector<T> pts, wts, ns;
+      int num_quad_pts = quadrature.get_quadrature_pts(i, pts, wts, ns);
+
+      BasisCache& cache = caches[t];
+      eval_basis_grad_cached(i, wc, pts, cache);
+      const std::vector<T>&N = cache.N, &Nxi = cache.Nxi;
+
+      T element_blocks[max_nnodes_per_element * block_size];
+      std::fill(element_blocks,
+                element_blocks + max_nnodes_per_element * block_size, T(0.0));
+
+      for (int j = 0; j < num_quad_pts; j++) {
+        int offset_n = j * max_nnodes_per_element;
+        int offset_nxi = j * max_nnodes_per_element * spatial_dim;
+
+        // Evaluate the derivative of the spatial dof in the computational
+        // coordinates
+        A2D::Vec<T, spatial_dim> xloc, nrm_ref;
+        A2D::Mat<T, spatial_dim, spatial_dim> J;
+        interp_val_grad<T, Basis, spatial_dim>(element_xloc, &N[offset_n],
+                                               &Nxi[offset_nxi], &xloc, &J);
+
+        // Evaluate the derivative of the dof in the computational coordinates
+        typename Physics::dof_t vals{};
+        typename Physics::grad_t grad_ref{}, grad{};
+        interp_val_grad<T, Basis>(element_dof, &N[offset_n], &Nxi[offset_nxi],
+                                  &vals, &grad_ref);
+        if (x) {
+          interp_val_grad<T, Basis>(element_x, &N[offset_n], nullptr, &xq,
+                                    nullptr);
+        }
+
+        if constexpr (Quadrature::quad_type == QuadPtType::SURFACE) {
+          for (int d = 0; d < spatial_dim; d++) {
+            nrm_ref[d] = ns[spatial_dim * j + d];
+          }
+        }
+
+        // Transform gradient from ref coordinates to physical coordinates
+        transform(J, grad_ref, grad);
+
+        typename Physics::jac_t jac_vals{};
+        typename Physics::jac_mixed_t jac_mixed{}, jac_mixed_ref{};
+        typename Physics::jac_grad_t jac_grad{}, jac_grad_ref{};
+
+        physics.jacobian(wts[j], xq, xloc, nrm_ref, J, vals, grad, jac_vals,
+                         jac_mixed, jac_grad);
+
+        // Transform hessian from physical coordinates back to ref coordinates
+        jtransform<T, dof_per_node, spatial_dim>(J, jac_grad, jac_grad_ref);
+        mtransform(J, jac_mixed, jac_mixed_ref);
+
+        // Only the nodal diagonal blocks are evaluated, which costs
+        // O(nnodes) instead of O(nnodes^2) per quadrature point
+        add_matrix_block_diagonal<T, Basis, dof_per_node, diag_only>(
+            &N[offset_n], &Nxi[offset_nxi], jac_vals, jac_mixed_ref,
+            jac_grad_ref, element_blocks);
+      }
+
+      T* element_out =
+          element_out_all.data() + i * max_nnodes_per_element * out_size;
+      for (int n = 0; n < max_nnodes_per_element; n++) {
+        for (int k = 0; k < out_size; k++) {
+          // The k-th diagonal entry of a block is at (dof_per_node + 1) * k
+          int index = diag_only ? (dof_per_node + 1) * k : k;
+          element_out[out_size * n + k] =
+              element_blocks[block_size * n + index];
+        }
+      }
+    });
+
+    for (int i = 0; i < num_elements; i++) {
+      add_element_res<T, out_size, Basis>(
+          element_nnodes[i], element_nodes.data() + i * max_nnodes_per_element,
+          element_out_all.data() + i * max_nnodes_per_element * out_size, out);
+    }
+  }
+
   const Mesh& mesh;
   const Quadrature& quadrature;
   const Basis& basis;
   const Physics& physics;
+
+  // Not thread-safe: a single analysis object should not be used by multiple
+  // threads at the same time
+  mutable ElementScheduler scheduler;
 };
 
 #endif  // XCGD_ANALYSIS_H
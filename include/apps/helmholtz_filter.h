@@ -5,8 +5,11 @@
 #include "apps/robust_projection.h"
 #include "elements/gd_mesh.h"
 #include "elements/gd_vandermonde.h"
+#include "multigrid.h"
 #include "physics/helmholtz.h"
 #include "sparse_utils/sparse_utils.h"
+#include "utils/cholesky.h"
+#include "utils/memory.h"
 
 /**
  * @brief A Helmholtz filter defined on a structural grid.
@@ -14,11 +17,17 @@
  * @tparam T numeric type
  * @tparam Np_1d GD degree, note that this can be different from the Np_1d used
  * for the analysis, if wished
+ * @tparam Factor_ sparse Cholesky solver of the filter matrix, the matrix is
+ * well conditioned, so MixedPrecisionCholesky<T> usually converges in a couple
+ * of refinement steps. Not used if the filter is solved by multigrid. For
+ * SimplicialCholesky<T>, only the upper triangle of the matrix is assembled
  */
-template <typename T, int Np_1d, class Grid_ = StructuredGrid2D<T>>
+template <typename T, int Np_1d, class Grid_ = StructuredGrid2D<T>,
+          class Factor_ = SparseUtils::SparseCholesky<T>>
 class HelmholtzFilter final {
  public:
   using Grid = Grid_;
+  using Factor = Factor_;
   using Mesh = GridMesh<T, Np_1d, Grid_>;
   using Quadrature =
       GDGaussQuadrature2D<T, Np_1d, QuadPtType::INNER, SurfQuad::NA, Mesh>;
@@ -28,12 +37,25 @@ class HelmholtzFilter final {
   using Physics = HelmholtzPhysics<T, Basis::spatial_dim>;
   using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
   using BSRMat = GalerkinBSRMat<T, Physics::dof_per_node>;
+  using SymBSRMat = SymmetricGalerkinBSRMat<T, Physics::dof_per_node>;
   using CSCMat = SparseUtils::CSCMat<T>;
   using Proj = RobustProjection<T>;
+  using Multigrid = GDMultigrid<T, Mesh, Physics::dof_per_node>;
+
+  // Relative tolerance of the multigrid preconditioned CG, tight enough that
+  // the filter and its gradient stay consistent
+  static constexpr double multigrid_rtol = 1e-12;
+  static constexpr int multigrid_max_iter = 500;
 
  public:
+  /**
+   * @param use_multigrid solve the filter by multigrid preconditioned CG
+   * instead of factorizing the matrix, which avoids the fill-in of the factor
+   * on large grids
+   */
   HelmholtzFilter(T r0, Grid& grid, bool use_robust_projection = false,
-                  double proj_beta = -1.0, double proj_eta = -1.0)
+                  double proj_beta = -1.0, double proj_eta = -1.0,
+                  bool use_multigrid = false)
       : mesh(grid),
         quadrature(mesh),
         basis(mesh),
@@ -51,25 +73,39 @@ class HelmholtzFilter final {
         },
         &rowp, &cols);
 
-    int nnz = rowp[num_nodes];
-    jac_bsr = new BSRMat(num_nodes, nnz, rowp, cols);
-    delete[] rowp;
-    delete[] cols;
-
     // Set up the Jacobian matrix - for Helmholtz problem, the Jacobian matrix
     // does not change with x, so we can set it up and factorize it only once
     std::vector<T> zeros(num_nodes, 0.0);
-    analysis.jacobian(zeros.data(), zeros.data(), jac_bsr);
+    if (is_simplicial_cholesky<Factor>::value and !use_multigrid) {
+      // The factor only reads the upper triangle
+      jac_sym = new SymBSRMat(num_nodes, rowp, cols);
+      analysis.jacobian(zeros.data(), zeros.data(), jac_sym);
+    } else {
+      int nnz = rowp[num_nodes];
+      jac_bsr = new BSRMat(num_nodes, nnz, rowp, cols);
+      analysis.jacobian(zeros.data(), zeros.data(), jac_bsr);
+    }
+    delete[] rowp;
+    delete[] cols;
 
-    // Convert it to CSC and perform Cholesky factorization
-    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
-    SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
-    chol = new SparseUtils::SparseCholesky<T>(jac_csc);
-    chol->factor();
+    if (use_multigrid) {
+      mg = new Multigrid(this->mesh);
+      mg->setup(jac_bsr);
+    } else {
+      // Convert it to CSC and perform Cholesky factorization
+      if constexpr (is_simplicial_cholesky<Factor>::value) {
+        jac_csc = jac_sym->to_csc();
+        chol = new Factor(jac_csc, true);
+      } else {
+        jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
+        chol = new Factor(jac_csc);
+      }
+      chol->factor();
 
 #ifdef XCGD_DEBUG_MODE
-    jac_csc->write_mtx("Helmholtz_K.mtx");
+      jac_csc->write_mtx("Helmholtz_K.mtx");
 #endif
+    }
 
     // Set up the robust projector if specified
     if (use_robust_projection) {
@@ -82,10 +118,22 @@ class HelmholtzFilter final {
       delete chol;
       chol = nullptr;
     }
+    if (mg) {
+      delete mg;
+      mg = nullptr;
+    }
     if (jac_bsr) {
       delete jac_bsr;
       jac_bsr = nullptr;
     }
+    if (jac_sym) {
+      delete jac_sym;
+      jac_sym = nullptr;
+    }
+    if (jac_csc) {
+      delete jac_csc;
+      jac_csc = nullptr;
+    }
     if (proj) {
       delete proj;
       proj = nullptr;
@@ -129,7 +177,41 @@ class HelmholtzFilter final {
   Basis& get_basis() { return basis; }
   Analysis& get_analysis() { return analysis; }
 
+  // Memory of the mesh, the analysis, and the matrices kept for the solves
+  MemoryReport memory_report() const {
+    MemoryReport report;
+    report.merge("mesh", mesh.memory_report());
+    report.merge("analysis", analysis.memory_report());
+    report.add("jacobian",
+               jac_sym ? memory_bytes(*jac_sym) : memory_bytes(*jac_bsr));
+    if (chol) {
+      report.add("jacobian_csc", memory_bytes(*jac_csc));
+      report.add("factor", factor_memory_bytes(*chol));
+    }
+    return report;
+  }
+
  private:
+  // Solve K x = b in place
+  void solve(T* b) {
+    if (chol) {
+      chol->solve(b);
+      return;
+    }
+    std::vector<T> rhs(b, b + num_nodes);
+    std::fill(b, b + num_nodes, T(0.0));
+    int niter =
+        mg->solve_pcg(rhs.data(), b, multigrid_rtol, multigrid_max_iter);
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "multigrid preconditioned CG did not converge in %d "
+                    "iterations",
+                    multigrid_max_iter);
+      throw std::runtime_error(msg);
+    }
+  }
+
   void filterApply(const T* x, T* phi) {
     std::fill(phi, phi + num_nodes, 0.0);
     std::vector<T> zeros(num_nodes, 0.0);
@@ -140,13 +222,17 @@ class HelmholtzFilter final {
 #ifdef XCGD_DEBUG_MODE
     std::vector<T> rhs(phi, phi + num_nodes);
 #endif
-    chol->solve(phi);
+    solve(phi);
 
 #ifdef XCGD_DEBUG_MODE
     // Check error
     // res = Ku - rhs
     std::vector<T> Ku(num_nodes);
-    jac_bsr->axpy(phi, Ku.data());
+    if (jac_sym) {
+      jac_sym->axpy(phi, Ku.data());
+    } else {
+      jac_bsr->axpy(phi, Ku.data());
+    }
     T err = 0.0;
     for (int i = 0; i < num_nodes; i++) {
       err += (Ku[i] - rhs[i]) * (Ku[i] - rhs[i]);
@@ -159,7 +245,7 @@ class HelmholtzFilter final {
   void filterApplyGradient(const T* x, const T* dfdphi, T* dfdx) {
     std::vector<T> zeros(num_nodes, 0.0);
     std::vector<T> psi(dfdphi, dfdphi + num_nodes);
-    chol->solve(psi.data());
+    solve(psi.data());
     for (int i = 0; i < num_nodes; i++) {
       psi[i] *= -1.0;
     }
@@ -174,11 +260,15 @@ class HelmholtzFilter final {
   Analysis analysis;
   int num_nodes;
 
-  // Jacobian matrix
+  // Jacobian matrix, or its upper triangle, and the CSC copy that is
+  // factorized
   BSRMat* jac_bsr = nullptr;
+  SymBSRMat* jac_sym = nullptr;
+  CSCMat* jac_csc = nullptr;
 
-  // Cholesky factorization
-  SparseUtils::SparseCholesky<T>* chol = nullptr;
+  // Cholesky factorization, or the multigrid hierarchy
+  Factor* chol = nullptr;
+  Multigrid* mg = nullptr;
 
   // Robust projection
   Proj* proj = nullptr;
@@ -1,7 +1,9 @@
 #include "analysis.h"
+#include "multigrid.h"
 #include "physics/poisson.h"
 #include "sparse_utils/sparse_utils.h"
 #include "utils/misc.h"
+#include "utils/reduced_system.h"
 
 #pragma once
 
@@ -68,35 +70,20 @@ class PoissonApp final {
     jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
 
     // Set the right hand side
-    std::vector<T> rhs(ndof, 0.0), t1(ndof, 0.0), t2(ndof, 0.0);
+    std::vector<T> rhs(ndof, 0.0), zeros(ndof, 0.0);
 
-    analysis.residual(nullptr, t1.data(), rhs.data());
+    analysis.residual(nullptr, zeros.data(), rhs.data());
     for (int i = 0; i < rhs.size(); i++) {
       rhs[i] *= -1.0;
     }
-    for (int i = 0; i < bc_dof.size(); i++) {
-      rhs[bc_dof[i]] = bc_vals[i];
-    }
-
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t1[bc_dof[i]] = bc_vals[i];
-    }
-
-    jac_bsr->axpy(t1.data(), t2.data());
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t2[bc_dof[i]] = 0.0;
-    }
-
-    for (int i = 0; i < rhs.size(); i++) {
-      t2[i] = rhs[i] - t2[i];
-    }
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
 
     // Factorize Jacobian matrix
     SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
     SparseUtils::SparseCholesky<T>* chol =
         new SparseUtils::SparseCholesky<T>(jac_csc);
     chol->factor();
-    std::vector<T> sol = t2;
+    std::vector<T> sol = rhs_bcs;
     chol->solve(sol.data());
 
 #ifdef XCGD_DEBUG_MODE
@@ -124,6 +111,54 @@ class PoissonApp final {
     return sol;
   }
 
+  /**
+   * @brief Solve the linear system by the conjugate gradient method
+   * preconditioned by a geometric multigrid V-cycle instead of a sparse
+   * Cholesky factorization
+   *
+   * @param rtol relative tolerance of the residual
+   * @param max_iter maximum number of CG iterations
+   */
+  std::vector<T> solve_multigrid(const std::vector<int>& bc_dof,
+                                 const std::vector<T>& bc_vals,
+                                 double rtol = 1e-10, int max_iter = 500,
+                                 bool verbose = false) {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+
+    // Compute Jacobian matrix
+    BSRMat* jac_bsr = jacobian(bc_dof);
+
+    // Set the right hand side
+    std::vector<T> rhs(ndof, 0.0), zeros(ndof, 0.0);
+
+    analysis.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
+    }
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
+
+    GDMultigrid<T, Mesh, Physics::dof_per_node> mg(mesh);
+    mg.setup(jac_bsr, bc_dof);
+    if (verbose) mg.get_solver().print_info();
+
+    std::vector<T> sol(ndof, 0.0);
+    int niter =
+        mg.solve_pcg(rhs_bcs.data(), sol.data(), rtol, max_iter, verbose);
+
+    if (jac_bsr) delete jac_bsr;
+
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "multigrid preconditioned CG did not converge in %d "
+                    "iterations",
+                    max_iter);
+      throw std::runtime_error(msg);
+    }
+
+    return sol;
+  }
+
   Mesh& get_mesh() { return mesh; }
   Quadrature& get_quadrature() { return quadrature; }
   Basis& get_basis() { return basis; }
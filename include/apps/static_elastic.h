@@ -1,22 +1,64 @@
 #include <array>
+#include <functional>
+#include <tuple>
+#include <type_traits>
 
 #include "analysis.h"
 #include "elements/gd_mesh.h"
+#include "multigrid.h"
 #include "physics/linear_elasticity.h"
 #include "sparse_utils/sparse_utils.h"
+#include "utils/cholesky.h"
+#include "utils/krylov.h"
+#include "utils/lanczos.h"
+#include "utils/memory.h"
+#include "utils/reduced_system.h"
 #include "utils/vtk.h"
 
 #ifndef XCGD_STATIC_ELASTIC_H
 #define XCGD_STATIC_ELASTIC_H
 
-template <typename T, class Mesh, class Quadrature, class Basis, class IntFunc>
+/**
+ * @brief Sizes of the temporary matrices of the last solve of the elastic apps
+ *
+ * The peak of a direct solve is reached either while the element matrices are
+ * assembled into the Jacobian, or at the factorization, when the Jacobian, its
+ * CSC copy and the factor coexist. The factor is reported as unknown if it
+ * doesn't report its size, see factor_memory_bytes(), the peak is then a lower
+ * bound. The multigrid hierarchy of the iterative solves is not counted.
+ */
+struct ElasticSolveMemory {
+  std::size_t jac = 0;      // Jacobian, full or reduced
+  std::size_t jac_csc = 0;  // CSC copy of the Jacobian
+  std::size_t factor = 0;   // Cholesky factor, may be MemoryReport::unknown
+
+  // assembly: bytes of the element matrices of GalerkinAnalysis::jacobian()
+  void add_to(MemoryReport& report, std::size_t assembly) const {
+    std::size_t known_factor = factor == MemoryReport::unknown ? 0 : factor;
+    report.add_transient("solve.jacobian", jac);
+    report.add_transient("solve.jacobian_csc", jac_csc);
+    report.add_transient("solve.factor", factor);
+    report.add_transient("solve",
+                         jac + std::max(assembly, jac_csc + known_factor));
+  }
+};
+
+/**
+ * @tparam Factor_ sparse Cholesky solver of the stiffness matrix, constructed
+ * from a CSC matrix and providing factor() and solve(), use
+ * MixedPrecisionCholesky<T> to factor in single precision
+ */
+template <typename T, class Mesh, class Quadrature, class Basis, class IntFunc,
+          class Factor_ = SparseUtils::SparseCholesky<T>>
 class StaticElastic final {
  public:
   using Physics = LinearElasticity<T, Basis::spatial_dim, IntFunc>;
+  using Factor = Factor_;
 
  private:
   using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
   using BSRMat = GalerkinBSRMat<T, Physics::dof_per_node>;
+  using SymBSRMat = SymmetricGalerkinBSRMat<T, Physics::dof_per_node>;
   using CSCMat = SparseUtils::CSCMat<T>;
 
  public:
@@ -31,166 +73,480 @@ class StaticElastic final {
   ~StaticElastic() = default;
 
   // Compute Jacobian matrix without boundary conditions
-  BSRMat* jacobian() {
-    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+  BSRMat* jacobian() { return assemble_jacobian<BSRMat>(); }
 
-    // Set up Jacobian matrix
-    int *rowp = nullptr, *cols = nullptr;
-    auto& mesh = this->mesh;
-    SparseUtils::CSRFromConnectivityFunctor(
-        mesh.get_num_nodes(), mesh.get_num_elements(),
-        mesh.max_nnodes_per_element,
-        [&mesh](int elem, int* nodes) -> int {
-          return mesh.get_elem_dof_nodes(elem, nodes);
-        },
-        &rowp, &cols);
+  // Compute the upper triangle of the Jacobian matrix without boundary
+  // conditions
+  SymBSRMat* symmetric_jacobian() { return assemble_jacobian<SymBSRMat>(); }
 
-    int nnz = rowp[mesh.get_num_nodes()];
-    BSRMat* jac_bsr = new BSRMat(mesh.get_num_nodes(), nnz, rowp, cols);
+  std::vector<T> solve(
+      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
 
-    // Compute Jacobian matrix
+    // Set right hand side (load)
+    rhs = std::vector<T>(ndof, 0.0);
     std::vector<T> zeros(ndof, 0.0);
-    analysis.jacobian(nullptr, zeros.data(), jac_bsr);
 
-    if (rowp) delete rowp;
-    if (cols) delete cols;
+    analysis.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
+    }
 
-    return jac_bsr;
+    // Factorize Jacobian matrix, the Dirichlet bcs are lifted into sol
+    std::vector<T> sol;
+    std::shared_ptr<Factor> chol = factor_jacobian(bc_dof, bc_vals, sol);
+    chol->solve(sol.data());
+
+    if (chol_out) {
+      *chol_out = chol;
+    }
+
+#ifdef XCGD_DEBUG_MODE
+    print_residual(bc_dof, sol);
+#endif
+
+    return sol;
   }
 
+  template <class... LoadAnalyses>
   std::vector<T> solve(
       const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
-      std::shared_ptr<SparseUtils::SparseCholesky<T>>* chol_out = nullptr) {
+      const std::tuple<LoadAnalyses...>& load_analyses,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
     int ndof = Physics::dof_per_node * mesh.get_num_nodes();
 
-    // Compute Jacobian matrix
-    BSRMat* jac_bsr = jacobian();
-    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
-    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
-    jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
-
-    // Set right hand side (Dirichlet bcs and load)
+    // Set right hand side (load)
     rhs = std::vector<T>(ndof, 0.0);
-    std::vector<T> t1(ndof, 0.0), t2(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
 
-    analysis.residual(nullptr, t1.data(), rhs.data());
+    // Add external load contributions to the right-hand size
+    std::apply(
+        [&zeros, this](auto&&... load_analysis) mutable {
+          (load_analysis.residual(nullptr, zeros.data(), this->rhs.data()),
+           ...);
+        },
+        load_analyses);
     for (int i = 0; i < rhs.size(); i++) {
       rhs[i] *= -1.0;
     }
-    for (int i = 0; i < bc_dof.size(); i++) {
-      rhs[bc_dof[i]] = bc_vals[i];
-    }
 
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t1[bc_dof[i]] = bc_vals[i];
-    }
+    // Factorize Jacobian matrix, the Dirichlet bcs are lifted into sol
+    std::vector<T> sol;
+    std::shared_ptr<Factor> chol = factor_jacobian(bc_dof, bc_vals, sol);
+    chol->solve(sol.data());
 
-    jac_bsr->axpy(t1.data(), t2.data());
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t2[bc_dof[i]] = 0.0;
+    if (chol_out) {
+      *chol_out = chol;
     }
 
+#ifdef XCGD_DEBUG_MODE
+    print_residual(bc_dof, sol);
+#endif
+
+    return sol;
+  }
+
+  /**
+   * @brief Solve one load case per load analysis against a single
+   * factorization
+   *
+   * Unlike solve(), which sums all loads into one right hand side, each load
+   * analysis defines its own load case. The load vectors are assembled
+   * concurrently and all cases are solved as one block of right hand sides.
+   * Dirichlet values bc_vals apply to every load case. After the call,
+   * get_rhs() holds the right hand sides of all load cases in the same layout
+   * as the solutions.
+   *
+   * Note: the load analyses must be distinct objects, as they are evaluated
+   * concurrently
+   *
+   * @return solutions, column major ndof x nloads, the k-th load case is
+   * stored at [k * ndof, (k + 1) * ndof)
+   */
+  template <class... LoadAnalyses>
+  std::vector<T> solve_multi_load(
+      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
+      const std::tuple<LoadAnalyses...>& load_analyses,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
+    constexpr int nloads = sizeof...(LoadAnalyses);
+    static_assert(nloads > 0, "at least one load analysis is needed");
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+
+    // Assemble the external loads, one column per load analysis
+    rhs = std::vector<T>(std::size_t(ndof) * nloads, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
+    std::array<std::function<void()>, nloads> assemble_load;
+    int load = 0;
+    std::apply(
+        [&](auto&&... load_analysis) {
+          ((assemble_load[load] =
+                [la = &load_analysis, &zeros, this, ndof, load]() {
+                  la->residual(nullptr, zeros.data(),
+                               &this->rhs[std::size_t(load) * ndof]);
+                },
+            load++),
+           ...);
+        },
+        load_analyses);
+#pragma omp parallel for schedule(dynamic, 1) if (nloads > 1)
+    for (int i = 0; i < nloads; i++) assemble_load[i]();
     for (int i = 0; i < rhs.size(); i++) {
-      t2[i] = rhs[i] - t2[i];
+      rhs[i] *= -1.0;
     }
 
-    // Factorize Jacobian matrix
-    SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol =
-        std::make_shared<SparseUtils::SparseCholesky<T>>(jac_csc);
-    chol->factor();
-    std::vector<T> sol = t2;
-    chol->solve(sol.data());
+    // Factorize Jacobian matrix once for all load cases, the Dirichlet bcs
+    // are lifted into every column of sol
+    std::vector<T> sol;
+    std::shared_ptr<Factor> chol =
+        factor_jacobian(bc_dof, bc_vals, sol, nloads);
+    solve_multiple_rhs(*chol, sol.data(), ndof, nloads);
 
     if (chol_out) {
       *chol_out = chol;
     }
 
-#ifdef XCGD_DEBUG_MODE
-    // Write Jacobian matrix to a file
-    jac_csc->write_mtx("K_bcs.mtx");
+    return sol;
+  }
 
-    // Check error
-    // res = Ku - rhs
-    std::vector<T> Ku(sol.size());
-    jac_bsr->axpy(sol.data(), Ku.data());
-    T err = 0.0;
-    for (int i = 0; i < Ku.size(); i++) {
-      err += (Ku[i] - rhs[i]) * (Ku[i] - rhs[i]);
+  /**
+   * @brief Solve the linear system by the conjugate gradient method
+   * preconditioned by a geometric multigrid V-cycle, which avoids the fill-in
+   * of the Cholesky factorization for large grids
+   *
+   * @param rtol relative tolerance of the residual
+   * @param max_iter maximum number of CG iterations
+   */
+  std::vector<T> solve_multigrid(const std::vector<int>& bc_dof,
+                                 const std::vector<T>& bc_vals,
+                                 double rtol = 1e-10, int max_iter = 500,
+                                 bool verbose = false) {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+
+    // Compute Jacobian matrix
+    BSRMat* jac_bsr = jacobian();
+    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
+
+    // Set right hand side (Dirichlet bcs and load)
+    rhs = std::vector<T>(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
+
+    analysis.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
     }
-    std::printf("[Debug] Linear elasticity residual:\n");
-    std::printf("||Ku - f||_2: %25.15e\n", sqrt(err));
-#endif
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
+
+    GDMultigrid<T, Mesh, Physics::dof_per_node> mg(mesh);
+    mg.setup(jac_bsr, bc_dof);
+    if (verbose) mg.get_solver().print_info();
+
+    std::vector<T> sol(ndof, 0.0);
+    int niter =
+        mg.solve_pcg(rhs_bcs.data(), sol.data(), rtol, max_iter, verbose);
 
+    last_solve = {memory_bytes(*jac_bsr), 0, 0};
     if (jac_bsr) delete jac_bsr;
-    if (jac_csc) delete jac_csc;
+
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "multigrid preconditioned CG did not converge in %d "
+                    "iterations",
+                    max_iter);
+      throw std::runtime_error(msg);
+    }
 
     return sol;
   }
 
+  /**
+   * @brief Iterative solve for a sequence of slowly varying problems, such as
+   * the design iterations of an optimization
+   *
+   * CG is preconditioned by the geometric multigrid, warm started from the
+   * previous solution and deflated by the solutions of the previous solves,
+   * see KrylovRecycler. The recycled vectors are stored on the grid verts, so
+   * they carry over when the cut mesh changes. The operator and the
+   * preconditioner are kept for solve_adjoint_iterative().
+   */
   template <class... LoadAnalyses>
-  std::vector<T> solve(
+  std::vector<T> solve_iterative(
       const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
-      const std::tuple<LoadAnalyses...>& load_analyses,
-      std::shared_ptr<SparseUtils::SparseCholesky<T>>* chol_out = nullptr) {
-    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+      const std::tuple<LoadAnalyses...>& load_analyses, double rtol = 1e-10,
+      int max_iter = 500, bool verbose = false) {
+    constexpr int dof_per_node = Physics::dof_per_node;
+    int ndof = dof_per_node * mesh.get_num_nodes();
 
     // Compute Jacobian matrix
     BSRMat* jac_bsr = jacobian();
     jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
-    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
-    jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
 
     // Set right hand side (Dirichlet bcs and load)
     rhs = std::vector<T>(ndof, 0.0);
-    std::vector<T> t1(ndof, 0.0), t2(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
 
-    // Add external load contributions to the right-hand size
     std::apply(
-        [&t1, this](auto&&... load_analysis) mutable {
-          (load_analysis.residual(nullptr, t1.data(), this->rhs.data()), ...);
+        [&zeros, this](auto&&... load_analysis) mutable {
+          (load_analysis.residual(nullptr, zeros.data(), this->rhs.data()),
+           ...);
         },
         load_analyses);
     for (int i = 0; i < rhs.size(); i++) {
       rhs[i] *= -1.0;
     }
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
 
-    for (int i = 0; i < bc_dof.size(); i++) {
-      rhs[bc_dof[i]] = bc_vals[i];
+    iterative_mg = std::make_unique<GDMultigrid<T, Mesh, dof_per_node>>(mesh);
+    iterative_mg->setup(jac_bsr, bc_dof);
+    last_solve = {memory_bytes(*jac_bsr), 0, 0};
+    if (jac_bsr) delete jac_bsr;
+
+    std::vector<int> store_index(ndof);
+    for (int n = 0; n < mesh.get_num_nodes(); n++) {
+      for (int d = 0; d < dof_per_node; d++) {
+        store_index[dof_per_node * n + d] =
+            dof_per_node * mesh.get_node_vert(n) + d;
+      }
     }
+    const auto& A = iterative_mg->get_solver().get_operator(0);
+    recycler.set_operator(
+        ndof, [&A](const T* x, T* y) { csr_mult(A, x, y); }, store_index,
+        dof_per_node * mesh.get_grid().get_num_verts());
 
+    std::vector<T> sol(ndof, 0.0);
+    recycler.warm_start(0, sol.data());
     for (int i = 0; i < bc_dof.size(); i++) {
-      t1[bc_dof[i]] = bc_vals[i];
+      sol[bc_dof[i]] = bc_vals[i];
     }
+    solve_recycled(rhs_bcs.data(), sol.data(), 0, rtol, max_iter, verbose);
 
-    jac_bsr->axpy(t1.data(), t2.data());
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t2[bc_dof[i]] = 0.0;
+    return sol;
+  }
+
+  /**
+   * @brief Solve K psi = b in place with the operator of the last
+   * solve_iterative(), this is the iterative counterpart of chol->solve() for
+   * the adjoint equations
+   */
+  void solve_adjoint_iterative(T* psi, double rtol = 1e-10, int max_iter = 500,
+                               bool verbose = false) {
+    if (!iterative_mg) {
+      throw std::runtime_error(
+          "solve_iterative() needs to be called before "
+          "solve_adjoint_iterative()");
     }
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+    std::vector<T> b(psi, psi + ndof);
+    std::fill(psi, psi + ndof, T(0.0));
+    recycler.warm_start(1, psi);
+    solve_recycled(b.data(), psi, 1, rtol, max_iter, verbose);
+  }
+
+  KrylovRecycler<T>& get_recycler() { return recycler; }
+
+  /**
+   * @brief Solve the problem with the Dirichlet dof eliminated
+   *
+   * Only the free dof are assembled and factorized, the prescribed values
+   * enter the right hand side through the lifting block K_fc.
+   *
+   * @param chol_out if not nullptr, stores the factorization of the reduced
+   * matrix, whose dof are numbered by get_dof_map()
+   * @return the full solution vector
+   */
+  std::vector<T> solve_reduced(
+      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+    if (not dof_map.matches(ndof, bc_dof)) {
+      dof_map = DirichletDofMap(ndof, bc_dof);
+    }
+
+    // Compute the reduced Jacobian matrix
+    ReducedBSRMat<T, Physics::dof_per_node> jac(
+        mesh.get_num_nodes(), mesh.get_num_elements(),
+        mesh.max_nnodes_per_element,
+        [this](int elem, int* nodes) -> int {
+          return mesh.get_elem_dof_nodes(elem, nodes);
+        },
+        dof_map);
+    std::vector<T> zeros(ndof, 0.0);
+    analysis.jacobian(nullptr, zeros.data(), &jac);
+    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac.get_free_block());
 
+    // Set right hand side (load and lifting of the Dirichlet bcs)
+    rhs = std::vector<T>(ndof, 0.0);
+    analysis.residual(nullptr, zeros.data(), rhs.data());
     for (int i = 0; i < rhs.size(); i++) {
-      t2[i] = rhs[i] - t2[i];
+      rhs[i] *= -1.0;
+    }
+    std::vector<T> rhs_free(dof_map.get_num_free());
+    jac.lift(rhs.data(), bc_vals.data(), rhs_free.data());
+    for (int i = 0; i < bc_dof.size(); i++) {
+      rhs[bc_dof[i]] = bc_vals[i];
     }
 
-    // Factorize Jacobian matrix
-    SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol =
-        std::make_shared<SparseUtils::SparseCholesky<T>>(jac_csc);
+    // Factorize the reduced Jacobian matrix
+    std::shared_ptr<Factor> chol = std::make_shared<Factor>(jac_csc);
     chol->factor();
-    std::vector<T> sol = t2;
-
-    chol->solve(sol.data());
+    chol->solve(rhs_free.data());
 
     if (chol_out) {
       *chol_out = chol;
     }
 
+    last_solve = {jac.get_memory_bytes(), memory_bytes(*jac_csc),
+                  factor_memory_bytes(*chol)};
+    if (jac_csc) delete jac_csc;
+
+    std::vector<T> sol(ndof);
+    dof_map.expand(rhs_free.data(), bc_vals.data(), sol.data());
+    return sol;
+  }
+
+  /**
+   * @brief Solve K psi = b in place with the factor of the last
+   * solve_reduced(), this is the counterpart of chol->solve() for the adjoint
+   * equations
+   *
+   * @param psi full vector, the Dirichlet entries are set to zero
+   */
+  void solve_adjoint_reduced(Factor& chol, T* psi) const {
+    std::vector<T> psi_free(dof_map.get_num_free());
+    dof_map.restrict(psi, psi_free.data());
+    chol.solve(psi_free.data());
+    dof_map.expand(psi_free.data(), (const T*)nullptr, psi);
+  }
+
+  /**
+   * @brief Estimate the extremal eigenvalues and the condition number of the
+   * stiffness matrix with the Dirichlet bcs applied, see
+   * estimate_eigenvalues()
+   *
+   * @param chol factor returned by solve() with the same bc_dof, the smallest
+   * eigenvalue is found by shift-invert with it
+   */
+  EigenEstimate estimate_condition_number(const std::vector<int>& bc_dof,
+                                          Factor& chol, double rtol = 1e-6) {
+    BSRMat* jac_bsr = jacobian();
+    EigenEstimate est = estimate_eigenvalues(
+        jac_bsr, bc_dof, [&chol](T* x) { chol.solve(x); }, 300, rtol);
+    delete jac_bsr;
+    return est;
+  }
+
+  const DirichletDofMap& get_dof_map() const { return dof_map; }
+
+  std::vector<T>& get_rhs() { return rhs; }
+
+  Mesh& get_mesh() { return mesh; }
+  Quadrature& get_quadrature() { return quadrature; }
+  Basis& get_basis() { return basis; }
+  Analysis& get_analysis() { return analysis; }
+
+  // Memory of the mesh, the analysis, and the matrices of the last solve
+  MemoryReport memory_report() const {
+    MemoryReport report, analysis_report = analysis.memory_report();
+    if constexpr (has_memory_report<Mesh>::value) {
+      report.merge("mesh", mesh.memory_report());
+    }
+    report.merge("analysis", analysis_report);
+    report.add("rhs", memory_bytes(rhs));
+    last_solve.add_to(report, analysis_report.get_bytes("jacobian"));
+    return report;
+  }
+
+ private:
+  template <class Mat>
+  Mat* assemble_jacobian() {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+
+    // Set up Jacobian matrix
+    int *rowp = nullptr, *cols = nullptr;
+    auto& mesh = this->mesh;
+    SparseUtils::CSRFromConnectivityFunctor(
+        mesh.get_num_nodes(), mesh.get_num_elements(),
+        mesh.max_nnodes_per_element,
+        [&mesh](int elem, int* nodes) -> int {
+          return mesh.get_elem_dof_nodes(elem, nodes);
+        },
+        &rowp, &cols);
+
+    Mat* jac = nullptr;
+    if constexpr (std::is_same_v<Mat, SymBSRMat>) {
+      jac = new SymBSRMat(mesh.get_num_nodes(), rowp, cols);
+    } else {
+      int nnz = rowp[mesh.get_num_nodes()];
+      jac = new BSRMat(mesh.get_num_nodes(), nnz, rowp, cols);
+    }
+
+    // Compute Jacobian matrix
+    std::vector<T> zeros(ndof, 0.0);
+    analysis.jacobian(nullptr, zeros.data(), jac);
+
+    if (rowp) delete rowp;
+    if (cols) delete cols;
+
+    return jac;
+  }
+
+  /**
+   * @brief Factorize the Jacobian matrix whose Dirichlet rows and columns are
+   * replaced by the identity
+   *
+   * SimplicialCholesky factors the upper triangle alone, so for this Factor
+   * the Jacobian is assembled as a SymmetricGalerkinBSRMat, which halves the
+   * memory and the scatter work of the assembly.
+   *
+   * @param rhs_bcs output, rhs with the Dirichlet values lifted, see
+   * lift_dirichlet_bcs()
+   * @param nrhs number of load cases held by rhs, see solve_multi_load()
+   */
+  std::shared_ptr<Factor> factor_jacobian(const std::vector<int>& bc_dof,
+                                          const std::vector<T>& bc_vals,
+                                          std::vector<T>& rhs_bcs,
+                                          int nrhs = 1) {
+    SymBSRMat* jac_sym = nullptr;
+    BSRMat* jac_bsr = nullptr;
+    CSCMat* jac_csc = nullptr;
+    std::shared_ptr<Factor> chol;
+    if constexpr (is_simplicial_cholesky<Factor>::value) {
+      jac_sym = symmetric_jacobian();
+      rhs_bcs = lift_dirichlet_bcs(jac_sym, bc_dof, bc_vals, rhs, nrhs);
+      jac_sym->zero_rows_and_columns(bc_dof.size(), bc_dof.data());
+      jac_csc = jac_sym->to_csc();
+      chol = std::make_shared<Factor>(jac_csc, true);
+    } else {
+      jac_bsr = jacobian();
+      jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
+      rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs, nrhs);
+      jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
+      jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
+      chol = std::make_shared<Factor>(jac_csc);
+    }
+    chol->factor();
+
 #ifdef XCGD_DEBUG_MODE
     // Write Jacobian matrix to a file
     jac_csc->write_mtx("K_bcs.mtx");
+#endif
+
+    last_solve = {jac_sym ? memory_bytes(*jac_sym) : memory_bytes(*jac_bsr),
+                  memory_bytes(*jac_csc), factor_memory_bytes(*chol)};
+    if (jac_sym) delete jac_sym;
+    if (jac_bsr) delete jac_bsr;
+    if (jac_csc) delete jac_csc;
+
+    return chol;
+  }
 
-    // Check error
-    // res = Ku - rhs
+#ifdef XCGD_DEBUG_MODE
+  // Print ||Ku - f||, f = rhs holds the prescribed values at the bc dof
+  void print_residual(const std::vector<int>& bc_dof,
+                      const std::vector<T>& sol) {
+    BSRMat* jac_bsr = jacobian();
+    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
     std::vector<T> Ku(sol.size());
     jac_bsr->axpy(sol.data(), Ku.data());
     T err = 0.0;
@@ -199,22 +555,23 @@ class StaticElastic final {
     }
     std::printf("[Debug] Linear elasticity residual:\n");
     std::printf("||Ku - f||_2: %25.15e\n", sqrt(err));
+    delete jac_bsr;
+  }
 #endif
 
-    if (jac_bsr) delete jac_bsr;
-    if (jac_csc) delete jac_csc;
-
-    return sol;
+  void solve_recycled(const T* b, T* x, int slot, double rtol, int max_iter,
+                      bool verbose) {
+    const MultigridSolver<T>& mg = iterative_mg->get_solver();
+    int niter = recycler.solve([&mg](const T* r, T* z) { mg.apply(r, z); }, b,
+                               x, slot, rtol, max_iter, verbose);
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "recycled CG did not converge in %d iterations", max_iter);
+      throw std::runtime_error(msg);
+    }
   }
 
-  std::vector<T>& get_rhs() { return rhs; }
-
-  Mesh& get_mesh() { return mesh; }
-  Quadrature& get_quadrature() { return quadrature; }
-  Basis& get_basis() { return basis; }
-  Analysis& get_analysis() { return analysis; }
-
- private:
   Mesh& mesh;
   Quadrature& quadrature;
   Basis& basis;
@@ -223,16 +580,25 @@ class StaticElastic final {
   Analysis analysis;
 
   std::vector<T> rhs;
+  DirichletDofMap dof_map;
+
+  // State of the iterative solves
+  KrylovRecycler<T> recycler;
+  std::unique_ptr<GDMultigrid<T, Mesh, Physics::dof_per_node>> iterative_mg;
+
+  ElasticSolveMemory last_solve;
 };
 
 // App class for the elastic problem using a main mesh and a conjugate
 // mesh for ersatz material, where
 // (conjucate mesh) U (main mesh) = grid
 template <typename T, class Mesh, class Quadrature, class Basis, class IntFunc,
-          class Grid_ = StructuredGrid2D<T>>
+          class Grid_ = StructuredGrid2D<T>,
+          class Factor_ = SparseUtils::SparseCholesky<T>>
 class StaticElasticErsatz final {
  public:
   using Physics = LinearElasticity<T, Basis::spatial_dim, IntFunc>;
+  using Factor = Factor_;
 
  private:
   static_assert(Mesh::is_cut_mesh, "StaticElasticErsatz only takes a cut mesh");
@@ -241,14 +607,22 @@ class StaticElasticErsatz final {
   using Analysis =
       GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics, grid_is_mesh>;
   using BSRMat = GalerkinBSRMat<T, Physics::dof_per_node>;
+  using SymBSRMat = SymmetricGalerkinBSRMat<T, Physics::dof_per_node>;
   using CSCMat = SparseUtils::CSCMat<T>;
   static int constexpr max_nnodes_per_element =
       2 * Mesh::max_nnodes_per_element;
+  using GroundMesh = GridMesh<T, Mesh::Np_1d, Grid>;
 
  public:
+  /**
+   * @param ersatz_ratio stiffness of the ersatz material relative to the solid
+   * @param ersatz_band number of cell layers of ersatz material kept around
+   * the solid, the void beyond the band is discarded and its dof are
+   * eliminated. A negative value fills the entire void with ersatz material
+   */
   StaticElasticErsatz(T E, T nu, Mesh& mesh, Quadrature& quadrature,
                       Basis& basis, const IntFunc& int_func,
-                      double ersatz_ratio = 1e-6)
+                      double ersatz_ratio = 1e-6, int ersatz_band = -1)
       : grid(mesh.get_grid()),
         mesh_l(mesh),
         mesh_r(grid),
@@ -259,206 +633,528 @@ class StaticElasticErsatz final {
         physics_l(E, nu, int_func),
         physics_r(E * ersatz_ratio, nu, int_func),
         analysis_l(mesh_l, quadrature_l, basis_l, physics_l),
-        analysis_r(mesh_r, quadrature_r, basis_r, physics_r) {
-    for (int i = 0; i < grid.get_num_verts(); i++) {
-      mesh_r.get_lsf_dof()[i] = -mesh_l.get_lsf_dof()[i];
-    }
-    mesh_r.update_mesh();
+        analysis_r(mesh_r, quadrature_r, basis_r, physics_r),
+        ersatz_band(ersatz_band) {
+    update_mesh_ersatz();
   }
 
   ~StaticElasticErsatz() = default;
 
   // Compute Jacobian matrix without boundary conditions
-  BSRMat* jacobian() {
+  BSRMat* jacobian() { return assemble_jacobian<BSRMat>(); }
+
+  // Compute the upper triangle of the Jacobian matrix without boundary
+  // conditions
+  SymBSRMat* symmetric_jacobian() { return assemble_jacobian<SymBSRMat>(); }
+
+  std::vector<T> solve(
+      const std::vector<int>& bc_dof_, const std::vector<T>& bc_vals_,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
     int ndof = Physics::dof_per_node * grid.get_num_verts();
+    auto [bc_dof, bc_vals] = append_void_dof(bc_dof_, bc_vals_);
 
-    // Set up Jacobian matrix
-    int *rowp = nullptr, *cols = nullptr;
-    auto& mesh_l = this->mesh_l;
-    auto& mesh_r = this->mesh_r;
-    SparseUtils::CSRFromConnectivityFunctor(
-        grid.get_num_verts(), grid.get_num_cells(), max_nnodes_per_element,
-        [mesh_l, mesh_r](int cell, int* verts) -> int {
-          const auto& cell_elems_l = mesh_l.get_cell_elems();
-          const auto& cell_elems_r = mesh_r.get_cell_elems();
+    // Set right hand side (load)
+    rhs = std::vector<T>(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
 
-          int nverts = 0;
-          int verts_work[max_nnodes_per_element];
+    analysis_l.residual(nullptr, zeros.data(), rhs.data());
+    analysis_r.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
+    }
 
-          if (cell_elems_l.count(cell)) {
-            nverts += mesh_l.get_cell_dof_verts(cell, verts_work);
-          }
+    // Factorize Jacobian matrix, the Dirichlet bcs are lifted into sol
+    std::vector<T> sol;
+    std::shared_ptr<Factor> chol = factor_jacobian(bc_dof, bc_vals, sol);
+    chol->solve(sol.data());
 
-          if (cell_elems_r.count(cell)) {
-            nverts += mesh_r.get_cell_dof_verts(cell, verts_work + nverts);
-          }
+    if (chol_out) {
+      *chol_out = chol;
+    }
 
-          std::set<int> verts_set(verts_work, verts_work + nverts);
+#ifdef XCGD_DEBUG_MODE
+    print_residual(bc_dof, sol);
+#endif
 
-          int i = 0;
-          for (auto it = verts_set.begin(); it != verts_set.end(); it++, i++) {
-            verts[i] = *it;
-          }
+    return sol;
+  }
 
-          nverts = verts_set.size();
+  template <class... LoadAnalyses>
+  std::vector<T> solve(
+      const std::vector<int>& bc_dof_, const std::vector<T>& bc_vals_,
+      const std::tuple<LoadAnalyses...>& load_analyses,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
+    int ndof = Physics::dof_per_node * grid.get_num_verts();
+    auto [bc_dof, bc_vals] = append_void_dof(bc_dof_, bc_vals_);
+
+    // Set right hand side (load)
+    rhs = std::vector<T>(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
 
-          return nverts;
+    // Add external load contributions to the right-hand size
+    std::apply(
+        [&zeros, this](auto&&... load_analysis) mutable {
+          (load_analysis.residual(nullptr, zeros.data(), this->rhs.data()),
+           ...);
         },
-        &rowp, &cols);
+        load_analyses);
 
-    int nnz = rowp[grid.get_num_verts()];
-    BSRMat* jac_bsr = new BSRMat(grid.get_num_verts(), nnz, rowp, cols);
+    // Add internal load contributions to the right-hand size
+    analysis_l.residual(nullptr, zeros.data(), rhs.data());
+    analysis_r.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
+    }
 
-    // Compute Jacobian matrix
-    std::vector<T> zeros(ndof, 0.0);
-    analysis_l.jacobian(nullptr, zeros.data(), jac_bsr, true);
-    analysis_r.jacobian(nullptr, zeros.data(), jac_bsr, false);
+    // Factorize Jacobian matrix, the Dirichlet bcs are lifted into sol
+    std::vector<T> sol;
+    std::shared_ptr<Factor> chol = factor_jacobian(bc_dof, bc_vals, sol);
+    chol->solve(sol.data());
 
-    if (rowp) delete rowp;
-    if (cols) delete cols;
+    if (chol_out) {
+      *chol_out = chol;
+    }
 
-    return jac_bsr;
+#ifdef XCGD_DEBUG_MODE
+    print_residual(bc_dof, sol);
+#endif
+
+    return sol;
   }
 
-  std::vector<T> solve(
-      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
-      std::shared_ptr<SparseUtils::SparseCholesky<T>>* chol_out = nullptr) {
-    int ndof = Physics::dof_per_node * grid.get_num_verts();
+  /**
+   * @brief Solve the linear system by multigrid preconditioned CG, see
+   * StaticElastic::solve_multigrid()
+   *
+   * The multigrid hierarchy is built on the full grid, as the dof of the
+   * ersatz problem live on all grid verts.
+   */
+  std::vector<T> solve_multigrid(const std::vector<int>& bc_dof_,
+                                 const std::vector<T>& bc_vals_,
+                                 double rtol = 1e-10, int max_iter = 500,
+                                 bool verbose = false) {
+    constexpr int dof_per_node = Physics::dof_per_node;
+    int ndof = dof_per_node * grid.get_num_verts();
+    auto [bc_dof, bc_vals] = append_void_dof(bc_dof_, bc_vals_);
 
     // Compute Jacobian matrix
     BSRMat* jac_bsr = jacobian();
     jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
-    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
-    jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
 
     // Set right hand side (Dirichlet bcs and load)
     rhs = std::vector<T>(ndof, 0.0);
-    std::vector<T> t1(ndof, 0.0), t2(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
 
-    analysis_l.residual(nullptr, t1.data(), rhs.data());
-    analysis_r.residual(nullptr, t1.data(), rhs.data());
+    analysis_l.residual(nullptr, zeros.data(), rhs.data());
+    analysis_r.residual(nullptr, zeros.data(), rhs.data());
     for (int i = 0; i < rhs.size(); i++) {
       rhs[i] *= -1.0;
     }
-    for (int i = 0; i < bc_dof.size(); i++) {
-      rhs[bc_dof[i]] = bc_vals[i];
-    }
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
 
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t1[bc_dof[i]] = bc_vals[i];
-    }
+    if (!grid_mesh) grid_mesh = std::make_unique<GroundMesh>(grid);
+    GDMultigrid<T, GroundMesh, dof_per_node> mg(*grid_mesh);
+    mg.setup(jac_bsr, bc_dof);
+    if (verbose) mg.get_solver().print_info();
 
-    jac_bsr->axpy(t1.data(), t2.data());
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t2[bc_dof[i]] = 0.0;
-    }
+    std::vector<T> sol(ndof, 0.0);
+    int niter =
+        mg.solve_pcg(rhs_bcs.data(), sol.data(), rtol, max_iter, verbose);
 
-    for (int i = 0; i < rhs.size(); i++) {
-      t2[i] = rhs[i] - t2[i];
+    last_solve = {memory_bytes(*jac_bsr), 0, 0};
+    if (jac_bsr) delete jac_bsr;
+
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "multigrid preconditioned CG did not converge in %d "
+                    "iterations",
+                    max_iter);
+      throw std::runtime_error(msg);
     }
 
-    // Factorize Jacobian matrix
-    SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol =
-        std::make_shared<SparseUtils::SparseCholesky<T>>(jac_csc);
-    chol->factor();
-    std::vector<T> sol = t2;
-    chol->solve(sol.data());
+    return sol;
+  }
 
-    if (chol_out) {
-      *chol_out = chol;
-    }
+  /**
+   * @brief Iterative solve for a sequence of slowly varying problems, see
+   * StaticElastic::solve_iterative()
+   *
+   * The multigrid hierarchy is built on the full grid, as the dof of the
+   * ersatz problem live on all grid verts.
+   */
+  template <class... LoadAnalyses>
+  std::vector<T> solve_iterative(
+      const std::vector<int>& bc_dof_, const std::vector<T>& bc_vals_,
+      const std::tuple<LoadAnalyses...>& load_analyses, double rtol = 1e-10,
+      int max_iter = 500, bool verbose = false) {
+    constexpr int dof_per_node = Physics::dof_per_node;
+    int ndof = dof_per_node * grid.get_num_verts();
+    auto [bc_dof, bc_vals] = append_void_dof(bc_dof_, bc_vals_);
 
-#ifdef XCGD_DEBUG_MODE
-    // Write Jacobian matrix to a file
-    jac_csc->write_mtx("K_bcs.mtx");
+    // Compute Jacobian matrix
+    BSRMat* jac_bsr = jacobian();
+    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
 
-    // Check error
-    // res = Ku - rhs
-    std::vector<T> Ku(sol.size());
-    jac_bsr->axpy(sol.data(), Ku.data());
-    T err = 0.0;
-    for (int i = 0; i < Ku.size(); i++) {
-      err += (Ku[i] - rhs[i]) * (Ku[i] - rhs[i]);
+    // Set right hand side (Dirichlet bcs and load)
+    rhs = std::vector<T>(ndof, 0.0);
+    std::vector<T> zeros(ndof, 0.0);
+
+    std::apply(
+        [&zeros, this](auto&&... load_analysis) mutable {
+          (load_analysis.residual(nullptr, zeros.data(), this->rhs.data()),
+           ...);
+        },
+        load_analyses);
+    analysis_l.residual(nullptr, zeros.data(), rhs.data());
+    analysis_r.residual(nullptr, zeros.data(), rhs.data());
+    for (int i = 0; i < rhs.size(); i++) {
+      rhs[i] *= -1.0;
     }
-    std::printf("[Debug] Linear elasticity residual:\n");
-    std::printf("||Ku - f||_2: %25.15e\n", sqrt(err));
-#endif
+    std::vector<T> rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
 
+    if (!grid_mesh) grid_mesh = std::make_unique<GroundMesh>(grid);
+    iterative_mg =
+        std::make_unique<GDMultigrid<T, GroundMesh, dof_per_node>>(*grid_mesh);
+    iterative_mg->setup(jac_bsr, bc_dof);
+    last_solve = {memory_bytes(*jac_bsr), 0, 0};
     if (jac_bsr) delete jac_bsr;
-    if (jac_csc) delete jac_csc;
+
+    const auto& A = iterative_mg->get_solver().get_operator(0);
+    recycler.set_operator(ndof, [&A](const T* x, T* y) { csr_mult(A, x, y); });
+
+    std::vector<T> sol(ndof, 0.0);
+    recycler.warm_start(0, sol.data());
+    for (int i = 0; i < bc_dof.size(); i++) {
+      sol[bc_dof[i]] = bc_vals[i];
+    }
+    solve_recycled(rhs_bcs.data(), sol.data(), 0, rtol, max_iter, verbose);
 
     return sol;
   }
 
+  /**
+   * @brief Solve K psi = b in place with the operator of the last
+   * solve_iterative(), see StaticElastic::solve_adjoint_iterative()
+   */
+  void solve_adjoint_iterative(T* psi, double rtol = 1e-10, int max_iter = 500,
+                               bool verbose = false) {
+    if (!iterative_mg) {
+      throw std::runtime_error(
+          "solve_iterative() needs to be called before "
+          "solve_adjoint_iterative()");
+    }
+    int ndof = Physics::dof_per_node * grid.get_num_verts();
+    std::vector<T> b(psi, psi + ndof);
+    std::fill(psi, psi + ndof, T(0.0));
+    recycler.warm_start(1, psi);
+    solve_recycled(b.data(), psi, 1, rtol, max_iter, verbose);
+  }
+
+  KrylovRecycler<T>& get_recycler() { return recycler; }
+
+  /**
+   * @brief Solve the problem with the Dirichlet dof eliminated
+   *
+   * Only the free dof are assembled and factorized, the prescribed values
+   * enter the right hand side through the lifting block K_fc.
+   *
+   * @param chol_out if not nullptr, stores the factorization of the reduced
+   * matrix, whose dof are numbered by get_dof_map()
+   * @return the full solution vector
+   */
+  std::vector<T> solve_reduced(
+      const std::vector<int>& bc_dof_, const std::vector<T>& bc_vals_,
+      std::shared_ptr<Factor>* chol_out = nullptr) {
+    return solve_reduced(bc_dof_, bc_vals_, std::tuple<>{}, chol_out);
+  }
+
+  // Same as above, with external loads
   template <class... LoadAnalyses>
-  std::vector<T> solve(
-      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals,
+  std::vector<T> solve_reduced(
+      const std::vector<int>& bc_dof_, const std::vector<T>& bc_vals_,
       const std::tuple<LoadAnalyses...>& load_analyses,
-      std::shared_ptr<SparseUtils::SparseCholesky<T>>* chol_out = nullptr) {
+      std::shared_ptr<Factor>* chol_out = nullptr) {
     int ndof = Physics::dof_per_node * grid.get_num_verts();
+    auto [bc_dof, bc_vals] = append_void_dof(bc_dof_, bc_vals_);
+    if (not dof_map.matches(ndof, bc_dof)) {
+      dof_map = DirichletDofMap(ndof, bc_dof);
+    }
 
-    // Compute Jacobian matrix
-    BSRMat* jac_bsr = jacobian();
-    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
-    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
-    jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
+    // Compute the reduced Jacobian matrix
+    ReducedBSRMat<T, Physics::dof_per_node> jac(
+        grid.get_num_verts(), grid.get_num_cells(), max_nnodes_per_element,
+        [this](int cell, int* verts) -> int {
+          return get_cell_dof_verts(cell, verts);
+        },
+        dof_map);
+    std::vector<T> zeros(ndof, 0.0);
+    analysis_l.jacobian(nullptr, zeros.data(), &jac, true);
+    analysis_r.jacobian(nullptr, zeros.data(), &jac, false);
+    CSCMat* jac_csc = SparseUtils::bsr_to_csc(jac.get_free_block());
 
-    // Set right hand side (Dirichlet bcs and load)
+    // Set right hand side (load and lifting of the Dirichlet bcs)
     rhs = std::vector<T>(ndof, 0.0);
-    std::vector<T> t1(ndof, 0.0), t2(ndof, 0.0);
-
-    // Add external load contributions to the right-hand size
     std::apply(
-        [&t1, this](auto&&... load_analysis) mutable {
-          (load_analysis.residual(nullptr, t1.data(), this->rhs.data()), ...);
+        [&zeros, this](auto&&... load_analysis) mutable {
+          (load_analysis.residual(nullptr, zeros.data(), this->rhs.data()),
+           ...);
         },
         load_analyses);
-
-    // Add internal load contributions to the right-hand size
-    analysis_l.residual(nullptr, t1.data(), rhs.data());
-    analysis_r.residual(nullptr, t1.data(), rhs.data());
+    analysis_l.residual(nullptr, zeros.data(), rhs.data());
+    analysis_r.residual(nullptr, zeros.data(), rhs.data());
     for (int i = 0; i < rhs.size(); i++) {
       rhs[i] *= -1.0;
     }
-
+    std::vector<T> rhs_free(dof_map.get_num_free());
+    jac.lift(rhs.data(), bc_vals.data(), rhs_free.data());
     for (int i = 0; i < bc_dof.size(); i++) {
       rhs[bc_dof[i]] = bc_vals[i];
     }
 
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t1[bc_dof[i]] = bc_vals[i];
+    // Factorize the reduced Jacobian matrix
+    std::shared_ptr<Factor> chol = std::make_shared<Factor>(jac_csc);
+    chol->factor();
+    chol->solve(rhs_free.data());
+
+    if (chol_out) {
+      *chol_out = chol;
     }
 
-    jac_bsr->axpy(t1.data(), t2.data());
-    for (int i = 0; i < bc_dof.size(); i++) {
-      t2[bc_dof[i]] = 0.0;
+    last_solve = {jac.get_memory_bytes(), memory_bytes(*jac_csc),
+                  factor_memory_bytes(*chol)};
+    if (jac_csc) delete jac_csc;
+
+    std::vector<T> sol(ndof);
+    dof_map.expand(rhs_free.data(), bc_vals.data(), sol.data());
+    return sol;
+  }
+
+  /**
+   * @brief Solve K psi = b in place with the factor of the last
+   * solve_reduced(), see StaticElastic::solve_adjoint_reduced()
+   *
+   * @param psi full vector, the Dirichlet and void entries are set to zero
+   */
+  void solve_adjoint_reduced(Factor& chol, T* psi) const {
+    std::vector<T> psi_free(dof_map.get_num_free());
+    dof_map.restrict(psi, psi_free.data());
+    chol.solve(psi_free.data());
+    dof_map.expand(psi_free.data(), (const T*)nullptr, psi);
+  }
+
+  /**
+   * @brief Update the ersatz mesh from the level set function of the solid
+   * mesh, call this after the solid mesh is updated
+   *
+   * Within the band, the ersatz level set is the negated solid level set.
+   * Beyond the band, the ersatz level set keeps the sign of the solid level
+   * set such that these verts are outside of both meshes.
+   */
+  void update_mesh_ersatz() {
+    int nverts = grid.get_num_verts();
+    lsf_ersatz_sign.assign(nverts, T(-1.0));
+
+    if (ersatz_band >= 0) {
+      const int* nxy = grid.get_nxy();
+      std::vector<bool> in_band(nverts, false);
+      for (const auto& [cell, elem] : mesh_l.get_cell_elems()) {
+        int exy[Mesh::spatial_dim];
+        grid.get_cell_coords(cell, exy);
+        for (int iy = std::max(exy[1] - ersatz_band, 0);
+             iy <= std::min(exy[1] + 1 + ersatz_band, nxy[1]); iy++) {
+          for (int ix = std::max(exy[0] - ersatz_band, 0);
+               ix <= std::min(exy[0] + 1 + ersatz_band, nxy[0]); ix++) {
+            in_band[grid.get_coords_vert(ix, iy)] = true;
+          }
+        }
+      }
+      for (int i = 0; i < nverts; i++) {
+        if (not in_band[i]) lsf_ersatz_sign[i] = 1.0;
+      }
     }
 
-    for (int i = 0; i < rhs.size(); i++) {
-      t2[i] = rhs[i] - t2[i];
+    const std::vector<T>& lsf_l = mesh_l.get_lsf_dof();
+    std::vector<T>& lsf_r = mesh_r.get_lsf_dof();
+    for (int i = 0; i < nverts; i++) {
+      lsf_r[i] = lsf_ersatz_sign[i] * lsf_l[i];
     }
+    mesh_r.update_mesh();
+  }
 
-    // Factorize Jacobian matrix
-    SparseUtils::CholOrderingType order = SparseUtils::CholOrderingType::ND;
+  void set_ersatz_band(int band) {
+    ersatz_band = band;
+    update_mesh_ersatz();
+  }
+  int get_ersatz_band() const { return ersatz_band; }
+
+  // Dof of the verts that are in neither the solid mesh nor the ersatz mesh,
+  // they are eliminated as homogeneous Dirichlet dof by the solvers
+  std::vector<int> get_void_dof() const {
+    std::vector<int> void_dof;
+    if (ersatz_band < 0) return void_dof;
+    const auto& vert_nodes_l = mesh_l.get_vert_nodes();
+    const auto& vert_nodes_r = mesh_r.get_vert_nodes();
+    for (int i = 0; i < grid.get_num_verts(); i++) {
+      if (vert_nodes_l.count(i) or vert_nodes_r.count(i)) continue;
+      for (int d = 0; d < Physics::dof_per_node; d++) {
+        void_dof.push_back(Physics::dof_per_node * i + d);
+      }
+    }
+    return void_dof;
+  }
 
-    std::shared_ptr<SparseUtils::SparseCholesky<T>> chol =
-        std::make_shared<SparseUtils::SparseCholesky<T>>(jac_csc);
-    chol->factor();
-    std::vector<T> sol = t2;
+  /**
+   * @brief Add the contribution of the ersatz material to psi^T dR/dphi,
+   * where phi is the level set function of the solid mesh
+   *
+   * The ersatz level set depends on phi through lsf_r = s * phi with s = -1
+   * within the band and s = 1 beyond the band
+   */
+  void ersatz_LSF_jacobian_adjoint_product(const T dof[], const T psi[],
+                                           T dfdphi[]) const {
+    ersatz_LSF_jacobian_adjoint_product(1, &dof, &psi, &dfdphi);
+  }
 
-    chol->solve(sol.data());
+  // Batched version of the above, see
+  // GalerkinAnalysis::LSF_jacobian_adjoint_product()
+  void ersatz_LSF_jacobian_adjoint_product(int nrhs, const T* const dofs[],
+                                           const T* const psis[],
+                                           T* const dfdphis[]) const {
+    int nverts = grid.get_num_verts();
+    std::vector<T> dfdlsf(std::size_t(nverts) * nrhs, T(0.0));
+    std::vector<T*> dfdlsfs(nrhs);
+    for (int k = 0; k < nrhs; k++) {
+      dfdlsfs[k] = &dfdlsf[std::size_t(k) * nverts];
+    }
+    analysis_r.LSF_jacobian_adjoint_product(nrhs, dofs, psis, dfdlsfs.data());
+    for (int k = 0; k < nrhs; k++) {
+      for (int i = 0; i < nverts; i++) {
+        dfdphis[k][i] += lsf_ersatz_sign[i] * dfdlsfs[k][i];
+      }
+    }
+  }
 
-    if (chol_out) {
-      *chol_out = chol;
+  // See StaticElastic::estimate_condition_number(), the void dof are treated
+  // as Dirichlet dof as in solve()
+  EigenEstimate estimate_condition_number(const std::vector<int>& bc_dof_,
+                                          Factor& chol, double rtol = 1e-6) {
+    auto [bc_dof, bc_vals] =
+        append_void_dof(bc_dof_, std::vector<T>(bc_dof_.size(), T(0.0)));
+    BSRMat* jac_bsr = jacobian();
+    EigenEstimate est = estimate_eigenvalues(
+        jac_bsr, bc_dof, [&chol](T* x) { chol.solve(x); }, 300, rtol);
+    delete jac_bsr;
+    return est;
+  }
+
+  const DirichletDofMap& get_dof_map() const { return dof_map; }
+
+  std::vector<T>& get_rhs() { return rhs; }
+
+  Mesh& get_mesh() { return mesh_l; }
+  Mesh& get_mesh_ersatz() { return mesh_r; }
+
+  Quadrature& get_quadrature() { return quadrature_l; }
+  Quadrature& get_quadrature_ersatz() { return quadrature_r; }
+  Basis& get_basis() { return basis_l; }
+  Basis& get_basis_ersatz() { return basis_r; }
+  Analysis& get_analysis() { return analysis_l; }
+  Analysis& get_analysis_ersatz() { return analysis_r; }
+
+  // Memory of both meshes and analyses, and the matrices of the last solve
+  MemoryReport memory_report() const {
+    MemoryReport report, analysis_report_l = analysis_l.memory_report(),
+                         analysis_report_r = analysis_r.memory_report();
+    report.merge("mesh", mesh_l.memory_report());
+    report.merge("mesh_ersatz", mesh_r.memory_report());
+    report.merge("analysis", analysis_report_l);
+    report.merge("analysis_ersatz", analysis_report_r);
+    report.add("lsf_ersatz_sign", memory_bytes(lsf_ersatz_sign));
+    report.add("rhs", memory_bytes(rhs));
+    last_solve.add_to(report,
+                      std::max(analysis_report_l.get_bytes("jacobian"),
+                               analysis_report_r.get_bytes("jacobian")));
+    return report;
+  }
+
+ private:
+  template <class Mat>
+  Mat* assemble_jacobian() {
+    int ndof = Physics::dof_per_node * grid.get_num_verts();
+
+    // Set up Jacobian matrix
+    int *rowp = nullptr, *cols = nullptr;
+    SparseUtils::CSRFromConnectivityFunctor(
+        grid.get_num_verts(), grid.get_num_cells(), max_nnodes_per_element,
+        [this](int cell, int* verts) -> int {
+          return get_cell_dof_verts(cell, verts);
+        },
+        &rowp, &cols);
+
+    Mat* jac = nullptr;
+    if constexpr (std::is_same_v<Mat, SymBSRMat>) {
+      jac = new SymBSRMat(grid.get_num_verts(), rowp, cols);
+    } else {
+      int nnz = rowp[grid.get_num_verts()];
+      jac = new BSRMat(grid.get_num_verts(), nnz, rowp, cols);
     }
 
+    // Compute Jacobian matrix
+    std::vector<T> zeros(ndof, 0.0);
+    analysis_l.jacobian(nullptr, zeros.data(), jac, true);
+    analysis_r.jacobian(nullptr, zeros.data(), jac, false);
+
+    if (rowp) delete rowp;
+    if (cols) delete cols;
+
+    return jac;
+  }
+
+  // See StaticElastic::factor_jacobian(), bc_dof includes the void dof
+  std::shared_ptr<Factor> factor_jacobian(const std::vector<int>& bc_dof,
+                                          const std::vector<T>& bc_vals,
+                                          std::vector<T>& rhs_bcs) {
+    SymBSRMat* jac_sym = nullptr;
+    BSRMat* jac_bsr = nullptr;
+    CSCMat* jac_csc = nullptr;
+    std::shared_ptr<Factor> chol;
+    if constexpr (is_simplicial_cholesky<Factor>::value) {
+      jac_sym = symmetric_jacobian();
+      rhs_bcs = lift_dirichlet_bcs(jac_sym, bc_dof, bc_vals, rhs);
+      jac_sym->zero_rows_and_columns(bc_dof.size(), bc_dof.data());
+      jac_csc = jac_sym->to_csc();
+      chol = std::make_shared<Factor>(jac_csc, true);
+    } else {
+      jac_bsr = jacobian();
+      jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
+      rhs_bcs = lift_dirichlet_bcs(jac_bsr, bc_dof, bc_vals, rhs);
+      jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
+      jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
+      chol = std::make_shared<Factor>(jac_csc);
+    }
+    chol->factor();
+
 #ifdef XCGD_DEBUG_MODE
     // Write Jacobian matrix to a file
     jac_csc->write_mtx("K_bcs.mtx");
+#endif
 
-    // Check error
-    // res = Ku - rhs
+    last_solve = {jac_sym ? memory_bytes(*jac_sym) : memory_bytes(*jac_bsr),
+                  memory_bytes(*jac_csc), factor_memory_bytes(*chol)};
+    if (jac_sym) delete jac_sym;
+    if (jac_bsr) delete jac_bsr;
+    if (jac_csc) delete jac_csc;
+
+    return chol;
+  }
+
+#ifdef XCGD_DEBUG_MODE
+  // Print ||Ku - f||, f = rhs holds the prescribed values at the bc dof
+  void print_residual(const std::vector<int>& bc_dof,
+                      const std::vector<T>& sol) {
+    BSRMat* jac_bsr = jacobian();
+    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
     std::vector<T> Ku(sol.size());
     jac_bsr->axpy(sol.data(), Ku.data());
     T err = 0.0;
@@ -467,27 +1163,66 @@ class StaticElasticErsatz final {
     }
     std::printf("[Debug] Linear elasticity residual:\n");
     std::printf("||Ku - f||_2: %25.15e\n", sqrt(err));
+    delete jac_bsr;
+  }
 #endif
 
-    if (jac_bsr) delete jac_bsr;
-    if (jac_csc) delete jac_csc;
+  void solve_recycled(const T* b, T* x, int slot, double rtol, int max_iter,
+                      bool verbose) {
+    const MultigridSolver<T>& mg = iterative_mg->get_solver();
+    int niter = recycler.solve([&mg](const T* r, T* z) { mg.apply(r, z); }, b,
+                               x, slot, rtol, max_iter, verbose);
+    if (niter < 0) {
+      char msg[256];
+      std::snprintf(msg, 256,
+                    "recycled CG did not converge in %d iterations", max_iter);
+      throw std::runtime_error(msg);
+    }
+  }
 
-    return sol;
+  // Append the void dof to the Dirichlet dof with zero prescribed values
+  std::pair<std::vector<int>, std::vector<T>> append_void_dof(
+      const std::vector<int>& bc_dof, const std::vector<T>& bc_vals) const {
+    std::pair<std::vector<int>, std::vector<T>> ret{bc_dof, bc_vals};
+    std::vector<int> void_dof = get_void_dof();
+    ret.first.insert(ret.first.end(), void_dof.begin(), void_dof.end());
+    ret.second.resize(ret.first.size(), T(0.0));
+    return ret;
   }
 
-  std::vector<T>& get_rhs() { return rhs; }
+  // Union of the dof verts of the cell from both meshes, sorted
+  int get_cell_dof_verts(int cell, int* verts) const {
+    const auto& cell_elems_l = mesh_l.get_cell_elems();
+    const auto& cell_elems_r = mesh_r.get_cell_elems();
 
-  Mesh& get_mesh() { return mesh_l; }
-  Mesh& get_mesh_ersatz() { return mesh_r; }
+    int nverts = 0;
+    int verts_work[max_nnodes_per_element];
 
-  Quadrature& get_quadrature() { return quadrature_l; }
-  Quadrature& get_quadrature_ersatz() { return quadrature_r; }
-  Basis& get_basis() { return basis_l; }
-  Basis& get_basis_ersatz() { return basis_r; }
-  Analysis& get_analysis() { return analysis_l; }
-  Analysis& get_analysis_ersatz() { return analysis_r; }
+    if (cell_elems_l.count(cell)) {
+      nverts += mesh_l.get_cell_dof_verts(cell, verts_work);
+    }
+
+    if (cell_elems_r.count(cell)) {
+      nverts += mesh_r.get_cell_dof_verts(cell, verts_work + nverts);
+    }
+
+    // Cells beyond the ersatz band only provide the diagonal entries of the
+    // void dof
+    if (nverts == 0) {
+      grid.get_cell_verts(cell, verts_work);
+      nverts = Grid::nverts_per_cell;
+    }
+
+    std::set<int> verts_set(verts_work, verts_work + nverts);
+
+    int i = 0;
+    for (auto it = verts_set.begin(); it != verts_set.end(); it++, i++) {
+      verts[i] = *it;
+    }
+
+    return verts_set.size();
+  }
 
- private:
   const Grid& grid;
   Mesh &mesh_l, mesh_r;
   Quadrature &quadrature_l, quadrature_r;
@@ -496,7 +1231,19 @@ class StaticElasticErsatz final {
   Physics physics_l, physics_r;
   Analysis analysis_l, analysis_r;
 
+  int ersatz_band;
+  std::vector<T> lsf_ersatz_sign;  // d(lsf_r)/d(lsf_l)
+
   std::vector<T> rhs;
+  DirichletDofMap dof_map;
+
+  // State of the iterative solves
+  KrylovRecycler<T> recycler;
+  std::unique_ptr<GroundMesh> grid_mesh;
+  std::unique_ptr<GDMultigrid<T, GroundMesh, Physics::dof_per_node>>
+      iterative_mg;
+
+  ElasticSolveMemory last_solve;
 };
 
 #endif  // XCGD_STATIC_ELASTIC_H
@@ -0,0 +1,395 @@
+#ifndef XCGD_STATIC_HYPERELASTIC_H
+#define XCGD_STATIC_HYPERELASTIC_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "analysis.h"
+#include "physics/neohookean.h"
+#include "sparse_utils/sparse_utils.h"
+#include "utils/krylov.h"
+#include "utils/misc.h"
+
+/**
+ * @brief Options of the Newton solver of StaticHyperelastic
+ */
+struct NewtonOptions {
+  double rtol = 1e-10;  // relative tolerance of the residual norm
+  double atol = 1e-14;  // absolute tolerance of the residual norm
+  int max_iter = 50;    // maximum number of Newton iterations per load step
+  int num_load_steps = 1;  // the bcs and loads are applied incrementally
+
+  // Backtracking line search on the total potential energy
+  int max_line_search = 20;
+  double armijo_c1 = 1e-4;
+  double backtrack_factor = 0.5;
+
+  // Modified Newton: the factorization of the Jacobian is reused until it is
+  // older than max_jacobian_age iterations, or a step reduces the residual by
+  // less than the reuse_contraction factor. max_jacobian_age = 1 is the full
+  // Newton method.
+  int max_jacobian_age = 1;
+  double reuse_contraction = 0.25;
+
+  // Inexact Newton-CG: the Newton step is solved by CG with exact
+  // Jacobian-vector products, preconditioned by the (possibly stale)
+  // factorization. The tolerance is min(cg_forcing, sqrt(|r| / |r0|)). The
+  // preconditioner is refactorized once CG needs more than cg_refactor_iter
+  // iterations, max_jacobian_age should be large in this mode.
+  bool newton_cg = false;
+  double cg_forcing = 0.1;
+  int cg_max_iter = 200;
+  int cg_refactor_iter = 20;
+
+  bool verbose = false;
+};
+
+/**
+ * @brief Statistics of the last StaticHyperelastic::solve() call
+ */
+struct NewtonReport {
+  bool converged = false;
+  int num_iterations = 0;      // summed over load steps
+  int num_factorizations = 0;  // number of Cholesky factorizations
+  int num_cg_iterations = 0;   // summed over Newton-CG steps
+  std::vector<double> residual_history;
+};
+
+/**
+ * @brief App for static problems of Neo-Hookean hyperelasticity
+ *
+ * The nonlinear equations are solved by a damped Newton method with a
+ * backtracking line search on the total potential energy. Jacobian
+ * factorizations can be reused across iterations (modified Newton) or used as
+ * the preconditioner of an inexact Newton-CG method.
+ */
+template <typename T, class Mesh, class Quadrature, class Basis>
+class StaticHyperelastic final {
+ public:
+  using Physics = NeohookeanPhysics<T, Basis::spatial_dim>;
+
+ private:
+  using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
+  using BSRMat = GalerkinBSRMat<T, Physics::dof_per_node>;
+  using CSCMat = SparseUtils::CSCMat<T>;
+  using Chol = SparseUtils::SparseCholesky<T>;
+
+ public:
+  StaticHyperelastic(T C1, T D1, Mesh& mesh, Quadrature& quadrature,
+                     Basis& basis)
+      : mesh(mesh),
+        quadrature(quadrature),
+        basis(basis),
+        physics(C1, D1),
+        analysis(mesh, quadrature, basis, physics) {}
+
+  ~StaticHyperelastic() { clear_factor(); }
+
+  StaticHyperelastic(const StaticHyperelastic&) = delete;
+  StaticHyperelastic& operator=(const StaticHyperelastic&) = delete;
+
+  // Compute Jacobian matrix at the given state without boundary conditions
+  BSRMat* jacobian(const T* dof) {
+    // Set up Jacobian matrix
+    int *rowp = nullptr, *cols = nullptr;
+    auto& mesh = this->mesh;
+    SparseUtils::CSRFromConnectivityFunctor(
+        mesh.get_num_nodes(), mesh.get_num_elements(),
+        mesh.max_nnodes_per_element,
+        [&mesh](int elem, int* nodes) -> int {
+          return mesh.get_elem_dof_nodes(elem, nodes);
+        },
+        &rowp, &cols);
+
+    int nnz = rowp[mesh.get_num_nodes()];
+    BSRMat* jac_bsr = new BSRMat(mesh.get_num_nodes(), nnz, rowp, cols);
+
+    analysis.jacobian(nullptr, dof, jac_bsr);
+
+    if (rowp) delete rowp;
+    if (cols) delete cols;
+
+    return jac_bsr;
+  }
+
+  std::vector<T> solve(const std::vector<int>& bc_dof,
+                       const std::vector<T>& bc_vals,
+                       const std::vector<T>& u0 = {}) {
+    return solve(bc_dof, bc_vals, std::tuple<>{}, u0);
+  }
+
+  /**
+   * @brief Solve the nonlinear static problem
+   *
+   * @param bc_dof Dirichlet dof
+   * @param bc_vals prescribed values of the Dirichlet dof
+   * @param load_analyses external loads, treated as dead loads, i.e. their
+   * Jacobians are not assembled
+   * @param u0 initial guess, zero if empty
+   * @return the displacement
+   */
+  template <class... LoadAnalyses>
+  std::vector<T> solve(const std::vector<int>& bc_dof,
+                       const std::vector<T>& bc_vals,
+                       const std::tuple<LoadAnalyses...>& load_analyses,
+                       const std::vector<T>& u0 = {}) {
+    int ndof = Physics::dof_per_node * mesh.get_num_nodes();
+    std::vector<T> u = u0.empty() ? std::vector<T>(ndof, T(0.0)) : u0;
+
+    report = NewtonReport{};
+    clear_factor();
+
+    int nsteps = std::max(options.num_load_steps, 1);
+    for (int step = 1; step <= nsteps; step++) {
+      T lambda = T(step) / T(nsteps);
+      if (options.verbose) {
+        std::printf("[newton] load step %d/%d, load factor: %.4f\n", step,
+                    nsteps, freal(lambda));
+      }
+
+      // Move the Dirichlet dof to the current load level, the Jacobian of the
+      // last load step remains a valid (stale) approximation
+      for (int i = 0; i < bc_dof.size(); i++) {
+        u[bc_dof[i]] = lambda * bc_vals[i];
+      }
+
+      report.converged = newton(bc_dof, lambda, load_analyses, u);
+      if (not report.converged) break;
+    }
+
+    clear_factor();
+    return u;
+  }
+
+  /**
+   * @brief Evaluate the residual with zeros at the Dirichlet dof
+   *
+   * @param lambda load factor
+   */
+  template <class... LoadAnalyses>
+  std::vector<T> residual(const std::vector<int>& bc_dof, T lambda,
+                          const std::tuple<LoadAnalyses...>& load_analyses,
+                          const std::vector<T>& u) const {
+    std::vector<T> res(u.size(), T(0.0)), res_load(u.size(), T(0.0));
+    analysis.residual(nullptr, u.data(), res.data());
+    std::apply(
+        [&](auto&&... load_analysis) {
+          (load_analysis.residual(nullptr, u.data(), res_load.data()), ...);
+        },
+        load_analyses);
+    for (int i = 0; i < res.size(); i++) res[i] += lambda * res_load[i];
+    for (int i : bc_dof) res[i] = 0.0;
+    return res;
+  }
+
+  // Total potential energy at load factor lambda
+  template <class... LoadAnalyses>
+  T potential_energy(T lambda, const std::tuple<LoadAnalyses...>& load_analyses,
+                     const std::vector<T>& u) const {
+    T load_energy = 0.0;
+    std::apply(
+        [&](auto&&... load_analysis) {
+          ((load_energy += load_analysis.energy(nullptr, u.data())), ...);
+        },
+        load_analyses);
+    return analysis.energy(nullptr, u.data()) + lambda * load_energy;
+  }
+
+  void set_options(const NewtonOptions& options_) { options = options_; }
+  NewtonOptions& get_options() { return options; }
+  const NewtonReport& get_report() const { return report; }
+
+  Mesh& get_mesh() { return mesh; }
+  Quadrature& get_quadrature() { return quadrature; }
+  Basis& get_basis() { return basis; }
+  Analysis& get_analysis() { return analysis; }
+
+ private:
+  static double norm(const std::vector<T>& v) {
+    double s = 0.0;
+    for (const T& vi : v) s += freal(vi * vi);
+    return sqrt(s);
+  }
+
+  static double dot(const std::vector<T>& u, const std::vector<T>& v) {
+    double s = 0.0;
+    for (int i = 0; i < u.size(); i++) s += freal(u[i] * v[i]);
+    return s;
+  }
+
+  // Assemble and factorize the Jacobian with the Dirichlet rows and columns
+  // replaced by the identity
+  void factor(const std::vector<int>& bc_dof, const std::vector<T>& u) {
+    clear_factor();
+    BSRMat* jac_bsr = jacobian(u.data());
+    jac_bsr->zero_rows(bc_dof.size(), bc_dof.data());
+    jac_csc = SparseUtils::bsr_to_csc(jac_bsr);
+    jac_csc->zero_columns(bc_dof.size(), bc_dof.data());
+    delete jac_bsr;
+
+    chol = std::make_shared<Chol>(jac_csc);
+    chol->factor();
+    jac_age = 0;
+    report.num_factorizations++;
+  }
+
+  void clear_factor() {
+    chol.reset();
+    if (jac_csc) delete jac_csc;
+    jac_csc = nullptr;
+  }
+
+  // Solve J du = -res by CG with Jacobian-vector products
+  int solve_cg(const std::vector<int>& bc_dof, const std::vector<T>& u,
+               const std::vector<T>& res, double rtol, std::vector<T>& du) {
+    int ndof = u.size();
+    std::vector<T> up(ndof);
+    auto matvec = [&](const T* p, T* Jp) {
+      up.assign(p, p + ndof);
+      for (int i : bc_dof) up[i] = 0.0;
+      std::fill(Jp, Jp + ndof, T(0.0));
+      analysis.jacobian_product(nullptr, u.data(), up.data(), Jp);
+      for (int i : bc_dof) Jp[i] = p[i];
+    };
+    auto precond = [&](const T* r, T* z) {
+      std::copy(r, r + ndof, z);
+      if (chol) chol->solve(z);
+    };
+
+    std::vector<T> b(ndof);
+    for (int i = 0; i < ndof; i++) b[i] = -res[i];
+    std::fill(du.begin(), du.end(), T(0.0));
+    int niter = pcg<T>(ndof, matvec, precond, b.data(), du.data(), rtol,
+                       options.cg_max_iter);
+    return niter;
+  }
+
+  /**
+   * @brief Newton iterations for a fixed load factor
+   *
+   * @return true if converged
+   */
+  template <class... LoadAnalyses>
+  bool newton(const std::vector<int>& bc_dof, T lambda,
+              const std::tuple<LoadAnalyses...>& load_analyses,
+              std::vector<T>& u) {
+    int ndof = u.size();
+    std::vector<T> res = residual(bc_dof, lambda, load_analyses, u);
+    std::vector<T> du(ndof), u_trial(ndof);
+
+    double rnorm0 = norm(res), rnorm = rnorm0;
+    bool force_refactor = false;
+
+    for (int iter = 0; iter <= options.max_iter; iter++) {
+      report.residual_history.push_back(rnorm);
+      if (options.verbose) {
+        std::printf("[newton] iter: %3d, |r|: %.10e, |r|/|r0|: %.10e\n", iter,
+                    rnorm, rnorm0 > 0.0 ? rnorm / rnorm0 : 0.0);
+      }
+      if (rnorm <= options.atol or rnorm <= options.rtol * rnorm0) return true;
+      if (iter == options.max_iter) break;
+      report.num_iterations++;
+
+      if (not chol or force_refactor or jac_age >= options.max_jacobian_age) {
+        factor(bc_dof, u);
+        force_refactor = false;
+      }
+      jac_age++;
+
+      // Compute the search direction
+      bool fresh = jac_age == 1;
+      bool descent = false;
+      for (int attempt = 0; attempt < 2 and not descent; attempt++) {
+        if (options.newton_cg) {
+          double rtol = std::min(options.cg_forcing, sqrt(rnorm / rnorm0));
+          int niter = solve_cg(bc_dof, u, res, rtol, du);
+          report.num_cg_iterations += niter < 0 ? options.cg_max_iter : niter;
+          if (niter < 0 or niter > options.cg_refactor_iter) {
+            force_refactor = true;
+          }
+        } else {
+          for (int i = 0; i < ndof; i++) du[i] = -res[i];
+          chol->solve(du.data());
+        }
+        for (int i : bc_dof) du[i] = 0.0;
+
+        // A stale Jacobian may not give a descent direction, refactorize once
+        descent = dot(du, res) < 0.0;
+        if (not descent and not fresh) {
+          factor(bc_dof, u);
+          jac_age = 1;
+          fresh = true;
+        } else {
+          break;
+        }
+      }
+
+      // Fall back to the steepest descent direction if the Jacobian is not
+      // positive definite at u
+      if (not descent) {
+        for (int i = 0; i < ndof; i++) du[i] = -res[i];
+        for (int i : bc_dof) du[i] = 0.0;
+      }
+
+      // Backtracking line search with the Armijo condition
+      T energy = potential_energy(lambda, load_analyses, u);
+      double slope = dot(du, res);
+      double alpha = 1.0;
+      bool accepted = false;
+      for (int ls = 0; ls < options.max_line_search; ls++) {
+        for (int i = 0; i < ndof; i++) u_trial[i] = u[i] + alpha * du[i];
+        T energy_trial = potential_energy(lambda, load_analyses, u_trial);
+        if (std::isfinite(freal(energy_trial)) and
+            freal(energy_trial) <=
+                freal(energy) + options.armijo_c1 * alpha * slope) {
+          accepted = true;
+          break;
+        }
+        alpha *= options.backtrack_factor;
+      }
+      if (not accepted) {
+        if (options.verbose) {
+          std::printf("[newton] line search failed at iteration %d\n", iter);
+        }
+        return false;
+      }
+      if (options.verbose and alpha < 1.0) {
+        std::printf("[newton] step length: %.4e\n", alpha);
+      }
+
+      u.swap(u_trial);
+      res = residual(bc_dof, lambda, load_analyses, u);
+      double rnorm_new = norm(res);
+
+      // The stale factorization is no longer contracting fast enough
+      if (not options.newton_cg and
+          rnorm_new > options.reuse_contraction * rnorm) {
+        force_refactor = true;
+      }
+      rnorm = rnorm_new;
+    }
+
+    return false;
+  }
+
+  Mesh& mesh;
+  Quadrature& quadrature;
+  Basis& basis;
+
+  Physics physics;
+  Analysis analysis;
+
+  NewtonOptions options;
+  NewtonReport report;
+
+  // The current (possibly stale) factorization of the Jacobian
+  CSCMat* jac_csc = nullptr;
+  std::shared_ptr<Chol> chol;
+  int jac_age = 0;
+};
+
+#endif  // XCGD_STATIC_HYPERELASTIC_H
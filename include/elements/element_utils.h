@@ -533,6 +533,83 @@ void add_matrix(
   }
 }
 
+/**
+ * @brief Assemble only the nodal diagonal blocks of the Hessian d^2e/du^2,
+ * see add_matrix()
+ *
+ * @tparam diag_only if true, only the diagonal entries of each block are
+ * computed, the off-diagonal entries are left untouched
+ * @param elem_blocks dim x dim blocks stored row by row for each node, size
+ * of max_nnodes_per_element * dim * dim
+ */
+template <typename T, class Basis, int dim, bool diag_only = false>
+void add_matrix_block_diagonal(
+    const T N[], const T Nxi[], const A2D::Mat<T, dim, dim> &coef_vals,
+    const A2D::Mat<T, dim, Basis::spatial_dim * dim> &coef_mixed,
+    const A2D::Mat<T, dim * Basis::spatial_dim, dim * Basis::spatial_dim>
+        &coef_hess,
+    T elem_blocks[]) {
+  static constexpr int spatial_dim = Basis::spatial_dim;
+  static constexpr int max_nnodes_per_element = Basis::max_nnodes_per_element;
+
+  for (int i = 0; i < max_nnodes_per_element; i++) {
+    T ni = N[i];
+    const T *nxi = &Nxi[spatial_dim * i];
+
+    for (int ii = 0; ii < dim; ii++) {
+      for (int jj = 0; jj < dim; jj++) {
+        if (diag_only and ii != jj) continue;
+
+        T val = 0.0;
+        for (int kk = 0; kk < spatial_dim; kk++) {
+          for (int ll = 0; ll < spatial_dim; ll++) {
+            val += coef_hess(spatial_dim * ii + kk, spatial_dim * jj + ll) *
+                   nxi[kk] * nxi[ll];
+          }
+        }
+
+        for (int ll = 0; ll < spatial_dim; ll++) {
+          val += (coef_mixed(ii, spatial_dim * jj + ll) +
+                  coef_mixed(jj, spatial_dim * ii + ll)) *
+                 ni * nxi[ll];
+        }
+
+        elem_blocks[dim * dim * i + dim * ii + jj] +=
+            val + coef_vals(ii, jj) * ni * ni;
+      }
+    }
+  }
+}
+
+// dim == 1
+template <typename T, class Basis, int dim = 1, bool diag_only = false>
+void add_matrix_block_diagonal(
+    const T N[], const T Nxi[], const T &coef_val,
+    const A2D::Vec<T, Basis::spatial_dim> &coef_mixed,
+    const A2D::Mat<T, Basis::spatial_dim, Basis::spatial_dim> &coef_hess,
+    T elem_blocks[]) {
+  static constexpr int spatial_dim = Basis::spatial_dim;
+  static constexpr int max_nnodes_per_element = Basis::max_nnodes_per_element;
+
+  for (int i = 0; i < max_nnodes_per_element; i++) {
+    T ni = N[i];
+    const T *nxi = &Nxi[spatial_dim * i];
+
+    T val = 0.0;
+    for (int kk = 0; kk < spatial_dim; kk++) {
+      for (int ll = 0; ll < spatial_dim; ll++) {
+        val += coef_hess(kk, ll) * nxi[kk] * nxi[ll];
+      }
+    }
+
+    for (int ll = 0; ll < spatial_dim; ll++) {
+      val += 2.0 * coef_mixed(ll) * ni * nxi[ll];
+    }
+
+    elem_blocks[i] += val + coef_val * ni * ni;
+  }
+}
+
 /**
  * @brief Compute ∂|J|q/∂ξq: the derivatives of the Jacobian determinant w.r.t.
  * reference coordinates ξ at a quadrature point
@@ -5,6 +5,8 @@
 #include <array>
 #include <limits>
 #include <map>
+#include <numeric>
+#include <queue>
 #include <set>
 #include <vector>
 
@@ -12,6 +14,7 @@
 #include "quadrature_general.hpp"
 #include "utils/exceptions.h"
 #include "utils/loggers.h"
+#include "utils/memory.h"
 #include "utils/misc.h"
 
 /**
@@ -308,6 +311,12 @@ class GridMesh : public GDMeshBase<T, Np_1d, Grid_> {
   // Caution: this is a dummy function that does not return meaningful value
   inline int get_elem_dir(int elem) const { return 0; }
 
+  MemoryReport memory_report() const {
+    MemoryReport report;
+    report.add("regular_stencil_elems", memory_bytes(regular_stencil_elems));
+    return report;
+  }
+
  private:
   int num_nodes = -1;
   int num_elements = -1;
@@ -317,6 +326,46 @@ class GridMesh : public GDMeshBase<T, Np_1d, Grid_> {
   std::set<int> regular_stencil_elems;
 };
 
+/**
+ * @brief Numbering of the elements and nodes of a CutMesh
+ *
+ * NATURAL: row-major cell/vertex order of the ground grid, as discovered
+ * MORTON: along the Morton (Z-order) curve over the grid index coordinates
+ * HILBERT: along the Hilbert curve over the grid index coordinates
+ * RCM: nodes by reverse Cuthill-McKee on the stencil graph, elements by their
+ *      smallest node index
+ */
+enum class MeshOrdering { NATURAL, MORTON, HILBERT, RCM };
+
+// Interleave the bits of the index coordinates (ix, iy)
+inline long long morton_key(int ix, int iy) {
+  long long key = 0;
+  for (int b = 0; b < 31; b++) {
+    key |= (long long)((ix >> b) & 1) << (2 * b);
+    key |= (long long)((iy >> b) & 1) << (2 * b + 1);
+  }
+  return key;
+}
+
+// Distance along the Hilbert curve that fills the n-by-n grid, n is a power of
+// 2 and 0 <= ix, iy < n
+inline long long hilbert_key(int n, int ix, int iy) {
+  long long key = 0;
+  for (int s = n / 2; s > 0; s /= 2) {
+    int rx = (ix & s) > 0;
+    int ry = (iy & s) > 0;
+    key += (long long)s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        ix = n - 1 - ix;
+        iy = n - 1 - iy;
+      }
+      std::swap(ix, iy);
+    }
+  }
+  return key;
+}
+
 /**
  * @brief The Galerkin difference mesh defined on a structured
  * grid with cuts defined by a level set function
@@ -350,8 +399,12 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
    * Note: Within the analysis domain, lsf <= 0
    */
   template <class Func>
-  CutMesh(const Grid& grid, const Func& lsf)
-      : MeshBase(grid), lsf_mesh(grid), lsf_dof(lsf_mesh.get_num_nodes()) {
+  CutMesh(const Grid& grid, const Func& lsf,
+          MeshOrdering ordering = MeshOrdering::NATURAL)
+      : MeshBase(grid),
+        lsf_mesh(grid),
+        lsf_dof(lsf_mesh.get_num_nodes()),
+        ordering(ordering) {
     for (int i = 0; i < lsf_dof.size(); i++) {
       T xloc[spatial_dim];
       lsf_mesh.get_node_xloc(i, xloc);
@@ -360,10 +413,11 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
     update_mesh();
   }
 
-  CutMesh(const Grid& grid)
+  CutMesh(const Grid& grid, MeshOrdering ordering = MeshOrdering::NATURAL)
       : MeshBase(grid),
         lsf_mesh(grid),
-        lsf_dof(lsf_mesh.get_num_nodes(), -1.0) {
+        lsf_dof(lsf_mesh.get_num_nodes(), -1.0),
+        ordering(ordering) {
     update_mesh();
   }
 
@@ -491,6 +545,56 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
   inline void update_mesh() {
     // update_mesh_spiral();
     update_mesh_push();
+    update_mesh_ordering();
+  }
+
+  // Change the numbering of elements and nodes, this updates the mesh
+  void set_ordering(MeshOrdering ordering_) {
+    ordering = ordering_;
+    update_mesh();
+  }
+  inline MeshOrdering get_ordering() const { return ordering; }
+
+  /**
+   * @brief Permutations between the current numbering and the natural
+   * (row-major) numbering of the same mesh
+   *
+   * perm[i] is the natural index of the i-th node/element, iperm is the
+   * inverse, i.e. iperm[perm[i]] = i
+   */
+  inline const std::vector<int>& get_node_perm() const { return node_perm; }
+  inline const std::vector<int>& get_node_iperm() const { return node_iperm; }
+  inline const std::vector<int>& get_elem_perm() const { return elem_perm; }
+  inline const std::vector<int>& get_elem_iperm() const { return elem_iperm; }
+
+  /**
+   * @brief Map a nodal vector from the current numbering to the natural
+   * numbering
+   *
+   * @param vals nodal values, length of get_num_nodes() * dim
+   * @param dim number of values per node
+   */
+  template <typename T2>
+  std::vector<T2> to_natural_node_order(const T2* vals, int dim = 1) const {
+    std::vector<T2> out(num_nodes * dim);
+    for (int i = 0; i < num_nodes; i++) {
+      for (int d = 0; d < dim; d++) {
+        out[dim * node_perm[i] + d] = vals[dim * i + d];
+      }
+    }
+    return out;
+  }
+
+  // Inverse of to_natural_node_order()
+  template <typename T2>
+  std::vector<T2> from_natural_node_order(const T2* vals, int dim = 1) const {
+    std::vector<T2> out(num_nodes * dim);
+    for (int i = 0; i < num_nodes; i++) {
+      for (int d = 0; d < dim; d++) {
+        out[dim * i + d] = vals[dim * node_perm[i] + d];
+      }
+    }
+    return out;
   }
 
   inline const Map<int, int>& get_vert_nodes() const { return vert_nodes; }
@@ -511,6 +615,26 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
     return cell_dirs[elem_cells[elem]];
   }
 
+  // Bytes of the topology of the cut mesh, which is rebuilt by update_mesh()
+  MemoryReport memory_report() const {
+    MemoryReport report;
+    report.merge("lsf_mesh", lsf_mesh.memory_report());
+    report.add("lsf_dof", memory_bytes(lsf_dof));
+    report.add("elem_nodes", memory_bytes(elem_nodes));
+    report.add("node_verts", memory_bytes(node_verts));
+    report.add("vert_nodes", memory_bytes(vert_nodes));
+    report.add("elem_cells", memory_bytes(elem_cells));
+    report.add("cell_elems", memory_bytes(cell_elems));
+    report.add("cell_dirs", memory_bytes(cell_dirs));
+    report.add("cut_elems", memory_bytes(cut_elems));
+    report.add("regular_stencil_elems", memory_bytes(regular_stencil_elems));
+    report.add("permutations", memory_bytes(node_perm) +
+                                   memory_bytes(node_iperm) +
+                                   memory_bytes(elem_perm) +
+                                   memory_bytes(elem_iperm));
+    return report;
+  }
+
  private:
   // Update the mesh when the lsf_dof is updated
   void update_mesh_init() {
@@ -749,6 +873,196 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
     }
   }
 
+  /**
+   * @brief Renumber the elements and nodes according to the ordering, this is
+   * called after the natural numbering and the element->node mapping are built
+   */
+  void update_mesh_ordering() {
+    // new index -> natural index
+    node_perm.resize(num_nodes);
+    elem_perm.resize(num_elements);
+    std::iota(node_perm.begin(), node_perm.end(), 0);
+    std::iota(elem_perm.begin(), elem_perm.end(), 0);
+
+    if (ordering == MeshOrdering::MORTON or
+        ordering == MeshOrdering::HILBERT) {
+      const int* nxy = this->grid.get_nxy();
+      int n = 1;
+      while (n < nxy[0] + 1 or n < nxy[1] + 1) n *= 2;
+      auto key = [this, n](const int* ixy) {
+        return ordering == MeshOrdering::MORTON
+                   ? morton_key(ixy[0], ixy[1])
+                   : hilbert_key(n, ixy[0], ixy[1]);
+      };
+
+      std::vector<long long> node_keys(num_nodes), elem_keys(num_elements);
+      for (int i = 0; i < num_nodes; i++) {
+        int ixy[2] = {-1, -1};
+        this->grid.get_vert_coords(node_verts.at(i), ixy);
+        node_keys[i] = key(ixy);
+      }
+      for (int i = 0; i < num_elements; i++) {
+        int exy[2] = {-1, -1};
+        this->grid.get_cell_coords(elem_cells[i], exy);
+        elem_keys[i] = key(exy);
+      }
+      std::stable_sort(
+          node_perm.begin(), node_perm.end(),
+          [&node_keys](int a, int b) { return node_keys[a] < node_keys[b]; });
+      std::stable_sort(
+          elem_perm.begin(), elem_perm.end(),
+          [&elem_keys](int a, int b) { return elem_keys[a] < elem_keys[b]; });
+    } else if (ordering == MeshOrdering::RCM) {
+      node_perm = reverse_cuthill_mckee();
+
+      std::vector<int> rank(num_nodes);
+      for (int i = 0; i < num_nodes; i++) rank[node_perm[i]] = i;
+      std::vector<int> elem_keys(num_elements, num_nodes);
+      for (int e = 0; e < num_elements; e++) {
+        for (int node : elem_nodes.at(e)) {
+          elem_keys[e] = std::min(elem_keys[e], rank[node]);
+        }
+      }
+      std::stable_sort(
+          elem_perm.begin(), elem_perm.end(),
+          [&elem_keys](int a, int b) { return elem_keys[a] < elem_keys[b]; });
+    }
+
+    node_iperm.resize(num_nodes);
+    elem_iperm.resize(num_elements);
+    for (int i = 0; i < num_nodes; i++) node_iperm[node_perm[i]] = i;
+    for (int i = 0; i < num_elements; i++) elem_iperm[elem_perm[i]] = i;
+
+    if (ordering == MeshOrdering::NATURAL) return;
+
+    // Apply the permutations
+    Map<int, int> node_verts_new, vert_nodes_new;
+    for (int i = 0; i < num_nodes; i++) {
+      int vert = node_verts.at(node_perm[i]);
+      node_verts_new[i] = vert;
+      vert_nodes_new[vert] = i;
+    }
+    node_verts = std::move(node_verts_new);
+    vert_nodes = std::move(vert_nodes_new);
+
+    Map<int, std::vector<int>> elem_nodes_new;
+    std::vector<int> elem_cells_new(num_elements);
+    for (int i = 0; i < num_elements; i++) {
+      std::vector<int> nodes = elem_nodes.at(elem_perm[i]);
+      for (int& node : nodes) node = node_iperm[node];
+      elem_nodes_new[i] = std::move(nodes);
+      elem_cells_new[i] = elem_cells[elem_perm[i]];
+      cell_elems[elem_cells_new[i]] = i;
+    }
+    elem_nodes = std::move(elem_nodes_new);
+    elem_cells = std::move(elem_cells_new);
+
+    std::set<int> cut_elems_new, regular_stencil_elems_new;
+    for (int e : cut_elems) cut_elems_new.insert(elem_iperm[e]);
+    for (int e : regular_stencil_elems) {
+      regular_stencil_elems_new.insert(elem_iperm[e]);
+    }
+    cut_elems = std::move(cut_elems_new);
+    regular_stencil_elems = std::move(regular_stencil_elems_new);
+  }
+
+  /**
+   * @brief Reverse Cuthill-McKee ordering of the nodes, two nodes are adjacent
+   * if they appear in the stencil of a same element
+   *
+   * @return new index -> natural index
+   */
+  std::vector<int> reverse_cuthill_mckee() const {
+    std::vector<std::vector<int>> adj(num_nodes);
+    for (int e = 0; e < num_elements; e++) {
+      const std::vector<int>& nodes = elem_nodes.at(e);
+      for (int a : nodes) {
+        adj[a].insert(adj[a].end(), nodes.begin(), nodes.end());
+      }
+    }
+    for (int i = 0; i < num_nodes; i++) {
+      std::sort(adj[i].begin(), adj[i].end());
+      adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+    }
+
+    // Breadth-first level structure rooted at r, returns the number of levels
+    // and the lowest-degree node in the last level
+    std::vector<int> level(num_nodes, -1);
+    auto bfs_levels = [&](int r, std::vector<int>& comp) {
+      comp.clear();
+      comp.push_back(r);
+      level[r] = 0;
+      int last = r;
+      for (int k = 0; k < (int)comp.size(); k++) {
+        int v = comp[k];
+        for (int w : adj[v]) {
+          if (level[w] < 0) {
+            level[w] = level[v] + 1;
+            comp.push_back(w);
+          }
+        }
+      }
+      int depth = level[comp.back()];
+      for (int v : comp) {
+        if (level[v] == depth and adj[v].size() < adj[last].size()) last = v;
+        if (level[last] != depth) last = v;
+      }
+      for (int v : comp) level[v] = -1;
+      return std::make_pair(depth, last);
+    };
+
+    std::vector<int> order;
+    order.reserve(num_nodes);
+    std::vector<bool> visited(num_nodes, false);
+
+    // Candidate starting nodes, one per connected component, lowest degree
+    // first
+    std::vector<int> starts(num_nodes);
+    std::iota(starts.begin(), starts.end(), 0);
+    std::stable_sort(starts.begin(), starts.end(), [&adj](int a, int b) {
+      return adj[a].size() < adj[b].size();
+    });
+
+    std::vector<int> comp;
+    for (int s : starts) {
+      if (visited[s]) continue;
+
+      // Find a pseudo-peripheral node of this component (George-Liu)
+      auto [depth, far] = bfs_levels(s, comp);
+      while (true) {
+        auto [depth_far, far_next] = bfs_levels(far, comp);
+        if (depth_far <= depth) break;
+        s = far;
+        depth = depth_far;
+        far = far_next;
+      }
+
+      std::queue<int> q;
+      q.push(s);
+      visited[s] = true;
+      while (!q.empty()) {
+        int v = q.front();
+        q.pop();
+        order.push_back(v);
+
+        std::vector<int> nbrs;
+        for (int w : adj[v]) {
+          if (!visited[w]) {
+            visited[w] = true;
+            nbrs.push_back(w);
+          }
+        }
+        std::stable_sort(nbrs.begin(), nbrs.end(), [&adj](int a, int b) {
+          return adj[a].size() < adj[b].size();
+        });
+        for (int w : nbrs) q.push(w);
+      }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+
   // Given the lsf dof, interpolate the gradient of the lsf at the centroid
   // a cell using bilinear quad element
   std::array<T, spatial_dim> interp_lsf_grad(int cell) {
@@ -912,6 +1226,12 @@ class CutMesh final : public GDMeshBase<T, Np_1d, Grid_> {
   // Whether the element has the regular stencil
   // elements far from the boundaries usually have regular stencils
   std::set<int> regular_stencil_elems;
+
+  // Numbering of elements and nodes, and the permutations to the natural
+  // numbering
+  MeshOrdering ordering = MeshOrdering::NATURAL;
+  std::vector<int> node_perm, node_iperm;  // new -> natural, natural -> new
+  std::vector<int> elem_perm, elem_iperm;  // new -> natural, natural -> new
 };
 
 /**
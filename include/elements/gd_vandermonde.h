@@ -8,8 +8,11 @@
 #include <functional>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "dual.hpp"
@@ -17,7 +20,9 @@
 #include "element_utils.h"
 #include "gaussquad.hpp"
 #include "gd_mesh.h"
+#include "quadrature_compression.h"
 #include "quadrature_multipoly.hpp"
+#include "utils/dense_lu.h"
 #include "utils/linalg.h"
 #include "utils/loggers.h"
 #include "utils/misc.h"
@@ -137,6 +142,7 @@ class VandermondeEvaluator {
   static constexpr int spatial_dim = Mesh::spatial_dim;
   static constexpr int Np_1d = Mesh::Np_1d;
   static constexpr int p = Np_1d - 1;
+  static constexpr int max_nnodes_per_element = Mesh::max_nnodes_per_element;
 
  public:
   /**
@@ -154,7 +160,7 @@ class VandermondeEvaluator {
       construct_permutation(nodes, perm, _);
     }
 
-    Ck.resize(nnodes * nnodes);
+    std::array<T, max_nnodes_per_element * max_nnodes_per_element> V;
 
     std::vector<std::pair<int, int>> verts(nnodes, {-1, -1});
     for (int i = 0; i < verts.size(); i++) {
@@ -197,15 +203,18 @@ class VandermondeEvaluator {
 
       for (int col = 0; col < nnodes; col++) {
         auto indices = pterms[col];
-        Ck[i + nnodes * col] = xpows[indices.first] * ypows[indices.second];
+        V[i + nnodes * col] = xpows[indices.first] * ypows[indices.second];
       }
     }
 
-    double cond;
-    direct_inverse(nnodes, Ck.data(), &cond, '1');
-    cond = 1.0 / cond;
+    // We never form C = inv(V) explicitly, instead, we keep the factorization
+    // and solve V^T N = v for the basis values at each evaluation point
+    lu.factor(nnodes, V.data());
 
-    VandermondeCondLogger::add(elem, cond);
+    // The condition number estimate is only needed for diagnostics
+    if (VandermondeCondLogger::is_active()) {
+      VandermondeCondLogger::add(elem, 1.0 / lu.rcond());
+    }
   }
 
   /**
@@ -221,8 +230,6 @@ class VandermondeEvaluator {
   template <typename T2>
   void operator()(int elem, const T2* pt, T2* N, T2* Nxi,
                   T2* Nxixi = (T2*)nullptr) const {
-    static constexpr int max_nnodes_per_element = Mesh::max_nnodes_per_element;
-
     std::vector<int> _, iperm;
     if (reorder_nodes) {
       int nodes[Np_1d * Np_1d];
@@ -240,8 +247,7 @@ class VandermondeEvaluator {
       construct_permutation(nodes, _, iperm);
     }
 
-    std::vector<T2> xpows(Np_1d), ypows(Np_1d), dxpows(Np_1d), dypows(Np_1d),
-        dx2pows(Np_1d), dy2pows(Np_1d);
+    std::array<T2, Np_1d> xpows, ypows, dxpows, dypows, dx2pows, dy2pows;
 
     T2 xi = pt[0] * xi_h[0] + xi_min[0];
     T2 eta = pt[1] * xi_h[1] + xi_min[1];
@@ -270,29 +276,60 @@ class VandermondeEvaluator {
                 T2(0.0));
     }
 
+    // Right hand sides v, ∂v/∂ξ, ∂v/∂η, ∂2v/∂ξ2, ∂2v/∂ξ∂η, ∂2v/∂η2
+    constexpr int max_rhs = 6;
+    int nrhs = 0;
+    int rhs_n = -1, rhs_nxi = -1, rhs_nxixi = -1;
+    if (N) {
+      rhs_n = nrhs;
+      nrhs += 1;
+    }
+    if (Nxi) {
+      rhs_nxi = nrhs;
+      nrhs += spatial_dim;
+    }
+    if (Nxixi) {
+      rhs_nxixi = nrhs;
+      nrhs += 3;
+    }
+
+    std::array<T2, max_rhs * max_nnodes_per_element> rhs;
+    for (int row = 0; row < nnodes; row++) {
+      auto [j, k] = pterms[row];
+      if (N) {
+        rhs[rhs_n * nnodes + row] = xpows[j] * ypows[k];
+      }
+      if (Nxi) {
+        rhs[rhs_nxi * nnodes + row] = dxpows[j] * ypows[k];
+        rhs[(rhs_nxi + 1) * nnodes + row] = xpows[j] * dypows[k];
+      }
+      if (Nxixi) {
+        rhs[rhs_nxixi * nnodes + row] = dx2pows[j] * ypows[k];
+        rhs[(rhs_nxixi + 1) * nnodes + row] = dxpows[j] * dypows[k];
+        rhs[(rhs_nxixi + 2) * nnodes + row] = xpows[j] * dy2pows[k];
+      }
+    }
+
+    // N = C^T v = V^{-T} v, all right hand sides in one sweep of the factors
+    lu.solve_transpose(nrhs, rhs.data());
+
     for (int i = 0; i < nnodes; i++) {
-      for (int row = 0; row < nnodes; row++) {
-        auto [j, k] = pterms[row];
-        int index = iperm.size() ? row + nnodes * iperm[i] : row + nnodes * i;
-        if (N) {
-          // N = C^T v
-          // Ni = C[j, i] v[j]
-          N[i] += Ck[index] * xpows[j] * ypows[k];  // (row, i) entry
-        }
-        if (Nxi) {
-          Nxi[spatial_dim * i] += Ck[index] * dxpows[j] * ypows[k];
-          Nxi[spatial_dim * i + 1] += Ck[index] * xpows[j] * dypows[k];
-        }
-        if (Nxixi) {
-          Nxixi[spatial_dim * spatial_dim * i] +=
-              Ck[index] * dx2pows[j] * ypows[k];
-          Nxixi[spatial_dim * spatial_dim * i + 1] +=
-              Ck[index] * dxpows[j] * dypows[k];
-          Nxixi[spatial_dim * spatial_dim * i + 2] +=
-              Ck[index] * dxpows[j] * dypows[k];
-          Nxixi[spatial_dim * spatial_dim * i + 3] +=
-              Ck[index] * xpows[j] * dy2pows[k];
-        }
+      int c = iperm.size() ? iperm[i] : i;
+      if (N) {
+        N[i] = rhs[rhs_n * nnodes + c];
+      }
+      if (Nxi) {
+        Nxi[spatial_dim * i] = rhs[rhs_nxi * nnodes + c];
+        Nxi[spatial_dim * i + 1] = rhs[(rhs_nxi + 1) * nnodes + c];
+      }
+      if (Nxixi) {
+        Nxixi[spatial_dim * spatial_dim * i] = rhs[rhs_nxixi * nnodes + c];
+        Nxixi[spatial_dim * spatial_dim * i + 1] =
+            rhs[(rhs_nxixi + 1) * nnodes + c];
+        Nxixi[spatial_dim * spatial_dim * i + 2] =
+            rhs[(rhs_nxixi + 1) * nnodes + c];
+        Nxixi[spatial_dim * spatial_dim * i + 3] =
+            rhs[(rhs_nxixi + 2) * nnodes + c];
       }
     }
   }
@@ -331,7 +368,7 @@ class VandermondeEvaluator {
   const Mesh& mesh;
 
   int nnodes;
-  std::vector<T> Ck;
+  DenseLU<T, max_nnodes_per_element> lu;  // LU factors of the Vandermonde V
   std::vector<std::pair<int, int>> pterms;
   T xi_min[spatial_dim], xi_h[spatial_dim];
 
@@ -445,9 +482,27 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
   constexpr static int spatial_dim = Basis::spatial_dim;
   constexpr static int max_nnodes_per_element = Basis::max_nnodes_per_element;
 
+  // Products of two GD basis functions are in Q_{2p}, compressed rules
+  // integrate this space exactly so bilinear forms are unaffected
+  constexpr static int compress_degree = 2 * (Np_1d - 1);
+
  public:
-  GDLSFQuadrature2D(const CutMesh_& mesh)
-      : mesh(mesh), lsf_mesh(mesh.get_lsf_mesh()) {}
+  /**
+   * @param mesh the cut mesh
+   * @param compress if true, the algoim rule of each cut element is compressed
+   * to at most (2 * Np_1d - 1)^2 points with positive weights that preserve
+   * the moments of Q_{2p}, see quadrature_compression.h. Compressed rules are
+   * cached and reused as long as the element LSF dof don't change. Only
+   * supported for the INNER quadrature.
+   */
+  GDLSFQuadrature2D(const CutMesh_& mesh, bool compress = false)
+      : mesh(mesh), lsf_mesh(mesh.get_lsf_mesh()), compress(compress) {
+    if (compress and quad_type != QuadPtType::INNER) {
+      throw NotImplemented(
+          "quadrature compression is only implemented for the INNER "
+          "quadrature");
+    }
+  }
 
   /**
    * @brief Get the quadrature points and weights
@@ -465,10 +520,6 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
     // this is the element index in lsf mesh
     int cell = mesh.get_elem_cell(elem);
 
-    // Create the functor that evaluates the interpolation given an arbitrary
-    // point within the computational coordinates
-    VandermondeEvaluator<T, GridMesh_> eval(lsf_mesh, cell);
-
     // Get element LSF dofs
     const std::vector<T>& lsf_dof = mesh.get_lsf_dof();
     T element_lsf[max_nnodes_per_element];
@@ -476,9 +527,44 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
     get_element_vars<T, lsf_dim, GridMesh_, Basis>(lsf_mesh, cell,
                                                    lsf_dof.data(), element_lsf);
 
+    if (get_precomputed(elem, cell, element_lsf, false, pts, wts, ns)) {
+      return wts.size();
+    }
+
+    if (compress and mesh.is_cut_elem(elem)) {
+      if (get_cached_rule(elem, element_lsf, false, pts, wts)) {
+        ns.clear();
+        return wts.size();
+      }
+    }
+
+    // Create the functor that evaluates the interpolation given an arbitrary
+    // point within the computational coordinates
+    VandermondeEvaluator<T, GridMesh_> eval(lsf_mesh, cell);
+
     // Get quadrature points and weights
     getQuadrature(element_lsf, eval, pts, wts, ns);
 
+    if (compress and mesh.is_cut_elem(elem)) {
+      std::vector<T> new_wts;
+      std::vector<int> selected =
+          compress_quadrature(compress_degree, pts, wts, new_wts);
+
+      CompressedRule rule;
+      rule.element_lsf.assign(element_lsf,
+                              element_lsf + max_nnodes_per_element);
+      rule.pts.resize(spatial_dim * selected.size());
+      for (int j = 0; j < selected.size(); j++) {
+        for (int d = 0; d < spatial_dim; d++) {
+          rule.pts[spatial_dim * j + d] = pts[spatial_dim * selected[j] + d];
+        }
+      }
+      rule.wts = new_wts;
+      pts = rule.pts;
+      wts = rule.wts;
+      set_cached_rule(elem, std::move(rule));
+    }
+
     return wts.size();
   }
 
@@ -503,10 +589,6 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
     // this is the element index in lsf mesh
     int cell = mesh.get_elem_cell(elem);
 
-    // Create the functor that evaluates the interpolation given an arbitrary
-    // point within the computational coordinates
-    VandermondeEvaluator<T, GridMesh_> eval(lsf_mesh, cell);
-
     // Get element LSF dofs
     const std::vector<T>& lsf_dof = mesh.get_lsf_dof();
     T element_lsf[max_nnodes_per_element];
@@ -514,6 +596,23 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
     get_element_vars<T, lsf_dim, GridMesh_, Basis>(lsf_mesh, cell,
                                                    lsf_dof.data(), element_lsf);
 
+    if (get_precomputed(elem, cell, element_lsf, true, pts, wts, ns, &pts_grad,
+                        &wts_grad)) {
+      return wts.size();
+    }
+
+    if (compress and mesh.is_cut_elem(elem)) {
+      if (get_cached_rule(elem, element_lsf, true, pts, wts, &pts_grad,
+                          &wts_grad)) {
+        ns.clear();
+        return wts.size();
+      }
+    }
+
+    // Create the functor that evaluates the interpolation given an arbitrary
+    // point within the computational coordinates
+    VandermondeEvaluator<T, GridMesh_> eval(lsf_mesh, cell);
+
     // Get quadrature points and weights
     getQuadrature(element_lsf, eval, pts, wts, ns);
 
@@ -559,10 +658,224 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
       }
     }
 
+    if (compress and mesh.is_cut_elem(elem)) {
+      std::vector<T> new_wts, new_wts_grad;
+      std::vector<int> selected =
+          compress_quadrature(compress_degree, pts, wts, new_wts);
+      compress_quadrature_grad(compress_degree, max_nnodes_per_element, pts,
+                               wts, pts_grad, wts_grad, selected, new_wts,
+                               new_wts_grad);
+
+      CompressedRule rule;
+      rule.element_lsf.assign(element_lsf,
+                              element_lsf + max_nnodes_per_element);
+      rule.has_grad = true;
+      int nsel = selected.size();
+      rule.pts.resize(spatial_dim * nsel);
+      rule.pts_grad.resize(spatial_dim * max_nnodes_per_element * nsel);
+      for (int j = 0; j < nsel; j++) {
+        int q = selected[j];
+        for (int d = 0; d < spatial_dim; d++) {
+          rule.pts[spatial_dim * j + d] = pts[spatial_dim * q + d];
+        }
+        for (int i = 0; i < max_nnodes_per_element; i++) {
+          for (int d = 0; d < spatial_dim; d++) {
+            rule.pts_grad[(j * max_nnodes_per_element + i) * spatial_dim + d] =
+                pts_grad[(q * max_nnodes_per_element + i) * spatial_dim + d];
+          }
+        }
+      }
+      rule.wts = new_wts;
+      rule.wts_grad = new_wts_grad;
+
+      pts = rule.pts;
+      wts = rule.wts;
+      pts_grad = rule.pts_grad;
+      wts_grad = rule.wts_grad;
+      num_quad_pts = nsel;
+      set_cached_rule(elem, std::move(rule));
+    }
+
     return num_quad_pts;
   }
 
+  /**
+   * @brief Evaluate the quadrature rules of all elements of the current mesh
+   * and store them in a table owned by this object, such that subsequent
+   * get_quadrature_pts() and get_quadrature_pts_grad() calls are only lookups.
+   *
+   * Elements are processed in parallel (if OpenMP is enabled) with dynamic
+   * scheduling, cut elements first, as the cost of the algoim integration
+   * varies a lot from element to element.
+   *
+   * Call this after each CutMesh::update_mesh(). Entries whose cell or
+   * element LSF dof no longer match the mesh are ignored, and the rule is
+   * computed on the fly instead.
+   *
+   * @param with_grad if true, also store derivatives of the quadrature points
+   * and weights w.r.t. the element LSF dof
+   */
+  void precompute(bool with_grad = false) {
+    int num_elements = mesh.get_num_elements();
+
+    // Cut elements are much more expensive, schedule them first
+    std::vector<int> order;
+    order.reserve(num_elements);
+    for (int elem : mesh.get_cut_elems()) order.push_back(elem);
+    for (int elem = 0; elem < num_elements; elem++) {
+      if (!mesh.is_cut_elem(elem)) order.push_back(elem);
+    }
+
+    clear_precomputed();
+
+    std::vector<std::vector<T>> pts(num_elements), wts(num_elements),
+        ns(num_elements), pts_grad(num_elements), wts_grad(num_elements);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_elements; i++) {
+      int elem = order[i];
+      if (with_grad) {
+        get_quadrature_pts_grad(elem, pts[elem], wts[elem], ns[elem],
+                                pts_grad[elem], wts_grad[elem]);
+      } else {
+        get_quadrature_pts(elem, pts[elem], wts[elem], ns[elem]);
+      }
+    }
+
+    // Pack the rules to a compact table
+    PrecomputedTable& tab = table;
+    tab.has_grad = with_grad;
+    tab.offsets.resize(num_elements + 1);
+    tab.cells.resize(num_elements);
+    tab.element_lsf.resize(num_elements * max_nnodes_per_element);
+
+    tab.offsets[0] = 0;
+    for (int elem = 0; elem < num_elements; elem++) {
+      tab.offsets[elem + 1] = tab.offsets[elem] + wts[elem].size();
+    }
+    int nq = tab.offsets[num_elements];
+    tab.pts.resize(spatial_dim * nq);
+    tab.wts.resize(nq);
+    if constexpr (quad_type == QuadPtType::SURFACE) {
+      tab.ns.resize(spatial_dim * nq);
+    }
+    if (with_grad) {
+      tab.pts_grad.resize(spatial_dim * max_nnodes_per_element * nq);
+      tab.wts_grad.resize(max_nnodes_per_element * nq);
+    }
+
+    const std::vector<T>& lsf_dof = mesh.get_lsf_dof();
+    for (int elem = 0; elem < num_elements; elem++) {
+      int cell = mesh.get_elem_cell(elem);
+      tab.cells[elem] = cell;
+      get_element_vars<T, 1, GridMesh_, Basis>(
+          lsf_mesh, cell, lsf_dof.data(),
+          &tab.element_lsf[elem * max_nnodes_per_element]);
+
+      int q0 = tab.offsets[elem];
+      std::copy(pts[elem].begin(), pts[elem].end(),
+                tab.pts.begin() + spatial_dim * q0);
+      std::copy(wts[elem].begin(), wts[elem].end(), tab.wts.begin() + q0);
+      if constexpr (quad_type == QuadPtType::SURFACE) {
+        std::copy(ns[elem].begin(), ns[elem].end(),
+                  tab.ns.begin() + spatial_dim * q0);
+      }
+      if (with_grad) {
+        std::copy(pts_grad[elem].begin(), pts_grad[elem].end(),
+                  tab.pts_grad.begin() +
+                      spatial_dim * max_nnodes_per_element * q0);
+        std::copy(wts_grad[elem].begin(), wts_grad[elem].end(),
+                  tab.wts_grad.begin() + max_nnodes_per_element * q0);
+      }
+    }
+    tab.valid = true;
+  }
+
+  // Drop the table created by precompute()
+  void clear_precomputed() { table = PrecomputedTable(); }
+
+  bool is_precomputed() const { return table.valid; }
+
  private:
+  // Compact storage of precomputed quadrature rules for all elements, rule of
+  // element e occupies the range [offsets[e], offsets[e + 1])
+  struct PrecomputedTable {
+    bool valid = false;
+    bool has_grad = false;
+    std::vector<int> offsets;
+    std::vector<int> cells;      // elem -> cell at the time of precompute()
+    std::vector<T> element_lsf;  // element LSF dof at the time of precompute()
+    std::vector<T> pts, wts, ns, pts_grad, wts_grad;
+  };
+
+  bool get_precomputed(int elem, int cell, const T element_lsf[],
+                       bool need_grad, std::vector<T>& pts,
+                       std::vector<T>& wts, std::vector<T>& ns,
+                       std::vector<T>* pts_grad = nullptr,
+                       std::vector<T>* wts_grad = nullptr) const {
+    const PrecomputedTable& tab = table;
+    if (!tab.valid or (need_grad and !tab.has_grad)) return false;
+    if (elem >= int(tab.cells.size()) or tab.cells[elem] != cell) return false;
+    const T* lsf = &tab.element_lsf[elem * max_nnodes_per_element];
+    if (!std::equal(lsf, lsf + max_nnodes_per_element, element_lsf)) {
+      return false;
+    }
+
+    int q0 = tab.offsets[elem], q1 = tab.offsets[elem + 1];
+    pts.assign(tab.pts.begin() + spatial_dim * q0,
+               tab.pts.begin() + spatial_dim * q1);
+    wts.assign(tab.wts.begin() + q0, tab.wts.begin() + q1);
+    if constexpr (quad_type == QuadPtType::SURFACE) {
+      ns.assign(tab.ns.begin() + spatial_dim * q0,
+                tab.ns.begin() + spatial_dim * q1);
+    } else {
+      ns.clear();
+    }
+    if (need_grad) {
+      constexpr int n = max_nnodes_per_element;
+      pts_grad->assign(tab.pts_grad.begin() + spatial_dim * n * q0,
+                       tab.pts_grad.begin() + spatial_dim * n * q1);
+      wts_grad->assign(tab.wts_grad.begin() + n * q0,
+                       tab.wts_grad.begin() + n * q1);
+    }
+    return true;
+  }
+
+  struct CompressedRule {
+    std::vector<T> element_lsf;  // the rule is only valid for these values
+    std::vector<T> pts, wts;
+    bool has_grad = false;
+    std::vector<T> pts_grad, wts_grad;
+  };
+
+  // Look up the compressed rule of elem, return false if it's not available
+  bool get_cached_rule(int elem, const T element_lsf[], bool need_grad,
+                       std::vector<T>& pts, std::vector<T>& wts,
+                       std::vector<T>* pts_grad = nullptr,
+                       std::vector<T>* wts_grad = nullptr) const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = compressed_rules.find(elem);
+    if (it == compressed_rules.end()) return false;
+    const CompressedRule& rule = it->second;
+    if (need_grad and !rule.has_grad) return false;
+    if (!std::equal(rule.element_lsf.begin(), rule.element_lsf.end(),
+                    element_lsf)) {
+      return false;
+    }
+    pts = rule.pts;
+    wts = rule.wts;
+    if (need_grad) {
+      *pts_grad = rule.pts_grad;
+      *wts_grad = rule.wts_grad;
+    }
+    return true;
+  }
+
+  void set_cached_rule(int elem, CompressedRule&& rule) const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    compressed_rules[elem] = std::move(rule);
+  }
+
   template <typename T2>
   void get_phi_vals(const VandermondeEvaluator<T, GridMesh_>& eval,
                     const T2 element_dof[],
@@ -661,6 +974,12 @@ class GDLSFQuadrature2D final : public QuadratureBase<T, quad_type> {
 
   // Mesh for the LSF dof. All grid verts are dof nodes.
   const GridMesh_& lsf_mesh;
+
+  PrecomputedTable table;
+
+  bool compress = false;
+  mutable std::mutex cache_mutex;
+  mutable std::unordered_map<int, CompressedRule> compressed_rules;
 };
 
 /**
@@ -704,14 +1023,16 @@ class GDBasis2D final : public BasisBase<T, Mesh_> {
     N.resize(max_nnodes_per_element * num_quad_pts);
     Nxi.resize(max_nnodes_per_element * num_quad_pts * spatial_dim);
 
-    std::shared_ptr<VandermondeEvaluator<T, Mesh>> eval;
+    std::optional<VandermondeEvaluator<T, Mesh>> irregular_eval;
+    const VandermondeEvaluator<T, Mesh>* eval = regular_eval.get();
     if (mesh.is_regular_stencil_elem(elem)) {
-      eval = regular_eval;
-      VandermondeCondLogger::add(
-          elem, VandermondeCondLogger::get(
-                    *(mesh.get_regular_stencil_elems().begin())));
+      if (VandermondeCondLogger::is_active()) {
+        VandermondeCondLogger::add(
+            elem, VandermondeCondLogger::get(
+                      *(mesh.get_regular_stencil_elems().begin())));
+      }
     } else {
-      eval = std::make_shared<VandermondeEvaluator<T, Mesh>>(mesh, elem);
+      eval = &irregular_eval.emplace(mesh, elem);
     }
 
     for (int q = 0; q < num_quad_pts; q++) {
@@ -729,14 +1050,16 @@ class GDBasis2D final : public BasisBase<T, Mesh_> {
     Nxixi.resize(max_nnodes_per_element * num_quad_pts * spatial_dim *
                  spatial_dim);
 
-    std::shared_ptr<VandermondeEvaluator<T, Mesh>> eval;
+    std::optional<VandermondeEvaluator<T, Mesh>> irregular_eval;
+    const VandermondeEvaluator<T, Mesh>* eval = regular_eval.get();
     if (mesh.is_regular_stencil_elem(elem)) {
-      eval = regular_eval;
-      VandermondeCondLogger::add(
-          elem, VandermondeCondLogger::get(
-                    *(mesh.get_regular_stencil_elems().begin())));
+      if (VandermondeCondLogger::is_active()) {
+        VandermondeCondLogger::add(
+            elem, VandermondeCondLogger::get(
+                      *(mesh.get_regular_stencil_elems().begin())));
+      }
     } else {
-      eval = std::make_shared<VandermondeEvaluator<T, Mesh>>(mesh, elem);
+      eval = &irregular_eval.emplace(mesh, elem);
     }
 
     for (int q = 0; q < num_quad_pts; q++) {
@@ -0,0 +1,521 @@
+#ifndef XCGD_QUADRATURE_COMPRESSION_H
+#define XCGD_QUADRATURE_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "utils/misc.h"
+
+/**
+ * Compression of positive-weight quadrature rules on the reference cell
+ * [0, 1]^2.
+ *
+ * Given a rule {x_q, w_q}, q = 0, ..., M - 1 (e.g. the one generated by algoim
+ * for a cut cell), we find a subset S of the points and new positive weights
+ * w'_s such that the moments of a polynomial space P of dimension K are
+ * preserved:
+ *
+ *   sum_{s in S} φ_k(x_s) w'_s = sum_q φ_k(x_q) w_q,  k = 0, ..., K - 1
+ *
+ * Tchakaloff's theorem guarantees such a rule with |S| <= K exists, and it is
+ * constructed here by Caratheodory pruning: repeatedly move the weights along a
+ * null vector of the moment matrix until one of them vanishes.
+ *
+ * P is the tensor-product space Q_q = span{x^i y^j, 0 <= i, j <= q}, which is
+ * represented by shifted Legendre polynomials for conditioning.
+ */
+
+/**
+ * @brief Evaluate the shifted Legendre polynomials on [0, 1] and derivatives
+ *
+ * @param q [in] maximum degree
+ * @param x [in] coordinate in [0, 1]
+ * @param P [out] P_0(x), ..., P_q(x)
+ * @param dP [out] derivatives dP_i/dx, optional
+ */
+template <typename T>
+void eval_shifted_legendre(int q, T x, T* P, T* dP = nullptr) {
+  T t = 2.0 * x - 1.0;
+  P[0] = 1.0;
+  if (dP) dP[0] = 0.0;
+  if (q >= 1) {
+    P[1] = t;
+    if (dP) dP[1] = 2.0;
+  }
+  for (int n = 1; n < q; n++) {
+    P[n + 1] = ((2.0 * n + 1.0) * t * P[n] - T(n) * P[n - 1]) / (n + 1.0);
+    if (dP) dP[n + 1] = dP[n - 1] + 2.0 * (2.0 * n + 1.0) * P[n];
+  }
+}
+
+/**
+ * @brief Evaluate the moment functions φ_k of Q_q at a 2d point
+ *
+ * @param q [in] polynomial degree in each direction
+ * @param pt [in] point in [0, 1]^2
+ * @param phi [out] φ_k, size of K = (q + 1)^2
+ * @param dphi [out] (∂φ_k/∂x, ∂φ_k/∂y) for each k, size of 2K, optional
+ */
+template <typename T>
+void eval_moment_functions(int q, const T* pt, T* phi, T* dphi = nullptr) {
+  std::vector<T> px(q + 1), py(q + 1), dpx(q + 1), dpy(q + 1);
+  eval_shifted_legendre(q, pt[0], px.data(), dpx.data());
+  eval_shifted_legendre(q, pt[1], py.data(), dpy.data());
+  for (int j = 0, k = 0; j <= q; j++) {
+    for (int i = 0; i <= q; i++, k++) {
+      phi[k] = px[i] * py[j];
+      if (dphi) {
+        dphi[2 * k] = dpx[i] * py[j];
+        dphi[2 * k + 1] = px[i] * dpy[j];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Householder QR with column pivoting A P = Q R of a dense column-major
+ * m x n matrix, the factors are stored in place (LAPACK geqp3 layout)
+ *
+ * @return numerical rank
+ */
+template <typename T>
+int qr_pivoted(int m, int n, T* A, int* perm, T* tau, double rtol = 1e-10) {
+  std::vector<double> norms(n);
+  for (int j = 0; j < n; j++) {
+    perm[j] = j;
+    double s = 0.0;
+    for (int i = 0; i < m; i++) s += freal(A[i + m * j] * A[i + m * j]);
+    norms[j] = s;
+  }
+
+  int kmax = std::min(m, n);
+  int rank = kmax;
+  double r00 = 0.0;
+  for (int k = 0; k < kmax; k++) {
+    // Pivot the column with the largest remaining norm to position k
+    int p = k;
+    for (int j = k + 1; j < n; j++) {
+      if (norms[j] > norms[p]) p = j;
+    }
+    if (p != k) {
+      for (int i = 0; i < m; i++) std::swap(A[i + m * k], A[i + m * p]);
+      std::swap(norms[k], norms[p]);
+      std::swap(perm[k], perm[p]);
+    }
+
+    // Householder reflector for A(k:m, k)
+    double alpha = 0.0;
+    for (int i = k; i < m; i++) alpha += freal(A[i + m * k] * A[i + m * k]);
+    alpha = std::sqrt(alpha);
+
+    if (k == 0) r00 = alpha;
+    if (alpha <= rtol * r00 or alpha == 0.0) {
+      rank = k;
+      for (int kk = k; kk < kmax; kk++) tau[kk] = 0.0;
+      break;
+    }
+
+    T akk = A[k + m * k];
+    T beta = freal(akk) >= 0.0 ? T(-alpha) : T(alpha);
+    T v0 = akk - beta;
+    for (int i = k + 1; i < m; i++) A[i + m * k] /= v0;
+    tau[k] = (beta - akk) / beta;
+    A[k + m * k] = beta;
+
+    // Apply the reflector to the trailing columns
+    for (int j = k + 1; j < n; j++) {
+      T s = A[k + m * j];
+      for (int i = k + 1; i < m; i++) s += A[i + m * k] * A[i + m * j];
+      s *= tau[k];
+      A[k + m * j] -= s;
+      for (int i = k + 1; i < m; i++) A[i + m * j] -= s * A[i + m * k];
+
+      double nrm = 0.0;
+      for (int i = k + 1; i < m; i++) nrm += freal(A[i + m * j] * A[i + m * j]);
+      norms[j] = nrm;
+    }
+  }
+  return rank;
+}
+
+/**
+ * @brief Given the pivoted QR of an m x n matrix with rank < n, compute a
+ * vector c != 0 such that A c = 0
+ */
+template <typename T>
+void qr_null_vector(int m, int n, int rank, const T* QR, const int* perm,
+                    T* c) {
+  // Solve R11 y = -R12 e_0 where R11 is rank x rank
+  std::vector<T> y(rank);
+  for (int i = 0; i < rank; i++) y[i] = -QR[i + m * rank];
+  for (int i = rank - 1; i >= 0; i--) {
+    for (int j = i + 1; j < rank; j++) y[i] -= QR[i + m * j] * y[j];
+    y[i] /= QR[i + m * i];
+  }
+  std::fill(c, c + n, T(0.0));
+  for (int i = 0; i < rank; i++) c[perm[i]] = y[i];
+  c[perm[rank]] = 1.0;
+}
+
+/**
+ * @brief Solve the consistent overdetermined system A x = b in the least
+ * squares sense given the pivoted QR of A (m x n, full column rank)
+ *
+ * @param b [in, out] right hand side of size m, first n entries store the
+ * solution on exit
+ */
+template <typename T>
+void qr_solve(int m, int n, const T* QR, const int* perm, const T* tau, T* b) {
+  // b <- Q^T b
+  for (int k = 0; k < n; k++) {
+    T s = b[k];
+    for (int i = k + 1; i < m; i++) s += QR[i + m * k] * b[i];
+    s *= tau[k];
+    b[k] -= s;
+    for (int i = k + 1; i < m; i++) b[i] -= s * QR[i + m * k];
+  }
+  // R y = Q^T b
+  for (int i = n - 1; i >= 0; i--) {
+    for (int j = i + 1; j < n; j++) b[i] -= QR[i + m * j] * b[j];
+    b[i] /= QR[i + m * i];
+  }
+  // x = P y
+  std::vector<T> x(n);
+  for (int i = 0; i < n; i++) x[perm[i]] = b[i];
+  std::copy(x.begin(), x.end(), b);
+}
+
+/**
+ * @brief Caratheodory pruning of the weights w on the columns of the moment
+ * matrix A (K x M, column-major), optionally with the tangents of the weights
+ *
+ * The pruning is a sequence of steps w <- w - α c, where c is a null vector of
+ * a window of columns and α is the largest step that keeps w non-negative.
+ * Given the tangents of A and w w.r.t. a set of parameters, the tangents of
+ * each step are propagated with the branches (window, zeroed point) held
+ * fixed, where the null vector is normalized as by qr_null_vector(), hence
+ * A_B dc_B = -dA c on its basis columns B.
+ *
+ * @param active [in, out] indices of the points with nonzero weights
+ * @param dA [in] ∂A[k, q]/∂p_i, stored as [(q * nparams + i) * K + k],
+ * optional
+ * @param dw [in, out] ∂w_q/∂p_i, stored as [q * nparams + i], optional
+ */
+template <typename T>
+void caratheodory_prune(int K, const std::vector<T>& A, std::vector<T>& w,
+                        std::vector<int>& active, double drop_tol,
+                        int nparams = 0, const std::vector<T>* dA = nullptr,
+                        std::vector<T>* dw = nullptr) {
+  std::vector<T> sub, tau, c, dc, r;
+  std::vector<int> perm;
+
+  // Caratheodory pruning on a window of at most K + 1 columns: such a window
+  // always has a non-trivial null vector, eliminate one point per step. Once
+  // the window is linearly independent we are done.
+  while (true) {
+    int n = std::min<int>(active.size(), K + 1);
+
+    sub.resize(K * n);
+    tau.resize(n);
+    perm.resize(n);
+    c.resize(n);
+    for (int j = 0; j < n; j++) {
+      std::copy(&A[K * active[j]], &A[K * active[j]] + K, &sub[K * j]);
+    }
+    int rank = qr_pivoted(K, n, sub.data(), perm.data(), tau.data());
+
+    if (rank == n) {
+      if (n == int(active.size())) break;  // remaining points are independent
+      // Window is independent but more points remain, which can't happen for
+      // n = K + 1 columns in a K-dimensional space
+      throw std::runtime_error("quadrature compression failed unexpectedly");
+    }
+
+    qr_null_vector(K, n, rank, sub.data(), perm.data(), c.data());
+
+    // Make sure at least one component is positive
+    bool has_pos = false;
+    for (int j = 0; j < n; j++) {
+      if (freal(c[j]) > 0.0) {
+        has_pos = true;
+        break;
+      }
+    }
+    if (!has_pos) {
+      for (int j = 0; j < n; j++) c[j] = -c[j];
+    }
+
+    // Tangents of the null vector, dc = 0 on the non-basis columns
+    if (dw) {
+      dc.assign(n * nparams, T(0.0));
+      r.resize(K);
+      for (int i = 0; i < nparams; i++) {
+        std::fill(r.begin(), r.end(), T(0.0));
+        for (int j = 0; j < n; j++) {
+          const T* dAj = &(*dA)[(active[j] * nparams + i) * K];
+          for (int k = 0; k < K; k++) r[k] -= dAj[k] * c[j];
+        }
+        // r <- Q^T r, then solve R11 y = r(0:rank)
+        for (int k = 0; k < rank; k++) {
+          T s = r[k];
+          for (int m = k + 1; m < K; m++) s += sub[m + K * k] * r[m];
+          s *= tau[k];
+          r[k] -= s;
+          for (int m = k + 1; m < K; m++) r[m] -= s * sub[m + K * k];
+        }
+        for (int k = rank - 1; k >= 0; k--) {
+          for (int m = k + 1; m < rank; m++) r[k] -= sub[k + K * m] * r[m];
+          r[k] /= sub[k + K * k];
+        }
+        for (int k = 0; k < rank; k++) dc[perm[k] * nparams + i] = r[k];
+      }
+    }
+
+    // Largest step that keeps all weights non-negative
+    int jmin = -1;
+    T alpha = 0.0;
+    for (int j = 0; j < n; j++) {
+      if (freal(c[j]) > 0.0) {
+        T a = w[active[j]] / c[j];
+        if (jmin < 0 or freal(a) < freal(alpha)) {
+          alpha = a;
+          jmin = j;
+        }
+      }
+    }
+
+    if (dw) {
+      for (int i = 0; i < nparams; i++) {
+        T dalpha = ((*dw)[active[jmin] * nparams + i] -
+                    alpha * dc[jmin * nparams + i]) /
+                   c[jmin];
+        for (int j = 0; j < n; j++) {
+          (*dw)[active[j] * nparams + i] -=
+              dalpha * c[j] + alpha * dc[j * nparams + i];
+        }
+        (*dw)[active[jmin] * nparams + i] = 0.0;
+      }
+    }
+
+    for (int j = 0; j < n; j++) w[active[j]] -= alpha * c[j];
+    w[active[jmin]] = 0.0;
+
+    // Remove vanished points from the window
+    std::vector<int> keep;
+    keep.reserve(active.size());
+    for (int j = 0; j < int(active.size()); j++) {
+      if (j < n and freal(w[active[j]]) <= drop_tol) continue;
+      keep.push_back(active[j]);
+    }
+    active = keep;
+  }
+}
+
+/**
+ * @brief Compress a positive 2d quadrature rule such that the integrals of
+ * Q_degree are preserved
+ *
+ * @param degree [in] polynomial degree in each direction to be integrated
+ * exactly
+ * @param pts [in] quadrature points, [x0, y0, x1, y1, ...]
+ * @param wts [in] positive quadrature weights
+ * @param new_wts [out] weights of the compressed rule
+ * @param refine [in] recompute the weights of the retained points from the
+ * original moments, the pruned weights are kept if false or if the refined
+ * ones lose positivity
+ * @return indices of the retained points, same size as new_wts
+ */
+template <typename T>
+std::vector<int> compress_quadrature(int degree, const std::vector<T>& pts,
+                                     const std::vector<T>& wts,
+                                     std::vector<T>& new_wts,
+                                     bool refine = true) {
+  constexpr int spatial_dim = 2;
+  const int K = (degree + 1) * (degree + 1);
+  const int M = wts.size();
+
+  std::vector<int> active(M);
+  std::iota(active.begin(), active.end(), 0);
+  std::vector<T> w(wts);
+
+  if (M <= K) {
+    new_wts = w;
+    return active;
+  }
+
+  // Moment matrix, column q stores φ_k(x_q)
+  std::vector<T> A(K * M);
+  for (int q = 0; q < M; q++) {
+    eval_moment_functions(degree, &pts[spatial_dim * q], &A[K * q]);
+  }
+
+  double wmax = 0.0;
+  for (int q = 0; q < M; q++) wmax = std::max(wmax, std::fabs(freal(w[q])));
+  double drop_tol = 1e-14 * wmax;
+
+  caratheodory_prune(K, A, w, active, drop_tol);
+
+  // Recompute the weights of the retained points from the original moments to
+  // remove the drift accumulated during pruning
+  int n = active.size();
+  std::vector<T> b(K, T(0.0));
+  bool positive = false;
+  if (refine) {
+    for (int q = 0; q < M; q++) {
+      for (int k = 0; k < K; k++) b[k] += A[k + K * q] * wts[q];
+    }
+    std::vector<T> sub(K * n), tau(n);
+    std::vector<int> perm(n);
+    for (int j = 0; j < n; j++) {
+      std::copy(&A[K * active[j]], &A[K * active[j]] + K, &sub[K * j]);
+    }
+    qr_pivoted(K, n, sub.data(), perm.data(), tau.data());
+    qr_solve(K, n, sub.data(), perm.data(), tau.data(), b.data());
+
+    positive = true;
+    for (int j = 0; j < n; j++) {
+      if (freal(b[j]) <= 0.0) positive = false;
+    }
+  }
+
+  new_wts.resize(n);
+  for (int j = 0; j < n; j++) {
+    new_wts[j] = positive ? b[j] : w[active[j]];
+  }
+  return active;
+}
+
+/**
+ * @brief Derivatives of the compressed weights w.r.t. a set of parameters,
+ * given the derivatives of the original rule. The retained point set is held
+ * fixed, and the derivatives follow the branch taken by compress_quadrature():
+ * the refined weights solve A_S w' = A w, hence
+ *
+ *   A_S dw' = dA w + A dw - dA_S w'
+ *
+ * otherwise the pruning steps are differentiated, see caratheodory_prune().
+ *
+ * @param degree [in] same degree used by compress_quadrature()
+ * @param nparams [in] number of parameters
+ * @param pts, wts [in] original rule
+ * @param pts_grad [in] ∂x_q/∂p_i, stored as [(q * nparams + i) * 2 + d]
+ * @param wts_grad [in] ∂w_q/∂p_i, stored as [q * nparams + i]
+ * @param selected [in] output of compress_quadrature()
+ * @param new_wts [in] output of compress_quadrature()
+ * @param new_wts_grad [out] ∂w'_s/∂p_i, stored as [s * nparams + i]
+ * @param refine [in] same flag used by compress_quadrature()
+ */
+template <typename T>
+void compress_quadrature_grad(int degree, int nparams,
+                              const std::vector<T>& pts,
+                              const std::vector<T>& wts,
+                              const std::vector<T>& pts_grad,
+                              const std::vector<T>& wts_grad,
+                              const std::vector<int>& selected,
+                              const std::vector<T>& new_wts,
+                              std::vector<T>& new_wts_grad,
+                              bool refine = true) {
+  constexpr int spatial_dim = 2;
+  const int K = (degree + 1) * (degree + 1);
+  const int M = wts.size();
+  const int n = selected.size();
+
+  new_wts_grad.resize(n * nparams);
+
+  // The rule is not compressed
+  if (M <= K) {
+    std::copy(wts_grad.begin(), wts_grad.end(), new_wts_grad.begin());
+    return;
+  }
+
+  std::vector<T> A(K * M), dA(spatial_dim * K * M);
+  for (int q = 0; q < M; q++) {
+    eval_moment_functions(degree, &pts[spatial_dim * q], &A[K * q],
+                          &dA[spatial_dim * K * q]);
+  }
+
+  std::vector<T> AS(K * n), tau(n);
+  std::vector<int> perm(n);
+  for (int j = 0; j < n; j++) {
+    std::copy(&A[K * selected[j]], &A[K * selected[j]] + K, &AS[K * j]);
+  }
+  qr_pivoted(K, n, AS.data(), perm.data(), tau.data());
+
+  // Repeat the positivity check of compress_quadrature() to find the branch
+  bool positive = false;
+  if (refine) {
+    std::vector<T> b(K, T(0.0));
+    for (int q = 0; q < M; q++) {
+      for (int k = 0; k < K; k++) b[k] += A[k + K * q] * wts[q];
+    }
+    qr_solve(K, n, AS.data(), perm.data(), tau.data(), b.data());
+    positive = true;
+    for (int j = 0; j < n; j++) {
+      if (freal(b[j]) <= 0.0) positive = false;
+    }
+  }
+
+  if (!positive) {
+    // ∂A[k, q]/∂p_i = ∇φ_k(x_q) · ∂x_q/∂p_i
+    std::vector<T> dAp(K * M * nparams);
+    for (int q = 0; q < M; q++) {
+      for (int i = 0; i < nparams; i++) {
+        const T* dx = &pts_grad[(q * nparams + i) * spatial_dim];
+        for (int k = 0; k < K; k++) {
+          const T* dphi = &dA[spatial_dim * (K * q + k)];
+          dAp[(q * nparams + i) * K + k] = dphi[0] * dx[0] + dphi[1] * dx[1];
+        }
+      }
+    }
+
+    double wmax = 0.0;
+    for (int q = 0; q < M; q++) {
+      wmax = std::max(wmax, std::fabs(freal(wts[q])));
+    }
+    std::vector<int> active(M);
+    std::iota(active.begin(), active.end(), 0);
+    std::vector<T> w(wts), dw(wts_grad);
+    caratheodory_prune(K, A, w, active, 1e-14 * wmax, nparams, &dAp, &dw);
+
+    if (active != selected) {
+      throw std::runtime_error(
+          "compress_quadrature_grad: retained points differ from the ones "
+          "selected by compress_quadrature()");
+    }
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < nparams; i++) {
+        new_wts_grad[j * nparams + i] = dw[selected[j] * nparams + i];
+      }
+    }
+    return;
+  }
+
+  std::vector<T> rhs(K);
+  for (int i = 0; i < nparams; i++) {
+    std::fill(rhs.begin(), rhs.end(), T(0.0));
+    for (int q = 0; q < M; q++) {
+      const T* dx = &pts_grad[(q * nparams + i) * spatial_dim];
+      T dw = wts_grad[q * nparams + i];
+      for (int k = 0; k < K; k++) {
+        const T* dphi = &dA[spatial_dim * (K * q + k)];
+        rhs[k] += (dphi[0] * dx[0] + dphi[1] * dx[1]) * wts[q] +
+                  A[k + K * q] * dw;
+      }
+    }
+    for (int j = 0; j < n; j++) {
+      int q = selected[j];
+      const T* dx = &pts_grad[(q * nparams + i) * spatial_dim];
+      for (int k = 0; k < K; k++) {
+        const T* dphi = &dA[spatial_dim * (K * q + k)];
+        rhs[k] -= (dphi[0] * dx[0] + dphi[1] * dx[1]) * new_wts[j];
+      }
+    }
+    qr_solve(K, n, AS.data(), perm.data(), tau.data(), rhs.data());
+    for (int j = 0; j < n; j++) new_wts_grad[j * nparams + i] = rhs[j];
+  }
+}
+
+#endif  // XCGD_QUADRATURE_COMPRESSION_H
@@ -0,0 +1,803 @@
+#ifndef XCGD_MULTIGRID_H
+#define XCGD_MULTIGRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "elements/gd_mesh.h"
+#include "elements/gd_vandermonde.h"
+#include "sparse_utils/sparse_utils.h"
+#include "utils/krylov.h"
+#include "utils/misc.h"
+
+/**
+ * @brief y = A * x for a scalar CSR matrix
+ */
+template <typename T>
+void csr_mult(const SparseUtils::CSRMat<T>& A, const T* x, T* y) {
+#pragma omp parallel for
+  for (int i = 0; i < A.nrows; i++) {
+    T s = 0.0;
+    for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+      s += A.vals[jp] * x[A.cols[jp]];
+    }
+    y[i] = s;
+  }
+}
+
+/**
+ * @brief Transpose of a scalar CSR matrix, column indices of each row of the
+ * transpose are sorted
+ *
+ * @return the transpose, owned by the caller
+ */
+template <typename T>
+SparseUtils::CSRMat<T>* csr_transpose(const SparseUtils::CSRMat<T>& A) {
+  int nnz = A.rowp[A.nrows];
+  std::vector<int> rowp(A.ncols + 1, 0), cols(nnz);
+  std::vector<T> vals(nnz);
+  for (int jp = 0; jp < nnz; jp++) rowp[A.cols[jp] + 1]++;
+  for (int i = 0; i < A.ncols; i++) rowp[i + 1] += rowp[i];
+  std::vector<int> pos(rowp.begin(), rowp.end() - 1);
+  for (int i = 0; i < A.nrows; i++) {
+    for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+      int k = pos[A.cols[jp]]++;
+      cols[k] = i;
+      vals[k] = A.vals[jp];
+    }
+  }
+  return new SparseUtils::CSRMat<T>(A.ncols, A.nrows, nnz, rowp.data(),
+                                    cols.data(), vals.data());
+}
+
+/**
+ * @brief Sparse matrix-matrix product C = A * B (Gustavson's algorithm)
+ *
+ * @return C, owned by the caller, column indices of each row are sorted
+ */
+template <typename T>
+SparseUtils::CSRMat<T>* csr_matmat(const SparseUtils::CSRMat<T>& A,
+                                   const SparseUtils::CSRMat<T>& B) {
+  if (A.ncols != B.nrows) {
+    char msg[256];
+    std::snprintf(msg, 256, "incompatible shapes (%d, %d) x (%d, %d)", A.nrows,
+                  A.ncols, B.nrows, B.ncols);
+    throw std::runtime_error(msg);
+  }
+
+  std::vector<int> rowp(A.nrows + 1, 0), cols;
+  std::vector<T> vals;
+  std::vector<int> marker(B.ncols, -1);
+  std::vector<std::pair<int, T>> row;
+  for (int i = 0; i < A.nrows; i++) {
+    row.clear();
+    for (int ka = A.rowp[i]; ka < A.rowp[i + 1]; ka++) {
+      int j = A.cols[ka];
+      T a = A.vals[ka];
+      for (int kb = B.rowp[j]; kb < B.rowp[j + 1]; kb++) {
+        int c = B.cols[kb];
+        if (marker[c] < 0) {
+          marker[c] = row.size();
+          row.push_back({c, a * B.vals[kb]});
+        } else {
+          row[marker[c]].second += a * B.vals[kb];
+        }
+      }
+    }
+    std::sort(row.begin(), row.end(), [](const auto& p1, const auto& p2) {
+      return p1.first < p2.first;
+    });
+    for (auto& [c, v] : row) {
+      marker[c] = -1;
+      cols.push_back(c);
+      vals.push_back(v);
+    }
+    rowp[i + 1] = cols.size();
+  }
+  return new SparseUtils::CSRMat<T>(A.nrows, B.ncols, rowp[A.nrows],
+                                    rowp.data(), cols.data(), vals.data());
+}
+
+/**
+ * @brief Convert a block CSR matrix to a scalar CSR matrix
+ *
+ * Rows and columns of the Dirichlet dof are replaced by the identity such that
+ * the operator stays symmetric.
+ *
+ * @return the matrix, owned by the caller
+ */
+template <typename T, int M>
+SparseUtils::CSRMat<T>* bsr_to_csr(const GalerkinBSRMat<T, M>* bsr,
+                                   const std::vector<int>& bc_dof = {}) {
+  int n = bsr->nbrows * M, nnz = bsr->rowp[bsr->nbrows] * M * M;
+  std::vector<int> rowp(n + 1, 0), cols(nnz);
+  std::vector<T> vals(nnz);
+
+  std::vector<bool> is_bc(n, false);
+  for (int dof : bc_dof) is_bc[dof] = true;
+
+  int k = 0;
+  for (int ib = 0; ib < bsr->nbrows; ib++) {
+    for (int ii = 0; ii < M; ii++) {
+      int i = M * ib + ii;
+      for (int jp = bsr->rowp[ib]; jp < bsr->rowp[ib + 1]; jp++) {
+        for (int jj = 0; jj < M; jj++, k++) {
+          int j = M * bsr->cols[jp] + jj;
+          T v = bsr->vals[M * M * jp + M * ii + jj];
+          if (is_bc[i] or is_bc[j]) v = i == j ? T(1.0) : T(0.0);
+          cols[k] = j;
+          vals[k] = v;
+        }
+      }
+      rowp[i + 1] = k;
+    }
+  }
+  return new SparseUtils::CSRMat<T>(n, n, nnz, rowp.data(), cols.data(),
+                                    vals.data());
+}
+
+/**
+ * @brief The algebraic part of a multigrid V-cycle, given the finest operator
+ * and the prolongation operators between consecutive levels
+ *
+ * - Coarse operators are Galerkin products A_{l+1} = P_l^T A_l P_l, coarse dof
+ *   without fine support get an identity row
+ * - The smoother is a l1-Jacobi sweep over all dof, followed by a symmetric
+ *   Gauss-Seidel sweep over a set of dof (e.g. dof of cut elements, whose rows
+ *   are poorly scaled). The post-smoother is the adjoint of the pre-smoother so
+ *   that the V-cycle is a symmetric preconditioner
+ * - The coarsest level is solved directly by a Cholesky factorization
+ */
+template <typename T>
+class MultigridSolver {
+ private:
+  using CSRMat = SparseUtils::CSRMat<T>;
+  using CSCMat = SparseUtils::CSCMat<T>;
+
+ public:
+  // Coarsest levels up to this size are factorized as dense matrices
+  static constexpr int max_dense_coarse_size = 2000;
+
+  MultigridSolver() = default;
+  MultigridSolver(const MultigridSolver&) = delete;
+  MultigridSolver& operator=(const MultigridSolver&) = delete;
+  ~MultigridSolver() { clear_coarse_factor(); }
+
+  /**
+   * @param A0 operator on the finest level
+   * @param P P[l] prolongates from level l + 1 to level l
+   * @param gs_dofs gs_dofs[l] are the dof smoothed by Gauss-Seidel on level l,
+   * optional
+   */
+  void setup(std::unique_ptr<CSRMat> A0, std::vector<std::unique_ptr<CSRMat>> P,
+             std::vector<std::vector<int>> gs_dofs = {}) {
+    int nlevels = P.size() + 1;
+    levels.clear();
+    levels.resize(nlevels);
+    levels[0].A = std::move(A0);
+    for (int l = 0; l < nlevels - 1; l++) {
+      levels[l].PT.reset(csr_transpose(*P[l]));
+      levels[l].P = std::move(P[l]);
+      std::unique_ptr<CSRMat> AP(csr_matmat(*levels[l].A, *levels[l].P));
+      std::unique_ptr<CSRMat> PTAP(csr_matmat(*levels[l].PT, *AP));
+      levels[l + 1].A.reset(add_identity_to_empty_rows(*PTAP));
+    }
+
+    for (int l = 0; l < nlevels; l++) {
+      Level& lv = levels[l];
+      const CSRMat& A = *lv.A;
+      int n = A.nrows;
+      lv.diag.assign(n, T(0.0));
+      lv.l1diag.assign(n, T(0.0));
+      for (int i = 0; i < n; i++) {
+        for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+          if (A.cols[jp] == i) lv.diag[i] = A.vals[jp];
+          lv.l1diag[i] += fabs(freal(A.vals[jp]));
+        }
+        if (freal(lv.diag[i]) <= 0.0) {
+          char msg[256];
+          std::snprintf(msg, 256,
+                        "non-positive diagonal entry %.6e at row %d of level "
+                        "%d, the operator is not positive definite",
+                        freal(lv.diag[i]), i, l);
+          throw std::runtime_error(msg);
+        }
+      }
+      if (l < (int)gs_dofs.size()) lv.gs_dofs = gs_dofs[l];
+      lv.r.assign(n, T(0.0));
+      lv.b.assign(n, T(0.0));
+      lv.x.assign(n, T(0.0));
+    }
+
+    factor_coarse();
+  }
+
+  void set_smoothing(int nu_pre_, int nu_post_) {
+    nu_pre = nu_pre_;
+    nu_post = nu_post_;
+  }
+
+  int get_num_levels() const { return levels.size(); }
+  const CSRMat& get_operator(int level) const { return *levels[level].A; }
+  const CSRMat& get_prolongation(int level) const { return *levels[level].P; }
+
+  // sum of nnz of all operators over the nnz of the finest operator
+  double operator_complexity() const {
+    double nnz = 0.0;
+    for (const auto& lv : levels) nnz += get_nnz(*lv.A);
+    return nnz / get_nnz(*levels[0].A);
+  }
+
+  /**
+   * @brief Perform one V-cycle on A x = b
+   *
+   * @param b [in] right hand side
+   * @param x [in, out] initial guess on entry, updated solution on exit
+   */
+  void vcycle(const T* b, T* x) const { vcycle(0, b, x); }
+
+  // Apply the V-cycle as a preconditioner, z = M^{-1} r
+  void apply(const T* r, T* z) const {
+    std::fill(z, z + levels[0].A->nrows, T(0.0));
+    vcycle(0, r, z);
+  }
+
+  /**
+   * @brief Solve A x = b by V-cycles as a stationary iteration
+   *
+   * @return number of V-cycles, or -1 if not converged
+   */
+  int solve(const T* b, T* x, double rtol = 1e-10, int max_iter = 100,
+            bool verbose = false) const {
+    const Level& lv = levels[0];
+    int n = lv.A->nrows;
+    double bnorm = 0.0;
+    for (int i = 0; i < n; i++) bnorm += freal(b[i] * b[i]);
+    bnorm = bnorm > 0.0 ? sqrt(bnorm) : 1.0;
+
+    for (int iter = 0; iter <= max_iter; iter++) {
+      residual(*lv.A, b, x, lv.r.data());
+      double rnorm = 0.0;
+      for (int i = 0; i < n; i++) rnorm += freal(lv.r[i] * lv.r[i]);
+      rnorm = sqrt(rnorm);
+      if (verbose) {
+        std::printf("[multigrid] cycle: %4d, |r|/|b|: %.10e\n", iter,
+                    rnorm / bnorm);
+      }
+      if (rnorm <= rtol * bnorm) return iter;
+      if (iter < max_iter) vcycle(0, b, x);
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Solve A x = b by the conjugate gradient method preconditioned by
+   * the V-cycle
+   *
+   * @return number of iterations, or -1 if not converged
+   */
+  int solve_pcg(const T* b, T* x, double rtol = 1e-10, int max_iter = 500,
+                bool verbose = false) const {
+    const CSRMat& A = *levels[0].A;
+    return pcg<T>(
+        A.nrows, [&A](const T* u, T* v) { csr_mult(A, u, v); },
+        [this](const T* r, T* z) { apply(r, z); }, b, x, rtol, max_iter,
+        verbose);
+  }
+
+  void print_info(std::FILE* fp = stdout) const {
+    for (int l = 0; l < get_num_levels(); l++) {
+      std::fprintf(fp,
+                   "[multigrid] level %2d, ndof: %9d, nnz: %11d, gs dof: %8d\n",
+                   l, levels[l].A->nrows, get_nnz(*levels[l].A),
+                   (int)levels[l].gs_dofs.size());
+    }
+    std::fprintf(fp, "[multigrid] operator complexity: %.3f\n",
+                 operator_complexity());
+  }
+
+ private:
+  struct Level {
+    std::unique_ptr<CSRMat> A, P, PT;
+    std::vector<T> diag, l1diag;
+    std::vector<int> gs_dofs;
+    mutable std::vector<T> r, b, x;  // work vectors
+  };
+
+  static int get_nnz(const CSRMat& A) { return A.rowp[A.nrows]; }
+
+  static CSRMat* add_identity_to_empty_rows(const CSRMat& A) {
+    std::vector<int> rowp(A.nrows + 1, 0), cols;
+    std::vector<T> vals;
+    cols.reserve(get_nnz(A) + A.nrows);
+    vals.reserve(get_nnz(A) + A.nrows);
+    for (int i = 0; i < A.nrows; i++) {
+      bool empty = true;
+      for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+        if (A.vals[jp] != T(0.0)) empty = false;
+      }
+      if (empty) {
+        cols.push_back(i);
+        vals.push_back(T(1.0));
+      } else {
+        cols.insert(cols.end(), A.cols + A.rowp[i], A.cols + A.rowp[i + 1]);
+        vals.insert(vals.end(), A.vals + A.rowp[i], A.vals + A.rowp[i + 1]);
+      }
+      rowp[i + 1] = cols.size();
+    }
+    return new CSRMat(A.nrows, A.ncols, rowp[A.nrows], rowp.data(), cols.data(),
+                      vals.data());
+  }
+
+  // r = b - A * x
+  static void residual(const CSRMat& A, const T* b, const T* x, T* r) {
+    csr_mult(A, x, r);
+#pragma omp parallel for
+    for (int i = 0; i < A.nrows; i++) r[i] = b[i] - r[i];
+  }
+
+  void jacobi(const Level& lv, const T* b, T* x) const {
+    residual(*lv.A, b, x, lv.r.data());
+#pragma omp parallel for
+    for (int i = 0; i < lv.A->nrows; i++) x[i] += lv.r[i] / lv.l1diag[i];
+  }
+
+  void gauss_seidel_row(const Level& lv, int i, const T* b, T* x) const {
+    const CSRMat& A = *lv.A;
+    T s = b[i];
+    for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+      s -= A.vals[jp] * x[A.cols[jp]];
+    }
+    x[i] += s / lv.diag[i];
+  }
+
+  void symmetric_gauss_seidel(const Level& lv, const T* b, T* x) const {
+    for (int i : lv.gs_dofs) gauss_seidel_row(lv, i, b, x);
+    for (auto it = lv.gs_dofs.rbegin(); it != lv.gs_dofs.rend(); it++) {
+      gauss_seidel_row(lv, *it, b, x);
+    }
+  }
+
+  void vcycle(int l, const T* b, T* x) const {
+    const Level& lv = levels[l];
+    int n = lv.A->nrows;
+
+    if (l == get_num_levels() - 1) {
+      // x += A^{-1} (b - A x)
+      residual(*lv.A, b, x, lv.r.data());
+      solve_coarse(lv.r.data());
+      for (int i = 0; i < n; i++) x[i] += lv.r[i];
+      return;
+    }
+
+    for (int s = 0; s < nu_pre; s++) {
+      jacobi(lv, b, x);
+      symmetric_gauss_seidel(lv, b, x);
+    }
+
+    // Restrict the residual and solve the coarse correction
+    residual(*lv.A, b, x, lv.r.data());
+    const Level& lc = levels[l + 1];
+    csr_mult(*lv.PT, lv.r.data(), lc.b.data());
+    std::fill(lc.x.begin(), lc.x.end(), T(0.0));
+    vcycle(l + 1, lc.b.data(), lc.x.data());
+
+    // Prolongate the correction
+    csr_mult(*lv.P, lc.x.data(), lv.r.data());
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) x[i] += lv.r[i];
+
+    for (int s = 0; s < nu_post; s++) {
+      symmetric_gauss_seidel(lv, b, x);
+      jacobi(lv, b, x);
+    }
+  }
+
+  void factor_coarse() {
+    clear_coarse_factor();
+    const CSRMat& A = *levels.back().A;
+    int n = A.nrows;
+
+    if (n <= max_dense_coarse_size) {
+      // Dense Cholesky, stored column by column
+      dense_chol.assign(n * n, T(0.0));
+      for (int i = 0; i < n; i++) {
+        for (int jp = A.rowp[i]; jp < A.rowp[i + 1]; jp++) {
+          dense_chol[i + n * A.cols[jp]] = A.vals[jp];
+        }
+      }
+      for (int j = 0; j < n; j++) {
+        T d = dense_chol[j + n * j];
+        for (int k = 0; k < j; k++) {
+          d -= dense_chol[j + n * k] * dense_chol[j + n * k];
+        }
+        if (freal(d) <= 0.0) {
+          throw std::runtime_error(
+              "coarsest multigrid operator is not positive definite");
+        }
+        d = sqrt(d);
+        dense_chol[j + n * j] = d;
+        for (int i = j + 1; i < n; i++) {
+          T s = dense_chol[i + n * j];
+          for (int k = 0; k < j; k++) {
+            s -= dense_chol[i + n * k] * dense_chol[j + n * k];
+          }
+          dense_chol[i + n * j] = s / d;
+        }
+      }
+    } else {
+      // The operator is symmetric, so its CSR arrays are also its CSC arrays
+      coarse_csc = new CSCMat(n, n, get_nnz(A), A.rowp, A.cols, A.vals);
+      coarse_chol = new SparseUtils::SparseCholesky<T>(coarse_csc);
+      coarse_chol->factor();
+    }
+  }
+
+  void solve_coarse(T* x) const {
+    if (coarse_chol) {
+      coarse_chol->solve(x);
+      return;
+    }
+    int n = levels.back().A->nrows;
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < i; k++) x[i] -= dense_chol[i + n * k] * x[k];
+      x[i] /= dense_chol[i + n * i];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      for (int k = i + 1; k < n; k++) x[i] -= dense_chol[k + n * i] * x[k];
+      x[i] /= dense_chol[i + n * i];
+    }
+  }
+
+  void clear_coarse_factor() {
+    if (coarse_chol) delete coarse_chol;
+    if (coarse_csc) delete coarse_csc;
+    coarse_chol = nullptr;
+    coarse_csc = nullptr;
+    dense_chol.clear();
+  }
+
+  std::vector<Level> levels;
+  int nu_pre = 2, nu_post = 2;
+
+  // Factorization of the coarsest operator
+  std::vector<T> dense_chol;
+  CSCMat* coarse_csc = nullptr;
+  SparseUtils::SparseCholesky<T>* coarse_chol = nullptr;
+};
+
+/**
+ * @brief Geometric multigrid for Galerkin difference discretizations
+ *
+ * The hierarchy follows the structured ground grid: each coarse grid halves
+ * the number of cells of the finer one. For a CutMesh, the coarse meshes are
+ * cut by the level set function injected from the finer grid. The
+ * prolongation interpolates the coarse GD basis at the fine nodes, coarse
+ * operators are Galerkin products.
+ *
+ * @tparam Mesh GridMesh or CutMesh, the mesh that defines the fine dof
+ * @tparam dof_per_node number of dof per node of the operator
+ */
+template <typename T, class Mesh, int dof_per_node = 1>
+class GDMultigrid final {
+ private:
+  static_assert(Mesh::is_gd_mesh, "GDMultigrid requires a GD mesh");
+  using Grid = typename Mesh::Grid;
+  using Basis = GDBasis2D<T, Mesh>;
+  static constexpr int Np_1d = Mesh::Np_1d;
+  static constexpr int spatial_dim = Mesh::spatial_dim;
+  static constexpr int max_nnodes_per_element = Mesh::max_nnodes_per_element;
+
+ public:
+  /**
+   * @param mesh the fine mesh
+   * @param max_levels maximum number of levels, including the finest one
+   * @param min_coarse_ndof coarsening stops once a level has no more dof than
+   * this
+   */
+  GDMultigrid(const Mesh& mesh, int max_levels = 10, int min_coarse_ndof = 500)
+      : mesh(mesh), max_levels(max_levels), min_coarse_ndof(min_coarse_ndof) {}
+
+  /**
+   * @brief Build the hierarchy for the current state of the mesh and the
+   * operator
+   *
+   * @param A the fine operator
+   * @param bc_dof Dirichlet dof, their rows and columns are replaced by the
+   * identity, and they are not corrected by the coarse levels
+   */
+  void setup(const GalerkinBSRMat<T, dof_per_node>* A,
+             const std::vector<int>& bc_dof = {}) {
+    build_meshes();
+
+    int nlevels = meshes.size() + 1;
+    std::vector<std::unique_ptr<SparseUtils::CSRMat<T>>> P(nlevels - 1);
+    std::vector<std::vector<int>> gs_dofs(nlevels);
+    const std::vector<int> no_bc_dof;
+    for (int l = 0; l < nlevels - 1; l++) {
+      P[l].reset(build_prolongation(get_mesh(l), *meshes[l],
+                                    l == 0 ? bc_dof : no_bc_dof));
+    }
+    for (int l = 0; l < nlevels; l++) {
+      gs_dofs[l] = get_gs_dofs(get_mesh(l), l == 0 ? bc_dof : no_bc_dof);
+    }
+
+    solver.setup(std::unique_ptr<SparseUtils::CSRMat<T>>(bsr_to_csr(A, bc_dof)),
+                 std::move(P), std::move(gs_dofs));
+  }
+
+  const MultigridSolver<T>& get_solver() const { return solver; }
+  MultigridSolver<T>& get_solver() { return solver; }
+
+  int get_num_levels() const { return solver.get_num_levels(); }
+
+  void vcycle(const T* b, T* x) const { solver.vcycle(b, x); }
+  void apply(const T* r, T* z) const { solver.apply(r, z); }
+
+  int solve(const T* b, T* x, double rtol = 1e-10, int max_iter = 100,
+            bool verbose = false) const {
+    return solver.solve(b, x, rtol, max_iter, verbose);
+  }
+  int solve_pcg(const T* b, T* x, double rtol = 1e-10, int max_iter = 500,
+                bool verbose = false) const {
+    return solver.solve_pcg(b, x, rtol, max_iter, verbose);
+  }
+
+ private:
+  const Mesh& get_mesh(int level) const {
+    return level == 0 ? mesh : *meshes[level - 1];
+  }
+
+  // Create the coarse grids and meshes
+  void build_meshes() {
+    meshes.clear();
+    grids.clear();
+
+    while ((int)meshes.size() + 1 < max_levels) {
+      const Mesh& fine = get_mesh(meshes.size());
+      const Grid& fgrid = fine.get_grid();
+      const int* nxy = fgrid.get_nxy();
+
+      if (fine.get_num_nodes() * dof_per_node <= min_coarse_ndof) break;
+      if (nxy[0] % 2 or nxy[1] % 2) break;
+      int nxy_c[spatial_dim] = {nxy[0] / 2, nxy[1] / 2};
+      if (nxy_c[0] < Np_1d - 1 or nxy_c[1] < Np_1d - 1) break;
+
+      auto grid = std::make_unique<Grid>(nxy_c, fgrid.get_lxy(),
+                                         fgrid.get_xy0());
+      std::unique_ptr<Mesh> coarse;
+      if constexpr (Mesh::is_cut_mesh) {
+        // Inject the level set function
+        coarse = std::make_unique<Mesh>(*grid);
+        std::vector<T>& lsf_c = coarse->get_lsf_dof();
+        const std::vector<T>& lsf_f = fine.get_lsf_dof();
+        for (int v = 0; v < grid->get_num_verts(); v++) {
+          int ixy[spatial_dim] = {-1, -1};
+          grid->get_vert_coords(v, ixy);
+          ixy[0] *= 2;
+          ixy[1] *= 2;
+          lsf_c[v] = lsf_f[fgrid.get_coords_vert(ixy)];
+        }
+        coarse->update_mesh();
+      } else {
+        coarse = std::make_unique<Mesh>(*grid);
+      }
+
+      // The coarse GD basis needs at least one regular stencil
+      if (coarse->get_num_elements() == 0 or
+          coarse->get_regular_stencil_elems().empty()) {
+        break;
+      }
+
+      grids.push_back(std::move(grid));
+      meshes.push_back(std::move(coarse));
+    }
+  }
+
+  // Get the element of the coarse mesh that is active on the given cell, or -1
+  static int get_cell_elem(const Mesh& m, int cell) {
+    if constexpr (Mesh::is_cut_mesh) {
+      const auto& cell_elems = m.get_cell_elems();
+      auto it = cell_elems.find(cell);
+      return it == cell_elems.end() ? -1 : it->second;
+    } else {
+      return cell;
+    }
+  }
+
+  // Get the cell of an element of the coarse mesh
+  static int get_elem_cell(const Mesh& m, int elem) {
+    if constexpr (Mesh::is_cut_mesh) {
+      return m.get_elem_cell(elem);
+    } else {
+      return elem;
+    }
+  }
+
+  /**
+   * @brief Build the prolongation from the coarse mesh to the fine mesh by
+   * evaluating the coarse GD basis at the fine nodes.
+   *
+   * A fine node is interpolated by the coarse element that contains it, or by
+   * the closest active coarse element if the containing cells are inactive,
+   * in which case the coarse polynomial basis is extrapolated. Thin features
+   * of the fine mesh may vanish on the coarse grid, their nodes are then
+   * extrapolated from the nearest active coarse element of the entire mesh.
+   *
+   * @return the prolongation, owned by the caller
+   */
+  SparseUtils::CSRMat<T>* build_prolongation(
+      const Mesh& fine, Mesh& coarse, const std::vector<int>& bc_dof) const {
+    const Grid& gf = fine.get_grid();
+    const Grid& gc = coarse.get_grid();
+    const int* nc = gc.get_nxy();
+
+    // Find the coarse element for each fine node
+    int nf = fine.get_num_nodes();
+    std::vector<int> node_elems(nf, -1);
+    for (int i = 0; i < nf; i++) {
+      int ixy[spatial_dim] = {-1, -1};
+      gf.get_vert_coords(fine.get_node_vert(i), ixy);
+      double u = 0.5 * ixy[0], v = 0.5 * ixy[1];  // in coarse cell units
+      int cx = std::min(ixy[0] / 2, nc[0] - 1);
+      int cy = std::min(ixy[1] / 2, nc[1] - 1);
+
+      // Distance from the node to the coarse cell (ex, ey), in cell units
+      auto cell_dist = [u, v](int ex, int ey) {
+        double dx = std::max({0.0, ex - u, u - (ex + 1)});
+        double dy = std::max({0.0, ey - v, v - (ey + 1)});
+        return std::max(dx, dy);
+      };
+
+      double dmin = std::numeric_limits<double>::max();
+      for (int ey = std::max(cy - Np_1d, 0);
+           ey <= std::min(cy + Np_1d, nc[1] - 1); ey++) {
+        for (int ex = std::max(cx - Np_1d, 0);
+             ex <= std::min(cx + Np_1d, nc[0] - 1); ex++) {
+          int e = get_cell_elem(coarse, gc.get_coords_cell(ex, ey));
+          if (e < 0) continue;
+          double d = cell_dist(ex, ey);
+          if (d < dmin) {
+            dmin = d;
+            node_elems[i] = e;
+          }
+        }
+      }
+
+      if (node_elems[i] < 0) {
+        for (int e = 0; e < coarse.get_num_elements(); e++) {
+          int exy[spatial_dim] = {-1, -1};
+          gc.get_cell_coords(get_elem_cell(coarse, e), exy);
+          double d = cell_dist(exy[0], exy[1]);
+          if (d < dmin) {
+            dmin = d;
+            node_elems[i] = e;
+          }
+        }
+      }
+    }
+
+    // Bucket fine nodes by coarse elements, so that the coarse basis of each
+    // element is only set up once
+    int nce = coarse.get_num_elements();
+    std::vector<int> ptr(nce + 1, 0), fine_nodes(nf);
+    for (int i = 0; i < nf; i++) ptr[node_elems[i] + 1]++;
+    for (int e = 0; e < nce; e++) ptr[e + 1] += ptr[e];
+    {
+      std::vector<int> pos(ptr.begin(), ptr.end() - 1);
+      for (int i = 0; i < nf; i++) fine_nodes[pos[node_elems[i]]++] = i;
+    }
+
+    std::vector<bool> is_bc(nf * dof_per_node, false);
+    for (int dof : bc_dof) is_bc[dof] = true;
+
+    // Interpolation weights of each fine node, nodal
+    std::vector<int> row_nnodes(nf, 0);
+    std::vector<int> row_nodes(nf * max_nnodes_per_element);
+    std::vector<T> row_vals(nf * max_nnodes_per_element);
+
+    Basis basis(coarse);
+    for (int e = 0; e < nce; e++) {
+      int npts = ptr[e + 1] - ptr[e];
+      if (npts == 0) continue;
+
+      T xmin[spatial_dim], xmax[spatial_dim];
+      coarse.get_elem_vert_ranges(e, xmin, xmax);
+
+      std::vector<T> pts(spatial_dim * npts), N, Nxi;
+      for (int k = 0; k < npts; k++) {
+        T xloc[spatial_dim];
+        fine.get_node_xloc(fine_nodes[ptr[e] + k], xloc);
+        for (int d = 0; d < spatial_dim; d++) {
+          pts[spatial_dim * k + d] = (xloc[d] - xmin[d]) / (xmax[d] - xmin[d]);
+        }
+      }
+      basis.eval_basis_grad(e, pts, N, Nxi);
+
+      int nodes[max_nnodes_per_element];
+      int nnodes = coarse.get_elem_dof_nodes(e, nodes);
+      for (int k = 0; k < npts; k++) {
+        int i = fine_nodes[ptr[e] + k];
+        row_nnodes[i] = nnodes;
+        for (int j = 0; j < nnodes; j++) {
+          row_nodes[max_nnodes_per_element * i + j] = nodes[j];
+          row_vals[max_nnodes_per_element * i + j] =
+              N[max_nnodes_per_element * k + j];
+        }
+      }
+    }
+
+    // Assemble the prolongation, block diagonal w.r.t. the dof of a node
+    int nrows = nf * dof_per_node;
+    int ncols = coarse.get_num_nodes() * dof_per_node;
+    std::vector<int> rowp(nrows + 1, 0), cols;
+    std::vector<T> vals;
+    std::vector<std::pair<int, T>> row;
+    for (int i = 0; i < nf; i++) {
+      for (int d = 0; d < dof_per_node; d++) {
+        int dof = dof_per_node * i + d;
+        if (not is_bc[dof]) {
+          row.clear();
+          for (int j = 0; j < row_nnodes[i]; j++) {
+            row.push_back(
+                {dof_per_node * row_nodes[max_nnodes_per_element * i + j] + d,
+                 row_vals[max_nnodes_per_element * i + j]});
+          }
+          std::sort(row.begin(), row.end(), [](const auto& p1, const auto& p2) {
+            return p1.first < p2.first;
+          });
+          for (auto& [c, val] : row) {
+            cols.push_back(c);
+            vals.push_back(val);
+          }
+        }
+        rowp[dof + 1] = cols.size();
+      }
+    }
+    return new SparseUtils::CSRMat<T>(nrows, ncols, rowp[nrows], rowp.data(),
+                                      cols.data(), vals.data());
+  }
+
+  // Dof of the elements that are cut or have irregular stencils, excluding the
+  // Dirichlet dof
+  static std::vector<int> get_gs_dofs(const Mesh& m,
+                                      const std::vector<int>& bc_dof) {
+    std::vector<bool> flag(m.get_num_nodes() * dof_per_node, false);
+    for (int e = 0; e < m.get_num_elements(); e++) {
+      bool irregular = not m.is_regular_stencil_elem(e);
+      if constexpr (Mesh::is_cut_mesh) {
+        irregular = irregular or m.is_cut_elem(e);
+      }
+      if (not irregular) continue;
+      int nodes[max_nnodes_per_element];
+      int nnodes = m.get_elem_dof_nodes(e, nodes);
+      for (int j = 0; j < nnodes; j++) {
+        for (int d = 0; d < dof_per_node; d++) {
+          flag[dof_per_node * nodes[j] + d] = true;
+        }
+      }
+    }
+    for (int dof : bc_dof) flag[dof] = false;
+
+    std::vector<int> dofs;
+    for (int i = 0; i < flag.size(); i++) {
+      if (flag[i]) dofs.push_back(i);
+    }
+    return dofs;
+  }
+
+  const Mesh& mesh;
+  int max_levels, min_coarse_ndof;
+
+  std::vector<std::unique_ptr<Grid>> grids;   // coarse grids
+  std::vector<std::unique_ptr<Mesh>> meshes;  // coarse meshes
+  MultigridSolver<T> solver;
+};
+
+#endif  // XCGD_MULTIGRID_H
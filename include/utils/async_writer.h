@@ -0,0 +1,150 @@
+#ifndef XCGD_ASYNC_WRITER_H
+#define XCGD_ASYNC_WRITER_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "utils/timer.h"
+
+/**
+ * @brief A dedicated output thread that executes write tasks in submission
+ * order
+ *
+ * The caller snapshots everything a task needs into the task itself (e.g. a
+ * fully buffered VTUWriter), so the computation can continue immediately.
+ * The queue is bounded: submit() blocks while max_pending tasks are waiting,
+ * which limits the memory held by snapshots if the disk cannot keep up.
+ *
+ * Example usage:
+ *   AsyncWriter writer;
+ *   auto j = std::make_shared<json>(...);
+ *   writer.submit([j]() { write_json("out.json", *j); });
+ *   ...
+ *   writer.flush();
+ */
+class AsyncWriter {
+ public:
+  /**
+   * @param max_pending maximum number of queued tasks, not counting the one
+   * being executed, 0 executes every task synchronously in submit()
+   */
+  AsyncWriter(int max_pending = 4) : max_pending(max_pending) {
+    if (max_pending > 0) {
+      worker = std::thread([this]() { run(); });
+    }
+  }
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  // Executes all queued tasks before returning
+  ~AsyncWriter() {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      stop = true;
+    }
+    cv_task.notify_all();
+    if (worker.joinable()) worker.join();
+    if (error) {
+      try {
+        std::rethrow_exception(error);
+      } catch (const std::exception& e) {
+        std::fprintf(stderr, "[AsyncWriter] a write task failed: %s\n",
+                     e.what());
+      }
+    }
+  }
+
+  /**
+   * @brief Queue a task, blocks while the queue is full
+   *
+   * If a previous task has thrown, the exception is rethrown here.
+   */
+  void submit(std::function<void()> task) {
+    if (max_pending == 0) {
+      task();
+      return;
+    }
+
+    StopWatch watch;
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_space.wait(lock,
+                  [this]() { return tasks.size() < max_pending or error; });
+    blocked_time += watch.lap();
+    rethrow_error();
+    tasks.push_back(std::move(task));
+    lock.unlock();
+    cv_task.notify_one();
+  }
+
+  // Wait until all submitted tasks are executed
+  void flush() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_space.wait(lock, [this]() { return tasks.empty() and !busy; });
+    rethrow_error();
+  }
+
+  // Total time submit() has spent waiting for the queue
+  double get_blocked_time() const {
+    std::unique_lock<std::mutex> lock(mtx);
+    return blocked_time;
+  }
+
+ private:
+  void run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_task.wait(lock, [this]() { return stop or !tasks.empty(); });
+        if (tasks.empty()) return;  // stop requested and nothing left
+        task = std::move(tasks.front());
+        tasks.pop_front();
+        busy = true;
+      }
+      cv_space.notify_all();
+
+      std::exception_ptr e = nullptr;
+      try {
+        task();
+      } catch (...) {
+        e = std::current_exception();
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        busy = false;
+        if (e and !error) error = e;
+      }
+      cv_space.notify_all();
+    }
+  }
+
+  // Must be called with mtx locked
+  void rethrow_error() {
+    if (error) {
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  int max_pending;
+  std::thread worker;
+
+  mutable std::mutex mtx;
+  std::condition_variable cv_task;   // a task is queued or stop is requested
+  std::condition_variable cv_space;  // a task is taken or finished
+  std::deque<std::function<void()>> tasks;
+  bool busy = false;
+  bool stop = false;
+  std::exception_ptr error = nullptr;
+  double blocked_time = 0.0;
+};
+
+#endif  // XCGD_ASYNC_WRITER_H
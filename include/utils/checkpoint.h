@@ -0,0 +1,373 @@
+#ifndef XCGD_CHECKPOINT_H
+#define XCGD_CHECKPOINT_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Binary checkpoint format, version 1
+ *
+ *   header (64 bytes):
+ *     char     magic[8]     "XCGDCKPT"
+ *     uint32   version
+ *     uint32   byte order mark 0x01020304
+ *     uint64   number of entries
+ *     uint64   offset of the entry table
+ *     padding
+ *   arrays: raw data, each starting at a 64-byte aligned offset
+ *   entry table, for each entry:
+ *     uint32   length of the name, followed by the name
+ *     uint32   data type, see CheckpointType
+ *     uint64   number of values
+ *     uint64   offset of the data
+ *
+ * All integers and arrays are little-endian, complex values are pairs of
+ * little-endian doubles. The arrays are aligned in the file, so a reader on a
+ * little-endian machine can use them in place from a memory map, a big-endian
+ * machine swaps the bytes when it copies them.
+ */
+enum class CheckpointType : std::uint32_t {
+  UINT8 = 1,
+  INT32 = 2,
+  INT64 = 3,
+  FLOAT32 = 4,
+  FLOAT64 = 5,
+  COMPLEX128 = 6
+};
+
+template <typename V>
+constexpr CheckpointType checkpoint_type() {
+  if constexpr (std::is_same_v<V, std::uint8_t> or std::is_same_v<V, char>) {
+    return CheckpointType::UINT8;
+  } else if constexpr (std::is_same_v<V, std::int32_t>) {
+    return CheckpointType::INT32;
+  } else if constexpr (std::is_same_v<V, std::int64_t>) {
+    return CheckpointType::INT64;
+  } else if constexpr (std::is_same_v<V, float>) {
+    return CheckpointType::FLOAT32;
+  } else if constexpr (std::is_same_v<V, double>) {
+    return CheckpointType::FLOAT64;
+  } else {
+    static_assert(std::is_same_v<V, std::complex<double>>,
+                  "unsupported checkpoint data type");
+    return CheckpointType::COMPLEX128;
+  }
+}
+
+constexpr std::uint32_t checkpoint_version = 1;
+constexpr char checkpoint_magic[8] = {'X', 'C', 'G', 'D', 'C', 'K', 'P', 'T'};
+constexpr std::uint32_t checkpoint_bom = 0x01020304;
+constexpr std::size_t checkpoint_alignment = 64;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool checkpoint_native_little_endian = false;
+#else
+constexpr bool checkpoint_native_little_endian = true;
+#endif
+
+// Size of the words whose bytes are swapped, i.e. of the real components
+inline std::size_t checkpoint_word_size(CheckpointType type) {
+  switch (type) {
+    case CheckpointType::UINT8:
+      return 1;
+    case CheckpointType::INT32:
+    case CheckpointType::FLOAT32:
+      return 4;
+    case CheckpointType::INT64:
+    case CheckpointType::FLOAT64:
+    case CheckpointType::COMPLEX128:
+      return 8;
+  }
+  throw std::runtime_error("unknown checkpoint data type");
+}
+
+// Reverse the byte order of each word of size w in the nbytes of data
+inline void checkpoint_byteswap(std::uint8_t* data, std::size_t nbytes,
+                                std::size_t w) {
+  for (std::size_t i = 0; i + w <= nbytes; i += w) {
+    std::reverse(data + i, data + i + w);
+  }
+}
+
+// Convert between the native and the little-endian byte order, the
+// conversion is its own inverse
+inline void checkpoint_to_little_endian(std::uint8_t* data, std::size_t nbytes,
+                                        std::size_t w) {
+  if (!checkpoint_native_little_endian) checkpoint_byteswap(data, nbytes, w);
+}
+
+// Unsigned integer to and from its little-endian bytes
+template <typename U>
+void checkpoint_put_le(char* dst, U val) {
+  for (std::size_t i = 0; i < sizeof(U); i++) {
+    dst[i] = static_cast<char>((val >> (8 * i)) & 0xff);
+  }
+}
+
+template <typename U>
+U checkpoint_get_le(const std::uint8_t* src) {
+  U val = 0;
+  for (std::size_t i = 0; i < sizeof(U); i++) val |= U(src[i]) << (8 * i);
+  return val;
+}
+
+/**
+ * @brief Collects named arrays and writes them to a checkpoint file
+ *
+ * The data is copied by add(), so the writer is a complete snapshot that can
+ * be written later, e.g. by an AsyncWriter.
+ */
+class CheckpointWriter {
+ public:
+  template <typename V>
+  void add(const std::string& name, const V* data, std::size_t size) {
+    Entry& e = entries[name];
+    e.type = checkpoint_type<V>();
+    e.count = size;
+    e.bytes.resize(size * sizeof(V));
+    if (size) std::memcpy(e.bytes.data(), data, e.bytes.size());
+    checkpoint_to_little_endian(e.bytes.data(), e.bytes.size(),
+                                checkpoint_word_size(e.type));
+  }
+
+  template <typename V>
+  void add(const std::string& name, const std::vector<V>& vals) {
+    add(name, vals.data(), vals.size());
+  }
+
+  template <typename V>
+  void add_scalar(const std::string& name, V val) {
+    add(name, &val, 1);
+  }
+
+  void add_string(const std::string& name, const std::string& str) {
+    add(name, str.data(), str.size());
+  }
+
+  /**
+   * @brief Write the checkpoint, a temporary file is renamed to path once
+   * complete, so an existing checkpoint is never left half written
+   */
+  void write(const std::string& path) const {
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out) {
+      throw std::runtime_error("CheckpointWriter: failed to open " + tmp_path);
+    }
+
+    // Data offsets
+    std::map<std::string, std::uint64_t> offsets;
+    std::uint64_t offset = checkpoint_alignment;
+    for (const auto& [name, e] : entries) {
+      offsets[name] = offset;
+      offset = align(offset + e.bytes.size());
+    }
+    std::uint64_t table_offset = offset;
+
+    char header[checkpoint_alignment] = {};
+    std::uint64_t nentries = entries.size();
+    std::memcpy(header, checkpoint_magic, 8);
+    checkpoint_put_le(header + 8, checkpoint_version);
+    checkpoint_put_le(header + 12, checkpoint_bom);
+    checkpoint_put_le(header + 16, nentries);
+    checkpoint_put_le(header + 24, table_offset);
+    out.write(header, checkpoint_alignment);
+
+    const char zeros[checkpoint_alignment] = {};
+    for (const auto& [name, e] : entries) {
+      out.write(reinterpret_cast<const char*>(e.bytes.data()), e.bytes.size());
+      std::size_t pad = align(e.bytes.size()) - e.bytes.size();
+      out.write(zeros, pad);
+    }
+
+    for (const auto& [name, e] : entries) {
+      char buf[20];
+      checkpoint_put_le(buf, std::uint32_t(name.size()));
+      out.write(buf, 4);
+      out.write(name.data(), name.size());
+      checkpoint_put_le(buf, static_cast<std::uint32_t>(e.type));
+      checkpoint_put_le(buf + 4, e.count);
+      checkpoint_put_le(buf + 12, offsets[name]);
+      out.write(buf, 20);
+    }
+
+    out.close();
+    if (!out) {
+      throw std::runtime_error("CheckpointWriter: failed to write " +
+                               tmp_path);
+    }
+    std::filesystem::rename(tmp_path, path);
+  }
+
+ private:
+  struct Entry {
+    CheckpointType type;
+    std::uint64_t count = 0;
+    std::vector<std::uint8_t> bytes;
+  };
+
+  static std::uint64_t align(std::uint64_t n) {
+    return (n + checkpoint_alignment - 1) / checkpoint_alignment *
+           checkpoint_alignment;
+  }
+
+  std::map<std::string, Entry> entries;
+};
+
+/**
+ * @brief Memory-mapped reader of a checkpoint file
+ *
+ * view() returns pointers into the mapping without copying, they are valid
+ * for the lifetime of the reader. The arrays are only usable in place on a
+ * little-endian machine, get() converts them to the native byte order.
+ */
+class CheckpointReader {
+ public:
+  CheckpointReader(const std::string& path) : path(path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) fail("failed to open");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      fail("failed to stat");
+    }
+    size = st.st_size;
+    if (size < checkpoint_alignment) {
+      close(fd);
+      fail("file too small");
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) fail("mmap failed");
+    data = static_cast<const std::uint8_t*>(ptr);
+
+    if (std::memcmp(data, checkpoint_magic, 8) != 0) {
+      unmap();
+      fail("not a checkpoint file");
+    }
+    version = checkpoint_get_le<std::uint32_t>(data + 8);
+    std::uint32_t bom = checkpoint_get_le<std::uint32_t>(data + 12);
+    std::uint64_t nentries = checkpoint_get_le<std::uint64_t>(data + 16);
+    std::uint64_t table_offset = checkpoint_get_le<std::uint64_t>(data + 24);
+    if (bom != checkpoint_bom) {
+      unmap();
+      fail("byte order mismatch");
+    }
+    if (version > checkpoint_version) {
+      unmap();
+      fail("written by a newer version");
+    }
+
+    std::uint64_t p = table_offset;
+    for (std::uint64_t i = 0; i < nentries; i++) {
+      Entry e;
+      if (p + 4 > size) break;
+      std::uint32_t len = checkpoint_get_le<std::uint32_t>(data + p);
+      if (p + 4 + len + 20 > size) break;
+      std::string name(reinterpret_cast<const char*>(data + p + 4), len);
+      p += 4 + len;
+      e.type = static_cast<CheckpointType>(
+          checkpoint_get_le<std::uint32_t>(data + p));
+      e.count = checkpoint_get_le<std::uint64_t>(data + p + 4);
+      e.offset = checkpoint_get_le<std::uint64_t>(data + p + 12);
+      p += 20;
+      entries[name] = e;
+    }
+    if (entries.size() != nentries) {
+      unmap();
+      fail("truncated entry table");
+    }
+  }
+
+  CheckpointReader(const CheckpointReader&) = delete;
+  CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+  ~CheckpointReader() { unmap(); }
+
+  std::uint32_t get_version() const { return version; }
+
+  bool has(const std::string& name) const { return entries.count(name); }
+
+  // Pointer to the little-endian data of the entry in the mapping, and its
+  // size, only available on a little-endian machine
+  template <typename V>
+  const V* view(const std::string& name, std::size_t* count) const {
+    if (!checkpoint_native_little_endian) {
+      fail("in-place views need a little-endian machine, use get()");
+    }
+    return raw<V>(name, count);
+  }
+
+  template <typename V>
+  std::vector<V> get(const std::string& name) const {
+    std::size_t count;
+    const V* ptr = raw<V>(name, &count);
+    std::vector<V> vals(count);
+    if (count) std::memcpy(vals.data(), ptr, count * sizeof(V));
+    checkpoint_to_little_endian(reinterpret_cast<std::uint8_t*>(vals.data()),
+                                count * sizeof(V),
+                                checkpoint_word_size(checkpoint_type<V>()));
+    return vals;
+  }
+
+  template <typename V>
+  V get_scalar(const std::string& name) const {
+    std::vector<V> vals = get<V>(name);
+    if (vals.size() != 1) fail(name + " is not a scalar");
+    return vals[0];
+  }
+
+  std::string get_string(const std::string& name) const {
+    std::size_t count;
+    const char* ptr = raw<char>(name, &count);
+    return std::string(ptr, count);
+  }
+
+ private:
+  struct Entry {
+    CheckpointType type;
+    std::uint64_t count = 0, offset = 0;
+  };
+
+  template <typename V>
+  const V* raw(const std::string& name, std::size_t* count) const {
+    auto it = entries.find(name);
+    if (it == entries.end()) fail("no entry " + name);
+    const Entry& e = it->second;
+    if (e.type != checkpoint_type<V>()) fail("type mismatch for " + name);
+    if (e.offset + e.count * sizeof(V) > size) fail("truncated entry " + name);
+    *count = e.count;
+    return reinterpret_cast<const V*>(data + e.offset);
+  }
+
+  [[noreturn]] void fail(const std::string& msg) const {
+    throw std::runtime_error("CheckpointReader(" + path + "): " + msg);
+  }
+
+  void unmap() {
+    if (data) munmap(const_cast<std::uint8_t*>(data), size);
+    data = nullptr;
+  }
+
+  std::string path;
+  const std::uint8_t* data = nullptr;
+  std::size_t size = 0;
+  std::uint32_t version = 0;
+  std::map<std::string, Entry> entries;
+};
+
+#endif  // XCGD_CHECKPOINT_H
@@ -0,0 +1,727 @@
+#ifndef XCGD_CHOLESKY_H
+#define XCGD_CHOLESKY_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sparse_utils/sparse_utils.h"
+#include "utils/memory.h"
+#include "utils/misc.h"
+
+/**
+ * @brief Fill-reducing ordering of a symmetric sparsity pattern by automatic
+ * nested dissection
+ *
+ * The graph is recursively bisected by the middle level of a breadth-first
+ * level structure rooted at a pseudo-peripheral node, the separator is
+ * ordered after the two halves. Only the pattern is needed, so this works on
+ * any matrix that bsr_to_csc() produces.
+ *
+ * @param n number of rows/columns
+ * @param colp, rows CSC pattern of the full symmetric matrix
+ * @param leaf_size subgraphs not larger than this are not bisected further
+ * @return perm, perm[k] is the original index of the k-th pivot
+ */
+inline std::vector<int> nested_dissection_ordering(int n, const int* colp,
+                                                   const int* rows,
+                                                   int leaf_size = 64) {
+  std::vector<int> perm;
+  perm.reserve(n);
+
+  // Subgraph label of each node, -1 once the node has been ordered
+  std::vector<int> label(n, 0);
+  std::vector<int> level(n, -1);
+  int num_labels = 1;
+
+  // Level structure of the component of root within the subgraph lab
+  auto bfs = [&](int root, int lab, std::vector<std::vector<int>>& levels) {
+    levels.clear();
+    levels.push_back({root});
+    level[root] = 0;
+    while (true) {
+      std::vector<int> next;
+      for (int i : levels.back()) {
+        for (int p = colp[i]; p < colp[i + 1]; p++) {
+          int j = rows[p];
+          if (label[j] == lab and level[j] < 0) {
+            level[j] = levels.size();
+            next.push_back(j);
+          }
+        }
+      }
+      if (next.empty()) break;
+      levels.push_back(std::move(next));
+    }
+    for (auto& l : levels) {
+      for (int i : l) level[i] = -1;
+    }
+  };
+
+  auto degree = [&](int i) { return colp[i + 1] - colp[i]; };
+
+  auto dissect = [&](auto& self, std::vector<int> nodes, int lab) -> void {
+    if (nodes.size() <= leaf_size) {
+      for (int i : nodes) label[i] = -1;
+      perm.insert(perm.end(), nodes.begin(), nodes.end());
+      return;
+    }
+
+    // Find a pseudo-peripheral root
+    std::vector<std::vector<int>> levels;
+    int root = nodes[0];
+    bfs(root, lab, levels);
+    for (int pass = 0; pass < 4; pass++) {
+      const auto& last = levels.back();
+      int cand = *std::min_element(
+          last.begin(), last.end(),
+          [&](int a, int b) { return degree(a) < degree(b); });
+      std::vector<std::vector<int>> cand_levels;
+      bfs(cand, lab, cand_levels);
+      if (cand_levels.size() <= levels.size()) break;
+      root = cand;
+      levels = std::move(cand_levels);
+    }
+
+    int nreached = 0;
+    for (auto& l : levels) nreached += l.size();
+
+    // Disconnected subgraph: split off the component of root
+    if (nreached < nodes.size()) {
+      int lab_comp = num_labels++, lab_rest = num_labels++;
+      std::vector<int> comp, rest;
+      comp.reserve(nreached);
+      for (auto& l : levels) {
+        for (int i : l) label[i] = lab_comp;
+        comp.insert(comp.end(), l.begin(), l.end());
+      }
+      for (int i : nodes) {
+        if (label[i] == lab) {
+          label[i] = lab_rest;
+          rest.push_back(i);
+        }
+      }
+      self(self, std::move(comp), lab_comp);
+      self(self, std::move(rest), lab_rest);
+      return;
+    }
+
+    // Too few levels to separate anything
+    if (levels.size() < 3) {
+      for (int i : nodes) label[i] = -1;
+      perm.insert(perm.end(), nodes.begin(), nodes.end());
+      return;
+    }
+
+    // The separator is the first level past half of the nodes
+    int sep = 1, count = levels[0].size();
+    while (sep < levels.size() - 2 and
+           count + levels[sep].size() <= nreached / 2) {
+      count += levels[sep].size();
+      sep++;
+    }
+
+    int lab_a = num_labels++, lab_b = num_labels++;
+    std::vector<int> a, b;
+    for (int l = 0; l < levels.size(); l++) {
+      if (l == sep) continue;
+      int lab_l = l < sep ? lab_a : lab_b;
+      auto& part = l < sep ? a : b;
+      for (int i : levels[l]) label[i] = lab_l;
+      part.insert(part.end(), levels[l].begin(), levels[l].end());
+    }
+    for (int i : levels[sep]) label[i] = -1;
+
+    self(self, std::move(a), lab_a);
+    self(self, std::move(b), lab_b);
+    perm.insert(perm.end(), levels[sep].begin(), levels[sep].end());
+  };
+
+  std::vector<int> nodes(n);
+  for (int i = 0; i < n; i++) nodes[i] = i;
+  dissect(dissect, std::move(nodes), 0);
+
+  return perm;
+}
+
+/**
+ * @brief Pattern of A + A^T without the duplicated diagonal, given the
+ * pattern of one triangle of a symmetric matrix A
+ */
+inline void symmetrize_pattern(int n, const int* colp, const int* rows,
+                               std::vector<int>& full_colp,
+                               std::vector<int>& full_rows) {
+  full_colp.assign(n + 1, 0);
+  for (int j = 0; j < n; j++) {
+    for (int p = colp[j]; p < colp[j + 1]; p++) {
+      int i = rows[p];
+      full_colp[j + 1]++;
+      if (i != j) full_colp[i + 1]++;
+    }
+  }
+  for (int j = 0; j < n; j++) full_colp[j + 1] += full_colp[j];
+  full_rows.resize(full_colp[n]);
+  std::vector<int> next(full_colp.begin(), full_colp.end() - 1);
+  for (int j = 0; j < n; j++) {
+    for (int p = colp[j]; p < colp[j + 1]; p++) {
+      int i = rows[p];
+      full_rows[next[j]++] = i;
+      if (i != j) full_rows[next[i]++] = j;
+    }
+  }
+}
+
+/**
+ * @brief Up-looking simplicial Cholesky factorization P A P^T = L L^T of a
+ * sparse symmetric positive definite matrix
+ *
+ * The factor is stored in the numeric type T, which does not have to match
+ * the type of the input matrix, in particular a double matrix can be factored
+ * in single precision.
+ *
+ * @tparam T numeric type of the factor
+ */
+template <typename T>
+class SimplicialCholesky final {
+ public:
+  /**
+   * @param n number of rows/columns
+   * @param colp, rows CSC pattern of the full (both triangles) matrix, or of
+   * its upper triangle only if upper_only is true
+   * @param perm fill-reducing ordering, nested dissection if empty
+   * @param upper_only whether only the upper triangle is stored, e.g. the
+   * output of SymmetricGalerkinBSRMat::to_csc()
+   */
+  SimplicialCholesky(int n, const int* colp, const int* rows,
+                     std::vector<int> perm = {}, bool upper_only = false)
+      : n(n), perm(std::move(perm)) {
+    if (this->perm.empty()) {
+      if (upper_only) {
+        // The ordering needs the adjacency of both triangles
+        std::vector<int> full_colp, full_rows;
+        symmetrize_pattern(n, colp, rows, full_colp, full_rows);
+        this->perm = nested_dissection_ordering(n, full_colp.data(),
+                                                full_rows.data());
+      } else {
+        this->perm = nested_dissection_ordering(n, colp, rows);
+      }
+    }
+    pinv.resize(n);
+    for (int k = 0; k < n; k++) pinv[this->perm[k]] = k;
+
+    // Upper triangle of P A P^T, Cmap[p] is the location of the p-th entry
+    // of the input in C, or -1 if it belongs to the lower triangle. An upper
+    // triangle input entry is moved to the upper triangle of P A P^T
+    // instead, as its transpose is not stored
+    auto to_upper = [&](int p, int j, int& ci, int& cj) {
+      ci = pinv[rows[p]], cj = pinv[j];
+      if (upper_only and ci > cj) std::swap(ci, cj);
+      return ci <= cj;
+    };
+
+    Cp.assign(n + 1, 0);
+    int nnz = colp[n];
+    for (int j = 0; j < n; j++) {
+      for (int p = colp[j]; p < colp[j + 1]; p++) {
+        int ci, cj;
+        if (to_upper(p, j, ci, cj)) Cp[cj + 1]++;
+      }
+    }
+    for (int j = 0; j < n; j++) Cp[j + 1] += Cp[j];
+    Ci.resize(Cp[n]);
+    Cmap.assign(nnz, -1);
+    std::vector<int> next(Cp.begin(), Cp.end() - 1);
+    for (int j = 0; j < n; j++) {
+      for (int p = colp[j]; p < colp[j + 1]; p++) {
+        int ci, cj;
+        if (to_upper(p, j, ci, cj)) {
+          Cmap[p] = next[cj];
+          Ci[next[cj]++] = ci;
+        }
+      }
+    }
+
+    etree();
+    symbolic();
+  }
+
+  /**
+   * @brief Set up the factorization of a CSC matrix, the interface follows
+   * SparseUtils::SparseCholesky
+   *
+   * @param mat symmetric positive definite matrix, only needed until factor()
+   * returns
+   * @param upper_only whether mat only stores its upper triangle
+   */
+  template <typename VT>
+  explicit SimplicialCholesky(SparseUtils::CSCMat<VT>* mat,
+                              bool upper_only = false)
+      : SimplicialCholesky(mat->ncols, mat->colp, mat->rows, {}, upper_only) {
+    set_values(mat->vals);
+  }
+
+  /**
+   * @brief Compute the numeric factorization
+   *
+   * @param vals values of the matrix, in the pattern passed to the
+   * constructor, of any type convertible to T
+   * @return true if successful, false if a non-positive pivot is met
+   */
+  template <typename VT>
+  bool factor(const VT* vals) {
+    set_values(vals);
+    return numeric();
+  }
+
+  // Factor the matrix passed to the constructor
+  void factor() {
+    if (!numeric()) {
+      throw std::runtime_error(
+          "SimplicialCholesky: matrix is not positive definite");
+    }
+  }
+
+  /**
+   * @brief Solve A x = b in place
+   *
+   * Both triangular sweeps run level by level, the rows within a level are
+   * independent and are processed in parallel.
+   *
+   * @param x on entry the right hand side, on exit the solution
+   */
+  template <typename VT>
+  void solve(VT* x) const {
+    std::vector<T> y(n);
+    for (int k = 0; k < n; k++) y[k] = T(x[perm[k]]);
+
+    // L y = b, row by row
+    for (int l = 0; l < num_levels(); l++) {
+#pragma omp parallel for if (level_ptr[l + 1] - level_ptr[l] > 64)
+      for (int q = level_ptr[l]; q < level_ptr[l + 1]; q++) {
+        int i = level_nodes[q];
+        T yi = y[i];
+        for (int p = LTp[i]; p < LTp[i + 1]; p++) yi -= LTx[p] * y[LTj[p]];
+        y[i] = yi / Lx[Lp[i]];
+      }
+    }
+
+    // L^T x = y, column by column of L in the reverse level order
+    for (int l = num_levels() - 1; l >= 0; l--) {
+#pragma omp parallel for if (level_ptr[l + 1] - level_ptr[l] > 64)
+      for (int q = level_ptr[l]; q < level_ptr[l + 1]; q++) {
+        int j = level_nodes[q];
+        T yj = y[j];
+        for (int p = Lp[j] + 1; p < Lp[j + 1]; p++) yj -= Lx[p] * y[Li[p]];
+        y[j] = yj / Lx[Lp[j]];
+      }
+    }
+
+    for (int k = 0; k < n; k++) x[perm[k]] = VT(y[k]);
+  }
+
+  /**
+   * @brief Solve A X = B in place for nrhs right hand sides
+   *
+   * The factor is traversed once for all right hand sides, which are stored
+   * interleaved in the work array so each entry of L is applied to a
+   * contiguous row of nrhs values.
+   *
+   * @param x on entry the right hand sides, on exit the solutions, column
+   * major n x nrhs
+   */
+  template <typename VT>
+  void solve(VT* x, int nrhs) const {
+    if (nrhs == 1) {
+      solve(x);
+      return;
+    }
+
+    std::vector<T> y(std::size_t(n) * nrhs);
+    for (int r = 0; r < nrhs; r++) {
+      for (int k = 0; k < n; k++) {
+        y[std::size_t(k) * nrhs + r] = T(x[std::size_t(r) * n + perm[k]]);
+      }
+    }
+
+    // L Y = B, row by row
+    for (int l = 0; l < num_levels(); l++) {
+#pragma omp parallel for if (level_ptr[l + 1] - level_ptr[l] > 64)
+      for (int q = level_ptr[l]; q < level_ptr[l + 1]; q++) {
+        int i = level_nodes[q];
+        T* yi = &y[std::size_t(i) * nrhs];
+        for (int p = LTp[i]; p < LTp[i + 1]; p++) {
+          const T* yj = &y[std::size_t(LTj[p]) * nrhs];
+          for (int r = 0; r < nrhs; r++) yi[r] -= LTx[p] * yj[r];
+        }
+        for (int r = 0; r < nrhs; r++) yi[r] /= Lx[Lp[i]];
+      }
+    }
+
+    // L^T X = Y, column by column of L in the reverse level order
+    for (int l = num_levels() - 1; l >= 0; l--) {
+#pragma omp parallel for if (level_ptr[l + 1] - level_ptr[l] > 64)
+      for (int q = level_ptr[l]; q < level_ptr[l + 1]; q++) {
+        int j = level_nodes[q];
+        T* yj = &y[std::size_t(j) * nrhs];
+        for (int p = Lp[j] + 1; p < Lp[j + 1]; p++) {
+          const T* yi = &y[std::size_t(Li[p]) * nrhs];
+          for (int r = 0; r < nrhs; r++) yj[r] -= Lx[p] * yi[r];
+        }
+        for (int r = 0; r < nrhs; r++) yj[r] /= Lx[Lp[j]];
+      }
+    }
+
+    for (int r = 0; r < nrhs; r++) {
+      for (int k = 0; k < n; k++) {
+        x[std::size_t(r) * n + perm[k]] = VT(y[std::size_t(k) * nrhs + r]);
+      }
+    }
+  }
+
+  int get_size() const { return n; }
+  int get_factor_nnz() const { return Lp[n]; }
+  const std::vector<int>& get_perm() const { return perm; }
+
+  // Bytes of the factor, the ordering and the symbolic data
+  std::size_t get_memory_bytes() const {
+    return memory_bytes(perm) + memory_bytes(pinv) + memory_bytes(parent) +
+           memory_bytes(Cp) + memory_bytes(Ci) + memory_bytes(Cmap) +
+           memory_bytes(Cx) + memory_bytes(Lp) + memory_bytes(Li) +
+           memory_bytes(Lx) + memory_bytes(LTp) + memory_bytes(LTj) +
+           memory_bytes(LTx) + memory_bytes(level_ptr) +
+           memory_bytes(level_nodes);
+  }
+
+ private:
+  template <typename VT>
+  void set_values(const VT* vals) {
+    Cx.assign(Ci.size(), T(0.0));
+    for (int p = 0; p < Cmap.size(); p++) {
+      if (Cmap[p] >= 0) Cx[Cmap[p]] += T(vals[p]);
+    }
+  }
+
+  bool numeric() {
+    std::vector<T> x(n, T(0.0));
+    std::vector<int> c(Lp.begin(), Lp.end() - 1), s(n), w(n, -1);
+    for (int k = 0; k < n; k++) {
+      int top = ereach(k, s.data(), w.data());
+      x[k] = 0.0;
+      for (int p = Cp[k]; p < Cp[k + 1]; p++) x[Ci[p]] += Cx[p];
+      T d = x[k];
+      x[k] = 0.0;
+      for (; top < n; top++) {
+        int i = s[top];
+        T lki = x[i] / Lx[Lp[i]];
+        x[i] = 0.0;
+        for (int p = Lp[i] + 1; p < c[i]; p++) x[Li[p]] -= Lx[p] * lki;
+        d -= lki * lki;
+        int p = c[i]++;
+        Li[p] = k;
+        Lx[p] = lki;
+      }
+      if (!(freal(d) > 0.0)) return false;
+      int p = c[k]++;
+      Li[p] = k;
+      Lx[p] = sqrt(d);
+    }
+
+    // Strictly lower part of L by rows, for the forward sweep
+    LTp.assign(n + 1, 0);
+    for (int j = 0; j < n; j++) {
+      for (int p = Lp[j] + 1; p < Lp[j + 1]; p++) LTp[Li[p] + 1]++;
+    }
+    for (int i = 0; i < n; i++) LTp[i + 1] += LTp[i];
+    LTj.resize(LTp[n]);
+    LTx.resize(LTp[n]);
+    std::copy(LTp.begin(), LTp.end() - 1, c.begin());
+    for (int j = 0; j < n; j++) {
+      for (int p = Lp[j] + 1; p < Lp[j + 1]; p++) {
+        int q = c[Li[p]]++;
+        LTj[q] = j;
+        LTx[q] = Lx[p];
+      }
+    }
+    return true;
+  }
+
+  int num_levels() const { return level_ptr.size() - 1; }
+
+  // Elimination tree of C
+  void etree() {
+    parent.assign(n, -1);
+    std::vector<int> ancestor(n, -1);
+    for (int k = 0; k < n; k++) {
+      for (int p = Cp[k]; p < Cp[k + 1]; p++) {
+        for (int i = Ci[p], inext; i != -1 and i < k; i = inext) {
+          inext = ancestor[i];
+          ancestor[i] = k;
+          if (inext == -1) parent[i] = k;
+        }
+      }
+    }
+  }
+
+  // Nonzero pattern of the k-th row of L, stored in s[top:n] in topological
+  // order
+  int ereach(int k, int* s, int* w) const {
+    int top = n;
+    w[k] = k;
+    for (int p = Cp[k]; p < Cp[k + 1]; p++) {
+      int i = Ci[p];
+      if (i > k) continue;
+      int len = 0;
+      for (; w[i] != k; i = parent[i]) {
+        s[len++] = i;
+        w[i] = k;
+      }
+      while (len > 0) s[--top] = s[--len];
+    }
+    return top;
+  }
+
+  // Column pointers of L from the row patterns
+  void symbolic() {
+    std::vector<int> counts(n, 1), s(n), w(n, -1);
+    for (int k = 0; k < n; k++) {
+      for (int top = ereach(k, s.data(), w.data()); top < n; top++) {
+        counts[s[top]]++;
+      }
+    }
+    Lp.assign(n + 1, 0);
+    for (int j = 0; j < n; j++) Lp[j + 1] = Lp[j] + counts[j];
+    Li.resize(Lp[n]);
+    Lx.resize(Lp[n]);
+
+    // Level of a column is its height in the elimination tree, the row
+    // pattern of L(j, :) only contains descendants of j
+    std::vector<int> level(n, 0);
+    int nlevels = 0;
+    for (int j = 0; j < n; j++) {
+      if (parent[j] >= 0) {
+        level[parent[j]] = std::max(level[parent[j]], level[j] + 1);
+      }
+      nlevels = std::max(nlevels, level[j] + 1);
+    }
+    level_ptr.assign(nlevels + 1, 0);
+    for (int j = 0; j < n; j++) level_ptr[level[j] + 1]++;
+    for (int l = 0; l < nlevels; l++) level_ptr[l + 1] += level_ptr[l];
+    level_nodes.resize(n);
+    std::vector<int> next(level_ptr.begin(), level_ptr.end() - 1);
+    for (int j = 0; j < n; j++) level_nodes[next[level[j]]++] = j;
+  }
+
+  int n;
+  std::vector<int> perm, pinv, parent;
+
+  // Upper triangle of the permuted matrix
+  std::vector<int> Cp, Ci, Cmap;
+  std::vector<T> Cx;
+
+  // The factor in CSC, the diagonal is the first entry of each column
+  std::vector<int> Lp, Li;
+  std::vector<T> Lx;
+
+  // Strictly lower part of the factor in CSR
+  std::vector<int> LTp, LTj;
+  std::vector<T> LTx;
+
+  // Columns grouped by their level in the elimination tree
+  std::vector<int> level_ptr, level_nodes;
+};
+
+/**
+ * @brief Cholesky solver that factors in low precision and recovers the
+ * accuracy of T by iterative refinement against the original matrix
+ *
+ * The low precision factor takes half the memory and bandwidth of a double
+ * factor. Each solve iterates
+ *
+ *   r = b - A x,  x += L^{-T} L^{-1} r
+ *
+ * with the residual computed in T. If the low precision factorization breaks
+ * down, or refinement stops reducing the residual (cond(A) too large for the
+ * low precision), the matrix is factored once in T and all subsequent solves
+ * are direct. Such fallbacks are counted, see get_num_fallbacks(), the
+ * caller decides whether to report them.
+ *
+ * The interface follows SparseUtils::SparseCholesky, so this can be used as
+ * the Factor of the apps.
+ *
+ * @tparam T numeric type of the matrix and the solution
+ * @tparam LowT numeric type of the factor
+ */
+template <typename T, typename LowT = float>
+class MixedPrecisionCholesky final {
+ public:
+  /**
+   * @param mat symmetric positive definite matrix, a copy is kept for the
+   * residual evaluations
+   * @param rtol tolerance of ||b - A x|| / ||b|| to stop the refinement
+   * @param max_refine maximum number of refinement steps
+   */
+  MixedPrecisionCholesky(SparseUtils::CSCMat<T>* mat, double rtol = 1e-12,
+                         int max_refine = 10)
+      : n(mat->ncols),
+        colp(mat->colp, mat->colp + mat->ncols + 1),
+        rows(mat->rows, mat->rows + mat->colp[mat->ncols]),
+        vals(mat->vals, mat->vals + mat->colp[mat->ncols]),
+        rtol(rtol),
+        max_refine(max_refine) {}
+
+  void factor() {
+    low = std::make_unique<SimplicialCholesky<LowT>>(n, colp.data(),
+                                                     rows.data());
+    high.reset();
+    if (!low->factor(vals.data())) {
+      low.reset();
+      fallback();
+    }
+  }
+
+  /**
+   * @brief Solve A x = b in place
+   *
+   * @param x on entry the right hand side, on exit the solution
+   */
+  void solve(T* x) {
+    if (!low and !high) {
+      throw std::runtime_error("MixedPrecisionCholesky: call factor() first");
+    }
+    num_refine = 0;
+    if (high) {
+      high->solve(x);
+      return;
+    }
+
+    std::vector<T> b(x, x + n), r(x, x + n), Ax(n);
+    std::fill(x, x + n, T(0.0));
+    double bnorm = norm(b.data());
+    if (bnorm == 0.0) return;
+
+    double rnorm = bnorm;
+    for (num_refine = 1; num_refine <= max_refine; num_refine++) {
+      low->solve(r.data());
+      for (int i = 0; i < n; i++) x[i] += r[i];
+
+      matvec(x, Ax.data());
+      for (int i = 0; i < n; i++) r[i] = b[i] - Ax[i];
+      double rnorm_new = norm(r.data());
+      if (rnorm_new <= rtol * bnorm) return;
+
+      // Refinement stalls
+      if (rnorm_new > 0.5 * rnorm) break;
+      rnorm = rnorm_new;
+    }
+
+    fallback();
+    std::copy(b.begin(), b.end(), x);
+    high->solve(x);
+  }
+
+  // Whether the solves have switched to the factor in T
+  bool is_fallback() const { return high != nullptr; }
+
+  // Number of times the matrix has been factored in T, either because the
+  // low precision factorization broke down or because refinement stalled
+  int get_num_fallbacks() const { return num_fallbacks; }
+
+  // Number of refinement steps of the last solve
+  int get_num_refinements() const { return num_refine; }
+
+  // Bytes of the copy of the matrix and of the factor
+  std::size_t get_memory_bytes() const {
+    return memory_bytes(colp) + memory_bytes(rows) + memory_bytes(vals) +
+           (low ? low->get_memory_bytes() : 0) +
+           (high ? high->get_memory_bytes() : 0);
+  }
+
+ private:
+  void fallback() {
+    num_fallbacks++;
+    low.reset();
+    high = std::make_unique<SimplicialCholesky<T>>(n, colp.data(), rows.data());
+    if (!high->factor(vals.data())) {
+      throw std::runtime_error(
+          "MixedPrecisionCholesky: matrix is not positive definite");
+    }
+  }
+
+  // A is symmetric, so y = A^T x can be gathered column by column
+  void matvec(const T* x, T* y) const {
+#pragma omp parallel for
+    for (int j = 0; j < n; j++) {
+      T yj = 0.0;
+      for (int p = colp[j]; p < colp[j + 1]; p++) yj += vals[p] * x[rows[p]];
+      y[j] = yj;
+    }
+  }
+
+  double norm(const T* x) const {
+    double s = 0.0;
+    for (int i = 0; i < n; i++) s += freal(x[i] * x[i]);
+    return sqrt(s);
+  }
+
+  int n;
+  std::vector<int> colp, rows;
+  std::vector<T> vals;
+  double rtol;
+  int max_refine;
+  int num_refine = 0;
+  int num_fallbacks = 0;
+
+  std::unique_ptr<SimplicialCholesky<LowT>> low;
+  std::unique_ptr<SimplicialCholesky<T>> high;
+};
+
+// Bytes of a factor of the apps, MemoryReport::unknown if the factor does not
+// report its size, e.g. SparseUtils::SparseCholesky
+template <class Factor>
+std::size_t factor_memory_bytes(const Factor& chol) {
+  if constexpr (has_memory_bytes<Factor>::value) {
+    return chol.get_memory_bytes();
+  } else {
+    return MemoryReport::unknown;
+  }
+}
+
+// Whether a factor of the apps is SimplicialCholesky, which can factor the
+// upper triangle alone, see SymmetricGalerkinBSRMat
+template <class Factor>
+struct is_simplicial_cholesky : std::false_type {};
+
+template <typename T>
+struct is_simplicial_cholesky<SimplicialCholesky<T>> : std::true_type {};
+
+template <class Factor, typename T, typename = void>
+struct has_multi_rhs_solve : std::false_type {};
+
+template <class Factor, typename T>
+struct has_multi_rhs_solve<
+    Factor, T,
+    std::void_t<decltype(std::declval<Factor&>().solve(
+        std::declval<T*>(), std::declval<int>()))>> : std::true_type {};
+
+/**
+ * @brief Solve for nrhs right hand sides with a factor of the apps, using
+ * the block solve solve(x, nrhs) if the factor has one, and one solve per
+ * right hand side otherwise
+ *
+ * @param x on entry the right hand sides, on exit the solutions, column
+ * major n x nrhs
+ */
+template <class Factor, typename T>
+void solve_multiple_rhs(Factor& chol, T* x, int n, int nrhs) {
+  if constexpr (has_multi_rhs_solve<Factor, T>::value) {
+    chol.solve(x, nrhs);
+  } else {
+    for (int r = 0; r < nrhs; r++) chol.solve(x + std::size_t(r) * n);
+  }
+}
+
+#endif  // XCGD_CHOLESKY_H
@@ -0,0 +1,255 @@
+#ifndef XCGD_DENSE_LU_H
+#define XCGD_DENSE_LU_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <stdexcept>
+
+#include "utils/exceptions.h"
+#include "utils/misc.h"
+
+/**
+ * @brief LU factorization with partial pivoting for small dense matrices whose
+ * size is bounded at compile time by Nmax, e.g. the Vandermonde matrices of GD
+ * stencils where Nmax = Np_1d * Np_1d.
+ *
+ * All storage lives in fixed-size arrays so the factorization never touches the
+ * heap. Matrices are stored column by column (LAPACK convention). Pivoting is
+ * based on the real part of the entries so that complex-step derivatives follow
+ * the same elimination sequence as the real computation.
+ *
+ * @tparam T numeric type, double or std::complex<double>
+ * @tparam Nmax maximum number of rows/columns
+ */
+template <typename T, int Nmax>
+class DenseLU {
+ public:
+  DenseLU() = default;
+
+  /**
+   * @brief Factorize P * A = L * U in place
+   *
+   * @param n_ [in] number of rows/columns, n_ <= Nmax
+   * @param A [in] matrix stored column by column, it is copied
+   */
+  void factor(int n_, const T* A) {
+    if (n_ > Nmax or n_ < 0) {
+      char msg[256];
+      std::snprintf(msg, 256, "matrix size %d exceeds the capacity %d", n_,
+                    Nmax);
+      throw std::runtime_error(msg);
+    }
+    n = n_;
+    std::copy(A, A + n * n, LU.begin());
+
+    // 1-norm of A, used by the condition number estimate
+    Anorm = 0.0;
+    for (int j = 0; j < n; j++) {
+      double s = 0.0;
+      for (int i = 0; i < n; i++) s += std::fabs(freal(LU[i + n * j]));
+      Anorm = std::max(Anorm, s);
+    }
+
+    for (int k = 0; k < n; k++) {
+      // Find the pivot
+      int p = k;
+      double vmax = std::fabs(freal(LU[k + n * k]));
+      for (int i = k + 1; i < n; i++) {
+        double v = std::fabs(freal(LU[i + n * k]));
+        if (v > vmax) {
+          vmax = v;
+          p = i;
+        }
+      }
+      ipiv[k] = p;
+      if (vmax == 0.0) throw LapackFailed("getrf", k + 1);
+
+      if (p != k) {
+        for (int j = 0; j < n; j++) std::swap(LU[k + n * j], LU[p + n * j]);
+      }
+
+      T inv = T(1.0) / LU[k + n * k];
+      for (int i = k + 1; i < n; i++) LU[i + n * k] *= inv;
+
+      for (int j = k + 1; j < n; j++) {
+        T ukj = LU[k + n * j];
+        for (int i = k + 1; i < n; i++) LU[i + n * j] -= LU[i + n * k] * ukj;
+      }
+    }
+  }
+
+  int size() const { return n; }
+
+  /**
+   * @brief Solve A x = b using the factorization
+   *
+   * @tparam T2 numeric type of the right hand side, may be an AD type
+   * @param b [in, out] right hand side of size n, stores the solution on exit
+   */
+  template <typename T2>
+  void solve(T2* b) const {
+    for (int k = 0; k < n; k++) {
+      if (ipiv[k] != k) std::swap(b[k], b[ipiv[k]]);
+    }
+    // L y = P b
+    for (int j = 0; j < n; j++) {
+      for (int i = j + 1; i < n; i++) b[i] -= LU[i + n * j] * b[j];
+    }
+    // U x = y
+    for (int j = n - 1; j >= 0; j--) {
+      b[j] /= LU[j + n * j];
+      for (int i = 0; i < j; i++) b[i] -= LU[i + n * j] * b[j];
+    }
+  }
+
+  /**
+   * @brief Solve A^T x = b using the factorization
+   *
+   * @tparam T2 numeric type of the right hand side, may be an AD type
+   * @param b [in, out] right hand side of size n, stores the solution on exit
+   */
+  template <typename T2>
+  void solve_transpose(T2* b) const {
+    // U^T z = b
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < i; k++) b[i] -= LU[k + n * i] * b[k];
+      b[i] /= LU[i + n * i];
+    }
+    // L^T w = z
+    for (int i = n - 1; i >= 0; i--) {
+      for (int k = i + 1; k < n; k++) b[i] -= LU[k + n * i] * b[k];
+    }
+    // x = P^T w
+    for (int k = n - 1; k >= 0; k--) {
+      if (ipiv[k] != k) std::swap(b[k], b[ipiv[k]]);
+    }
+  }
+
+  /**
+   * @brief Solve A^T X = B for several right hand sides at once, each entry of
+   * the factors is loaded once for all right hand sides
+   *
+   * @tparam T2 numeric type of the right hand sides, may be an AD type
+   * @param nrhs [in] number of right hand sides
+   * @param B [in, out] right hand sides stored one after another, i.e. entry i
+   * of the r-th right hand side is B[r * n + i], stores the solutions on exit
+   */
+  template <typename T2>
+  void solve_transpose(int nrhs, T2* B) const {
+    // U^T Z = B
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < i; k++) {
+        T uki = LU[k + n * i];
+        for (int r = 0; r < nrhs; r++) B[r * n + i] -= uki * B[r * n + k];
+      }
+      T uii = LU[i + n * i];
+      for (int r = 0; r < nrhs; r++) B[r * n + i] /= uii;
+    }
+    // L^T W = Z
+    for (int i = n - 1; i >= 0; i--) {
+      for (int k = i + 1; k < n; k++) {
+        T lki = LU[k + n * i];
+        for (int r = 0; r < nrhs; r++) B[r * n + i] -= lki * B[r * n + k];
+      }
+    }
+    // X = P^T W
+    for (int k = n - 1; k >= 0; k--) {
+      if (ipiv[k] != k) {
+        for (int r = 0; r < nrhs; r++) {
+          std::swap(B[r * n + k], B[r * n + ipiv[k]]);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Estimate the reciprocal of the 1-norm condition number of A using
+   * the Hager-Higham estimator (the same scheme LAPACK's gecon uses), which
+   * only requires a handful of solves with the existing factorization.
+   *
+   * Only the real part of the factorization is used.
+   */
+  double rcond() const {
+    if (n == 0) return 1.0;
+    if (Anorm == 0.0) return 0.0;
+
+    auto re = [this](int i, int j) { return freal(LU[i + n * j]); };
+    auto solve_real = [this, &re](double* b, bool transpose) {
+      if (not transpose) {
+        for (int k = 0; k < n; k++) {
+          if (ipiv[k] != k) std::swap(b[k], b[ipiv[k]]);
+        }
+        for (int j = 0; j < n; j++) {
+          for (int i = j + 1; i < n; i++) b[i] -= re(i, j) * b[j];
+        }
+        for (int j = n - 1; j >= 0; j--) {
+          b[j] /= re(j, j);
+          for (int i = 0; i < j; i++) b[i] -= re(i, j) * b[j];
+        }
+      } else {
+        for (int i = 0; i < n; i++) {
+          for (int k = 0; k < i; k++) b[i] -= re(k, i) * b[k];
+          b[i] /= re(i, i);
+        }
+        for (int i = n - 1; i >= 0; i--) {
+          for (int k = i + 1; k < n; k++) b[i] -= re(k, i) * b[k];
+        }
+        for (int k = n - 1; k >= 0; k--) {
+          if (ipiv[k] != k) std::swap(b[k], b[ipiv[k]]);
+        }
+      }
+    };
+    auto norm1 = [this](const double* v) {
+      double s = 0.0;
+      for (int i = 0; i < n; i++) s += std::fabs(v[i]);
+      return s;
+    };
+
+    std::array<double, Nmax> x, z;
+    std::fill(x.begin(), x.begin() + n, 1.0 / n);
+
+    double est = 0.0;
+    int jlast = -1;
+    for (int iter = 0; iter < 5; iter++) {
+      solve_real(x.data(), false);
+      double est_new = norm1(x.data());
+      if (iter > 0 and est_new <= est) break;
+      est = est_new;
+
+      for (int i = 0; i < n; i++) z[i] = x[i] >= 0.0 ? 1.0 : -1.0;
+      solve_real(z.data(), true);
+
+      int j = 0;
+      for (int i = 1; i < n; i++) {
+        if (std::fabs(z[i]) > std::fabs(z[j])) j = i;
+      }
+      if (j == jlast) break;
+      jlast = j;
+
+      std::fill(x.begin(), x.begin() + n, 0.0);
+      x[j] = 1.0;
+    }
+
+    // Higham's alternating-sign safeguard
+    if (n > 1) {
+      for (int i = 0; i < n; i++) {
+        x[i] = (i % 2 ? -1.0 : 1.0) * (1.0 + double(i) / double(n - 1));
+      }
+      solve_real(x.data(), false);
+      est = std::max(est, 2.0 * norm1(x.data()) / (3.0 * n));
+    }
+
+    return 1.0 / (Anorm * est);
+  }
+
+ private:
+  int n = 0;
+  double Anorm = 0.0;
+  std::array<T, Nmax * Nmax> LU;
+  std::array<int, Nmax> ipiv;
+};
+
+#endif  // XCGD_DENSE_LU_H
@@ -0,0 +1,376 @@
+#ifndef XCGD_KRYLOV_H
+#define XCGD_KRYLOV_H
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "utils/misc.h"
+
+/**
+ * @brief Preconditioned conjugate gradient method for a symmetric positive
+ * definite system A x = b
+ *
+ * @tparam MatVec callable, matvec(const T* x, T* y) computes y = A x
+ * @tparam Precond callable, precond(const T* r, T* z) computes z = M^{-1} r
+ * @param n [in] size of the system
+ * @param b [in] right hand side
+ * @param x [in, out] initial guess on entry, solution on exit
+ * @param rtol [in] relative tolerance of the residual norm w.r.t. ||b||
+ * @param max_iter [in] maximum number of iterations
+ * @param verbose [in] print residual history
+ *
+ * @return number of iterations, or -1 if not converged or a direction of
+ * non-positive curvature is met
+ */
+template <typename T, class MatVec, class Precond>
+int pcg(int n, const MatVec& matvec, const Precond& precond, const T* b, T* x,
+        double rtol = 1e-10, int max_iter = 1000, bool verbose = false) {
+  auto dot = [n](const T* u, const T* v) {
+    T s = 0.0;
+#pragma omp parallel for reduction(+ : s)
+    for (int i = 0; i < n; i++) s += u[i] * v[i];
+    return s;
+  };
+
+  std::vector<T> r(n), z(n), p(n), Ap(n);
+
+  matvec(x, Ap.data());
+  for (int i = 0; i < n; i++) r[i] = b[i] - Ap[i];
+
+  double bnorm = sqrt(freal(dot(b, b)));
+  if (bnorm == 0.0) bnorm = 1.0;
+  double rnorm = sqrt(freal(dot(r.data(), r.data())));
+  if (verbose) {
+    std::printf("[pcg] iter: %4d, |r|/|b|: %.10e\n", 0, rnorm / bnorm);
+  }
+  if (rnorm <= rtol * bnorm) return 0;
+
+  precond(r.data(), z.data());
+  p = z;
+  T rz = dot(r.data(), z.data());
+
+  for (int iter = 1; iter <= max_iter; iter++) {
+    matvec(p.data(), Ap.data());
+    T pAp = dot(p.data(), Ap.data());
+
+    // The operator is not positive definite along p, x holds the last iterate
+    if (freal(pAp) <= 0.0) {
+      if (verbose) {
+        std::printf("[pcg] iter: %4d, non-positive curvature %.10e\n", iter,
+                    freal(pAp));
+      }
+      return -1;
+    }
+    T alpha = rz / pAp;
+
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+      x[i] += alpha * p[i];
+      r[i] -= alpha * Ap[i];
+    }
+
+    rnorm = sqrt(freal(dot(r.data(), r.data())));
+    if (verbose) {
+      std::printf("[pcg] iter: %4d, |r|/|b|: %.10e\n", iter, rnorm / bnorm);
+    }
+    if (rnorm <= rtol * bnorm) return iter;
+
+    precond(r.data(), z.data());
+    T rz_new = dot(r.data(), z.data());
+    T beta = rz_new / rz;
+    rz = rz_new;
+
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) p[i] = z[i] + beta * p[i];
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Deflated preconditioned CG for a sequence of slowly varying symmetric
+ * positive definite systems, such as the design iterations of an optimization
+ *
+ * Solutions of the previous systems are kept in a persistent numbering and
+ * span the deflation subspace W of the next system. The initial residual is
+ * made orthogonal to W and the search directions are kept A-orthogonal to W,
+ * see Saad et al., A deflated version of the conjugate gradient algorithm,
+ * SIAM J. Sci. Comput., 2000. Solutions are recorded per slot (e.g. primal
+ * and adjoint), so each slot can be warm started from its previous solution.
+ */
+template <typename T>
+class KrylovRecycler {
+ public:
+  using MatVec = std::function<void(const T*, T*)>;
+
+  /**
+   * @param max_vectors maximum number of recycled vectors, the oldest ones
+   * are dropped first
+   */
+  KrylovRecycler(int max_vectors = 8) : max_vectors(max_vectors) {}
+
+  /**
+   * @brief Set the operator of the next system(s)
+   *
+   * @param n size of the system
+   * @param matvec matvec(x, y) computes y = A x, needs to be valid until the
+   * operator is replaced
+   * @param store_index store_index[i] is the persistent index of dof i, dof
+   * of different systems with the same persistent index are identified. If
+   * empty, the identity is assumed
+   * @param nstore size of the persistent numbering, n if store_index is empty
+   */
+  void set_operator(int n, MatVec matvec, std::vector<int> store_index = {},
+                    int nstore = -1) {
+    if (nstore < 0) nstore = n;
+    if (nstore != this->nstore) clear();
+    this->n = n;
+    this->nstore = nstore;
+    this->matvec = std::move(matvec);
+    this->store_index = std::move(store_index);
+
+    W.clear();
+    AW.clear();
+    std::vector<T> v(n);
+    for (const auto& s : stored) {
+      to_system(s.data(), v.data());
+      append(v);
+    }
+    factor_E();
+  }
+
+  /**
+   * @brief Populate x with the previous solution of the slot
+   *
+   * @return false if the slot has no solution yet, x is untouched then
+   */
+  bool warm_start(int slot, T* x) const {
+    auto it = last_solution.find(slot);
+    if (it == last_solution.end()) return false;
+    to_system(it->second.data(), x);
+    return true;
+  }
+
+  /**
+   * @brief Solve A x = b with the operator set by set_operator()
+   *
+   * @param precond precond(r, z) computes z = M^{-1} r
+   * @param b [in] right hand side
+   * @param x [in, out] initial guess on entry, solution on exit
+   * @param slot the solution is recorded for warm_start() of this slot
+   *
+   * @return number of iterations, or -1 if not converged
+   */
+  template <class Precond>
+  int solve(const Precond& precond, const T* b, T* x, int slot = 0,
+            double rtol = 1e-10, int max_iter = 1000, bool verbose = false) {
+    std::vector<T> r(n), z(n), p(n), Ap(n);
+
+    matvec(x, Ap.data());
+    for (int i = 0; i < n; i++) r[i] = b[i] - Ap[i];
+
+    // Remove the components of the error in span(W)
+    if (W.size() > 0) {
+      std::vector<T> mu =
+          solve_E([&](int k) { return dot(W[k].data(), r.data()); });
+      for (int k = 0; k < W.size(); k++) {
+        for (int i = 0; i < n; i++) {
+          x[i] += mu[k] * W[k][i];
+          r[i] -= mu[k] * AW[k][i];
+        }
+      }
+    }
+
+    double bnorm = sqrt(freal(dot(b, b)));
+    if (bnorm == 0.0) bnorm = 1.0;
+    double rnorm = sqrt(freal(dot(r.data(), r.data())));
+    if (verbose) {
+      std::printf("[recycled pcg] iter: %4d, |r|/|b|: %.10e, deflation: %d\n",
+                  0, rnorm / bnorm, int(W.size()));
+    }
+
+    int niter = -1;
+    if (rnorm <= rtol * bnorm) niter = 0;
+
+    if (niter < 0) {
+      precond(r.data(), z.data());
+      project(z.data(), p.data());
+      T rz = dot(r.data(), z.data());
+
+      for (int iter = 1; iter <= max_iter; iter++) {
+        matvec(p.data(), Ap.data());
+        T pAp = dot(p.data(), Ap.data());
+        if (freal(pAp) <= 0.0) break;
+        T alpha = rz / pAp;
+
+#pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+          x[i] += alpha * p[i];
+          r[i] -= alpha * Ap[i];
+        }
+
+        rnorm = sqrt(freal(dot(r.data(), r.data())));
+        if (verbose) {
+          std::printf("[recycled pcg] iter: %4d, |r|/|b|: %.10e\n", iter,
+                      rnorm / bnorm);
+        }
+        if (rnorm <= rtol * bnorm) {
+          niter = iter;
+          break;
+        }
+
+        precond(r.data(), z.data());
+        T rz_new = dot(r.data(), z.data());
+        T beta = rz_new / rz;
+        rz = rz_new;
+
+        // p = z + beta p - W E^{-1} AW^T z
+        project(z.data(), Ap.data());
+#pragma omp parallel for
+        for (int i = 0; i < n; i++) p[i] = Ap[i] + beta * p[i];
+      }
+    }
+
+    // Record the solution and recycle it for the following solves
+    std::vector<T>& sol = last_solution[slot];
+    sol.assign(nstore, T(0.0));
+    to_store(x, sol.data());
+    stored.push_back(sol);
+    if (stored.size() > max_vectors) stored.pop_front();
+    if (W.size() < max_vectors and append(std::vector<T>(x, x + n))) {
+      factor_E();
+    }
+
+    return niter;
+  }
+
+  // Drop all recycled vectors and recorded solutions
+  void clear() {
+    stored.clear();
+    last_solution.clear();
+    W.clear();
+    AW.clear();
+    E.clear();
+  }
+
+  // Dimension of the deflation subspace of the current system
+  int get_num_vectors() const { return W.size(); }
+
+ private:
+  // Orthonormalize v against W and append it along with A v, returns false if
+  // v is numerically in span(W)
+  bool append(std::vector<T> v) {
+    T vnorm0 = sqrt(freal(dot(v.data(), v.data())));
+    if (freal(vnorm0) == 0.0) return false;
+    for (int pass = 0; pass < 2; pass++) {
+      for (const auto& w : W) {
+        T c = dot(w.data(), v.data());
+        for (int i = 0; i < n; i++) v[i] -= c * w[i];
+      }
+    }
+    T vnorm = sqrt(freal(dot(v.data(), v.data())));
+    if (freal(vnorm) < 1e-8 * freal(vnorm0)) return false;
+    for (int i = 0; i < n; i++) v[i] /= vnorm;
+
+    std::vector<T> Av(n);
+    matvec(v.data(), Av.data());
+    W.push_back(std::move(v));
+    AW.push_back(std::move(Av));
+    return true;
+  }
+
+  // Cholesky factorization of E = W^T A W in place, vectors that make E
+  // numerically singular are dropped
+  void factor_E() {
+    int k = W.size();
+    E.assign(k * k, T(0.0));
+    for (int a = 0; a < k; a++) {
+      for (int b = 0; b <= a; b++) {
+        E[k * a + b] = dot(W[a].data(), AW[b].data());
+      }
+    }
+    for (int j = 0; j < k; j++) {
+      T d = E[k * j + j];
+      for (int m = 0; m < j; m++) d -= E[k * j + m] * E[k * j + m];
+      if (!(freal(d) > 0.0)) {
+        W.resize(j);
+        AW.resize(j);
+        factor_E();
+        return;
+      }
+      E[k * j + j] = sqrt(d);
+      for (int i = j + 1; i < k; i++) {
+        T s = E[k * i + j];
+        for (int m = 0; m < j; m++) s -= E[k * i + m] * E[k * j + m];
+        E[k * i + j] = s / E[k * j + j];
+      }
+    }
+  }
+
+  // mu = E^{-1} rhs, where rhs(k) gives the k-th entry of the right hand side
+  template <class Rhs>
+  std::vector<T> solve_E(const Rhs& rhs) const {
+    int k = W.size();
+    std::vector<T> mu(k);
+    for (int i = 0; i < k; i++) {
+      T s = rhs(i);
+      for (int m = 0; m < i; m++) s -= E[k * i + m] * mu[m];
+      mu[i] = s / E[k * i + i];
+    }
+    for (int i = k - 1; i >= 0; i--) {
+      T s = mu[i];
+      for (int m = i + 1; m < k; m++) s -= E[k * m + i] * mu[m];
+      mu[i] = s / E[k * i + i];
+    }
+    return mu;
+  }
+
+  // p = z - W E^{-1} AW^T z, the part of z that is A-orthogonal to W
+  void project(const T* z, T* p) const {
+    std::copy(z, z + n, p);
+    if (W.size() == 0) return;
+    std::vector<T> mu = solve_E([&](int k) { return dot(AW[k].data(), z); });
+    for (int k = 0; k < W.size(); k++) {
+      for (int i = 0; i < n; i++) p[i] -= mu[k] * W[k][i];
+    }
+  }
+
+  T dot(const T* u, const T* v) const {
+    T s = 0.0;
+#pragma omp parallel for reduction(+ : s)
+    for (int i = 0; i < n; i++) s += u[i] * v[i];
+    return s;
+  }
+
+  void to_system(const T* s, T* v) const {
+    for (int i = 0; i < n; i++) {
+      v[i] = store_index.empty() ? s[i] : s[store_index[i]];
+    }
+  }
+
+  void to_store(const T* v, T* s) const {
+    for (int i = 0; i < n; i++) {
+      s[store_index.empty() ? i : store_index[i]] = v[i];
+    }
+  }
+
+  int max_vectors;
+  int n = 0, nstore = -1;
+  MatVec matvec;
+  std::vector<int> store_index;
+
+  // Recycled vectors in the persistent numbering, oldest first
+  std::deque<std::vector<T>> stored;
+  std::map<int, std::vector<T>> last_solution;
+
+  // Orthonormal basis of the deflation subspace, A W, and the Cholesky
+  // factor of W^T A W (lower triangle, row-major)
+  std::vector<std::vector<T>> W, AW;
+  std::vector<T> E;
+};
+
+#endif  // XCGD_KRYLOV_H
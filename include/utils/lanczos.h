@@ -0,0 +1,242 @@
+#ifndef XCGD_LANCZOS_H
+#define XCGD_LANCZOS_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utils/json.h"
+#include "utils/linalg.h"
+#include "utils/misc.h"
+
+/**
+ * @brief Extremal eigenvalues of the symmetric tridiagonal matrix with
+ * diagonal alpha and off-diagonal beta, by bisection on the Sturm sequence
+ */
+inline std::pair<double, double> tridiagonal_extremal_eigenvalues(
+    const std::vector<double>& alpha, const std::vector<double>& beta) {
+  int m = alpha.size();
+
+  // Number of eigenvalues smaller than x
+  auto count = [&](double x) {
+    int c = 0;
+    double q = 1.0;
+    for (int i = 0; i < m; i++) {
+      double b2 = i > 0 ? beta[i - 1] * beta[i - 1] : 0.0;
+      q = alpha[i] - x - (i > 0 ? b2 / q : 0.0);
+      if (q == 0.0) q = -std::numeric_limits<double>::epsilon();
+      if (q < 0.0) c++;
+    }
+    return c;
+  };
+
+  // Gershgorin bounds
+  double lo = std::numeric_limits<double>::max();
+  double hi = std::numeric_limits<double>::lowest();
+  for (int i = 0; i < m; i++) {
+    double r = (i > 0 ? fabs(beta[i - 1]) : 0.0) +
+               (i < m - 1 ? fabs(beta[i]) : 0.0);
+    lo = std::min(lo, alpha[i] - r);
+    hi = std::max(hi, alpha[i] + r);
+  }
+
+  // Smallest x such that count(x) >= k
+  auto bisect = [&](int k) {
+    double a = lo, b = hi;
+    for (int it = 0; it < 200; it++) {
+      if (b - a <= 1e-15 * std::max(fabs(a), fabs(b))) break;
+      double c = 0.5 * (a + b);
+      if (count(c) >= k) {
+        b = c;
+      } else {
+        a = c;
+      }
+    }
+    return 0.5 * (a + b);
+  };
+
+  return {bisect(1), bisect(m)};
+}
+
+// Estimated extremal eigenvalues and the condition number of an SPD matrix
+struct EigenEstimate {
+  double lambda_min = 0.0;
+  double lambda_max = 0.0;
+  double cond = 0.0;
+  int num_iter_min = 0;  // Lanczos steps spent on lambda_min
+  int num_iter_max = 0;  // Lanczos steps spent on lambda_max
+  bool converged = false;
+
+  json to_json() const {
+    return json{{"lambda_min", lambda_min},     {"lambda_max", lambda_max},
+                {"cond", cond},                 {"num_iter_min", num_iter_min},
+                {"num_iter_max", num_iter_max}, {"converged", converged}};
+  }
+};
+
+/**
+ * @brief Lanczos iteration for the extremal eigenvalues of a symmetric
+ * operator
+ *
+ * No reorthogonalization is performed, loss of orthogonality only creates
+ * duplicated Ritz values, which does not affect the extremal ones.
+ *
+ * @param n size of the operator
+ * @param matvec matvec(x, y) computes y = A x
+ * @param need_min whether the smallest eigenvalue needs to converge as well,
+ * the largest one always does
+ * @param max_iter maximum number of Lanczos steps
+ * @param rtol the Ritz values are converged once they change less than rtol
+ * relatively within one step
+ * @param niter output, number of Lanczos steps
+ * @param converged output, whether the Ritz values converged
+ * @return {smallest, largest} Ritz value
+ */
+template <typename T, class MatVec>
+std::pair<double, double> lanczos_extremal_eigenvalues(
+    int n, const MatVec& matvec, bool need_min = true, int max_iter = 300,
+    double rtol = 1e-6, int* niter = nullptr, bool* converged = nullptr) {
+  auto dot = [n](const T* u, const T* v) {
+    T s = 0.0;
+#pragma omp parallel for reduction(+ : s)
+    for (int i = 0; i < n; i++) s += u[i] * v[i];
+    return freal(s);
+  };
+
+  // Deterministic random start vector
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  std::vector<T> v(n), v_prev(n, T(0.0)), w(n);
+  for (int i = 0; i < n; i++) v[i] = dist(gen);
+  double vnorm = sqrt(dot(v.data(), v.data()));
+  for (int i = 0; i < n; i++) v[i] /= vnorm;
+
+  std::vector<double> alpha, beta;
+  std::pair<double, double> ritz{0.0, 0.0}, ritz_prev{0.0, 0.0};
+  if (converged) *converged = false;
+
+  for (int j = 0; j < std::min(max_iter, n); j++) {
+    matvec(v.data(), w.data());
+    double a = dot(v.data(), w.data());
+    double b = j > 0 ? beta.back() : 0.0;
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) w[i] -= a * v[i] + b * v_prev[i];
+
+    // Local reorthogonalization against v
+    double c = dot(v.data(), w.data());
+    a += c;
+    for (int i = 0; i < n; i++) w[i] -= c * v[i];
+    alpha.push_back(a);
+
+    ritz = tridiagonal_extremal_eigenvalues(alpha, beta);
+    if (niter) *niter = j + 1;
+
+    double b_new = sqrt(dot(w.data(), w.data()));
+
+    // Invariant subspace, the Ritz values are exact
+    if (b_new <= 1e-14 * std::max(fabs(ritz.first), fabs(ritz.second))) {
+      if (converged) *converged = true;
+      break;
+    }
+
+    if (j > 0) {
+      bool max_conv =
+          fabs(ritz.second - ritz_prev.second) <= rtol * fabs(ritz.second);
+      bool min_conv =
+          fabs(ritz.first - ritz_prev.first) <= rtol * fabs(ritz.first);
+      if (max_conv and (min_conv or !need_min)) {
+        if (converged) *converged = true;
+        break;
+      }
+    }
+    ritz_prev = ritz;
+
+    beta.push_back(b_new);
+    for (int i = 0; i < n; i++) {
+      v_prev[i] = v[i];
+      v[i] = w[i] / b_new;
+    }
+  }
+
+  return ritz;
+}
+
+/**
+ * @brief Estimate the extremal eigenvalues and the condition number of a
+ * symmetric positive definite operator
+ *
+ * lambda_max is the largest Ritz value of A. lambda_min is the reciprocal of
+ * the largest Ritz value of A^{-1} if inv_solve is given (shift-invert with
+ * zero shift, which converges in a few steps regardless of the
+ * conditioning), otherwise it is the smallest Ritz value of A, which can take
+ * many steps for ill-conditioned operators.
+ *
+ * @param matvec matvec(x, y) computes y = A x
+ * @param inv_solve inv_solve(x) overwrites x with A^{-1} x, or nullptr, e.g.
+ * the solve() of an existing Cholesky factorization
+ */
+template <typename T, class MatVec, class InvSolve = std::nullptr_t>
+EigenEstimate estimate_eigenvalues(int n, const MatVec& matvec,
+                                   const InvSolve& inv_solve = nullptr,
+                                   int max_iter = 300, double rtol = 1e-6) {
+  EigenEstimate est;
+  bool conv_max = false, conv_min = false;
+
+  if constexpr (std::is_same_v<InvSolve, std::nullptr_t>) {
+    auto [lmin, lmax] = lanczos_extremal_eigenvalues<T>(
+        n, matvec, true, max_iter, rtol, &est.num_iter_max, &conv_max);
+    est.lambda_min = lmin;
+    est.lambda_max = lmax;
+    est.num_iter_min = est.num_iter_max;
+    conv_min = conv_max;
+  } else {
+    est.lambda_max = lanczos_extremal_eigenvalues<T>(n, matvec, false,
+                                                     max_iter, rtol,
+                                                     &est.num_iter_max,
+                                                     &conv_max)
+                         .second;
+    auto inv_matvec = [&inv_solve, n](const T* x, T* y) {
+      std::copy(x, x + n, y);
+      inv_solve(y);
+    };
+    est.lambda_min = 1.0 / lanczos_extremal_eigenvalues<T>(
+                               n, inv_matvec, false, max_iter, rtol,
+                               &est.num_iter_min, &conv_min)
+                               .second;
+  }
+
+  est.cond = est.lambda_max / est.lambda_min;
+  est.converged = conv_max and conv_min;
+  return est;
+}
+
+/**
+ * @brief Estimate the extremal eigenvalues and the condition number of an
+ * assembled matrix with Dirichlet dof
+ *
+ * The rows and columns of bc_dof are treated as identity, i.e. the operator
+ * is the same as the one factorized by the apps after zero_rows() and
+ * zero_columns(). mat may or may not have its bc rows zeroed.
+ */
+template <typename T, int M, class InvSolve = std::nullptr_t>
+EigenEstimate estimate_eigenvalues(const GalerkinBSRMat<T, M>* mat,
+                                   const std::vector<int>& bc_dof = {},
+                                   const InvSolve& inv_solve = nullptr,
+                                   int max_iter = 300, double rtol = 1e-6) {
+  int n = M * mat->nbrows;
+  std::vector<T> xbc(n);
+  auto matvec = [mat, &bc_dof, &xbc, n](const T* x, T* y) {
+    std::copy(x, x + n, xbc.begin());
+    for (int i : bc_dof) xbc[i] = 0.0;
+    std::fill(y, y + n, T(0.0));
+    mat->axpy(xbc.data(), y);
+    for (int i : bc_dof) y[i] = x[i];
+  };
+  return estimate_eigenvalues<T>(n, matvec, inv_solve, max_iter, rtol);
+}
+
+#endif  // XCGD_LANCZOS_H
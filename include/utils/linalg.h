@@ -1,12 +1,14 @@
 #ifndef XCGD_LINALG_H
 #define XCGD_LINALG_H
 
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 
 #include "sparse_utils/lapack_helpers.h"
 #include "sparse_utils/sparse_matrix.h"
 #include "utils/exceptions.h"
+#include "utils/memory.h"
 #include "utils/misc.h"
 
 template <typename T>
@@ -99,6 +101,25 @@ class GalerkinBSRMat final : public SparseUtils::BSRMat<T, M, M> {
       : SparseUtils::BSRMat<T, M, M>(nbrows, nbrows, nnz, rowp_, cols_, vals_) {
   }
 
+  // y += A * x, this hides the serial SparseUtils::BSRMat::axpy(), each
+  // thread owns a range of block rows so no synchronization is needed
+  void axpy(const T *x, T *y) const {
+#pragma omp parallel for
+    for (int i = 0; i < this->nbrows; i++) {
+      T yi[M] = {};
+      for (int jp = this->rowp[i]; jp < this->rowp[i + 1]; jp++) {
+        const T *xj = &x[M * this->cols[jp]];
+        const T *block = &this->vals[M * M * jp];
+        for (int ii = 0; ii < M; ii++) {
+          for (int jj = 0; jj < M; jj++) {
+            yi[ii] += block[M * ii + jj] * xj[jj];
+          }
+        }
+      }
+      for (int ii = 0; ii < M; ii++) y[M * i + ii] += yi[ii];
+    }
+  }
+
   template <class Mesh>
   void add_block_values(int elem, const Mesh &mesh, T mat[]) {
     constexpr int N = M;
@@ -150,4 +171,228 @@ class GalerkinBSRMat final : public SparseUtils::BSRMat<T, M, M> {
   }
 };
 
+/**
+ * @brief Symmetric counterpart of GalerkinBSRMat that only stores the upper
+ * triangular blocks (block column >= block row)
+ *
+ * This halves the memory and the scatter work of the Jacobian assembly for
+ * physics with symmetric Jacobians. The matrix can be passed to
+ * GalerkinAnalysis::jacobian() in place of GalerkinBSRMat.
+ */
+template <typename T, int M>
+class SymmetricGalerkinBSRMat final {
+ public:
+  /**
+   * @param nbrows number of block rows/columns
+   * @param rowp_, cols_ block CSR pattern of the full matrix, e.g. from
+   * SparseUtils::CSRFromConnectivityFunctor(), the lower triangle is dropped
+   */
+  SymmetricGalerkinBSRMat(int nbrows, const int *rowp_, const int *cols_)
+      : nbrows(nbrows), rowp(nbrows + 1, 0) {
+    for (int i = 0; i < nbrows; i++) {
+      for (int jp = rowp_[i]; jp < rowp_[i + 1]; jp++) {
+        if (cols_[jp] >= i) rowp[i + 1]++;
+      }
+    }
+    for (int i = 0; i < nbrows; i++) rowp[i + 1] += rowp[i];
+    nnz = rowp[nbrows];
+
+    cols.resize(nnz);
+    for (int i = 0, jp_upper = 0; i < nbrows; i++) {
+      for (int jp = rowp_[i]; jp < rowp_[i + 1]; jp++) {
+        if (cols_[jp] >= i) cols[jp_upper++] = cols_[jp];
+      }
+      std::sort(cols.begin() + rowp[i], cols.begin() + rowp[i + 1]);
+    }
+    vals.assign(M * M * nnz, T(0.0));
+
+    // Strictly lower blocks by block row, each referring to the stored
+    // transposed block, in the increasing order of the block column
+    lrowp.assign(nbrows + 1, 0);
+    for (int i = 0; i < nbrows; i++) {
+      for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+        if (cols[jp] > i) lrowp[cols[jp] + 1]++;
+      }
+    }
+    for (int i = 0; i < nbrows; i++) lrowp[i + 1] += lrowp[i];
+    lcols.resize(lrowp[nbrows]);
+    ljp.resize(lrowp[nbrows]);
+    std::vector<int> next(lrowp.begin(), lrowp.end() - 1);
+    for (int i = 0; i < nbrows; i++) {
+      for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+        if (cols[jp] > i) {
+          lcols[next[cols[jp]]] = i;
+          ljp[next[cols[jp]]++] = jp;
+        }
+      }
+    }
+  }
+
+  void zero() { std::fill(vals.begin(), vals.end(), T(0.0)); }
+
+  // Index of block (row, col) for row <= col, or SparseUtils::NO_INDEX
+  int find_value_index(int row, int col) const {
+    auto begin = cols.begin() + rowp[row], end = cols.begin() + rowp[row + 1];
+    auto it = std::lower_bound(begin, end, col);
+    if (it == end or *it != col) return SparseUtils::NO_INDEX;
+    return it - cols.begin();
+  }
+
+  // Same as GalerkinBSRMat::add_block_values(), blocks of the lower triangle
+  // of the element matrix are skipped
+  template <int max_nnodes_per_element>
+  void add_block_values(int nnodes, int *nodes, T mat[]) {
+    for (int ii = 0; ii < nnodes; ii++) {
+      int block_row = nodes[ii];
+
+      for (int jj = 0; jj < nnodes; jj++) {
+        int block_col = nodes[jj];
+        if (block_col < block_row) continue;
+
+        int jp = find_value_index(block_row, block_col);
+        if (jp != SparseUtils::NO_INDEX) {
+          for (int local_row = 0; local_row < M; local_row++) {
+            for (int local_col = 0; local_col < M; local_col++) {
+              vals[M * M * jp + M * local_row + local_col] +=
+                  mat[(M * ii + local_row) * max_nnodes_per_element * M +
+                      M * jj + local_col];
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // y += A * x, the lower triangle is applied through the transposed upper
+  // blocks, so each thread still owns a range of block rows
+  void axpy(const T *x, T *y) const {
+#pragma omp parallel for
+    for (int i = 0; i < nbrows; i++) {
+      T yi[M] = {};
+      for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+        const T *xj = &x[M * cols[jp]];
+        const T *block = &vals[M * M * jp];
+        for (int ii = 0; ii < M; ii++) {
+          for (int jj = 0; jj < M; jj++) {
+            yi[ii] += block[M * ii + jj] * xj[jj];
+          }
+        }
+      }
+      for (int kp = lrowp[i]; kp < lrowp[i + 1]; kp++) {
+        int jp = ljp[kp];
+        const T *xk = &x[M * lcols[kp]];
+        const T *block = &vals[M * M * jp];
+        for (int ii = 0; ii < M; ii++) {
+          for (int jj = 0; jj < M; jj++) {
+            yi[ii] += block[M * jj + ii] * xk[jj];
+          }
+        }
+      }
+      for (int ii = 0; ii < M; ii++) y[M * i + ii] += yi[ii];
+    }
+  }
+
+  /**
+   * @brief Zero the rows and columns of the given dof and set their diagonal
+   * entries to one, i.e. zero_rows() followed by zero_columns() of the full
+   * matrix
+   */
+  void zero_rows_and_columns(int nbcs, const int dof[]) {
+    std::vector<char> is_bc(M * nbrows, 0);
+    for (int k = 0; k < nbcs; k++) is_bc[dof[k]] = 1;
+
+    for (int i = 0; i < nbrows; i++) {
+      for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+        int j = cols[jp];
+        for (int ii = 0; ii < M; ii++) {
+          for (int jj = 0; jj < M; jj++) {
+            int r = M * i + ii, c = M * j + jj;
+            if (is_bc[r] or is_bc[c]) {
+              vals[M * M * jp + M * ii + jj] = r == c ? 1.0 : 0.0;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Export the upper triangle to a scalar CSC matrix, which can be
+   * factored by SimplicialCholesky with upper_only = true
+   *
+   * @return the matrix, owned by the caller
+   */
+  SparseUtils::CSCMat<T> *to_csc() const {
+    int n = M * nbrows;
+    std::vector<int> colp(n + 1, 0);
+    for (int j = 0; j < nbrows; j++) {
+      int nlower = lrowp[j + 1] - lrowp[j];
+      for (int jj = 0; jj < M; jj++) {
+        colp[M * j + jj + 1] = M * nlower + jj + 1;
+      }
+    }
+    for (int c = 0; c < n; c++) colp[c + 1] += colp[c];
+
+    // Column M * j + jj collects the blocks (k, j), k <= j, so the rows are
+    // sorted if the diagonal block comes last
+    std::vector<int> rows(colp[n]);
+    std::vector<T> csc_vals(colp[n]);
+    for (int j = 0; j < nbrows; j++) {
+      for (int jj = 0; jj < M; jj++) {
+        int p = colp[M * j + jj];
+        for (int kp = lrowp[j]; kp < lrowp[j + 1]; kp++) {
+          int jp = ljp[kp], k = lcols[kp];
+          for (int ii = 0; ii < M; ii++, p++) {
+            rows[p] = M * k + ii;
+            csc_vals[p] = vals[M * M * jp + M * ii + jj];
+          }
+        }
+        int jp = find_value_index(j, j);
+        for (int ii = 0; ii <= jj; ii++, p++) {
+          rows[p] = M * j + ii;
+          csc_vals[p] = jp == SparseUtils::NO_INDEX
+                            ? T(0.0)
+                            : vals[M * M * jp + M * ii + jj];
+        }
+      }
+    }
+
+    return new SparseUtils::CSCMat<T>(n, n, colp[n], colp.data(), rows.data(),
+                                      csc_vals.data());
+  }
+
+  std::size_t get_memory_bytes() const {
+    return memory_bytes(rowp) + memory_bytes(cols) + memory_bytes(vals) +
+           memory_bytes(lrowp) + memory_bytes(lcols) + memory_bytes(ljp);
+  }
+
+  int nbrows, nnz;        // number of block rows, number of stored blocks
+  std::vector<int> rowp;  // upper triangular block CSR pattern
+  std::vector<int> cols;
+  std::vector<T> vals;  // M x M blocks stored row by row
+
+ private:
+  // Strictly lower triangular block CSR pattern, ljp points to the stored
+  // transposed block
+  std::vector<int> lrowp, lcols, ljp;
+};
+
+// Bytes of the pattern and values of the sparse matrices
+template <typename T, int M>
+std::size_t memory_bytes(const GalerkinBSRMat<T, M>& mat) {
+  return (std::size_t(mat.nbrows) + 1 + mat.nnz) * sizeof(int) +
+         std::size_t(mat.nnz) * M * M * sizeof(T);
+}
+
+template <typename T, int M>
+std::size_t memory_bytes(const SymmetricGalerkinBSRMat<T, M>& mat) {
+  return mat.get_memory_bytes();
+}
+
+template <typename T>
+std::size_t memory_bytes(const SparseUtils::CSCMat<T>& mat) {
+  std::size_t nnz = mat.colp[mat.ncols];
+  return (std::size_t(mat.ncols) + 1 + nnz) * sizeof(int) + nnz * sizeof(T);
+}
+
 #endif  // XCGD_LINALG_H
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 
@@ -11,20 +14,25 @@ class DegenerateStencilLogger {
 
   static void add(int elem, int nnodes, int* nodes) {
     if (!active) return;
+    std::lock_guard<std::mutex> lock(mtx);
     stencils[elem] = std::vector<int>(nodes, nodes + nnodes);
   }
 
   static void clear() {
     if (!active) return;
+    std::lock_guard<std::mutex> lock(mtx);
     stencils.clear();
   }
 
-  const static std::map<int, std::vector<int>>& get_stencils() {
+  // A copy, the stencils may be added to concurrently
+  static std::map<int, std::vector<int>> get_stencils() {
+    std::lock_guard<std::mutex> lock(mtx);
     return stencils;
   }
 
  private:
-  inline static bool active = false;
+  inline static std::atomic<bool> active{false};
+  inline static std::mutex mtx;
 
   // elem -> stencil node indices
   inline static std::map<int, std::vector<int>> stencils = {};
@@ -37,29 +45,39 @@ class VandermondeCondLogger {
  public:
   static void enable() { active = true; }
   static void disable() { active = false; }
+  static bool is_active() { return active; }
 
   static void add(int elem, double cond) {
     if (!active) return;
+    std::lock_guard<std::mutex> lock(mtx);
     conds[elem] = cond;
   }
 
   static void clear() {
     if (!active) return;
+    std::lock_guard<std::mutex> lock(mtx);
     conds.clear();
   }
 
   // Get condition number of elem, if elem does not exist, quitely return NaN
   static double get(int elem) {
+    std::lock_guard<std::mutex> lock(mtx);
     try {
       return conds.at(elem);
     } catch (const std::out_of_range& e) {
       return std::numeric_limits<double>::quiet_NaN();
     }
   }
-  const static std::map<int, double>& get_conds() { return conds; }
+
+  // A copy, the condition numbers may be added to concurrently
+  static std::map<int, double> get_conds() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return conds;
+  }
 
  private:
-  inline static bool active = false;
+  inline static std::atomic<bool> active{false};
+  inline static std::mutex mtx;
 
   // elem -> stencil node indices
   inline static std::map<int, double> conds = {};
@@ -0,0 +1,287 @@
+#ifndef XCGD_MEMORY_H
+#define XCGD_MEMORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Heap bytes held by standard containers. The nodes of std::set, std::map
+ * and std::unordered_map are counted with the bookkeeping of libstdc++ on a
+ * 64-bit platform (color and three pointers for a tree node, one pointer for
+ * a hash node plus the bucket array), the allocator overhead is not counted.
+ */
+template <typename V>
+std::size_t memory_bytes(const std::vector<V>& v);
+inline std::size_t memory_bytes(const std::vector<bool>& v);
+template <typename K>
+std::size_t memory_bytes(const std::set<K>& s);
+template <typename K, typename V>
+std::size_t memory_bytes(const std::map<K, V>& m);
+template <typename K, typename V>
+std::size_t memory_bytes(const std::unordered_map<K, V>& m);
+
+// Heap bytes owned by an element of a container
+template <typename V>
+std::size_t memory_bytes_owned(const V& v) {
+  if constexpr (std::is_trivially_copyable_v<V>) {
+    return 0;
+  } else {
+    return memory_bytes(v);
+  }
+}
+
+template <typename V>
+std::size_t memory_bytes(const std::vector<V>& v) {
+  std::size_t bytes = v.capacity() * sizeof(V);
+  if constexpr (!std::is_trivially_copyable_v<V>) {
+    for (const V& e : v) bytes += memory_bytes_owned(e);
+  }
+  return bytes;
+}
+
+inline std::size_t memory_bytes(const std::vector<bool>& v) {
+  return (v.capacity() + 7) / 8;
+}
+
+template <typename K>
+std::size_t memory_bytes(const std::set<K>& s) {
+  return s.size() * (sizeof(K) + 4 * sizeof(void*));
+}
+
+template <typename K, typename V>
+std::size_t memory_bytes(const std::map<K, V>& m) {
+  std::size_t bytes =
+      m.size() * (sizeof(std::pair<const K, V>) + 4 * sizeof(void*));
+  for (const auto& [k, v] : m) bytes += memory_bytes_owned(v);
+  return bytes;
+}
+
+template <typename K, typename V>
+std::size_t memory_bytes(const std::unordered_map<K, V>& m) {
+  std::size_t bytes =
+      m.bucket_count() * sizeof(void*) +
+      m.size() * (sizeof(std::pair<const K, V>) + sizeof(void*));
+  for (const auto& [k, v] : m) bytes += memory_bytes_owned(v);
+  return bytes;
+}
+
+/**
+ * @brief Memory usage of an object broken down by component
+ *
+ * Persistent entries are held by the object between calls. A transient entry
+ * is the peak of the temporary buffers of one operation, i.e. the buffers
+ * that are alive at the same time at its high-water mark, named
+ * <operation>.<buffer> for the breakdown of an operation. Operations don't
+ * overlap, so the estimated peak usage of the object is its persistent bytes
+ * plus the largest transient entry.
+ *
+ * A component whose size can't be determined, e.g. a third-party factor, is
+ * added with the size unknown. It is printed as such and left out of the
+ * totals, which are then lower bounds.
+ */
+class MemoryReport {
+ public:
+  static constexpr std::size_t unknown =
+      std::numeric_limits<std::size_t>::max();
+
+  struct Entry {
+    std::string name;
+    std::size_t bytes;
+    bool transient;
+  };
+
+  void add(const std::string& name, std::size_t bytes) {
+    entries.push_back({name, bytes, false});
+  }
+
+  void add_transient(const std::string& name, std::size_t bytes) {
+    entries.push_back({name, bytes, true});
+  }
+
+  // Add the entries of another report with their names prefixed by prefix.
+  void merge(const std::string& prefix, const MemoryReport& other) {
+    for (const Entry& e : other.entries) {
+      entries.push_back({prefix + "." + e.name, e.bytes, e.transient});
+    }
+  }
+
+  const std::vector<Entry>& get_entries() const { return entries; }
+
+  // Bytes of an entry, 0 if there is no such entry, unknown if its size is
+  // unknown
+  std::size_t get_bytes(const std::string& name) const {
+    for (const Entry& e : entries) {
+      if (e.name == name) return e.bytes;
+    }
+    return 0;
+  }
+
+  std::size_t get_persistent_bytes() const {
+    std::size_t bytes = 0;
+    for (const Entry& e : entries) {
+      if (!e.transient and e.bytes != unknown) bytes += e.bytes;
+    }
+    return bytes;
+  }
+
+  std::size_t get_peak_transient_bytes() const {
+    std::size_t bytes = 0;
+    for (const Entry& e : entries) {
+      if (e.transient and e.bytes != unknown) bytes = std::max(bytes, e.bytes);
+    }
+    return bytes;
+  }
+
+  std::size_t get_peak_bytes() const {
+    return get_persistent_bytes() + get_peak_transient_bytes();
+  }
+
+  int get_num_unknown() const {
+    return std::count_if(entries.begin(), entries.end(),
+                         [](const Entry& e) { return e.bytes == unknown; });
+  }
+
+  void print(std::FILE* fp = stdout) const {
+    for (bool transient : {false, true}) {
+      std::fprintf(fp, "%s\n",
+                   transient ? "transient (peak of an operation):"
+                             : "persistent:");
+      for (const Entry& e : entries) {
+        if (e.transient != transient) continue;
+        if (e.bytes == unknown) {
+          std::fprintf(fp, "  %-48s %12s\n", e.name.c_str(), "unknown");
+        } else {
+          std::fprintf(fp, "  %-48s %12.3f MiB\n", e.name.c_str(),
+                       to_mib(e.bytes));
+        }
+      }
+    }
+    if (int n = get_num_unknown()) {
+      std::fprintf(fp, "totals exclude %d entr%s of unknown size\n", n,
+                   n == 1 ? "y" : "ies");
+    }
+    std::fprintf(fp, "%-50s %12.3f MiB\n", "persistent total",
+                 to_mib(get_persistent_bytes()));
+    std::fprintf(fp, "%-50s %12.3f MiB\n", "estimated peak",
+                 to_mib(get_peak_bytes()));
+  }
+
+ private:
+  static double to_mib(std::size_t bytes) { return bytes / 1048576.0; }
+
+  std::vector<Entry> entries;
+};
+
+template <class C, typename = void>
+struct has_memory_report : std::false_type {};
+
+template <class C>
+struct has_memory_report<
+    C, std::void_t<decltype(std::declval<const C&>().memory_report())>>
+    : std::true_type {};
+
+template <class C, typename = void>
+struct has_memory_bytes : std::false_type {};
+
+template <class C>
+struct has_memory_bytes<
+    C, std::void_t<decltype(std::declval<const C&>().get_memory_bytes())>>
+    : std::true_type {};
+
+/**
+ * @brief Process-wide count of the bytes allocated through TrackingAllocator
+ *
+ * The apps report the sizes of their components by inspection, see
+ * MemoryReport, the tracker instead measures the actual current and peak
+ * bytes of the tracked buffers, e.g. the element buffers of
+ * GalerkinAnalysis. An optional hook is called on every tracked allocation
+ * and deallocation, e.g. to log the usage over time.
+ */
+class MemoryTracker {
+ public:
+  // delta is positive for an allocation and negative for a deallocation,
+  // current is the tracked bytes after the operation
+  using Hook = void (*)(std::ptrdiff_t delta, std::size_t current);
+
+  static void set_hook(Hook h) { hook.store(h); }
+
+  static void allocated(std::size_t bytes) {
+    std::size_t cur =
+        current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    std::size_t p = peak.load(std::memory_order_relaxed);
+    while (cur > p and
+           !peak.compare_exchange_weak(p, cur, std::memory_order_relaxed)) {
+    }
+    if (Hook h = hook.load(std::memory_order_relaxed)) {
+      h(std::ptrdiff_t(bytes), cur);
+    }
+  }
+
+  static void deallocated(std::size_t bytes) {
+    std::size_t cur =
+        current.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    if (Hook h = hook.load(std::memory_order_relaxed)) {
+      h(-std::ptrdiff_t(bytes), cur);
+    }
+  }
+
+  static std::size_t get_current_bytes() { return current.load(); }
+  static std::size_t get_peak_bytes() { return peak.load(); }
+
+  // Start a new measurement of the peak from the current usage
+  static void reset_peak() { peak.store(current.load()); }
+
+ private:
+  inline static std::atomic<std::size_t> current{0}, peak{0};
+  inline static std::atomic<Hook> hook{nullptr};
+};
+
+// std::allocator that reports to MemoryTracker
+template <typename V>
+struct TrackingAllocator {
+  using value_type = V;
+
+  TrackingAllocator() = default;
+  template <typename U>
+  TrackingAllocator(const TrackingAllocator<U>&) {}
+
+  V* allocate(std::size_t n) {
+    V* p = std::allocator<V>().allocate(n);
+    MemoryTracker::allocated(n * sizeof(V));
+    return p;
+  }
+
+  void deallocate(V* p, std::size_t n) {
+    MemoryTracker::deallocated(n * sizeof(V));
+    std::allocator<V>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const TrackingAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const TrackingAllocator<U>&) const {
+    return false;
+  }
+};
+
+template <typename V>
+using TrackedVector = std::vector<V, TrackingAllocator<V>>;
+
+template <typename V>
+std::size_t memory_bytes(const TrackedVector<V>& v) {
+  return v.capacity() * sizeof(V);
+}
+
+#endif  // XCGD_MEMORY_H
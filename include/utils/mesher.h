@@ -1,162 +1,359 @@
 #ifndef XCGD_MESHER_H
 #define XCGD_MESHER_H
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
-#include <fstream>
-#include <iostream>
-#include <map>
-#include <sstream>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
-// Data Structures
-struct Node {
-  int index;
-  double x, y, z;
-};
+/**
+ * @brief Reader of the nodes and 10-node tetrahedral elements of an Abaqus
+ * input (.inp) file
+ *
+ * The file is memory-mapped and scanned once for the *Node and *Element
+ * blocks, the blocks are then split into chunks of whole lines that are parsed
+ * in parallel straight into the output arrays. Node and element labels must
+ * be numbered consecutively from 1, in any order, a duplicated or missing
+ * label is an error. Keywords are
+ * case-insensitive, blank lines and ** comments are skipped, and all other
+ * keyword blocks are ignored.
+ */
+class AbaqusInpReader {
+ public:
+  static constexpr int nodes_per_element = 10;
+
+  /**
+   * @param path path to the .inp file
+   * @param chunk_bytes approximate size of the chunks parsed in parallel
+   */
+  AbaqusInpReader(const std::string& path, std::size_t chunk_bytes = 1 << 20)
+      : path(path), chunk_bytes(std::max<std::size_t>(chunk_bytes, 1)) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) fail("failed to open");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      fail("failed to stat");
+    }
+    size = st.st_size;
+    if (size > 0) {
+      void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (ptr == MAP_FAILED) fail("mmap failed");
+      data = static_cast<const char*>(ptr);
+      madvise(ptr, size, MADV_SEQUENTIAL);
+    } else {
+      close(fd);
+    }
+    scan();
+  }
 
-struct Element {
-  int index;
-  std::vector<int> nodeIndices;
-};
+  AbaqusInpReader(const AbaqusInpReader&) = delete;
+  AbaqusInpReader& operator=(const AbaqusInpReader&) = delete;
 
-struct NodeSet {
-  std::string name;
-  std::vector<int> nodeIndices;
-};
+  ~AbaqusInpReader() {
+    if (data) munmap(const_cast<char*>(data), size);
+  }
 
-// Utility Functions
-std::string trim(const std::string &str) {
-  size_t first = str.find_first_not_of(' ');
-  if (std::string::npos == first) {
-    return str;
+  int get_num_nodes() const { return num_nodes; }
+  int get_num_elements() const { return num_elements; }
+
+  /**
+   * @brief Parse the blocks
+   *
+   * @param element_nodes output, 0-based node indices of each element, length
+   * nodes_per_element * num_elements
+   * @param xloc output, nodal coordinates, length 3 * num_nodes
+   */
+  template <typename T>
+  void read(int* element_nodes, T* xloc) const {
+    std::vector<Block> chunks;
+    for (const Block& b : blocks) {
+      std::size_t len = b.end - b.begin;
+      std::size_t n = std::max<std::size_t>(1, len / chunk_bytes);
+      const char* prev = b.begin;
+      for (std::size_t k = 1; k <= n; k++) {
+        const char* next = k == n ? b.end : line_start(b.begin + k * len / n);
+        if (next > prev) chunks.push_back(Block{prev, next, b.is_node});
+        prev = next;
+      }
+    }
+
+    // Whether each label has been read, a duplicated label may appear in
+    // different chunks
+    std::vector<std::atomic<char>> node_filled(num_nodes),
+        elem_filled(num_elements);
+
+    int nchunks = chunks.size();
+    std::vector<std::string> errors(nchunks);
+#pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < nchunks; c++) {
+      errors[c] = parse_chunk(chunks[c], element_nodes, xloc, node_filled,
+                              elem_filled);
+    }
+    for (const std::string& e : errors) {
+      if (!e.empty()) fail(e);
+    }
+
+    // There are as many data lines as labels, so a missing label comes with a
+    // duplicated one, which is reported above, unless the lines counted by
+    // scan() and parsed by parse_chunk() disagree
+    for (int i = 0; i < num_nodes; i++) {
+      if (!node_filled[i]) {
+        fail("node label " + std::to_string(i + 1) + " missing");
+      }
+    }
+    for (int i = 0; i < num_elements; i++) {
+      if (!elem_filled[i]) {
+        fail("element label " + std::to_string(i + 1) + " missing");
+      }
+    }
   }
-  size_t last = str.find_last_not_of(' ');
-  return str.substr(first, (last - first + 1));
-}
 
-// Main Parsing Logic
-template <typename T>
-void load_mesh(std::string filename, int *num_elements, int *num_nodes,
-               int **element_nodes, T **xloc) {
-  std::ifstream meshFile(filename);
-  if (!meshFile.is_open()) {
-    std::cerr << "Failed to open file: " << filename << std::endl;
+ private:
+  // A range of whole lines of the file
+  struct Block {
+    const char *begin, *end;
+    bool is_node;
+  };
+
+  [[noreturn]] void fail(const std::string& msg) const {
+    throw std::runtime_error("AbaqusInpReader(" + path + "): " + msg);
   }
 
-  std::string line;
+  static bool is_space(char c) { return c == ' ' or c == '\t' or c == '\r'; }
 
-  std::vector<Node> nodes;
-  std::map<int, Element> elements;
-  std::map<std::string, NodeSet> nodeSets;
+  static const char* skip_space(const char* p, const char* end) {
+    while (p < end and is_space(*p)) p++;
+    return p;
+  }
 
-  bool inNodesSection = false, inElementsSection = false,
-       inNodeSetsSection = false;
-  std::string currentSetName;
+  // Skip the separator between two values, i.e. a comma and/or whitespace
+  static const char* skip_sep(const char* p, const char* end) {
+    p = skip_space(p, end);
+    if (p < end and *p == ',') p = skip_space(p + 1, end);
+    return p;
+  }
 
-  while (getline(meshFile, line)) {
-    line = trim(line);
-    if (line.empty() || line[0] == '*') {
-      inNodesSection = line.find("*Node") != std::string::npos;
-      inElementsSection = line.find("*Element") != std::string::npos;
-      inNodeSetsSection = line.find("*Nset") != std::string::npos;
+  static const char* end_of_line(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return eol ? eol : end;
+  }
+
+  // Start of the first line that begins at or after p
+  const char* line_start(const char* p) const {
+    if (p == data or p[-1] == '\n') return p;
+    const char* eol = end_of_line(p, data + size);
+    return eol < data + size ? eol + 1 : eol;
+  }
 
-      if (inNodeSetsSection) {
-        size_t namePos = line.find("Nset=");
-        if (namePos != std::string::npos) {
-          currentSetName = line.substr(namePos + 5);
-          nodeSets[currentSetName] = NodeSet{currentSetName, {}};
+  // Keyword of a keyword line, i.e. the text before the first comma, compared
+  // case-insensitively
+  static bool keyword_is(const char* p, const char* eol, const char* kw) {
+    const char* e = static_cast<const char*>(std::memchr(p, ',', eol - p));
+    if (!e) e = eol;
+    while (e > p and is_space(e[-1])) e--;
+    std::size_t n = std::strlen(kw);
+    if (std::size_t(e - p) != n) return false;
+    for (std::size_t i = 0; i < n; i++) {
+      if (std::tolower(static_cast<unsigned char>(p[i])) != kw[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Locate the *Node and *Element blocks and count their data lines
+  void scan() {
+    const char* end = data + size;
+    Block* cur = nullptr;
+    for (const char* p = data; p < end;) {
+      const char* eol = end_of_line(p, end);
+      const char* s = skip_space(p, eol);
+      const char* next = eol < end ? eol + 1 : end;
+
+      if (s < eol and *s == '*' and (s + 1 == eol or s[1] != '*')) {
+        bool is_node = keyword_is(s, eol, "*node");
+        bool is_elem = keyword_is(s, eol, "*element");
+        if (is_node or is_elem) {
+          blocks.push_back(Block{next, next, is_node});
+          cur = &blocks.back();
+        } else {
+          cur = nullptr;
         }
+      } else if (cur) {
+        if (s < eol and *s != '*') (cur->is_node ? num_nodes : num_elements)++;
+        cur->end = next;
       }
+      p = next;
+    }
+  }
 
-      continue;
+  static const char* parse_int(const char* p, const char* end, int* val) {
+    bool neg = false;
+    if (p < end and (*p == '-' or *p == '+')) neg = *p++ == '-';
+    const char* s = p;
+    long long v = 0;
+    for (; p < end and unsigned(*p - '0') < 10; p++) {
+      v = 10 * v + (*p - '0');
+      if (v > INT_MAX) return nullptr;
     }
+    if (p == s) return nullptr;
+    *val = neg ? -v : v;
+    return p;
+  }
 
-    if (inNodesSection) {
-      std::istringstream iss(line);
-      std::string indexStr;
-      std::getline(iss, indexStr,
-                   ',');  // Read up to the first comma to get the node index.
-      int nodeIndex = std::stoi(indexStr);  // Convert index string to int.
-
-      Node node;
-      node.index = nodeIndex;
-
-      std::string coordinateStr;
-      std::getline(iss, coordinateStr,
-                   ',');  // Read up to the next comma for the x coordinate.
-      node.x = std::stod(coordinateStr);  // Convert to double.
-
-      std::getline(iss, coordinateStr,
-                   ',');  // Read up to the next comma for the y coordinate.
-      node.y = std::stod(coordinateStr);  // Convert to double.
-
-      std::getline(iss,
-                   coordinateStr);  // Read the rest of the line for the z
-                                    // coordinate (assuming no more commas).
-      node.z = std::stod(coordinateStr);  // Convert to double.
-
-      nodes.push_back(node);
-    } else if (inElementsSection) {
-      std::istringstream iss(line);
-      Element element;
-      if (!(iss >> element.index)) {  // Read and check the element's index.
-        std::cerr << "Failed to read element index from line: " << line
-                  << std::endl;
-        continue;  // Skip to the next line if the element index can't be read.
+  /**
+   * @brief Parse a floating point number
+   *
+   * Numbers with at most 15 significant digits and a small decimal exponent,
+   * i.e. virtually all coordinates written by meshers, are converted exactly
+   * with a single floating point multiplication or division, the rest are
+   * handed to strtod.
+   */
+  static const char* parse_double(const char* p, const char* end,
+                                  double* val) {
+    static constexpr double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* start = p;
+    bool neg = false;
+    if (p < end and (*p == '-' or *p == '+')) neg = *p++ == '-';
+
+    std::uint64_t mant = 0;
+    int ndigits = 0, exp10 = 0;
+    bool any = false, exact = true;
+    for (; p < end and unsigned(*p - '0') < 10; p++) {
+      any = true;
+      if (mant == 0 and *p == '0') continue;
+      if (ndigits < 19) {
+        mant = 10 * mant + (*p - '0');
+        ndigits++;
+      } else {
+        exp10++;
+        exact = false;
       }
-
-      // Read the rest of the line as a single string.
-      std::string restOfLine;
-      std::getline(iss, restOfLine);
-
-      // Use another stringstream to parse the node indices from restOfLine.
-      std::istringstream nodeStream(restOfLine);
-      std::string
-          nodeIndexStr;  // Use a string to temporarily hold each node index.
-
-      while (std::getline(nodeStream, nodeIndexStr,
-                          ',')) {     // Read up to the next comma.
-        if (!nodeIndexStr.empty()) {  // Check if the string is not empty.
-          std::istringstream indexStream(
-              nodeIndexStr);  // Use another stringstream to convert string to
-                              // int.
-          int nodeIndex;
-          if (indexStream >> nodeIndex) {  // Convert the string to an int.
-            element.nodeIndices.push_back(nodeIndex);
-          }
+    }
+    if (p < end and *p == '.') {
+      for (p++; p < end and unsigned(*p - '0') < 10; p++) {
+        any = true;
+        if (mant == 0 and *p == '0') {
+          exp10--;
+        } else if (ndigits < 19) {
+          mant = 10 * mant + (*p - '0');
+          ndigits++;
+          exp10--;
+        } else {
+          exact = false;
         }
       }
-      elements[element.index] = element;
-    } else if (inNodeSetsSection && !currentSetName.empty()) {
-      std::istringstream iss(line);
-      int nodeIndex;
-      while (iss >> nodeIndex) {
-        nodeSets[currentSetName].nodeIndices.push_back(nodeIndex);
-      }
     }
-  }
+    if (!any) return nullptr;
+    if (p < end and (*p == 'e' or *p == 'E')) {
+      int e;
+      const char* q = parse_int(p + 1, end, &e);
+      if (!q) return nullptr;
+      exp10 += e;
+      p = q;
+    }
 
-  meshFile.close();
+    if (exact and ndigits <= 15 and exp10 >= -22 and exp10 <= 22) {
+      double v = double(mant);
+      v = exp10 < 0 ? v / pow10[-exp10] : v * pow10[exp10];
+      *val = neg ? -v : v;
+      return p;
+    }
 
-  // Convert elements and nodeSets to flat structures
-  int num_elems = elements.size();
-  int *elem_nodes = new int[10 * num_elems];
+    // strtod needs a null-terminated string, and the mapping is not
+    std::string token(start, p);
+    *val = std::strtod(token.c_str(), nullptr);
+    return p;
+  }
 
-  for (const auto &elem : elements) {
-    for (int j = 0; j < 10; j++) {
-      elem_nodes[10 * (elem.second.index - 1) + j] =
-          elem.second.nodeIndices[j] - 1;
+  // Parse the lines of a chunk and mark the labels read, returns an error
+  // message on failure
+  template <typename T>
+  std::string parse_chunk(const Block& c, int* element_nodes, T* xloc,
+                          std::vector<std::atomic<char>>& node_filled,
+                          std::vector<std::atomic<char>>& elem_filled) const {
+    for (const char* p = c.begin; p < c.end;) {
+      const char* eol = end_of_line(p, c.end);
+      const char* s = skip_space(p, eol);
+      const char* line = p;
+      p = eol < c.end ? eol + 1 : c.end;
+      if (s == eol or *s == '*') continue;
+
+      int label;
+      const char* q = parse_int(s, eol, &label);
+      if (c.is_node) {
+        double x[3];
+        for (int d = 0; d < 3 and q; d++) {
+          q = parse_double(skip_sep(q, eol), eol, &x[d]);
+        }
+        if (!q) return "invalid node line: " + std::string(line, eol);
+        if (label < 1 or label > num_nodes) {
+          return "node label " + std::to_string(label) + " out of range";
+        }
+        if (node_filled[label - 1].exchange(1, std::memory_order_relaxed)) {
+          return "duplicated node label " + std::to_string(label);
+        }
+        for (int d = 0; d < 3; d++) xloc[3 * (label - 1) + d] = x[d];
+      } else {
+        int conn[nodes_per_element];
+        for (int j = 0; j < nodes_per_element and q; j++) {
+          q = parse_int(skip_sep(q, eol), eol, &conn[j]);
+        }
+        if (!q) return "invalid element line: " + std::string(line, eol);
+        if (label < 1 or label > num_elements) {
+          return "element label " + std::to_string(label) + " out of range";
+        }
+        if (elem_filled[label - 1].exchange(1, std::memory_order_relaxed)) {
+          return "duplicated element label " + std::to_string(label);
+        }
+        for (int j = 0; j < nodes_per_element; j++) {
+          element_nodes[nodes_per_element * (label - 1) + j] = conn[j] - 1;
+        }
+      }
     }
+    return "";
   }
 
-  int num_ns = nodes.size();
+  std::string path;
+  std::size_t chunk_bytes;
+  const char* data = nullptr;
+  std::size_t size = 0;
+  std::vector<Block> blocks;
+  int num_nodes = 0, num_elements = 0;
+};
+
+// Load the nodes and 10-node tetrahedral elements of an Abaqus input file
+template <typename T>
+void load_mesh(std::string filename, int *num_elements, int *num_nodes,
+               int **element_nodes, T **xloc) {
+  AbaqusInpReader reader(filename);
+  int num_elems = reader.get_num_elements();
+  int num_ns = reader.get_num_nodes();
+  int *elem_nodes = new int[AbaqusInpReader::nodes_per_element * num_elems];
   T *x = new T[3 * num_ns];
 
-  for (const auto &node : nodes) {
-    x[3 * (node.index - 1)] = node.x;
-    x[3 * (node.index - 1) + 1] = node.y;
-    x[3 * (node.index - 1) + 2] = node.z;
+  try {
+    reader.read(elem_nodes, x);
+  } catch (...) {
+    delete[] elem_nodes;
+    delete[] x;
+    throw;
   }
 
   *num_elements = num_elems;
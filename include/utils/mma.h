@@ -0,0 +1,431 @@
+#ifndef XCGD_MMA_H
+#define XCGD_MMA_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "utils/checkpoint.h"
+#include "utils/dense_lu.h"
+
+/**
+ * @brief Method of moving asymptotes (Svanberg 1987, 2007) for
+ *
+ *   min f0(x), s.t. fi(x) <= 0 for i = 1, ..., m and xmin <= x <= xmax
+ *
+ * Each update() builds the convex separable MMA approximation about the
+ * current design and solves it by the primal-dual interior point method of
+ * Svanberg's mmasub and subsolv, with the artificial variables a0 = 1,
+ * ai = 0, ci = 1000 and di = 1.
+ *
+ * The complete state of the method, i.e. the iteration count, the two previous
+ * iterates, the asymptotes and the multipliers of the last subproblem, is
+ * saved by save() and restored by load(), so an optimization restarted from a
+ * checkpoint follows the same iterates as an uninterrupted one.
+ */
+class MMAOptimizer {
+ public:
+  static constexpr int max_constraints = 15;
+
+  /**
+   * @param n [in] number of design variables
+   * @param m [in] number of constraints, 1 <= m <= max_constraints, m < n
+   * @param xmin, xmax [in] bounds of the design variables
+   * @param init_asymptote_offset [in] distance of the initial asymptotes from
+   * the design, relative to xmax - xmin
+   * @param move_limit [in] maximum step of a variable, relative to xmax - xmin
+   */
+  MMAOptimizer(int n, int m, const std::vector<double>& xmin,
+               const std::vector<double>& xmax,
+               double init_asymptote_offset = 0.5, double move_limit = 0.5)
+      : n(n),
+        m(m),
+        xmin(xmin),
+        xmax(xmax),
+        asyinit(init_asymptote_offset),
+        move(move_limit),
+        xold1(n),
+        xold2(n),
+        low(n),
+        upp(n),
+        y(m, 0.0),
+        lam(m, 0.0),
+        mu(m, 0.0),
+        s(m, 0.0),
+        xsi(n, 0.0),
+        eta(n, 0.0) {
+    if (m < 1 or m > max_constraints or m >= n) {
+      throw std::runtime_error("MMAOptimizer: invalid number of constraints " +
+                               std::to_string(m));
+    }
+    if (xmin.size() != n or xmax.size() != n) {
+      throw std::runtime_error("MMAOptimizer: bounds of wrong size");
+    }
+  }
+
+  /**
+   * @brief Take one MMA step
+   *
+   * @param x [in, out] current design on entry, next design on exit
+   * @param df0dx [in] objective gradient, of size n
+   * @param fval [in] constraint values fi, of size m
+   * @param dfdx [in] constraint gradients, m rows of size n
+   */
+  void update(double* x, const double* df0dx, const double* fval,
+              const double* dfdx) {
+    iter++;
+    if (iter == 1) {
+      std::copy(x, x + n, xold1.begin());
+      std::copy(x, x + n, xold2.begin());
+    }
+
+    // Move the asymptotes, they contract if the design oscillates and relax
+    // if it moves monotonically
+    for (int j = 0; j < n; j++) {
+      double dx = xmax[j] - xmin[j];
+      if (iter <= 2) {
+        low[j] = x[j] - asyinit * dx;
+        upp[j] = x[j] + asyinit * dx;
+      } else {
+        double zzz = (x[j] - xold1[j]) * (xold1[j] - xold2[j]);
+        double factor = zzz > 0.0 ? asyincr : (zzz < 0.0 ? asydecr : 1.0);
+        low[j] = x[j] - factor * (xold1[j] - low[j]);
+        upp[j] = x[j] + factor * (upp[j] - xold1[j]);
+        low[j] = std::clamp(low[j], x[j] - 10.0 * dx, x[j] - 0.01 * dx);
+        upp[j] = std::clamp(upp[j], x[j] + 0.01 * dx, x[j] + 10.0 * dx);
+      }
+    }
+
+    // Bounds and coefficients of the subproblem
+    std::vector<double> alfa(n), beta(n), p0(n), q0(n), P(m * n), Q(m * n),
+        b(m);
+    for (int j = 0; j < n; j++) {
+      double dx = xmax[j] - xmin[j];
+      alfa[j] = std::max({low[j] + albefa * (x[j] - low[j]), x[j] - move * dx,
+                          xmin[j]});
+      beta[j] = std::min({upp[j] - albefa * (upp[j] - x[j]), x[j] + move * dx,
+                          xmax[j]});
+
+      double ux2 = (upp[j] - x[j]) * (upp[j] - x[j]);
+      double xl2 = (x[j] - low[j]) * (x[j] - low[j]);
+      double xmamiinv = 1.0 / std::max(dx, 1e-5);
+
+      double p = std::max(df0dx[j], 0.0), q = std::max(-df0dx[j], 0.0);
+      double pq = 0.001 * (p + q) + raa0 * xmamiinv;
+      p0[j] = (p + pq) * ux2;
+      q0[j] = (q + pq) * xl2;
+
+      for (int i = 0; i < m; i++) {
+        double g = dfdx[i * n + j];
+        p = std::max(g, 0.0);
+        q = std::max(-g, 0.0);
+        pq = 0.001 * (p + q) + raa0 * xmamiinv;
+        P[i * n + j] = (p + pq) * ux2;
+        Q[i * n + j] = (q + pq) * xl2;
+      }
+    }
+    for (int i = 0; i < m; i++) {
+      b[i] = -fval[i];
+      for (int j = 0; j < n; j++) {
+        b[i] += P[i * n + j] / (upp[j] - x[j]) + Q[i * n + j] / (x[j] - low[j]);
+      }
+    }
+
+    std::copy(xold1.begin(), xold1.end(), xold2.begin());
+    std::copy(x, x + n, xold1.begin());
+    subsolve(alfa, beta, p0, q0, P, Q, b, x);
+  }
+
+  /**
+   * @brief Maximum norm of the KKT residual of the original problem at x,
+   * with the multipliers of the last subproblem
+   */
+  double kkt_residual(const double* x, const double* df0dx,
+                      const double* fval, const double* dfdx) const {
+    double res = 0.0;
+    auto add = [&res](double r) { res = std::max(res, std::fabs(r)); };
+    for (int j = 0; j < n; j++) {
+      double rex = df0dx[j] - xsi[j] + eta[j];
+      for (int i = 0; i < m; i++) rex += dfdx[i * n + j] * lam[i];
+      add(rex);
+      add(xsi[j] * (x[j] - xmin[j]));
+      add(eta[j] * (xmax[j] - x[j]));
+    }
+    double rez = a0 - zet;
+    for (int i = 0; i < m; i++) {
+      add(c + d * y[i] - mu[i] - lam[i]);
+      add(fval[i] - a * z - y[i] + s[i]);
+      add(mu[i] * y[i]);
+      add(lam[i] * s[i]);
+      rez -= a * lam[i];
+    }
+    add(rez);
+    add(zet * z);
+    return res;
+  }
+
+  // Number of updates taken
+  int get_iter() const { return iter; }
+
+  // Multipliers of the constraints from the last subproblem
+  const std::vector<double>& get_multipliers() const { return lam; }
+
+  void save(CheckpointWriter& ckpt, const std::string& prefix = "mma") const {
+    ckpt.add_scalar<std::int64_t>(prefix + ".iter", iter);
+    ckpt.add(prefix + ".xold1", xold1);
+    ckpt.add(prefix + ".xold2", xold2);
+    ckpt.add(prefix + ".low", low);
+    ckpt.add(prefix + ".upp", upp);
+    ckpt.add(prefix + ".y", y);
+    ckpt.add(prefix + ".lam", lam);
+    ckpt.add(prefix + ".mu", mu);
+    ckpt.add(prefix + ".s", s);
+    ckpt.add(prefix + ".xsi", xsi);
+    ckpt.add(prefix + ".eta", eta);
+    ckpt.add_scalar(prefix + ".z", z);
+    ckpt.add_scalar(prefix + ".zet", zet);
+  }
+
+  void load(const CheckpointReader& ckpt, const std::string& prefix = "mma") {
+    auto get = [&](const std::string& name, std::vector<double>& v) {
+      std::vector<double> vals = ckpt.get<double>(prefix + "." + name);
+      if (vals.size() != v.size()) {
+        throw std::runtime_error("MMAOptimizer: checkpointed " + name +
+                                 " is of size " + std::to_string(vals.size()) +
+                                 ", expect " + std::to_string(v.size()));
+      }
+      v = vals;
+    };
+    iter = ckpt.get_scalar<std::int64_t>(prefix + ".iter");
+    get("xold1", xold1);
+    get("xold2", xold2);
+    get("low", low);
+    get("upp", upp);
+    get("y", y);
+    get("lam", lam);
+    get("mu", mu);
+    get("s", s);
+    get("xsi", xsi);
+    get("eta", eta);
+    z = ckpt.get_scalar<double>(prefix + ".z");
+    zet = ckpt.get_scalar<double>(prefix + ".zet");
+  }
+
+ private:
+  /**
+   * @brief Solve the MMA subproblem by a primal-dual Newton method on the
+   * perturbed KKT conditions, the perturbation epsi is reduced by a factor of
+   * 10 until it reaches epsimin
+   *
+   * Sets x to the minimizer and the members to the multipliers.
+   */
+  void subsolve(const std::vector<double>& alfa,
+                const std::vector<double>& beta, const std::vector<double>& p0,
+                const std::vector<double>& q0, const std::vector<double>& P,
+                const std::vector<double>& Q, const std::vector<double>& b,
+                double* x) {
+    // Primal variables x, y, z and multipliers lam, xsi, eta, mu, zet, s
+    std::vector<double> xs(n), plam(n), qlam(n), gvec(m);
+    for (int j = 0; j < n; j++) {
+      xs[j] = 0.5 * (alfa[j] + beta[j]);
+      xsi[j] = std::max(1.0 / (xs[j] - alfa[j]), 1.0);
+      eta[j] = std::max(1.0 / (beta[j] - xs[j]), 1.0);
+    }
+    std::fill(y.begin(), y.end(), 1.0);
+    std::fill(lam.begin(), lam.end(), 1.0);
+    std::fill(mu.begin(), mu.end(), std::max(1.0, 0.5 * c));
+    std::fill(s.begin(), s.end(), 1.0);
+    z = 1.0;
+    zet = 1.0;
+
+    // plam, qlam and gvec at the current point
+    auto eval_terms = [&](const std::vector<double>& xv,
+                          const std::vector<double>& lv) {
+      for (int j = 0; j < n; j++) {
+        plam[j] = p0[j];
+        qlam[j] = q0[j];
+        for (int i = 0; i < m; i++) {
+          plam[j] += P[i * n + j] * lv[i];
+          qlam[j] += Q[i * n + j] * lv[i];
+        }
+      }
+      for (int i = 0; i < m; i++) {
+        gvec[i] = 0.0;
+        for (int j = 0; j < n; j++) {
+          gvec[i] += P[i * n + j] / (upp[j] - xv[j]) +
+                     Q[i * n + j] / (xv[j] - low[j]);
+        }
+      }
+    };
+
+    // 2-norm and max norm of the residual of the perturbed KKT conditions
+    auto residual = [&](double epsi, const std::vector<double>& xv,
+                        double* resmax) {
+      eval_terms(xv, lam);
+      double norm2 = 0.0, rmax = 0.0;
+      auto add = [&](double r) {
+        norm2 += r * r;
+        rmax = std::max(rmax, std::fabs(r));
+      };
+      for (int j = 0; j < n; j++) {
+        double ux = upp[j] - xv[j], xl = xv[j] - low[j];
+        add(plam[j] / (ux * ux) - qlam[j] / (xl * xl) - xsi[j] + eta[j]);
+        add(xsi[j] * (xv[j] - alfa[j]) - epsi);
+        add(eta[j] * (beta[j] - xv[j]) - epsi);
+      }
+      double rez = a0 - zet;
+      for (int i = 0; i < m; i++) {
+        add(c + d * y[i] - mu[i] - lam[i]);
+        add(gvec[i] - a * z - y[i] + s[i] - b[i]);
+        add(mu[i] * y[i] - epsi);
+        add(lam[i] * s[i] - epsi);
+        rez -= a * lam[i];
+      }
+      add(rez);
+      add(zet * z - epsi);
+      if (resmax) *resmax = rmax;
+      return std::sqrt(norm2);
+    };
+
+    std::vector<double> delx(n), diagx(n), dx(n), dxsi(n), deta(n), GG(m * n);
+    std::vector<double> dely(m), dellam(m), diagy(m), dy(m), dlam(m), dmu(m),
+        ds(m);
+    std::vector<double> x_old(n), y_old(m), lam_old(m), xsi_old(n), eta_old(n),
+        mu_old(m), s_old(m);
+    std::vector<double> AA((m + 1) * (m + 1)), bb(m + 1);
+    DenseLU<double, max_constraints + 1> lu;
+
+    for (double epsi = 1.0; epsi > epsimin; epsi *= 0.1) {
+      double resmax;
+      double resnorm = residual(epsi, xs, &resmax);
+
+      for (int ittt = 0; resmax > 0.9 * epsi and ittt < 200; ittt++) {
+        // Newton direction, reduced to a system of size m + 1 in lam and z
+        eval_terms(xs, lam);
+        for (int j = 0; j < n; j++) {
+          double ux1 = upp[j] - xs[j], xl1 = xs[j] - low[j];
+          double ux2 = ux1 * ux1, xl2 = xl1 * xl1;
+          for (int i = 0; i < m; i++) {
+            GG[i * n + j] = P[i * n + j] / ux2 - Q[i * n + j] / xl2;
+          }
+          delx[j] = plam[j] / ux2 - qlam[j] / xl2 - epsi / (xs[j] - alfa[j]) +
+                    epsi / (beta[j] - xs[j]);
+          diagx[j] = 2.0 * (plam[j] / (ux2 * ux1) + qlam[j] / (xl2 * xl1)) +
+                     xsi[j] / (xs[j] - alfa[j]) + eta[j] / (beta[j] - xs[j]);
+        }
+        double delz = a0 - epsi / z;
+        for (int i = 0; i < m; i++) {
+          dely[i] = c + d * y[i] - lam[i] - epsi / y[i];
+          delz -= a * lam[i];
+          dellam[i] = gvec[i] - a * z - y[i] - b[i] + epsi / lam[i];
+          diagy[i] = d + mu[i] / y[i];
+        }
+
+        for (int i = 0; i < m; i++) {
+          double blam = dellam[i] + dely[i] / diagy[i];
+          for (int j = 0; j < n; j++) {
+            blam -= GG[i * n + j] * delx[j] / diagx[j];
+          }
+          bb[i] = blam;
+          for (int k = 0; k < m; k++) {
+            double v = 0.0;
+            for (int j = 0; j < n; j++) {
+              v += GG[i * n + j] * GG[k * n + j] / diagx[j];
+            }
+            if (i == k) v += s[i] / lam[i] + 1.0 / diagy[i];
+            AA[i + (m + 1) * k] = v;
+          }
+          AA[i + (m + 1) * m] = a;
+          AA[m + (m + 1) * i] = a;
+        }
+        AA[m + (m + 1) * m] = -zet / z;
+        bb[m] = delz;
+        lu.factor(m + 1, AA.data());
+        lu.solve(bb.data());
+
+        for (int i = 0; i < m; i++) dlam[i] = bb[i];
+        double dz = bb[m];
+        for (int j = 0; j < n; j++) {
+          double gl = 0.0;
+          for (int i = 0; i < m; i++) gl += GG[i * n + j] * dlam[i];
+          dx[j] = -delx[j] / diagx[j] - gl / diagx[j];
+          dxsi[j] = -xsi[j] + epsi / (xs[j] - alfa[j]) -
+                    xsi[j] * dx[j] / (xs[j] - alfa[j]);
+          deta[j] = -eta[j] + epsi / (beta[j] - xs[j]) +
+                    eta[j] * dx[j] / (beta[j] - xs[j]);
+        }
+        for (int i = 0; i < m; i++) {
+          dy[i] = -dely[i] / diagy[i] + dlam[i] / diagy[i];
+          dmu[i] = -mu[i] + epsi / y[i] - mu[i] * dy[i] / y[i];
+          ds[i] = -s[i] + epsi / lam[i] - s[i] * dlam[i] / lam[i];
+        }
+        double dzet = -zet + epsi / z - zet * dz / z;
+
+        // Largest step that keeps the variables strictly feasible
+        double stminv = 1.0;
+        auto bound = [&stminv](double v, double dv) {
+          stminv = std::max(stminv, -1.01 * dv / v);
+        };
+        for (int j = 0; j < n; j++) {
+          bound(xs[j] - alfa[j], dx[j]);
+          bound(beta[j] - xs[j], -dx[j]);
+          bound(xsi[j], dxsi[j]);
+          bound(eta[j], deta[j]);
+        }
+        for (int i = 0; i < m; i++) {
+          bound(y[i], dy[i]);
+          bound(lam[i], dlam[i]);
+          bound(mu[i], dmu[i]);
+          bound(s[i], ds[i]);
+        }
+        bound(z, dz);
+        bound(zet, dzet);
+        double steg = 1.0 / stminv;
+
+        // Backtrack until the residual decreases
+        x_old = xs, y_old = y, lam_old = lam, xsi_old = xsi, eta_old = eta,
+        mu_old = mu, s_old = s;
+        double z_old = z, zet_old = zet;
+        double resnew = 2.0 * resnorm;
+        for (int itto = 0; resnew > resnorm and itto < 50; itto++) {
+          for (int j = 0; j < n; j++) {
+            xs[j] = x_old[j] + steg * dx[j];
+            xsi[j] = xsi_old[j] + steg * dxsi[j];
+            eta[j] = eta_old[j] + steg * deta[j];
+          }
+          for (int i = 0; i < m; i++) {
+            y[i] = y_old[i] + steg * dy[i];
+            lam[i] = lam_old[i] + steg * dlam[i];
+            mu[i] = mu_old[i] + steg * dmu[i];
+            s[i] = s_old[i] + steg * ds[i];
+          }
+          z = z_old + steg * dz;
+          zet = zet_old + steg * dzet;
+          resnew = residual(epsi, xs, &resmax);
+          steg *= 0.5;
+        }
+        resnorm = resnew;
+      }
+    }
+
+    std::copy(xs.begin(), xs.end(), x);
+  }
+
+  int n, m;
+  std::vector<double> xmin, xmax;
+
+  // Parameters of Svanberg's implementation
+  double asyinit, move;
+  static constexpr double asyincr = 1.2, asydecr = 0.7, albefa = 0.1,
+                          raa0 = 1e-5, epsimin = 1e-7;
+  static constexpr double a0 = 1.0, a = 0.0, c = 1000.0, d = 1.0;
+
+  // State of the method
+  int iter = 0;
+  std::vector<double> xold1, xold2, low, upp;
+  std::vector<double> y, lam, mu, s, xsi, eta;
+  double z = 1.0, zet = 1.0;
+};
+
+#endif  // XCGD_MMA_H
@@ -0,0 +1,309 @@
+#ifndef XCGD_REDUCED_SYSTEM_H
+#define XCGD_REDUCED_SYSTEM_H
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "sparse_utils/sparse_utils.h"
+#include "utils/linalg.h"
+#include "utils/memory.h"
+
+/**
+ * @brief Partition of the full dof into free dof and Dirichlet-constrained dof
+ *
+ * Free dof are numbered consecutively in the order of the full dof, the
+ * constrained dof are numbered in the order of bc_dof, which is also the order
+ * of the prescribed values. bc_dof may contain duplicates, as long as their
+ * prescribed values agree.
+ */
+class DirichletDofMap {
+ public:
+  DirichletDofMap() = default;
+  DirichletDofMap(int ndof, const std::vector<int>& bc_dof)
+      : ndof(ndof), bc_dof(bc_dof), full_to_reduced(ndof, 0) {
+    for (int i = 0; i < bc_dof.size(); i++) {
+      int dof = bc_dof[i];
+      if (dof < 0 or dof >= ndof) {
+        char msg[256];
+        std::snprintf(msg, 256, "Dirichlet dof %d is out of range [0, %d)",
+                      dof, ndof);
+        throw std::runtime_error(msg);
+      }
+      // Duplicated dof refer to their first occurrence
+      if (full_to_reduced[dof] == 0) full_to_reduced[dof] = -1 - i;
+    }
+    for (int i = 0; i < ndof; i++) {
+      if (full_to_reduced[i] >= 0) {
+        full_to_reduced[i] = free_dof.size();
+        free_dof.push_back(i);
+      }
+    }
+  }
+
+  // Check if the map was created for the given problem
+  bool matches(int ndof_, const std::vector<int>& bc_dof_) const {
+    return ndof == ndof_ and bc_dof == bc_dof_;
+  }
+
+  int get_num_dof() const { return ndof; }
+  int get_num_free() const { return free_dof.size(); }
+  int get_num_bc() const { return bc_dof.size(); }
+  const std::vector<int>& get_free_dof() const { return free_dof; }
+  const std::vector<int>& get_bc_dof() const { return bc_dof; }
+
+  // Index of a full dof in the free dof, or -1 if constrained
+  inline int get_free_index(int dof) const {
+    int i = full_to_reduced[dof];
+    return i >= 0 ? i : -1;
+  }
+
+  // Index of a full dof in bc_dof, or -1 if free
+  inline int get_bc_index(int dof) const {
+    int i = full_to_reduced[dof];
+    return i < 0 ? -1 - i : -1;
+  }
+
+  // Extract the free entries of a full vector
+  template <typename T>
+  void restrict(const T* full, T* reduced) const {
+    for (int i = 0; i < free_dof.size(); i++) reduced[i] = full[free_dof[i]];
+  }
+
+  // Assemble a full vector from its free entries and the prescribed values
+  template <typename T>
+  void expand(const T* reduced, const T* bc_vals, T* full) const {
+    for (int i = 0; i < free_dof.size(); i++) full[free_dof[i]] = reduced[i];
+    for (int i = 0; i < bc_dof.size(); i++) {
+      full[bc_dof[i]] = bc_vals ? bc_vals[i] : T(0.0);
+    }
+  }
+
+ private:
+  int ndof = 0;
+  std::vector<int> bc_dof, free_dof;
+
+  // >= 0: index of the free dof, < 0: -1 - index of the bc dof
+  std::vector<int> full_to_reduced;
+};
+
+/**
+ * @brief Jacobian matrix assembled directly on the free dof
+ *
+ * The full Jacobian is partitioned as
+ *
+ *   [K_ff K_fc]
+ *   [K_cf K_cc]
+ *
+ * where f are the free dof and c the constrained dof. Only K_ff, stored as a
+ * scalar BSR matrix, and the lifting block K_fc are assembled, the other
+ * blocks are dropped. The element matrices are scattered through the same
+ * add_block_values() interface as GalerkinBSRMat, so this can be passed to
+ * GalerkinAnalysis::jacobian() in place of the full matrix.
+ */
+template <typename T, int dof_per_node>
+class ReducedBSRMat final {
+ public:
+  using BSRMat = GalerkinBSRMat<T, 1>;
+
+  /**
+   * @param nnodes number of nodes
+   * @param nelems number of elements
+   * @param max_nnodes_per_element maximum number of nodes of an element
+   * @param element_nodes element_nodes(elem, nodes) returns the number of
+   * nodes of elem and populates nodes
+   * @param dof_map partition of the dof, must outlive this matrix
+   */
+  template <class ElementNodes>
+  ReducedBSRMat(int nnodes, int nelems, int max_nnodes_per_element,
+                const ElementNodes& element_nodes,
+                const DirichletDofMap& dof_map)
+      : dof_map(dof_map) {
+    if (dof_map.get_num_dof() != nnodes * dof_per_node) {
+      char msg[256];
+      std::snprintf(msg, 256, "dof map has %d dof, the mesh has %d",
+                    dof_map.get_num_dof(), nnodes * dof_per_node);
+      throw std::runtime_error(msg);
+    }
+
+    // Node to node connectivity
+    std::vector<std::set<int>> node_adj(nnodes);
+    std::vector<int> nodes(max_nnodes_per_element);
+    for (int e = 0; e < nelems; e++) {
+      int n = element_nodes(e, nodes.data());
+      for (int i = 0; i < n; i++) {
+        node_adj[nodes[i]].insert(nodes.begin(), nodes.begin() + n);
+      }
+    }
+
+    // Expand to the dof and split into the free and constrained columns
+    int nfree = dof_map.get_num_free();
+    std::vector<int> rowp(nfree + 1, 0), cols;
+    fc_rowp.assign(nfree + 1, 0);
+    for (int i = 0; i < nfree; i++) {
+      int node = dof_map.get_free_dof()[i] / dof_per_node;
+      for (int j : node_adj[node]) {
+        for (int d = 0; d < dof_per_node; d++) {
+          int col = dof_per_node * j + d;
+          if (int jf = dof_map.get_free_index(col); jf >= 0) {
+            cols.push_back(jf);
+          } else {
+            fc_cols.push_back(dof_map.get_bc_index(col));
+          }
+        }
+      }
+      // Free dof keep the order of the full dof, only the bc columns need to
+      // be sorted
+      std::sort(fc_cols.begin() + fc_rowp[i], fc_cols.end());
+      rowp[i + 1] = cols.size();
+      fc_rowp[i + 1] = fc_cols.size();
+    }
+    fc_vals.assign(fc_cols.size(), T(0.0));
+
+    Kff = new BSRMat(nfree, rowp[nfree], rowp.data(), cols.data());
+  }
+
+  ~ReducedBSRMat() {
+    if (Kff) delete Kff;
+  }
+
+  ReducedBSRMat(const ReducedBSRMat&) = delete;
+  ReducedBSRMat& operator=(const ReducedBSRMat&) = delete;
+
+  void zero() {
+    Kff->zero();
+    std::fill(fc_vals.begin(), fc_vals.end(), T(0.0));
+  }
+
+  /**
+   * @brief Add an element matrix, the signature follows
+   * GalerkinBSRMat::add_block_values()
+   *
+   * @param nnodes number of element nodes
+   * @param nodes element nodes
+   * @param elem_jac element matrix, row-major with the leading dimension
+   * max_nnodes_per_element * dof_per_node
+   */
+  template <int max_nnodes_per_element>
+  void add_block_values(int nnodes, const int* nodes, const T* elem_jac) {
+    constexpr int ld = max_nnodes_per_element * dof_per_node;
+    for (int i = 0; i < nnodes; i++) {
+      for (int ii = 0; ii < dof_per_node; ii++) {
+        int row = dof_map.get_free_index(dof_per_node * nodes[i] + ii);
+        if (row < 0) continue;
+        const T* jac_row = &elem_jac[(dof_per_node * i + ii) * ld];
+        for (int j = 0; j < nnodes; j++) {
+          for (int jj = 0; jj < dof_per_node; jj++) {
+            int dof = dof_per_node * nodes[j] + jj;
+            T val = jac_row[dof_per_node * j + jj];
+            if (int col = dof_map.get_free_index(dof); col >= 0) {
+              Kff->vals[find(Kff->rowp, Kff->cols, row, col)] += val;
+            } else {
+              int c = dof_map.get_bc_index(dof);
+              fc_vals[find(fc_rowp.data(), fc_cols.data(), row, c)] += val;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Compute the reduced right hand side rhs_f - K_fc * bc_vals
+   *
+   * @param rhs full right hand side
+   * @param bc_vals prescribed values, ordered as the bc_dof of the dof map
+   * @param rhs_reduced output, length of the number of free dof
+   */
+  void lift(const T* rhs, const T* bc_vals, T* rhs_reduced) const {
+    dof_map.restrict(rhs, rhs_reduced);
+    for (int i = 0; i < dof_map.get_num_free(); i++) {
+      for (int jp = fc_rowp[i]; jp < fc_rowp[i + 1]; jp++) {
+        rhs_reduced[i] -= fc_vals[jp] * bc_vals[fc_cols[jp]];
+      }
+    }
+  }
+
+  BSRMat* get_free_block() { return Kff; }
+  const DirichletDofMap& get_dof_map() const { return dof_map; }
+
+  // Bytes of K_ff and K_fc
+  std::size_t get_memory_bytes() const {
+    return (Kff ? memory_bytes(*Kff) : 0) + memory_bytes(fc_rowp) +
+           memory_bytes(fc_cols) + memory_bytes(fc_vals);
+  }
+
+ private:
+  // Location of (row, col) in a CSR structure with sorted columns
+  static int find(const int* rowp, const int* cols, int row, int col) {
+    const int* start = cols + rowp[row];
+    const int* end = cols + rowp[row + 1];
+    const int* it = std::lower_bound(start, end, col);
+    if (it == end or *it != col) {
+      char msg[256];
+      std::snprintf(msg, 256, "entry (%d, %d) is not in the sparsity pattern",
+                    row, col);
+      throw std::runtime_error(msg);
+    }
+    return it - cols;
+  }
+
+  const DirichletDofMap& dof_map;
+  BSRMat* Kff = nullptr;
+
+  // K_fc in CSR format, columns index the bc dof
+  std::vector<int> fc_rowp, fc_cols;
+  std::vector<T> fc_vals;
+};
+
+/**
+ * @brief Right hand side of the full system whose Dirichlet rows and columns
+ * are replaced by the identity
+ *
+ * This is the counterpart of ReducedBSRMat::lift() for solvers that keep the
+ * Dirichlet dof: the free entries are rhs_f - K_fc * bc_vals, the Dirichlet
+ * entries are the prescribed values.
+ *
+ * @param jac full Jacobian, GalerkinBSRMat or SymmetricGalerkinBSRMat, only
+ * its free rows are used
+ * @param rhs [in, out] load vectors, column major ndof x nrhs, on exit the
+ * Dirichlet entries are set to the prescribed values
+ * @param nrhs number of load vectors, the Dirichlet values apply to all of
+ * them
+ * @return the right hand sides of the system with eliminated columns, in the
+ * same layout as rhs
+ */
+template <typename T, class Mat>
+std::vector<T> lift_dirichlet_bcs(const Mat* jac,
+                                  const std::vector<int>& bc_dof,
+                                  const std::vector<T>& bc_vals,
+                                  std::vector<T>& rhs, int nrhs = 1) {
+  int ndof = rhs.size() / nrhs;
+
+  // t = K * u_c, where u_c only holds the prescribed values
+  std::vector<T> uc(ndof, T(0.0)), t(ndof, T(0.0));
+  for (int i = 0; i < bc_dof.size(); i++) {
+    uc[bc_dof[i]] = bc_vals[i];
+  }
+  jac->axpy(uc.data(), t.data());
+  for (int i = 0; i < bc_dof.size(); i++) {
+    t[bc_dof[i]] = 0.0;
+  }
+
+  std::vector<T> ret(rhs.size());
+  for (int k = 0; k < nrhs; k++) {
+    T* rhs_k = &rhs[std::size_t(k) * ndof];
+    T* ret_k = &ret[std::size_t(k) * ndof];
+    for (int i = 0; i < bc_dof.size(); i++) {
+      rhs_k[bc_dof[i]] = bc_vals[i];
+    }
+    for (int i = 0; i < ndof; i++) {
+      ret_k[i] = rhs_k[i] - t[i];
+    }
+  }
+  return ret;
+}
+
+#endif  // XCGD_REDUCED_SYSTEM_H
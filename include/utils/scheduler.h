@@ -0,0 +1,216 @@
+#ifndef XCGD_SCHEDULER_H
+#define XCGD_SCHEDULER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils/timer.h"
+
+/**
+ * @brief Work classes of elements, ordered from the most expensive to the
+ * cheapest
+ *
+ * CUT: elements intersected by the level set, they require algoim quadrature,
+ *      an irregular Vandermonde inverse and (optionally) quadrature
+ *      sensitivities
+ * IRREGULAR: interior elements whose GD stencil is truncated, they need their
+ *            own Vandermonde inverse
+ * REGULAR: interior elements with the full ground stencil, all of them share
+ *          the same basis evaluator
+ */
+enum class WorkClass : int { CUT = 0, IRREGULAR = 1, REGULAR = 2 };
+constexpr int NUM_WORK_CLASSES = 3;
+
+inline const char* work_class_name(WorkClass c) {
+  switch (c) {
+    case WorkClass::CUT:
+      return "cut";
+    case WorkClass::IRREGULAR:
+      return "irregular";
+    case WorkClass::REGULAR:
+      return "regular";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Determine the work class of an element
+ */
+template <class Mesh>
+WorkClass classify_element(const Mesh& mesh, int elem) {
+  if constexpr (Mesh::is_gd_mesh) {
+    if constexpr (Mesh::is_cut_mesh) {
+      if (mesh.is_cut_elem(elem)) return WorkClass::CUT;
+    }
+    if (!mesh.is_regular_stencil_elem(elem)) return WorkClass::IRREGULAR;
+  }
+  return WorkClass::REGULAR;
+}
+
+/**
+ * @brief Timing of the last scheduled loop
+ */
+struct SchedulerReport {
+  int num_threads = 0;
+  double wall_time = 0.0;
+
+  std::vector<double> busy_time;  // per thread, time spent in the kernel
+  std::vector<int> num_executed;  // per thread, number of elements executed
+
+  std::array<int, NUM_WORK_CLASSES> num_elems{};
+  std::array<double, NUM_WORK_CLASSES> class_time{};  // summed over threads
+
+  double idle_time(int thread) const {
+    return std::max(wall_time - busy_time[thread], 0.0);
+  }
+
+  // max busy time over mean busy time, 1.0 means perfect balance
+  double imbalance() const {
+    if (busy_time.empty()) return 1.0;
+    double tmax = *std::max_element(busy_time.begin(), busy_time.end());
+    double tavg = std::accumulate(busy_time.begin(), busy_time.end(), 0.0) /
+                  busy_time.size();
+    return tavg > 0.0 ? tmax / tavg : 1.0;
+  }
+
+  void print(std::FILE* fp = stdout) const {
+    std::fprintf(fp, "[scheduler] wall: %.4es, threads: %d, imbalance: %.3f\n",
+                 wall_time, num_threads, imbalance());
+    for (int c = 0; c < NUM_WORK_CLASSES; c++) {
+      std::fprintf(fp, "[scheduler] %10s elements: %8d, time: %.4es\n",
+                   work_class_name(WorkClass(c)), num_elems[c], class_time[c]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+      std::fprintf(fp,
+                   "[scheduler] thread %3d elements: %8d, busy: %.4es, idle: "
+                   "%.4es\n",
+                   t, num_executed[t], busy_time[t], idle_time(t));
+    }
+  }
+};
+
+/**
+ * @brief Cost-aware element scheduler
+ *
+ * Elements are split into work classes, and the classes are dispatched from
+ * the most expensive to the cheapest within a single parallel region. Each
+ * class is dynamically scheduled with its own chunk size and without a barrier
+ * in between, so threads that finish their share of the expensive elements
+ * move on to the cheap ones while the others are still busy.
+ */
+class ElementScheduler {
+ public:
+  ElementScheduler() : chunk_sizes{1, 4, 32} {}
+
+  template <class Mesh>
+  void classify(const Mesh& mesh) {
+    for (auto& e : elems) e.clear();
+    int nelems = mesh.get_num_elements();
+    for (int i = 0; i < nelems; i++) {
+      elems[int(classify_element(mesh, i))].push_back(i);
+    }
+  }
+
+  void set_chunk_size(WorkClass c, int chunk) {
+    if (chunk < 1) {
+      char msg[256];
+      std::snprintf(msg, 256, "chunk size must be positive, got %d", chunk);
+      throw std::runtime_error(msg);
+    }
+    chunk_sizes[int(c)] = chunk;
+  }
+  int get_chunk_size(WorkClass c) const { return chunk_sizes[int(c)]; }
+
+  const std::vector<int>& get_elems(WorkClass c) const {
+    return elems[int(c)];
+  }
+
+  static int get_max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  /**
+   * @brief Execute kernel(elem, work_class, thread) for all classified
+   * elements
+   *
+   * The first exception thrown by any kernel is re-thrown after the parallel
+   * region.
+   */
+  template <class Kernel>
+  void run(const Kernel& kernel) const {
+    int nthreads = get_max_threads();
+
+    report.num_threads = nthreads;
+    report.busy_time.assign(nthreads, 0.0);
+    report.num_executed.assign(nthreads, 0);
+    report.class_time.fill(0.0);
+    for (int c = 0; c < NUM_WORK_CLASSES; c++) {
+      report.num_elems[c] = elems[c].size();
+    }
+
+    std::vector<std::array<double, NUM_WORK_CLASSES>> thread_class_time(
+        nthreads, std::array<double, NUM_WORK_CLASSES>{});
+    std::exception_ptr eptr = nullptr;
+
+    StopWatch wall;
+#pragma omp parallel num_threads(nthreads)
+    {
+#ifdef _OPENMP
+      int t = omp_get_thread_num();
+#else
+      int t = 0;
+#endif
+      StopWatch watch;
+      for (int c = 0; c < NUM_WORK_CLASSES; c++) {
+        const std::vector<int>& e = elems[c];
+        int n = e.size();
+        int chunk = chunk_sizes[c];
+#pragma omp for schedule(dynamic, chunk) nowait
+        for (int k = 0; k < n; k++) {
+          double t1 = watch.lap();
+          try {
+            kernel(e[k], WorkClass(c), t);
+          } catch (...) {
+#pragma omp critical
+            if (!eptr) eptr = std::current_exception();
+          }
+          thread_class_time[t][c] += watch.lap() - t1;
+          report.num_executed[t]++;
+        }
+      }
+    }
+    report.wall_time = wall.lap();
+
+    for (int t = 0; t < nthreads; t++) {
+      for (int c = 0; c < NUM_WORK_CLASSES; c++) {
+        report.busy_time[t] += thread_class_time[t][c];
+        report.class_time[c] += thread_class_time[t][c];
+      }
+    }
+
+    if (eptr) std::rethrow_exception(eptr);
+  }
+
+  const SchedulerReport& get_report() const { return report; }
+
+ private:
+  std::array<int, NUM_WORK_CLASSES> chunk_sizes;
+  std::array<std::vector<int>, NUM_WORK_CLASSES> elems;
+  mutable SchedulerReport report;
+};
+
+#endif  // XCGD_SCHEDULER_H
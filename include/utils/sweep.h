@@ -0,0 +1,366 @@
+#ifndef XCGD_SWEEP_H
+#define XCGD_SWEEP_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * @brief One case of a parameter sweep, i.e. a set of named parameter values
+ */
+class SweepCase {
+ public:
+  SweepCase() = default;
+  SweepCase(std::vector<std::pair<std::string, std::string>> params)
+      : params(params) {}
+
+  bool has(const std::string& name) const {
+    for (const auto& [k, v] : params) {
+      if (k == name) return true;
+    }
+    return false;
+  }
+
+  const std::string& get_str(const std::string& name) const {
+    for (const auto& [k, v] : params) {
+      if (k == name) return v;
+    }
+    throw std::runtime_error("SweepCase: no parameter " + name);
+  }
+
+  template <typename V>
+  V get(const std::string& name) const {
+    V val;
+    std::istringstream ss(get_str(name));
+    if (!(ss >> val)) {
+      throw std::runtime_error("SweepCase: invalid value " + get_str(name) +
+                               " for parameter " + name);
+    }
+    return val;
+  }
+
+  // Value of the parameter if swept, otherwise the fallback value
+  template <typename V>
+  V get(const std::string& name, V fallback) const {
+    return has(name) ? get<V>(name) : fallback;
+  }
+
+  const std::vector<std::pair<std::string, std::string>>& get_params() const {
+    return params;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> params;
+};
+
+/**
+ * @brief Cartesian product of lists of parameter values
+ *
+ * A sweep spec file has one parameter per line, in the same syntax as the
+ * config files, but followed by a list of values:
+ *
+ *   # comment
+ *   Np_1d = 2 4 6
+ *   nxy = 8 16 32 64
+ *
+ * The cases are ordered with the first parameter varying the slowest.
+ */
+class SweepSpec {
+ public:
+  SweepSpec() = default;
+
+  SweepSpec(std::string spec_path) {
+    std::ifstream infile(spec_path);
+    if (!infile) {
+      throw std::runtime_error("SweepSpec: failed to open " + spec_path);
+    }
+    std::string line;
+    int lno = 0;
+    while (std::getline(infile, line)) {
+      lno++;
+      // skip empty lines and comments
+      if (line.find_first_not_of(" \t") == std::string::npos or
+          line[line.find_first_not_of(" \t")] == '#') {
+        continue;
+      }
+
+      std::string key, eq, val;
+      std::vector<std::string> vals;
+      std::istringstream ss(line);
+      ss >> key >> eq;
+      while (ss >> val and val[0] != '#') vals.push_back(val);
+
+      if (eq != "=" or vals.empty()) {
+        char msg[512];
+        std::snprintf(msg, 512, "%s:%d: expect <key> = <value> [<value> ...]",
+                      spec_path.c_str(), lno);
+        throw std::runtime_error(msg);
+      }
+      add_axis(key, vals);
+    }
+  }
+
+  void add_axis(std::string name, std::vector<std::string> vals) {
+    for (const auto& [k, v] : axes) {
+      if (k == name) {
+        throw std::runtime_error("SweepSpec: duplicated parameter " + name);
+      }
+    }
+    axes.push_back({name, vals});
+  }
+
+  const std::vector<std::pair<std::string, std::vector<std::string>>>&
+  get_axes() const {
+    return axes;
+  }
+
+  std::vector<SweepCase> get_cases() const {
+    if (axes.empty()) return {};
+    std::vector<SweepCase> cases;
+    std::vector<int> idx(axes.size(), 0);
+    while (true) {
+      std::vector<std::pair<std::string, std::string>> params;
+      for (int a = 0; a < axes.size(); a++) {
+        params.push_back({axes[a].first, axes[a].second[idx[a]]});
+      }
+      cases.push_back(SweepCase(params));
+
+      // Increment the multi-index, the last axis varies the fastest
+      int a = axes.size() - 1;
+      for (; a >= 0; a--) {
+        if (++idx[a] < axes[a].second.size()) break;
+        idx[a] = 0;
+      }
+      if (a < 0) break;
+    }
+    return cases;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::vector<std::string>>> axes;
+};
+
+/**
+ * @brief Results of a sweep, one row per case
+ */
+class SweepTable {
+ public:
+  struct Row {
+    SweepCase c;
+    bool ok = false;
+    std::string error;
+    double time = 0.0;  // wall time of the case in seconds
+    std::map<std::string, double> results;
+  };
+
+  SweepTable(const std::vector<SweepCase>& cases) : rows(cases.size()) {
+    for (int i = 0; i < cases.size(); i++) rows[i].c = cases[i];
+  }
+
+  std::vector<Row>& get_rows() { return rows; }
+  const std::vector<Row>& get_rows() const { return rows; }
+
+  int get_num_failed() const {
+    return std::count_if(rows.begin(), rows.end(),
+                         [](const Row& r) { return !r.ok; });
+  }
+
+  /**
+   * @brief Write the table as csv, the columns are the case parameters, the
+   * status and wall time of the case, followed by the union of all result
+   * names in alphabetical order. Results missing from a row are left empty.
+   */
+  void write_csv(std::string path) const {
+    std::ofstream out(path);
+    if (!out) {
+      throw std::runtime_error("SweepTable: failed to open " + path);
+    }
+
+    std::vector<std::string> params;
+    std::set<std::string> names;
+    for (const Row& r : rows) {
+      for (const auto& [k, v] : r.c.get_params()) {
+        if (std::find(params.begin(), params.end(), k) == params.end()) {
+          params.push_back(k);
+        }
+      }
+      for (const auto& [k, v] : r.results) names.insert(k);
+    }
+
+    for (const std::string& k : params) out << k << ",";
+    out << "status,time";
+    for (const std::string& k : names) out << "," << k;
+    out << "\n";
+
+    char buf[64];
+    for (const Row& r : rows) {
+      for (const std::string& k : params) {
+        if (r.c.has(k)) out << r.c.get_str(k);
+        out << ",";
+      }
+      std::snprintf(buf, 64, "%.3f", r.time);
+      out << (r.ok ? "ok" : "failed") << "," << buf;
+      for (const std::string& k : names) {
+        out << ",";
+        auto it = r.results.find(k);
+        if (it != r.results.end()) {
+          std::snprintf(buf, 64, "%.16e", it->second);
+          out << buf;
+        }
+      }
+      out << "\n";
+    }
+  }
+
+ private:
+  std::vector<Row> rows;
+};
+
+/**
+ * @brief Objects shared by the cases of a sweep, e.g. the grid and the mesh of
+ * all cases with the same mesh size
+ *
+ * An object is built by the first case that asks for its key, concurrent
+ * cases asking for the same key wait for it instead of building their own.
+ * The objects are shared by concurrent cases, so the cases must only read
+ * them. They live as long as the cache.
+ */
+class SweepCache {
+ public:
+  /**
+   * @param key identifies the object among the objects of type V
+   * @param make callable that returns std::shared_ptr<V>, invoked once per key,
+   * an exception it throws is rethrown to all cases asking for the key
+   */
+  template <class V, class Make>
+  std::shared_ptr<V> get(const std::string& key, const Make& make) {
+    std::string k = std::string(typeid(V).name()) + ":" + key;
+    std::promise<std::shared_ptr<void>> promise;
+    std::shared_future<std::shared_ptr<void>> future;
+    bool owner = false;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      auto it = entries.find(k);
+      if (it == entries.end()) {
+        future = promise.get_future().share();
+        entries[k] = future;
+        owner = true;
+      } else {
+        future = it->second;
+      }
+    }
+
+    // Build outside the lock, so other keys are not blocked
+    if (owner) {
+      try {
+        promise.set_value(std::shared_ptr<void>(make()));
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+      }
+    }
+    return std::static_pointer_cast<V>(future.get());
+  }
+
+  int size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return entries.size();
+  }
+
+ private:
+  mutable std::mutex mtx;
+  std::map<std::string, std::shared_future<std::shared_ptr<void>>> entries;
+};
+
+/**
+ * @brief Run all cases of a sweep in this process
+ *
+ * The cases are handed out dynamically to nworkers threads, and the OpenMP
+ * threads are split evenly among the workers. A case that throws is marked
+ * as failed in the table and the sweep carries on.
+ *
+ * @param cases the cases to run
+ * @param nworkers number of cases run concurrently, <= 0 to use all hardware
+ * threads
+ * @param run_case callable with signature
+ * std::map<std::string, double>(const SweepCase&), returns the results of a
+ * case
+ * @param verbose print a line per finished case
+ */
+template <class Func>
+SweepTable run_sweep(const std::vector<SweepCase>& cases, int nworkers,
+                     const Func& run_case, bool verbose = true) {
+  SweepTable table(cases);
+  auto& rows = table.get_rows();
+  int ncases = cases.size();
+
+  if (nworkers <= 0) {
+    nworkers = std::max<int>(1, std::thread::hardware_concurrency());
+  }
+  nworkers = std::max(1, std::min(nworkers, ncases));
+
+#ifdef _OPENMP
+  int nthreads = std::max(1, omp_get_max_threads() / nworkers);
+#endif
+
+  std::atomic<int> next{0}, nfinished{0};
+  std::mutex print_mtx;
+
+  auto work = [&]() {
+#ifdef _OPENMP
+    omp_set_num_threads(nthreads);
+#endif
+    for (int i = next++; i < ncases; i = next++) {
+      SweepTable::Row& row = rows[i];
+      auto t0 = std::chrono::steady_clock::now();
+      try {
+        row.results = run_case(cases[i]);
+        row.ok = true;
+      } catch (const std::exception& e) {
+        row.error = e.what();
+      } catch (...) {
+        row.error = "unknown exception";
+      }
+      row.time = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - t0)
+                     .count();
+
+      if (verbose) {
+        std::string desc;
+        for (const auto& [k, v] : cases[i].get_params()) {
+          desc += (desc.empty() ? "" : ", ") + k + ": " + v;
+        }
+        std::lock_guard<std::mutex> lock(print_mtx);
+        std::printf("[%d/%d] %s, %s (%.2f s)%s%s\n", ++nfinished, ncases,
+                    desc.c_str(), row.ok ? "done" : "failed", row.time,
+                    row.ok ? "" : ": ", row.error.c_str());
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < nworkers; w++) threads.emplace_back(work);
+  for (auto& t : threads) t.join();
+
+  return table;
+}
+
+#endif  // XCGD_SWEEP_H
@@ -1,19 +1,27 @@
 #ifndef XCGD_VTK_H
 #define XCGD_VTK_H
 
+#include <algorithm>
 #include <complex>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "utils/async_writer.h"
 
 // Linear and nonlinear cell types in VTK
 struct VTKID {
+  static constexpr int EMPTY_CELL = 0;
   static constexpr int VERTEX = 1;
   static constexpr int POLY_VERTEX = 2;
   static constexpr int LINE = 3;
@@ -61,6 +69,40 @@ void write_real_val(std::FILE* fp, std::complex<double> val) {
   std::fprintf(fp, "%-25.15e", val.real());
 }
 
+// VTK cell type of a linear or quadratic element with the given number of
+// corner nodes, or -1 if there is no such type
+template <int spatial_dim>
+int infer_vtk_elem_type(int corner_nodes_per_element) {
+  if constexpr (spatial_dim == 2) {
+    switch (corner_nodes_per_element) {
+      case 3:
+        return VTKID::TRIANGLE;
+      case 4:
+        return VTKID::QUAD;
+      case 6:
+        return VTKID::QUADRATIC_TRIANGLE;
+      case 8:
+        return VTKID::QUADRATIC_QUAD;
+    }
+  } else if constexpr (spatial_dim == 3) {
+    switch (corner_nodes_per_element) {
+      case 4:
+        return VTKID::TETRA;
+      case 5:
+        return VTKID::PYRAMID;
+      case 6:
+        return VTKID::WEDGE;
+      case 8:
+        return VTKID::HEXAHEDRON;
+      case 10:
+        return VTKID::QUADRATIC_TETRA;
+      case 20:
+        return VTKID::QUADRATIC_HEXAHEDRON;
+    }
+  }
+  return -1;
+}
+
 // VTK writer for 2d and 3d mesh
 template <typename T, class Mesh>
 class ToVTK {
@@ -83,43 +125,8 @@ class ToVTK {
 
     // If not provided, infer vtk type id from mesh.corner_nodes_per_element
     if (vtk_elem_type == -1) {
-      if constexpr (spatial_dim == 2) {
-        switch (mesh.corner_nodes_per_element) {
-          case 3:
-            vtk_elem_type = VTKID::TRIANGLE;
-            break;
-          case 4:
-            vtk_elem_type = VTKID::QUAD;
-            break;
-          case 6:
-            vtk_elem_type = VTKID::QUADRATIC_TRIANGLE;
-            break;
-          case 8:
-            vtk_elem_type = VTKID::QUADRATIC_QUAD;
-            break;
-        }
-      } else {  // spatial_dim == 3
-        switch (mesh.corner_nodes_per_element) {
-          case 4:
-            vtk_elem_type = VTKID::TETRA;
-            break;
-          case 5:
-            vtk_elem_type = VTKID::PYRAMID;
-            break;
-          case 6:
-            vtk_elem_type = VTKID::WEDGE;
-            break;
-          case 8:
-            vtk_elem_type = VTKID::HEXAHEDRON;
-            break;
-          case 10:
-            vtk_elem_type = VTKID::QUADRATIC_TETRA;
-            break;
-          case 20:
-            vtk_elem_type = VTKID::QUADRATIC_HEXAHEDRON;
-            break;
-        }
-      }
+      vtk_elem_type =
+          infer_vtk_elem_type<spatial_dim>(mesh.corner_nodes_per_element);
     }
 
     if (vtk_elem_type == -1) {
@@ -554,4 +561,629 @@ class StencilToVTK {
   std::FILE* fp = nullptr;
 };
 
+// Compression of the appended binary data of .vtu files
+enum class VTUCompression { NONE, LZ4 };
+
+/**
+ * @brief Compress src in the LZ4 block format
+ *
+ * A greedy single-probe hash match finder, which is much simpler than the
+ * reference implementation but produces blocks that any LZ4 decoder (e.g.
+ * vtkLZ4DataCompressor in ParaView) can read. Constant and repeated values,
+ * which are common in design and solution fields, compress well as
+ * overlapping matches.
+ *
+ * @param src input bytes
+ * @param n number of input bytes
+ * @param dst output, the compressed block
+ */
+inline void lz4_compress_block(const std::uint8_t* src, int n,
+                               std::vector<std::uint8_t>& dst) {
+  // Format constraints: a match is at least 4 bytes long, the last 5 bytes
+  // are literals, and the last match starts at least 12 bytes before the end
+  constexpr int min_match = 4, last_literals = 5, mf_limit = 12;
+  constexpr int hash_log = 14, max_offset = 65535;
+
+  dst.clear();
+  dst.reserve(n + n / 255 + 16);
+
+  auto read32 = [src](int i) {
+    std::uint32_t v;
+    std::memcpy(&v, src + i, 4);
+    return v;
+  };
+  auto hash = [](std::uint32_t v) {
+    return int((v * 2654435761u) >> (32 - hash_log));
+  };
+  auto put_length = [&dst](int len) {
+    for (; len >= 255; len -= 255) dst.push_back(255);
+    dst.push_back(len);
+  };
+
+  // Emit literals [anchor, ip) followed by a match, or only the literals if
+  // match_len is 0
+  auto emit = [&](int anchor, int ip, int offset, int match_len) {
+    int lit = ip - anchor;
+    int ml = match_len - min_match;
+    std::uint8_t token = std::min(lit, 15) << 4;
+    if (match_len > 0) token |= std::min(ml, 15);
+    dst.push_back(token);
+    if (lit >= 15) put_length(lit - 15);
+    dst.insert(dst.end(), src + anchor, src + ip);
+    if (match_len > 0) {
+      dst.push_back(offset & 0xff);
+      dst.push_back(offset >> 8);
+      if (ml >= 15) put_length(ml - 15);
+    }
+  };
+
+  std::vector<int> table(1 << hash_log, -1);
+  int anchor = 0, ip = 0, misses = 0;
+  while (ip + mf_limit < n) {
+    std::uint32_t v = read32(ip);
+    int h = hash(v);
+    int ref = table[h];
+    table[h] = ip;
+    if (ref >= 0 and ip - ref <= max_offset and read32(ref) == v) {
+      int len = min_match;
+      while (ip + len < n - last_literals and src[ref + len] == src[ip + len]) {
+        len++;
+      }
+      emit(anchor, ip, ip - ref, len);
+      ip += len;
+      anchor = ip;
+      misses = 0;
+    } else {
+      // Skip faster through incompressible data
+      ip += 1 + (misses++ >> 6);
+    }
+  }
+  emit(anchor, n, 0, 0);
+}
+
+/**
+ * @brief Decompress a block in the LZ4 block format
+ *
+ * @param src compressed block
+ * @param n number of bytes of the compressed block
+ * @param dst output, size of dst_size
+ * @param dst_size the exact decompressed size
+ */
+inline void lz4_decompress_block(const std::uint8_t* src, int n,
+                                 std::uint8_t* dst, int dst_size) {
+  auto fail = []() {
+    throw std::runtime_error("lz4_decompress_block(): corrupted input");
+  };
+
+  int ip = 0, op = 0;
+  auto get_length = [&](int len) {
+    if (len == 15) {
+      std::uint8_t b;
+      do {
+        if (ip >= n) fail();
+        b = src[ip++];
+        len += b;
+      } while (b == 255);
+    }
+    return len;
+  };
+
+  while (ip < n) {
+    std::uint8_t token = src[ip++];
+    int lit = get_length(token >> 4);
+    if (ip + lit > n or op + lit > dst_size) fail();
+    std::memcpy(dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
+
+    // The last sequence only has literals
+    if (ip == n) break;
+
+    if (ip + 2 > n) fail();
+    int offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    if (offset == 0 or offset > op) fail();
+    int ml = get_length(token & 15) + 4;
+    if (op + ml > dst_size) fail();
+
+    // Byte by byte since the match may overlap the output
+    for (int k = 0; k < ml; k++, op++) dst[op] = dst[op - offset];
+  }
+  if (op != dst_size) fail();
+}
+
+inline double real_val(double val) { return val; }
+inline double real_val(std::complex<double> val) { return val.real(); }
+
+/**
+ * @brief Writer of the VTK XML unstructured grid format (.vtu) with all
+ * arrays in raw binary appended data, optionally LZ4-compressed
+ *
+ * Compared to the legacy ASCII format, this avoids formatting each value and
+ * takes 8 bytes per double instead of 26 before compression.
+ */
+class VTUWriter {
+ public:
+  VTUWriter(VTUCompression compression = VTUCompression::NONE)
+      : compression(compression) {}
+
+  // xyz: 3 coordinates per point
+  void set_points(const std::vector<double>& xyz) {
+    num_points = xyz.size() / 3;
+    points = make_array("Points", "Float64", 3, xyz.data(), xyz.size());
+  }
+
+  /**
+   * @param conn concatenated point indices of all cells
+   * @param offsets offsets[i] is the end of the i-th cell in conn
+   * @param types VTK cell type of each cell, see VTKID
+   */
+  void set_cells(const std::vector<std::int64_t>& conn,
+                 const std::vector<std::int64_t>& offsets,
+                 const std::vector<std::uint8_t>& types) {
+    num_cells = types.size();
+    cells.clear();
+    cells.push_back(
+        make_array("connectivity", "Int64", 1, conn.data(), conn.size()));
+    cells.push_back(
+        make_array("offsets", "Int64", 1, offsets.data(), offsets.size()));
+    cells.push_back(
+        make_array("types", "UInt8", 1, types.data(), types.size()));
+  }
+
+  void add_point_data(const std::string& name, int ncomp,
+                      const std::vector<double>& vals) {
+    point_data.push_back(
+        make_array(name, "Float64", ncomp, vals.data(), vals.size()));
+  }
+
+  void add_cell_data(const std::string& name, int ncomp,
+                     const std::vector<double>& vals) {
+    cell_data.push_back(
+        make_array(name, "Float64", ncomp, vals.data(), vals.size()));
+  }
+
+  void write(const std::string& vtu_name) const {
+    std::vector<const Array*> arrays;
+    for (const Array& a : point_data) arrays.push_back(&a);
+    for (const Array& a : cell_data) arrays.push_back(&a);
+    arrays.push_back(&points);
+    for (const Array& a : cells) arrays.push_back(&a);
+
+    std::vector<std::vector<std::uint8_t>> encoded(arrays.size());
+    std::map<const Array*, std::size_t> offsets;
+    std::size_t offset = 0;
+    for (int i = 0; i < arrays.size(); i++) {
+      encoded[i] = encode(arrays[i]->bytes);
+      offsets[arrays[i]] = offset;
+      offset += encoded[i].size();
+    }
+
+    std::ofstream out(vtu_name, std::ios::binary);
+    if (!out) {
+      throw std::runtime_error("VTUWriter: failed to open " + vtu_name);
+    }
+
+    out << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\""
+        << (is_little_endian() ? "LittleEndian" : "BigEndian")
+        << "\" header_type=\"UInt64\"";
+    if (compression == VTUCompression::LZ4) {
+      out << " compressor=\"vtkLZ4DataCompressor\"";
+    }
+    out << ">\n<UnstructuredGrid>\n<Piece NumberOfPoints=\"" << num_points
+        << "\" NumberOfCells=\"" << num_cells << "\">\n";
+
+    auto write_header = [&](const Array& a) {
+      out << "<DataArray type=\"" << a.type << "\"";
+      if (!a.name.empty()) out << " Name=\"" << a.name << "\"";
+      out << " NumberOfComponents=\"" << a.ncomp
+          << "\" format=\"appended\" offset=\"" << offsets[&a] << "\"/>\n";
+    };
+
+    out << "<PointData>\n";
+    for (const Array& a : point_data) write_header(a);
+    out << "</PointData>\n<CellData>\n";
+    for (const Array& a : cell_data) write_header(a);
+    out << "</CellData>\n<Points>\n";
+    write_header(points);
+    out << "</Points>\n<Cells>\n";
+    for (const Array& a : cells) write_header(a);
+    out << "</Cells>\n</Piece>\n</UnstructuredGrid>\n"
+        << "<AppendedData encoding=\"raw\">\n_";
+    for (const auto& e : encoded) {
+      out.write(reinterpret_cast<const char*>(e.data()), e.size());
+    }
+    out << "\n</AppendedData>\n</VTKFile>\n";
+  }
+
+  // Uncompressed size of each compressed block, same as VTK's default
+  static constexpr std::size_t block_size = 32768;
+
+ private:
+  struct Array {
+    std::string name, type;
+    int ncomp = 1;
+    std::vector<std::uint8_t> bytes;
+  };
+
+  template <typename V>
+  static Array make_array(const std::string& name, const std::string& type,
+                          int ncomp, const V* data, std::size_t size) {
+    Array a{name, type, ncomp, std::vector<std::uint8_t>(size * sizeof(V))};
+    if (size) std::memcpy(a.bytes.data(), data, size * sizeof(V));
+    return a;
+  }
+
+  static bool is_little_endian() {
+    std::uint16_t v = 1;
+    std::uint8_t b;
+    std::memcpy(&b, &v, 1);
+    return b == 1;
+  }
+
+  // The UInt64 header followed by the (compressed) data
+  std::vector<std::uint8_t> encode(
+      const std::vector<std::uint8_t>& raw) const {
+    std::vector<std::uint64_t> header;
+    std::vector<std::vector<std::uint8_t>> blocks;
+
+    if (compression == VTUCompression::NONE) {
+      header = {raw.size()};
+    } else {
+      // [number of blocks, block size, size of the last partial block (0 if
+      // the last block is full), compressed size of each block]
+      std::size_t nblocks = (raw.size() + block_size - 1) / block_size;
+      blocks.resize(nblocks);
+#pragma omp parallel for
+      for (int b = 0; b < nblocks; b++) {
+        std::size_t start = b * block_size;
+        std::size_t size = std::min(block_size, raw.size() - start);
+        lz4_compress_block(raw.data() + start, size, blocks[b]);
+      }
+      header = {nblocks, block_size, raw.size() % block_size};
+      for (const auto& blk : blocks) header.push_back(blk.size());
+    }
+
+    std::vector<std::uint8_t> out(header.size() * sizeof(std::uint64_t));
+    std::memcpy(out.data(), header.data(), out.size());
+    if (compression == VTUCompression::NONE) {
+      out.insert(out.end(), raw.begin(), raw.end());
+    } else {
+      for (const auto& blk : blocks) {
+        out.insert(out.end(), blk.begin(), blk.end());
+      }
+    }
+    return out;
+  }
+
+  VTUCompression compression;
+  std::size_t num_points = 0, num_cells = 0;
+  Array points;
+  std::vector<Array> cells, point_data, cell_data;
+};
+
+/**
+ * @brief Binary .vtu counterpart of ToVTK with the same interface
+ *
+ * Everything is buffered and the file is written when the object goes out of
+ * scope, or by an explicit write(). If an AsyncWriter is given, the buffered
+ * data is handed over to it instead, so the mesh and the solution vectors can
+ * change as soon as write() returns.
+ */
+template <typename T, class Mesh>
+class ToVTU {
+ private:
+  static constexpr int spatial_dim = Mesh::spatial_dim;
+
+ public:
+  ToVTU(const Mesh& mesh, const std::string vtu_name = "result.vtu",
+        int vtk_elem_type_ = -1,
+        VTUCompression compression = VTUCompression::NONE,
+        AsyncWriter* async_writer = nullptr)
+      : mesh(mesh),
+        vtu_name(vtu_name),
+        vtk_elem_type(vtk_elem_type_),
+        writer(compression),
+        async_writer(async_writer) {
+    if (spatial_dim != 2 and spatial_dim != 3) {
+      char msg[256];
+      std::snprintf(msg, sizeof(msg),
+                    "Invalid spatial_dim, got %d, expect 2 or 3", spatial_dim);
+      throw std::runtime_error(msg);
+    }
+
+    if (vtk_elem_type == -1) {
+      vtk_elem_type =
+          infer_vtk_elem_type<spatial_dim>(mesh.corner_nodes_per_element);
+    }
+
+    if (vtk_elem_type == -1) {
+      char msg[256];
+      snprintf(
+          msg, 256,
+          "Cannot infer element type from corner_nodes_per_element(%d) for a "
+          "%d-dimensional mesh",
+          mesh.corner_nodes_per_element, spatial_dim);
+      throw std::runtime_error(msg);
+    }
+  }
+
+  ~ToVTU() {
+    if (!written) {
+      try {
+        write();
+      } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+      }
+    }
+  }
+
+  void write_mesh() {
+    int nnodes = mesh.get_num_nodes();
+    std::vector<double> xyz(3 * nnodes, 0.0);
+    for (int i = 0; i < nnodes; i++) {
+      T xloc[spatial_dim];
+      mesh.get_node_xloc(i, xloc);
+      for (int d = 0; d < spatial_dim; d++) xyz[3 * i + d] = real_val(xloc[d]);
+    }
+    writer.set_points(xyz);
+
+    int nelems = mesh.get_num_elements();
+    constexpr int nc = Mesh::corner_nodes_per_element;
+    std::vector<std::int64_t> conn(nc * nelems), offsets(nelems);
+    std::vector<std::uint8_t> types(nelems, vtk_elem_type);
+    for (int i = 0; i < nelems; i++) {
+      int nodes[nc];
+      mesh.get_elem_corner_nodes(i, nodes);
+      std::copy(nodes, nodes + nc, conn.begin() + nc * i);
+      offsets[i] = nc * (i + 1);
+    }
+    writer.set_cells(conn, offsets, types);
+  }
+
+  // Write nodal scalars
+  void write_sol(const std::string sol_name, const T* sol_vec) {
+    writer.add_point_data(sol_name, 1,
+                          to_double(mesh.get_num_nodes(), 1, sol_vec));
+  }
+
+  // Write nodal vectors
+  void write_vec(const std::string sol_name, const T* vec) {
+    writer.add_point_data(sol_name, 3,
+                          to_double(mesh.get_num_nodes(), spatial_dim, vec));
+  }
+
+  // Write cell scalars
+  void write_cell_sol(const std::string sol_name, const T* sol_vec) {
+    writer.add_cell_data(sol_name, 1,
+                         to_double(mesh.get_num_elements(), 1, sol_vec));
+  }
+
+  // Write cell vectors
+  void write_cell_vec(const std::string sol_name, const T* sol_vec) {
+    writer.add_cell_data(
+        sol_name, 3, to_double(mesh.get_num_elements(), spatial_dim, sol_vec));
+  }
+
+  void write() {
+    written = true;
+    if (async_writer) {
+      auto w = std::make_shared<VTUWriter>(std::move(writer));
+      async_writer->submit([w, name = vtu_name]() { w->write(name); });
+    } else {
+      writer.write(vtu_name);
+    }
+  }
+
+ private:
+  // Vectors are padded to 3 components as VTK expects
+  static std::vector<double> to_double(int n, int dim, const T* vals) {
+    int ncomp = dim == 1 ? 1 : 3;
+    std::vector<double> out(ncomp * n, 0.0);
+    for (int i = 0; i < n; i++) {
+      for (int d = 0; d < dim; d++) {
+        out[ncomp * i + d] = real_val(vals[dim * i + d]);
+      }
+    }
+    return out;
+  }
+
+  const Mesh& mesh;
+  std::string vtu_name;
+  int vtk_elem_type;
+  VTUWriter writer;
+  AsyncWriter* async_writer;
+  bool written = false;
+};
+
+/**
+ * @brief Binary .vtu counterpart of StencilToVTK, the stencil of an element
+ * is a polygon through its nodes, elements without a stencil are empty cells
+ *
+ * If an AsyncWriter is given, the file is written by its thread, and the mesh
+ * and the stencils can change as soon as write_stencils() returns.
+ */
+template <typename T, class Mesh>
+class StencilToVTU {
+ private:
+  static constexpr int spatial_dim = Mesh::spatial_dim;
+
+ public:
+  StencilToVTU(const Mesh& mesh, const std::string vtu_name = "stencils.vtu",
+               VTUCompression compression = VTUCompression::NONE,
+               AsyncWriter* async_writer = nullptr)
+      : mesh(mesh),
+        vtu_name(vtu_name),
+        compression(compression),
+        async_writer(async_writer) {}
+
+  template <class Map>
+  void write_stencils(const Map& stencils) {
+    auto writer = std::make_shared<VTUWriter>(compression);
+
+    int nnodes = mesh.get_num_nodes();
+    std::vector<double> xyz(3 * nnodes, 0.0);
+    for (int i = 0; i < nnodes; i++) {
+      T xloc[spatial_dim];
+      mesh.get_node_xloc(i, xloc);
+      for (int d = 0; d < spatial_dim; d++) xyz[3 * i + d] = real_val(xloc[d]);
+    }
+    writer->set_points(xyz);
+
+    int nelems = mesh.get_num_elements();
+    std::vector<std::int64_t> conn, offsets(nelems);
+    std::vector<std::uint8_t> types(nelems, VTKID::EMPTY_CELL);
+    for (int elem = 0; elem < nelems; elem++) {
+      if (stencils.count(elem)) {
+        for (int n : stencils.at(elem)) conn.push_back(n);
+        types[elem] = VTKID::POLYGON;
+      }
+      offsets[elem] = conn.size();
+    }
+    writer->set_cells(conn, offsets, types);
+
+    if (async_writer) {
+      async_writer->submit([writer, name = vtu_name]() { writer->write(name); });
+    } else {
+      writer->write(vtu_name);
+    }
+  }
+
+ private:
+  const Mesh& mesh;
+  std::string vtu_name;
+  VTUCompression compression;
+  AsyncWriter* async_writer;
+};
+
+/**
+ * @brief Binary .vtu counterpart of FieldToVTKNew, scattered points are
+ * written as vertex cells
+ *
+ * Example usage:
+ *   FieldToVTU<T, spatial_dim> vtu("field.vtu");
+ *   vtu.add_mesh(xloc);
+ *   vtu.write_mesh();
+ *   vtu.add_sol("VonMises", vals);
+ *   vtu.write_sol("VonMises");
+ */
+template <typename T, int spatial_dim>
+class FieldToVTU {
+ public:
+  FieldToVTU(const std::string vtu_name = "field.vtu",
+             VTUCompression compression = VTUCompression::NONE,
+             AsyncWriter* async_writer = nullptr)
+      : vtu_name(vtu_name), writer(compression), async_writer(async_writer) {}
+
+  ~FieldToVTU() {
+    try {
+      if (async_writer) {
+        auto w = std::make_shared<VTUWriter>(std::move(writer));
+        async_writer->submit([w, name = vtu_name]() { w->write(name); });
+      } else {
+        writer.write(vtu_name);
+      }
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "%s\n", e.what());
+    }
+  }
+
+  void add_mesh(const std::vector<T>& xloc) { xloc_scalars = xloc; }
+  void add_sol(const std::string name, const std::vector<T>& vals) {
+    scalars[name] = vals;
+  }
+  void add_vec(const std::string name, const std::vector<T>& vec) {
+    vectors[name] = vec;
+  }
+
+  void write_mesh() {
+    int nverts = xloc_scalars.size() / spatial_dim;
+    std::vector<double> xyz(3 * nverts, 0.0);
+    for (int i = 0; i < nverts; i++) {
+      for (int d = 0; d < spatial_dim; d++) {
+        xyz[3 * i + d] = real_val(xloc_scalars[spatial_dim * i + d]);
+      }
+    }
+    writer.set_points(xyz);
+
+    std::vector<std::int64_t> conn(nverts), offsets(nverts);
+    for (int i = 0; i < nverts; i++) {
+      conn[i] = i;
+      offsets[i] = i + 1;
+    }
+    writer.set_cells(conn, offsets,
+                     std::vector<std::uint8_t>(nverts, VTKID::VERTEX));
+  }
+
+  void write_sol(const std::string sol_name) {
+    const std::vector<T>& vals = scalars.at(sol_name);
+    std::vector<double> out(vals.size());
+    for (int i = 0; i < vals.size(); i++) out[i] = real_val(vals[i]);
+    writer.add_point_data(sol_name, 1, out);
+  }
+
+  void write_vec(const std::string sol_name) {
+    const std::vector<T>& vec = vectors.at(sol_name);
+    int nverts = vec.size() / spatial_dim;
+    std::vector<double> out(3 * nverts, 0.0);
+    for (int i = 0; i < nverts; i++) {
+      for (int d = 0; d < spatial_dim; d++) {
+        out[3 * i + d] = real_val(vec[spatial_dim * i + d]);
+      }
+    }
+    writer.add_point_data(sol_name, 3, out);
+  }
+
+ private:
+  std::string vtu_name;
+  VTUWriter writer;
+  AsyncWriter* async_writer;
+  std::vector<T> xloc_scalars;
+  std::map<std::string, std::vector<T>> scalars;
+  std::map<std::string, std::vector<T>> vectors;
+};
+
+/**
+ * @brief ParaView data (.pvd) index of a time series of .vtu files
+ *
+ * The index is rewritten on every add_dataset() so that it stays valid if
+ * the run is interrupted.
+ */
+class PVDWriter {
+ public:
+  PVDWriter(const std::string pvd_name) : pvd_name(pvd_name) {}
+
+  /**
+   * @param time the time step value, e.g. the optimization iteration
+   * @param file path to the dataset, stored relative to the .pvd file
+   */
+  void add_dataset(double time, const std::string& file) {
+    std::filesystem::path dir =
+        std::filesystem::path(pvd_name).parent_path();
+    if (dir.empty()) dir = ".";
+    datasets.push_back({time, std::filesystem::path(file)
+                                  .lexically_proximate(dir)
+                                  .generic_string()});
+
+    std::ofstream out(pvd_name);
+    if (!out) {
+      throw std::runtime_error("PVDWriter: failed to open " + pvd_name);
+    }
+    out << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"Collection\" version=\"0.1\">\n<Collection>\n";
+    for (const auto& [t, f] : datasets) {
+      char time_str[64];
+      std::snprintf(time_str, sizeof(time_str), "%.17g", t);
+      out << "<DataSet timestep=\"" << time_str << "\" file=\"" << f
+          << "\"/>\n";
+    }
+    out << "</Collection>\n</VTKFile>\n";
+  }
+
+ private:
+  std::string pvd_name;
+  std::vector<std::pair<double, std::string>> datasets;
+};
+
 #endif  // XCGD_VTK_H
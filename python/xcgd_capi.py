@@ -0,0 +1,269 @@
+"""
+ctypes wrapper of the xcgd C API (capi/xcgd_capi.h), build the shared library
+with -DXCGD_BUILD_CAPI=ON.
+
+The numpy arrays are handed over to the library by pointer, inputs and outputs
+are never copied as long as they are C-contiguous float64 (int32 for indices)
+arrays.
+
+Example:
+    from xcgd_capi import Problem
+
+    lsf = ...  # (nx + 1) * (ny + 1) LSF values at the grid vertices
+    prob = Problem("poisson", Np_1d=4, nx=64, ny=64, lx=1.0, ly=1.0, lsf=lsf,
+                   params=[-1.0, 0.0, 1e6])
+    u = prob.solve()
+    K = prob.jacobian()  # scipy.sparse.csr_matrix
+    dfdphi = prob.lsf_adjoint_product(u, psi)
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+_double_p = ctypes.POINTER(ctypes.c_double)
+_int_p = ctypes.POINTER(ctypes.c_int)
+
+PHYSICS = {"poisson": 0, "linear_elasticity": 1}
+
+
+def _load_library(path=None):
+    if path is None:
+        path = os.environ.get("XCGD_CAPI_LIB", "libxcgd_capi.so")
+    lib = ctypes.CDLL(path)
+
+    def sig(name, *argtypes, restype=ctypes.c_int):
+        f = getattr(lib, name)
+        f.argtypes = argtypes
+        f.restype = restype
+
+    vp, vpp = ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p)
+    c_int, c_double = ctypes.c_int, ctypes.c_double
+
+    sig("xcgd_get_last_error", restype=ctypes.c_char_p)
+    sig(
+        "xcgd_problem_create",
+        c_int,
+        c_int,
+        c_int,
+        c_int,
+        c_double,
+        c_double,
+        _double_p,
+        _double_p,
+        c_int,
+        vpp,
+    )
+    sig("xcgd_problem_destroy", vp, restype=None)
+    sig("xcgd_problem_update_lsf", vp, _double_p)
+    sig("xcgd_problem_get_sizes", vp, _int_p, _int_p, _int_p, _int_p)
+    sig("xcgd_problem_get_node_verts", vp, _int_p)
+    sig("xcgd_problem_residual", vp, _double_p, _double_p)
+    sig("xcgd_problem_jacobian_csr", vp, _int_p, _int_p, _double_p)
+    sig("xcgd_problem_solve", vp, _double_p)
+    sig("xcgd_problem_lsf_adjoint_product", vp, _double_p, _double_p, _double_p)
+    sig("xcgd_filter_create", c_int, c_int, c_int, c_double, c_double, c_double, vpp)
+    sig("xcgd_filter_destroy", vp, restype=None)
+    sig("xcgd_filter_apply", vp, _double_p, _double_p)
+    sig("xcgd_filter_apply_gradient", vp, _double_p, _double_p, _double_p)
+    return lib
+
+
+_lib = None
+
+
+def get_library(path=None):
+    """
+    Load the shared library once, from path, or $XCGD_CAPI_LIB, or the default
+    library search path
+    """
+    global _lib
+    if _lib is None:
+        _lib = _load_library(path)
+    return _lib
+
+
+def _check(status):
+    if status != 0:
+        raise RuntimeError(get_library().xcgd_get_last_error().decode())
+
+
+def _ptr(arr, dtype, size, name):
+    """
+    Pointer to the data of arr, which must be a contiguous array of the right
+    type and size so that it can be used without a copy
+    """
+    if not isinstance(arr, np.ndarray) or arr.dtype != dtype:
+        raise TypeError(f"{name} must be a numpy array of {np.dtype(dtype)}")
+    if not arr.flags["C_CONTIGUOUS"]:
+        raise ValueError(f"{name} must be C-contiguous")
+    if arr.size != size:
+        raise ValueError(f"{name} must have {size} entries, got {arr.size}")
+    return arr.ctypes.data_as(_double_p if dtype == np.float64 else _int_p)
+
+
+class Problem:
+    """
+    Cut-cell Poisson or linear elasticity problem, see xcgd_problem_create() in
+    xcgd_capi.h for the parameters
+    """
+
+    def __init__(self, physics, Np_1d, nx, ny, lx, ly, lsf, params):
+        lib = get_library()
+        self.nverts = (nx + 1) * (ny + 1)
+        lsf = np.ascontiguousarray(lsf, dtype=np.float64)
+        params = np.ascontiguousarray(params, dtype=np.float64)
+        self._handle = ctypes.c_void_p()
+        _check(
+            lib.xcgd_problem_create(
+                PHYSICS[physics],
+                Np_1d,
+                nx,
+                ny,
+                lx,
+                ly,
+                _ptr(lsf, np.float64, self.nverts, "lsf"),
+                params.ctypes.data_as(_double_p),
+                params.size,
+                ctypes.byref(self._handle),
+            )
+        )
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            get_library().xcgd_problem_destroy(self._handle)
+            self._handle = None
+
+    def update_lsf(self, lsf):
+        _check(
+            get_library().xcgd_problem_update_lsf(
+                self._handle, _ptr(lsf, np.float64, self.nverts, "lsf")
+            )
+        )
+
+    def get_sizes(self):
+        """
+        Returns:
+            nverts, nnodes, ndof, nnz
+        """
+        sizes = [ctypes.c_int() for _ in range(4)]
+        _check(
+            get_library().xcgd_problem_get_sizes(
+                self._handle, *[ctypes.byref(s) for s in sizes]
+            )
+        )
+        return tuple(s.value for s in sizes)
+
+    def get_node_verts(self):
+        _, nnodes, _, _ = self.get_sizes()
+        node_verts = np.empty(nnodes, dtype=np.int32)
+        _check(
+            get_library().xcgd_problem_get_node_verts(
+                self._handle, _ptr(node_verts, np.int32, nnodes, "node_verts")
+            )
+        )
+        return node_verts
+
+    def residual(self, dof, out=None):
+        _, _, ndof, _ = self.get_sizes()
+        out = np.empty(ndof) if out is None else out
+        _check(
+            get_library().xcgd_problem_residual(
+                self._handle,
+                _ptr(dof, np.float64, ndof, "dof"),
+                _ptr(out, np.float64, ndof, "out"),
+            )
+        )
+        return out
+
+    def jacobian(self):
+        """
+        Returns:
+            the Jacobian as a scipy.sparse.csr_matrix, the index and value
+            arrays are written in place by the library
+        """
+        from scipy.sparse import csr_matrix
+
+        _, _, ndof, nnz = self.get_sizes()
+        rowp = np.empty(ndof + 1, dtype=np.int32)
+        cols = np.empty(nnz, dtype=np.int32)
+        vals = np.empty(nnz, dtype=np.float64)
+        _check(
+            get_library().xcgd_problem_jacobian_csr(
+                self._handle,
+                _ptr(rowp, np.int32, ndof + 1, "rowp"),
+                _ptr(cols, np.int32, nnz, "cols"),
+                _ptr(vals, np.float64, nnz, "vals"),
+            )
+        )
+        return csr_matrix((vals, cols, rowp), shape=(ndof, ndof), copy=False)
+
+    def solve(self, out=None):
+        _, _, ndof, _ = self.get_sizes()
+        out = np.empty(ndof) if out is None else out
+        _check(
+            get_library().xcgd_problem_solve(
+                self._handle, _ptr(out, np.float64, ndof, "out")
+            )
+        )
+        return out
+
+    def lsf_adjoint_product(self, dof, psi, out=None):
+        """
+        Returns:
+            out += psi^T dR/dphi, out is zero-initialized if not given
+        """
+        _, _, ndof, _ = self.get_sizes()
+        out = np.zeros(self.nverts) if out is None else out
+        _check(
+            get_library().xcgd_problem_lsf_adjoint_product(
+                self._handle,
+                _ptr(dof, np.float64, ndof, "dof"),
+                _ptr(psi, np.float64, ndof, "psi"),
+                _ptr(out, np.float64, self.nverts, "out"),
+            )
+        )
+        return out
+
+
+class Filter:
+    """
+    Helmholtz filter on a structured grid
+    """
+
+    def __init__(self, Np_1d, nx, ny, lx, ly, r0):
+        lib = get_library()
+        self.nverts = (nx + 1) * (ny + 1)
+        self._handle = ctypes.c_void_p()
+        _check(
+            lib.xcgd_filter_create(Np_1d, nx, ny, lx, ly, r0, ctypes.byref(self._handle))
+        )
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            get_library().xcgd_filter_destroy(self._handle)
+            self._handle = None
+
+    def apply(self, x, out=None):
+        out = np.empty(self.nverts) if out is None else out
+        _check(
+            get_library().xcgd_filter_apply(
+                self._handle,
+                _ptr(x, np.float64, self.nverts, "x"),
+                _ptr(out, np.float64, self.nverts, "out"),
+            )
+        )
+        return out
+
+    def apply_gradient(self, x, dfdphi, out=None):
+        out = np.empty(self.nverts) if out is None else out
+        _check(
+            get_library().xcgd_filter_apply_gradient(
+                self._handle,
+                _ptr(x, np.float64, self.nverts, "x"),
+                _ptr(dfdphi, np.float64, self.nverts, "dfdphi"),
+                _ptr(out, np.float64, self.nverts, "out"),
+            )
+        )
+        return out
@@ -2,6 +2,7 @@
 
 #include "analysis.h"
 #include "elements/gd_vandermonde.h"
+#include "elements/quadrature_compression.h"
 #include "physics/linear_elasticity.h"
 #include "test_commons.h"
 #include "utils/vtk.h"
@@ -20,7 +21,7 @@ class Line {
   double k, b;
 };
 
-TEST(adjoint, GDLSFQuadratureGradient) {
+void test_lsf_quadrature_gradient(bool compress) {
   constexpr int Np_1d = 4;
   using T = double;
 
@@ -40,7 +41,7 @@ TEST(adjoint, GDLSFQuadratureGradient) {
   Grid grid(nxy, lxy);
   Mesh mesh(grid, lsf);
   Basis basis(mesh);
-  Quadrature quadrature(mesh);
+  Quadrature quadrature(mesh, compress);
 
   std::vector<T>& lsf_dof = mesh.get_lsf_dof();
 
@@ -144,3 +145,90 @@ TEST(adjoint, GDLSFQuadratureGradient) {
     EXPECT_NEAR(max_err, 0.0, tol);
   }
 }
+
+TEST(adjoint, GDLSFQuadratureGradient) { test_lsf_quadrature_gradient(false); }
+
+TEST(adjoint, GDLSFQuadratureCompressedGradient) {
+  test_lsf_quadrature_gradient(true);
+}
+
+// The derivatives of the compressed weights follow the branch taken by
+// compress_quadrature(): the refined weights, or the pruned weights that are
+// kept when the refinement is skipped or loses positivity
+TEST(adjoint, CompressQuadratureGradient) {
+  using T = double;
+  constexpr int degree = 3, nparams = 2, n1d = 7, M = n1d * n1d;
+
+  // Perturbed tensor rule, x_q(p) = x_q + p0 u_q + p1 v_q and
+  // w_q(p) = w_q (1 + p0 s_q + p1^2 t_q)
+  auto rnd = []() { return T(rand()) / RAND_MAX; };
+  std::vector<T> x0(2 * M), u(2 * M), v(2 * M), w0(M), s(M), t(M);
+  for (int q = 0; q < M; q++) {
+    x0[2 * q] = (q % n1d + 0.2 + 0.6 * rnd()) / n1d;
+    x0[2 * q + 1] = (q / n1d + 0.2 + 0.6 * rnd()) / n1d;
+    for (int d = 0; d < 2; d++) {
+      u[2 * q + d] = 0.1 * rnd();
+      v[2 * q + d] = 0.1 * rnd();
+    }
+    w0[q] = 0.5 + rnd();
+    s[q] = rnd() - 0.5;
+    t[q] = rnd() - 0.5;
+  }
+  auto eval_rule = [&](const T* p, std::vector<T>& pts, std::vector<T>& wts,
+                       std::vector<T>* pts_grad = nullptr,
+                       std::vector<T>* wts_grad = nullptr) {
+    pts.resize(2 * M);
+    wts.resize(M);
+    if (pts_grad) {
+      pts_grad->resize(2 * nparams * M);
+      wts_grad->resize(nparams * M);
+    }
+    for (int q = 0; q < M; q++) {
+      for (int d = 0; d < 2; d++) {
+        pts[2 * q + d] = x0[2 * q + d] + p[0] * u[2 * q + d] +
+                         p[1] * v[2 * q + d];
+      }
+      wts[q] = w0[q] * (1.0 + p[0] * s[q] + p[1] * p[1] * t[q]);
+      if (pts_grad) {
+        for (int d = 0; d < 2; d++) {
+          (*pts_grad)[(q * nparams) * 2 + d] = u[2 * q + d];
+          (*pts_grad)[(q * nparams + 1) * 2 + d] = v[2 * q + d];
+        }
+        (*wts_grad)[q * nparams] = w0[q] * s[q];
+        (*wts_grad)[q * nparams + 1] = 2.0 * w0[q] * p[1] * t[q];
+      }
+    }
+  };
+
+  T p[nparams] = {0.1, 0.2};
+  double h = 1e-6, tol = 1e-5;
+  for (bool refine : {true, false}) {
+    std::vector<T> pts, wts, pts_grad, wts_grad, new_wts, new_wts_grad;
+    eval_rule(p, pts, wts, &pts_grad, &wts_grad);
+    std::vector<int> selected =
+        compress_quadrature(degree, pts, wts, new_wts, refine);
+    compress_quadrature_grad(degree, nparams, pts, wts, pts_grad, wts_grad,
+                             selected, new_wts, new_wts_grad, refine);
+    EXPECT_LT(int(selected.size()), M);
+
+    for (int i = 0; i < nparams; i++) {
+      T p1[nparams] = {p[0], p[1]}, p2[nparams] = {p[0], p[1]};
+      p1[i] -= h;
+      p2[i] += h;
+      std::vector<T> pts1, wts1, new_wts1, pts2, wts2, new_wts2;
+      eval_rule(p1, pts1, wts1);
+      eval_rule(p2, pts2, wts2);
+      ASSERT_EQ(compress_quadrature(degree, pts1, wts1, new_wts1, refine),
+                selected);
+      ASSERT_EQ(compress_quadrature(degree, pts2, wts2, new_wts2, refine),
+                selected);
+
+      for (int j = 0; j < selected.size(); j++) {
+        T fd = (new_wts2[j] - new_wts1[j]) / (2.0 * h);
+        EXPECT_NEAR(new_wts_grad[j * nparams + i], fd,
+                    tol * std::max(1.0, fabs(fd)))
+            << "refine: " << refine << ", point: " << j;
+      }
+    }
+  }
+}
@@ -239,7 +239,363 @@ TEST(analysis, AdjJacProductElasticity) {
   test_LSF_jacobian_adjoint_product<4>(physics);
 }
 
+TEST(analysis, BatchedAdjJacProduct) {
+  constexpr int Np_1d = 4;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  auto int_func = [](const A2D::Vec<T, 2> xloc) { return A2D::Vec<T, 2>{}; };
+  using Physics = LinearElasticity<T, 2, typeof(int_func)>;
+  using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
+
+  int nxy[2] = {13, 9};
+  T lxy[2] = {3.0, 2.0};
+  T pt0[2] = {3.2, -0.5};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [pt0](T x[]) {
+    return 1.0 - (x[0] - pt0[0]) * (x[0] - pt0[0]) / 3.5 / 3.5 -
+           (x[1] - pt0[1]) * (x[1] - pt0[1]) / 2.0 / 2.0;  // <= 0
+  });
+  Basis basis(mesh);
+  Quadrature quadrature(mesh);
+  Physics physics(10.0, 0.3, int_func);
+  Analysis analysis(mesh, quadrature, basis, physics);
+
+  constexpr int nrhs = 3;
+  int ndof = mesh.get_num_nodes() * Physics::dof_per_node;
+  int ndv = grid.get_num_verts();
+
+  srand(42);
+  std::vector<std::vector<T>> dofs(nrhs, std::vector<T>(ndof)),
+      psis(nrhs, std::vector<T>(ndof));
+  for (int k = 0; k < nrhs; k++) {
+    for (int i = 0; i < ndof; i++) {
+      dofs[k][i] = (double)rand() / RAND_MAX;
+      psis[k][i] = (double)rand() / RAND_MAX;
+    }
+  }
+
+  // One load case at a time
+  std::vector<std::vector<T>> dfdphi_ref(nrhs, std::vector<T>(ndv, 0.0));
+  std::vector<T> dfdphi_sum_ref(ndv, 0.0);
+  for (int k = 0; k < nrhs; k++) {
+    analysis.LSF_jacobian_adjoint_product(dofs[k].data(), psis[k].data(),
+                                          dfdphi_ref[k].data());
+    for (int i = 0; i < ndv; i++) dfdphi_sum_ref[i] += dfdphi_ref[k][i];
+  }
+
+  // Batched, separate outputs and a shared output
+  std::vector<std::vector<T>> dfdphi(nrhs, std::vector<T>(ndv, 0.0));
+  std::vector<T> dfdphi_sum(ndv, 0.0);
+  const T *dof_ptrs[nrhs], *psi_ptrs[nrhs];
+  T *out_ptrs[nrhs], *sum_ptrs[nrhs];
+  for (int k = 0; k < nrhs; k++) {
+    dof_ptrs[k] = dofs[k].data();
+    psi_ptrs[k] = psis[k].data();
+    out_ptrs[k] = dfdphi[k].data();
+    sum_ptrs[k] = dfdphi_sum.data();
+  }
+  analysis.LSF_jacobian_adjoint_product(nrhs, dof_ptrs, psi_ptrs, out_ptrs);
+  analysis.LSF_jacobian_adjoint_product(nrhs, dof_ptrs, psi_ptrs, sum_ptrs);
+
+  for (int k = 0; k < nrhs; k++) {
+    EXPECT_VEC_NEAR(ndv, dfdphi[k], dfdphi_ref[k], 1e-12);
+  }
+  EXPECT_VEC_NEAR(ndv, dfdphi_sum, dfdphi_sum_ref, 1e-10);
+}
+
 TEST(analysis, EnergyPartialStressKS) {
   test_LSF_energy_derivatives<2>();
   test_LSF_energy_derivatives<4>();
 }
+
+TEST(analysis, StressMaxKSFused) {
+  constexpr int Np_1d = 4;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  using Stress = LinearElasticity2DVonMisesStress<T>;
+  using StressKS = LinearElasticity2DVonMisesStressAggregation<T>;
+  using StressAnalysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Stress>;
+  using StressKSAnalysis =
+      GalerkinAnalysis<T, Mesh, Quadrature, Basis, StressKS>;
+
+  double ksrho = 50.0;
+  T E = 10.0, nu = 0.3;
+  T yield_stress = 2.0;
+  Stress stress(E, nu);
+  StressKS stress_ks(ksrho, E, nu, yield_stress);
+
+  int nxy[2] = {13, 9};
+  T lxy[2] = {3.0, 2.0};
+  T pt0[2] = {3.2, -0.5};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [pt0](T x[]) {
+    return 1.0 - (x[0] - pt0[0]) * (x[0] - pt0[0]) / 3.5 / 3.5 -
+           (x[1] - pt0[1]) * (x[1] - pt0[1]) / 2.0 / 2.0;  // <= 0
+  });
+  Basis basis(mesh);
+  Quadrature quadrature(mesh);
+
+  StressAnalysis stress_analysis(mesh, quadrature, basis, stress);
+  StressKSAnalysis stress_ks_analysis(mesh, quadrature, basis, stress_ks);
+
+  std::vector<T> dof(mesh.get_num_nodes() * StressKS::dof_per_node);
+  srand(42);
+  for (T& v : dof) v = (double)rand() / RAND_MAX;
+
+  // Reference: pointwise field, max, then a second pass for the KS sum
+  auto [xloc_ref, stress_ref] = stress_analysis.interpolate_energy(dof.data());
+  T max_ref = *std::max_element(stress_ref.begin(), stress_ref.end());
+  stress_ks.set_max_stress_ratio(max_ref / yield_stress);
+  T ks_ref = stress_ks_analysis.energy(nullptr, dof.data());
+
+  std::vector<T> xloc_q, stress_q;
+  auto [max_stress, ks] = stress_analysis.energy_max_ks(
+      dof.data(), ksrho / yield_stress, &xloc_q, &stress_q);
+
+  EXPECT_NEAR(max_stress, max_ref, 1e-12 * max_ref);
+  EXPECT_NEAR(ks, ks_ref, 1e-12 * fabs(ks_ref));
+  ASSERT_EQ(xloc_q.size(), xloc_ref.size());
+  ASSERT_EQ(stress_q.size(), stress_ref.size());
+  EXPECT_VEC_NEAR(xloc_q.size(), xloc_q, xloc_ref, 1e-12);
+  EXPECT_VEC_NEAR(stress_q.size(), stress_q, stress_ref, 1e-12 * max_ref);
+
+  // The field is optional and does not affect the aggregates
+  auto [max_stress2, ks2] =
+      stress_analysis.energy_max_ks(dof.data(), ksrho / yield_stress);
+  EXPECT_EQ(max_stress2, max_stress);
+  EXPECT_EQ(ks2, ks);
+}
+
+TEST(analysis, ScheduledAssemblyIsDeterministic) {
+  constexpr int Np_1d = 4;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  auto source_func = [](const A2D::Vec<T, 2> xloc) {
+    return -1.2 * xloc(0) + 3.4 * xloc(1);
+  };
+  using Physics = PoissonPhysics<T, 2, typeof(source_func)>;
+  using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
+
+  int nxy[2] = {13, 9};
+  T lxy[2] = {3.0, 2.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](T x[]) {
+    return (x[0] - 1.5) * (x[0] - 1.5) + (x[1] - 1.0) * (x[1] - 1.0) - 0.8;
+  });
+  Basis basis(mesh);
+  Quadrature quadrature(mesh);
+  Physics physics(source_func);
+  Analysis analysis(mesh, quadrature, basis, physics);
+
+  int ndof = mesh.get_num_nodes();
+  std::vector<T> dof(ndof), p(ndof);
+  srand(42);
+  for (int i = 0; i < ndof; i++) {
+    dof[i] = (double)rand() / RAND_MAX;
+    p[i] = (double)rand() / RAND_MAX;
+  }
+
+  std::vector<T> res1(ndof, 0.0), jp1(ndof, 0.0);
+  analysis.residual(nullptr, dof.data(), res1.data());
+  analysis.jacobian_product(nullptr, dof.data(), p.data(), jp1.data());
+  T e1 = analysis.energy(nullptr, dof.data());
+
+  // Every element is executed exactly once
+  const SchedulerReport& report = analysis.get_scheduler_report();
+  EXPECT_EQ(report.num_elems[int(WorkClass::CUT)],
+            (int)mesh.get_cut_elems().size());
+  EXPECT_EQ(report.num_elems[0] + report.num_elems[1] + report.num_elems[2],
+            mesh.get_num_elements());
+  EXPECT_EQ(std::accumulate(report.num_executed.begin(),
+                            report.num_executed.end(), 0),
+            mesh.get_num_elements());
+
+  // Results are independent of the chunk sizes
+  analysis.set_chunk_size(WorkClass::CUT, 3);
+  analysis.set_chunk_size(WorkClass::IRREGULAR, 1);
+  analysis.set_chunk_size(WorkClass::REGULAR, 5);
+
+  std::vector<T> res2(ndof, 0.0), jp2(ndof, 0.0);
+  analysis.residual(nullptr, dof.data(), res2.data());
+  analysis.jacobian_product(nullptr, dof.data(), p.data(), jp2.data());
+  T e2 = analysis.energy(nullptr, dof.data());
+
+  EXPECT_EQ(e1, e2);
+  for (int i = 0; i < ndof; i++) {
+    EXPECT_EQ(res1[i], res2[i]);
+    EXPECT_EQ(jp1[i], jp2[i]);
+  }
+}
+
+template <int Np_1d, class Physics>
+void test_jacobian_block_diagonal(Physics& physics) {
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
+  constexpr int dof_per_node = Physics::dof_per_node;
+  using BSRMat = GalerkinBSRMat<T, dof_per_node>;
+
+  int nxy[2] = {13, 9};
+  T lxy[2] = {3.0, 2.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](T x[]) {
+    return (x[0] - 1.5) * (x[0] - 1.5) + (x[1] - 1.0) * (x[1] - 1.0) - 0.8;
+  });
+  Basis basis(mesh);
+  Quadrature quadrature(mesh);
+  Analysis analysis(mesh, quadrature, basis, physics);
+
+  int nnodes = mesh.get_num_nodes();
+  int ndof = dof_per_node * nnodes;
+  std::vector<T> dof(ndof);
+  srand(42);
+  for (int i = 0; i < ndof; i++) {
+    dof[i] = (double)rand() / RAND_MAX;
+  }
+
+  int *rowp = nullptr, *cols = nullptr;
+  SparseUtils::CSRFromConnectivityFunctor(
+      nnodes, mesh.get_num_elements(), mesh.max_nnodes_per_element,
+      [&mesh](int elem, int* nodes) -> int {
+        return mesh.get_elem_dof_nodes(elem, nodes);
+      },
+      &rowp, &cols);
+  BSRMat jac(nnodes, rowp[nnodes], rowp, cols);
+  analysis.jacobian(nullptr, dof.data(), &jac);
+
+  std::vector<T> diag(ndof, 0.0);
+  std::vector<T> blocks(dof_per_node * ndof, 0.0);
+  analysis.jacobian_diagonal(nullptr, dof.data(), diag.data());
+  analysis.jacobian_block_diagonal(nullptr, dof.data(), blocks.data());
+
+  constexpr int bsize = dof_per_node * dof_per_node;
+  for (int n = 0; n < nnodes; n++) {
+    int jp = jac.find_value_index(n, n);
+    ASSERT_NE(jp, SparseUtils::NO_INDEX);
+    for (int k = 0; k < bsize; k++) {
+      EXPECT_NEAR(blocks[bsize * n + k], jac.vals[bsize * jp + k], 1e-12);
+    }
+    for (int d = 0; d < dof_per_node; d++) {
+      EXPECT_NEAR(diag[dof_per_node * n + d],
+                  jac.vals[bsize * jp + (dof_per_node + 1) * d], 1e-12);
+    }
+  }
+
+  if (rowp) delete rowp;
+  if (cols) delete cols;
+}
+
+TEST(analysis, JacobianBlockDiagonal) {
+  auto source_func = [](const A2D::Vec<T, 2> xloc) {
+    return -1.2 * xloc(0) + 3.4 * xloc(1);
+  };
+  using Poisson = PoissonPhysics<T, 2, typeof(source_func)>;
+  Poisson poisson(source_func);
+  test_jacobian_block_diagonal<2>(poisson);
+  test_jacobian_block_diagonal<4>(poisson);
+
+  auto int_func = [](const A2D::Vec<T, 2> xloc) { return A2D::Vec<T, 2>{}; };
+  using Elasticity = LinearElasticity<T, 2, typeof(int_func)>;
+  Elasticity elasticity(10.0, 0.3, int_func);
+  test_jacobian_block_diagonal<2>(elasticity);
+  test_jacobian_block_diagonal<4>(elasticity);
+}
+
+template <int Np_1d, class Physics>
+void test_symmetric_jacobian(Physics& physics) {
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  using Analysis = GalerkinAnalysis<T, Mesh, Quadrature, Basis, Physics>;
+  constexpr int dof_per_node = Physics::dof_per_node;
+  using BSRMat = GalerkinBSRMat<T, dof_per_node>;
+  using SymBSRMat = SymmetricGalerkinBSRMat<T, dof_per_node>;
+
+  int nxy[2] = {13, 9};
+  T lxy[2] = {3.0, 2.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](T x[]) {
+    return (x[0] - 1.5) * (x[0] - 1.5) + (x[1] - 1.0) * (x[1] - 1.0) - 0.8;
+  });
+  Basis basis(mesh);
+  Quadrature quadrature(mesh);
+  Analysis analysis(mesh, quadrature, basis, physics);
+
+  int nnodes = mesh.get_num_nodes();
+  int ndof = dof_per_node * nnodes;
+  std::vector<T> dof(ndof), x(ndof);
+  srand(42);
+  for (int i = 0; i < ndof; i++) {
+    dof[i] = (double)rand() / RAND_MAX;
+    x[i] = (double)rand() / RAND_MAX;
+  }
+
+  int *rowp = nullptr, *cols = nullptr;
+  SparseUtils::CSRFromConnectivityFunctor(
+      nnodes, mesh.get_num_elements(), mesh.max_nnodes_per_element,
+      [&mesh](int elem, int* nodes) -> int {
+        return mesh.get_elem_dof_nodes(elem, nodes);
+      },
+      &rowp, &cols);
+  BSRMat jac(nnodes, rowp[nnodes], rowp, cols);
+  SymBSRMat jac_sym(nnodes, rowp, cols);
+  analysis.jacobian(nullptr, dof.data(), &jac);
+  analysis.jacobian(nullptr, dof.data(), &jac_sym);
+  EXPECT_EQ(jac_sym.nnz, (jac.nnz + nnodes) / 2);
+
+  std::vector<T> y(ndof, 0.0), y_sym(ndof, 0.0);
+  jac.axpy(x.data(), y.data());
+  jac_sym.axpy(x.data(), y_sym.data());
+  EXPECT_VEC_NEAR(ndof, y_sym, y, 1e-10);
+
+  // The exported upper triangle equals the upper triangle of the full matrix
+  SparseUtils::CSCMat<T>* csc = SparseUtils::bsr_to_csc(&jac);
+  SparseUtils::CSCMat<T>* csc_sym = jac_sym.to_csc();
+  int nnz_upper = 0;
+  for (int c = 0; c < ndof; c++) {
+    for (int p = csc->colp[c]; p < csc->colp[c + 1]; p++) {
+      if (csc->rows[p] <= c) nnz_upper++;
+    }
+  }
+  ASSERT_EQ(csc_sym->colp[ndof], nnz_upper);
+  for (int c = 0; c < ndof; c++) {
+    for (int p = csc_sym->colp[c]; p < csc_sym->colp[c + 1]; p++) {
+      int r = csc_sym->rows[p];
+      ASSERT_LE(r, c);
+      int q = csc->colp[c];
+      while (q < csc->colp[c + 1] and csc->rows[q] != r) q++;
+      ASSERT_LT(q, csc->colp[c + 1]);
+      EXPECT_NEAR(csc_sym->vals[p], csc->vals[q], 1e-12);
+    }
+  }
+
+  delete csc;
+  delete csc_sym;
+  if (rowp) delete rowp;
+  if (cols) delete cols;
+}
+
+TEST(analysis, SymmetricJacobian) {
+  auto source_func = [](const A2D::Vec<T, 2> xloc) {
+    return -1.2 * xloc(0) + 3.4 * xloc(1);
+  };
+  using Poisson = PoissonPhysics<T, 2, typeof(source_func)>;
+  Poisson poisson(source_func);
+  test_symmetric_jacobian<2>(poisson);
+  test_symmetric_jacobian<4>(poisson);
+
+  auto int_func = [](const A2D::Vec<T, 2> xloc) { return A2D::Vec<T, 2>{}; };
+  using Elasticity = LinearElasticity<T, 2, typeof(int_func)>;
+  Elasticity elasticity(10.0, 0.3, int_func);
+  test_symmetric_jacobian<2>(elasticity);
+  test_symmetric_jacobian<4>(elasticity);
+}
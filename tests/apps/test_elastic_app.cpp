@@ -1,3 +1,6 @@
+#include <numeric>
+#include <set>
+
 #include "analysis.h"
 #include "apps/static_elastic.h"
 #include "elements/gd_mesh.h"
@@ -155,3 +158,493 @@ void test_elastic_app() {
 
 TEST(apps, ElasticNp2) { test_elastic_app<2>(); }
 TEST(apps, ElasticNp4) { test_elastic_app<4>(); }
+
+template <int Np_1d>
+void test_elastic_reduced_solve() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {32, 16};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid);
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -xloc(0);
+    return intf;
+  };
+  StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun)> elastic(
+      E, nu, mesh, quadrature, basis, int_fun);
+
+  // Clamped left edge, prescribed horizontal displacement on the right edge
+  std::vector<int> bc_dof = get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+      mesh.get_left_boundary_nodes());
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+  for (int dof : get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+           mesh.get_right_boundary_nodes(), {0})) {
+    bc_dof.push_back(dof);
+    bc_vals.push_back(0.1);
+  }
+
+  std::vector<T> sol = elastic.solve(bc_dof, bc_vals);
+  std::vector<T> sol_reduced = elastic.solve_reduced(bc_dof, bc_vals);
+
+  EXPECT_EQ(elastic.get_dof_map().get_num_free() + bc_dof.size(), sol.size());
+  EXPECT_VEC_NEAR(sol.size(), sol_reduced, sol, 1e-10);
+}
+
+TEST(apps, ElasticReducedNp2) { test_elastic_reduced_solve<2>(); }
+TEST(apps, ElasticReducedNp4) { test_elastic_reduced_solve<4>(); }
+
+template <int Np_1d>
+void test_elastic_iterative_solve() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {32, 16};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid);
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    return A2D::Vec<T, Basis::spatial_dim>{};
+  };
+  StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun)> elastic(
+      E, nu, mesh, quadrature, basis, int_fun);
+
+  // Clamped left edge, prescribed horizontal displacement on the right edge
+  std::vector<int> bc_dof = get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+      mesh.get_left_boundary_nodes());
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+  for (int dof : get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+           mesh.get_right_boundary_nodes(), {0})) {
+    bc_dof.push_back(dof);
+    bc_vals.push_back(0.1);
+  }
+
+  std::shared_ptr<SparseUtils::SparseCholesky<T>> chol;
+  std::vector<T> sol = elastic.solve(bc_dof, bc_vals, std::tuple<>{}, &chol);
+
+  // The second solve starts from the recycled solution of the first one
+  for (int i = 0; i < 2; i++) {
+    std::vector<T> sol_iter =
+        elastic.solve_iterative(bc_dof, bc_vals, std::tuple<>{}, 1e-12);
+    EXPECT_VEC_NEAR(sol.size(), sol_iter, sol, 1e-7);
+  }
+  EXPECT_GE(elastic.get_recycler().get_num_vectors(), 1);
+
+  // Adjoint solve with the same operator
+  std::vector<T> psi(sol.size());
+  for (int i = 0; i < psi.size(); i++) psi[i] = T(rand()) / RAND_MAX;
+  for (int dof : bc_dof) psi[dof] = 0.0;
+  std::vector<T> psi_iter = psi;
+  chol->solve(psi.data());
+  elastic.solve_adjoint_iterative(psi_iter.data(), 1e-12);
+  EXPECT_VEC_NEAR(psi.size(), psi_iter, psi, 1e-7);
+}
+
+TEST(apps, ElasticIterativeNp2) { test_elastic_iterative_solve<2>(); }
+TEST(apps, ElasticIterativeNp4) { test_elastic_iterative_solve<4>(); }
+
+// Max norm of a - b relative to the max norm of b
+template <typename T>
+T rel_max_error(const std::vector<T>& a, const std::vector<T>& b) {
+  T err = 0.0, nrm = 0.0;
+  for (int i = 0; i < b.size(); i++) {
+    err = std::max(err, std::abs(a[i] - b[i]));
+    nrm = std::max(nrm, std::abs(b[i]));
+  }
+  return err / nrm;
+}
+
+template <int Np_1d>
+void test_elastic_multigrid_cut_mesh() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {32, 16};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](const T* x) { return x[1] - 0.1 * x[0] - 0.61; });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+  StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun)> elastic(
+      E, nu, mesh, quadrature, basis, int_fun);
+
+  std::vector<int> bc_dof = get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+      mesh.get_left_boundary_nodes());
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+
+  std::vector<T> sol = elastic.solve(bc_dof, bc_vals);
+  std::vector<T> sol_mg = elastic.solve_multigrid(bc_dof, bc_vals, 1e-12);
+  ASSERT_EQ(sol_mg.size(), sol.size());
+  EXPECT_LT(rel_max_error(sol_mg, sol), 1e-6);
+}
+
+TEST(apps, ElasticMultigridCutMeshNp2) { test_elastic_multigrid_cut_mesh<2>(); }
+TEST(apps, ElasticMultigridCutMeshNp4) { test_elastic_multigrid_cut_mesh<4>(); }
+
+template <int Np_1d>
+void test_elastic_ersatz_iterative_solve() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {32, 16};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](const T* x) { return x[1] - 0.1 * x[0] - 0.61; });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3, ersatz_ratio = 1e-3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+  using Elastic =
+      StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_fun)>;
+  Elastic elastic(E, nu, mesh, quadrature, basis, int_fun, ersatz_ratio);
+
+  // Clamped left edge, the dof of the ersatz problem are the grid verts
+  std::vector<int> bc_verts;
+  for (int iy = 0; iy <= nxy[1]; iy++) {
+    bc_verts.push_back(grid.get_coords_vert(0, iy));
+  }
+  std::vector<int> bc_dof =
+      get_dof_vec_from_nodes<T, Basis::spatial_dim>(bc_verts);
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+
+  std::shared_ptr<typename Elastic::Factor> chol;
+  std::vector<T> sol = elastic.solve(bc_dof, bc_vals, std::tuple<>{}, &chol);
+
+  // The second solve starts from the recycled solution of the first one
+  for (int i = 0; i < 2; i++) {
+    std::vector<T> sol_iter =
+        elastic.solve_iterative(bc_dof, bc_vals, std::tuple<>{}, 1e-12);
+    ASSERT_EQ(sol_iter.size(), sol.size());
+    EXPECT_LT(rel_max_error(sol_iter, sol), 1e-6);
+  }
+
+  std::vector<T> sol_mg = elastic.solve_multigrid(bc_dof, bc_vals, 1e-12);
+  ASSERT_EQ(sol_mg.size(), sol.size());
+  EXPECT_LT(rel_max_error(sol_mg, sol), 1e-6);
+
+  // Adjoint solve with the same operator
+  std::vector<T> psi(sol.size());
+  for (int i = 0; i < psi.size(); i++) psi[i] = T(rand()) / RAND_MAX;
+  for (int dof : bc_dof) psi[dof] = 0.0;
+  for (int dof : elastic.get_void_dof()) psi[dof] = 0.0;
+  std::vector<T> psi_iter = psi;
+  chol->solve(psi.data());
+  elastic.solve_adjoint_iterative(psi_iter.data(), 1e-12);
+  EXPECT_LT(rel_max_error(psi_iter, psi), 1e-6);
+}
+
+TEST(apps, ElasticErsatzIterativeNp2) {
+  test_elastic_ersatz_iterative_solve<2>();
+}
+TEST(apps, ElasticErsatzIterativeNp4) {
+  test_elastic_ersatz_iterative_solve<4>();
+}
+
+// SimplicialCholesky factors the upper triangle assembled by
+// SymmetricGalerkinBSRMat, the solution must match the full matrix path
+template <int Np_1d>
+void test_elastic_symmetric_solve() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {16, 8};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](const T* x) { return x[1] - 0.1 * x[0] - 0.61; });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+  using Simplicial = SimplicialCholesky<T>;
+
+  // Prescribed nonzero displacements exercise the lifting of the bcs
+  {
+    std::vector<int> bc_dof = get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+        mesh.get_left_boundary_nodes());
+    std::vector<T> bc_vals(bc_dof.size());
+    for (int i = 0; i < bc_vals.size(); i++) bc_vals[i] = 0.01 * (i % 3);
+
+    StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun)> elastic(
+        E, nu, mesh, quadrature, basis, int_fun);
+    StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun), Simplicial>
+        elastic_sym(E, nu, mesh, quadrature, basis, int_fun);
+
+    std::vector<T> sol = elastic.solve(bc_dof, bc_vals);
+    std::vector<T> sol_sym = elastic_sym.solve(bc_dof, bc_vals);
+    ASSERT_EQ(sol_sym.size(), sol.size());
+    EXPECT_LT(rel_max_error(sol_sym, sol), 1e-10);
+    EXPECT_VEC_NEAR(sol.size(), elastic_sym.get_rhs(), elastic.get_rhs(),
+                    1e-12);
+  }
+
+  {
+    std::vector<int> bc_verts;
+    for (int iy = 0; iy <= nxy[1]; iy++) {
+      bc_verts.push_back(grid.get_coords_vert(0, iy));
+    }
+    std::vector<int> bc_dof =
+        get_dof_vec_from_nodes<T, Basis::spatial_dim>(bc_verts);
+    std::vector<T> bc_vals(bc_dof.size());
+    for (int i = 0; i < bc_vals.size(); i++) bc_vals[i] = 0.01 * (i % 3);
+
+    StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_fun)> elastic(
+        E, nu, mesh, quadrature, basis, int_fun, 1e-3);
+    StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_fun),
+                        Simplicial>
+        elastic_sym(E, nu, mesh, quadrature, basis, int_fun, 1e-3);
+
+    std::vector<T> sol = elastic.solve(bc_dof, bc_vals);
+    std::vector<T> sol_sym = elastic_sym.solve(bc_dof, bc_vals);
+    ASSERT_EQ(sol_sym.size(), sol.size());
+    EXPECT_LT(rel_max_error(sol_sym, sol), 1e-10);
+  }
+}
+
+TEST(apps, ElasticSymmetricSolveNp2) { test_elastic_symmetric_solve<2>(); }
+TEST(apps, ElasticSymmetricSolveNp4) { test_elastic_symmetric_solve<4>(); }
+
+template <int Np_1d>
+void test_elastic_multi_load_solve() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {16, 8};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid);
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    return A2D::Vec<T, Basis::spatial_dim>{};
+  };
+  using Factor = SimplicialCholesky<T>;
+  StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun), Factor> elastic(
+      E, nu, mesh, quadrature, basis, int_fun);
+
+  std::vector<int> bc_dof = get_dof_vec_from_nodes<T, Basis::spatial_dim>(
+      mesh.get_left_boundary_nodes());
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+
+  // Three load cases on the right edge: horizontal, vertical and a shear
+  // traction on the lower part only
+  auto load_x = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(0) = 1.0;
+    return intf;
+  };
+  auto load_y = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+  auto load_low = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    if (xloc(1) <= 0.3) intf(1) = 2.0;
+    return intf;
+  };
+  using LoadQuadrature =
+      GDGaussQuadrature2D<T, Np_1d, QuadPtType::SURFACE, SurfQuad::RIGHT>;
+  using PhysicsX =
+      ElasticityExternalLoad<T, Basis::spatial_dim, typeof(load_x)>;
+  using PhysicsY =
+      ElasticityExternalLoad<T, Basis::spatial_dim, typeof(load_y)>;
+  using PhysicsLow =
+      ElasticityExternalLoad<T, Basis::spatial_dim, typeof(load_low)>;
+
+  std::set<int> load_elements;
+  for (int i = 0; i < nxy[1]; i++) {
+    load_elements.insert(grid.get_coords_cell(nxy[0] - 1, i));
+  }
+  LoadQuadrature load_quadrature(mesh, load_elements);
+  PhysicsX physics_x(load_x);
+  PhysicsY physics_y(load_y);
+  PhysicsLow physics_low(load_low);
+  GalerkinAnalysis<T, Mesh, LoadQuadrature, Basis, PhysicsX> analysis_x(
+      mesh, load_quadrature, basis, physics_x);
+  GalerkinAnalysis<T, Mesh, LoadQuadrature, Basis, PhysicsY> analysis_y(
+      mesh, load_quadrature, basis, physics_y);
+  GalerkinAnalysis<T, Mesh, LoadQuadrature, Basis, PhysicsLow> analysis_low(
+      mesh, load_quadrature, basis, physics_low);
+
+  std::vector<T> sol_x =
+      elastic.solve(bc_dof, bc_vals, std::make_tuple(analysis_x));
+  std::vector<T> sol_y =
+      elastic.solve(bc_dof, bc_vals, std::make_tuple(analysis_y));
+  std::vector<T> sol_low =
+      elastic.solve(bc_dof, bc_vals, std::make_tuple(analysis_low));
+  std::vector<T> sol_ref = concat_vectors<T>(
+      std::vector<std::vector<T>>{sol_x, sol_y, sol_low});
+
+  std::vector<T> sol = elastic.solve_multi_load(
+      bc_dof, bc_vals, std::make_tuple(analysis_x, analysis_y, analysis_low));
+  ASSERT_EQ(sol.size(), sol_ref.size());
+  EXPECT_VEC_NEAR(sol.size(), sol, sol_ref, 1e-10);
+  EXPECT_EQ(elastic.get_rhs().size(), sol.size());
+}
+
+TEST(apps, ElasticMultiLoadNp2) { test_elastic_multi_load_solve<2>(); }
+TEST(apps, ElasticMultiLoadNp4) { test_elastic_multi_load_solve<4>(); }
+
+template <int Np_1d>
+void test_elastic_ersatz_band() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {32, 16};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+
+  // Solid below a slanted line, the void above it is wider than the band
+  Mesh mesh(grid, [](const T* x) { return x[1] - 0.1 * x[0] - 0.31; });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    return A2D::Vec<T, Basis::spatial_dim>{};
+  };
+  using Elastic =
+      StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_fun)>;
+  Elastic elastic(E, nu, mesh, quadrature, basis, int_fun);
+
+  // Clamped left edge, the dof of the ersatz problem are the grid verts
+  std::vector<int> bc_verts;
+  for (int iy = 0; iy <= nxy[1]; iy++) {
+    bc_verts.push_back(grid.get_coords_vert(0, iy));
+  }
+  std::vector<int> bc_dof =
+      get_dof_vec_from_nodes<T, Basis::spatial_dim>(bc_verts);
+  std::vector<T> bc_vals(bc_dof.size(), 0.0);
+
+  // Downward traction on the right edge of the solid
+  auto load_func = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+  using LoadPhysics =
+      ElasticityExternalLoad<T, Basis::spatial_dim, typeof(load_func)>;
+  using LoadQuadrature =
+      GDGaussQuadrature2D<T, Np_1d, QuadPtType::SURFACE, SurfQuad::RIGHT, Mesh>;
+  using LoadAnalysis =
+      GalerkinAnalysis<T, Mesh, LoadQuadrature, Basis, LoadPhysics, true>;
+  LoadPhysics load_physics(load_func);
+  std::set<int> load_elements;
+  for (int e = 0; e < mesh.get_num_elements(); e++) {
+    int exy[2];
+    grid.get_cell_coords(mesh.get_elem_cell(e), exy);
+    if (exy[0] == nxy[0] - 1) load_elements.insert(e);
+  }
+  LoadQuadrature load_quadrature(mesh, load_elements);
+  LoadAnalysis load_analysis(mesh, load_quadrature, basis, load_physics);
+  std::tuple<LoadAnalysis> loads(load_analysis);
+
+  auto dot = [](const std::vector<T>& a, const std::vector<T>& b) {
+    return std::inner_product(a.begin(), a.end(), b.begin(), T(0.0));
+  };
+
+  // Reference: the entire void is filled with ersatz material
+  std::vector<T> sol_full = elastic.solve(bc_dof, bc_vals, loads);
+  T comp_full = dot(sol_full, elastic.get_rhs());
+  int ndof = sol_full.size();
+
+  // Only two cell layers of ersatz material, the void dof beyond them are
+  // eliminated
+  elastic.set_ersatz_band(2);
+  std::vector<int> void_dof = elastic.get_void_dof();
+  EXPECT_GT(void_dof.size(), 0);
+
+  std::shared_ptr<typename Elastic::Factor> chol;
+  std::vector<T> sol = elastic.solve_reduced(bc_dof, bc_vals, loads, &chol);
+  T comp = dot(sol, elastic.get_rhs());
+
+  std::set<int> constrained(bc_dof.begin(), bc_dof.end());
+  constrained.insert(void_dof.begin(), void_dof.end());
+  EXPECT_EQ(elastic.get_dof_map().get_num_free(),
+            ndof - int(constrained.size()));
+  EXPECT_LT(elastic.get_dof_map().get_num_free(), ndof - int(bc_dof.size()));
+  EXPECT_NEAR((comp - comp_full) / comp_full, 0.0, 1e-4);
+  for (int dof : void_dof) EXPECT_EQ(sol[dof], 0.0);
+
+  // The load is the rhs of the compliance adjoint, whose solution is sol
+  std::vector<T> psi = elastic.get_rhs();
+  elastic.solve_adjoint_reduced(*chol, psi.data());
+  EXPECT_VEC_NEAR(ndof, psi, sol, 1e-10);
+
+  // Finite difference check of the ersatz contribution to psi^T dR/dphi
+  int nverts = grid.get_num_verts();
+  std::vector<T> p(nverts), dfdphi(nverts, 0.0);
+  for (T& v : psi) v = T(rand()) / RAND_MAX;
+  for (T& v : p) v = T(rand()) / RAND_MAX;
+  elastic.ersatz_LSF_jacobian_adjoint_product(sol.data(), psi.data(),
+                                              dfdphi.data());
+
+  std::vector<T>& phi = mesh.get_lsf_dof();
+  auto perturb = [&](double h) {
+    for (int i = 0; i < nverts; i++) phi[i] += h * p[i];
+    mesh.update_mesh();
+    elastic.update_mesh_ersatz();
+  };
+  auto psi_res = [&]() {
+    std::vector<T> res(ndof, 0.0);
+    elastic.get_analysis_ersatz().residual(nullptr, sol.data(), res.data());
+    return dot(psi, res);
+  };
+
+  double h = 1e-6;
+  perturb(h);
+  T res_p = psi_res();
+  perturb(-2.0 * h);
+  T res_m = psi_res();
+  perturb(h);
+
+  T fd = (res_p - res_m) / (2.0 * h);
+  T exact = dot(dfdphi, p);
+  EXPECT_NEAR((fd - exact) / exact, 0.0, 1e-5);
+}
+
+TEST(apps, ElasticErsatzBandNp2) { test_elastic_ersatz_band<2>(); }
+TEST(apps, ElasticErsatzBandNp4) { test_elastic_ersatz_band<4>(); }
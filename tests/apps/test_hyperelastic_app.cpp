@@ -0,0 +1,86 @@
+#include "apps/static_hyperelastic.h"
+#include "elements/gd_mesh.h"
+#include "elements/gd_vandermonde.h"
+#include "test_commons.h"
+
+template <int Np_1d>
+class HyperelasticTest {
+ public:
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  using App = StaticHyperelastic<T, Mesh, Quadrature, Basis>;
+
+  HyperelasticTest()
+      : grid(nxy, lxy), mesh(grid), quadrature(mesh), basis(mesh) {
+    // Clamp the left edge, stretch and shear the right edge
+    for (int n : mesh.get_left_boundary_nodes()) {
+      for (int d = 0; d < 2; d++) {
+        bc_dof.push_back(2 * n + d);
+        bc_vals.push_back(0.0);
+      }
+    }
+    for (int n : mesh.get_right_boundary_nodes()) {
+      bc_dof.push_back(2 * n);
+      bc_vals.push_back(0.3);
+      bc_dof.push_back(2 * n + 1);
+      bc_vals.push_back(-0.2);
+    }
+  }
+
+  std::vector<T> solve(const NewtonOptions& options, NewtonReport& report) {
+    App app(C1, D1, mesh, quadrature, basis);
+    app.set_options(options);
+    std::vector<T> sol = app.solve(bc_dof, bc_vals);
+    report = app.get_report();
+    return sol;
+  }
+
+  int nxy[2] = {16, 8};
+  T lxy[2] = {2.0, 1.0};
+  T C1 = 0.5, D1 = 2.0;
+
+  Grid grid;
+  Mesh mesh;
+  Quadrature quadrature;
+  Basis basis;
+  std::vector<int> bc_dof;
+  std::vector<T> bc_vals;
+};
+
+template <int Np_1d>
+void test_hyperelastic_newton() {
+  HyperelasticTest<Np_1d> test;
+
+  NewtonOptions options;
+  options.num_load_steps = 2;
+
+  NewtonReport full, modified, newton_cg;
+  auto sol_full = test.solve(options, full);
+
+  options.max_jacobian_age = 10;
+  auto sol_modified = test.solve(options, modified);
+
+  options.newton_cg = true;
+  auto sol_newton_cg = test.solve(options, newton_cg);
+
+  EXPECT_TRUE(full.converged);
+  EXPECT_TRUE(modified.converged);
+  EXPECT_TRUE(newton_cg.converged);
+
+  // Full Newton factorizes once per iteration, the Jacobian reuse does not
+  EXPECT_EQ(full.num_factorizations, full.num_iterations);
+  EXPECT_LT(modified.num_factorizations, full.num_factorizations);
+  EXPECT_LT(newton_cg.num_factorizations, full.num_factorizations);
+
+  // The deformation is large, the solution is far from the linear one
+  EXPECT_GT(full.num_iterations, 2 * options.num_load_steps);
+
+  EXPECT_VEC_NEAR(sol_full.size(), sol_modified, sol_full, 1e-8);
+  EXPECT_VEC_NEAR(sol_full.size(), sol_newton_cg, sol_full, 1e-8);
+}
+
+TEST(apps, HyperelasticNewtonNp2) { test_hyperelastic_newton<2>(); }
+TEST(apps, HyperelasticNewtonNp4) { test_hyperelastic_newton<4>(); }
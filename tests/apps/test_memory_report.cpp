@@ -0,0 +1,173 @@
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "apps/helmholtz_filter.h"
+#include "apps/static_elastic.h"
+#include "elements/gd_mesh.h"
+#include "elements/gd_vandermonde.h"
+#include "test_commons.h"
+#include "utils/cholesky.h"
+#include "utils/memory.h"
+
+template <class Report>
+void expect_nonzero(const Report& report,
+                    const std::vector<std::string>& names) {
+  for (const std::string& name : names) {
+    EXPECT_GT(report.get_bytes(name), 0) << name;
+    EXPECT_NE(report.get_bytes(name), MemoryReport::unknown) << name;
+  }
+}
+
+// Bytes of the Jacobian assembled by the solve, the upper triangle alone for
+// SimplicialCholesky
+template <class Factor, class App>
+std::size_t solve_jacobian_bytes(App& app) {
+  std::size_t bytes = 0;
+  if constexpr (is_simplicial_cholesky<Factor>::value) {
+    auto* jac = app.symmetric_jacobian();
+    bytes = memory_bytes(*jac);
+    delete jac;
+  } else {
+    auto* jac = app.jacobian();
+    bytes = memory_bytes(*jac);
+    delete jac;
+  }
+  return bytes;
+}
+
+template <int Np_1d, class Factor>
+void test_elastic_memory_report(bool factor_known) {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {16, 8};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](const T* x) { return x[1] - 0.1 * x[0] - 0.61; });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+  T E = 100.0, nu = 0.3;
+
+  auto int_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    A2D::Vec<T, Basis::spatial_dim> intf;
+    intf(1) = -1.0;
+    return intf;
+  };
+
+  // Cut mesh
+  MemoryReport mesh_report = mesh.memory_report();
+  expect_nonzero(mesh_report, {"lsf_dof", "elem_nodes", "node_verts",
+                               "vert_nodes", "elem_cells", "cut_elems"});
+
+  // Static elastic on the cut mesh
+  {
+    StaticElastic<T, Mesh, Quadrature, Basis, typeof(int_fun), Factor> elastic(
+        E, nu, mesh, quadrature, basis, int_fun);
+
+    std::vector<int> bc_dof;
+    for (int node : mesh.get_left_boundary_nodes()) {
+      bc_dof.push_back(Basis::spatial_dim * node);
+      bc_dof.push_back(Basis::spatial_dim * node + 1);
+    }
+    std::vector<T> bc_vals(bc_dof.size(), 0.0);
+    std::shared_ptr<Factor> chol;
+    elastic.solve(bc_dof, bc_vals, &chol);
+
+    MemoryReport report = elastic.memory_report();
+    expect_nonzero(report,
+                   {"mesh.elem_nodes", "analysis.residual", "analysis.jacobian",
+                    "rhs", "solve.jacobian", "solve.jacobian_csc", "solve"});
+
+    // The Jacobian of the solve has the sparsity of jacobian()
+    EXPECT_EQ(report.get_bytes("solve.jacobian"),
+              solve_jacobian_bytes<Factor>(elastic));
+
+    if (factor_known) {
+      EXPECT_EQ(report.get_bytes("solve.factor"), factor_memory_bytes(*chol));
+      EXPECT_EQ(report.get_num_unknown(), 0);
+    } else {
+      EXPECT_EQ(report.get_bytes("solve.factor"), MemoryReport::unknown);
+      EXPECT_EQ(report.get_num_unknown(), 1);
+    }
+    EXPECT_GE(report.get_bytes("solve"),
+              report.get_bytes("solve.jacobian") +
+                  report.get_bytes("analysis.jacobian"));
+
+    // The element matrices are the only tracked buffers of jacobian()
+    MemoryTracker::reset_peak();
+    std::size_t base = MemoryTracker::get_current_bytes();
+    auto* jac_bsr = elastic.jacobian();
+    EXPECT_EQ(MemoryTracker::get_peak_bytes() - base,
+              report.get_bytes("analysis.jacobian"));
+    EXPECT_EQ(MemoryTracker::get_current_bytes(), base);
+    delete jac_bsr;
+  }
+
+  // Static elastic with ersatz material
+  {
+    StaticElasticErsatz<T, Mesh, Quadrature, Basis, typeof(int_fun), Factor>
+        elastic(E, nu, mesh, quadrature, basis, int_fun);
+
+    std::vector<int> bc_dof;
+    for (int iy = 0; iy <= nxy[1]; iy++) {
+      int vert = grid.get_coords_vert(0, iy);
+      bc_dof.push_back(Basis::spatial_dim * vert);
+      bc_dof.push_back(Basis::spatial_dim * vert + 1);
+    }
+    std::vector<T> bc_vals(bc_dof.size(), 0.0);
+    elastic.solve(bc_dof, bc_vals);
+
+    MemoryReport report = elastic.memory_report();
+    expect_nonzero(report, {"mesh.elem_nodes", "mesh_ersatz.elem_nodes",
+                            "analysis.jacobian", "analysis_ersatz.jacobian",
+                            "lsf_ersatz_sign", "rhs", "solve.jacobian",
+                            "solve.jacobian_csc", "solve"});
+
+    EXPECT_EQ(report.get_bytes("solve.jacobian"),
+              solve_jacobian_bytes<Factor>(elastic));
+
+    EXPECT_EQ(report.get_bytes("solve.factor") == MemoryReport::unknown,
+              !factor_known);
+  }
+}
+
+TEST(apps, ElasticMemoryReportNp2) {
+  test_elastic_memory_report<2, SimplicialCholesky<double>>(true);
+}
+TEST(apps, ElasticMemoryReportNp4) {
+  test_elastic_memory_report<4, SimplicialCholesky<double>>(true);
+}
+TEST(apps, ElasticMemoryReportSparseCholesky) {
+  test_elastic_memory_report<2, SparseUtils::SparseCholesky<double>>(false);
+}
+
+TEST(apps, HelmholtzFilterMemoryReport) {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  int nxy[2] = {16, 8};
+  T lxy[2] = {2.0, 1.0};
+  Grid grid(nxy, lxy);
+
+  HelmholtzFilter<T, 2> filter(0.05, grid);
+  MemoryReport report = filter.memory_report();
+  expect_nonzero(report, {"mesh.regular_stencil_elems", "analysis.residual",
+                          "analysis.jacobian", "jacobian", "jacobian_csc"});
+  EXPECT_EQ(report.get_bytes("factor"), MemoryReport::unknown);
+  EXPECT_EQ(report.get_persistent_bytes(),
+            report.get_bytes("mesh.regular_stencil_elems") +
+                report.get_bytes("jacobian") +
+                report.get_bytes("jacobian_csc"));
+
+  HelmholtzFilter<T, 2, Grid, SimplicialCholesky<T>> filter_simplicial(0.05,
+                                                                       grid);
+  std::size_t jac_bytes = report.get_bytes("jacobian");
+  report = filter_simplicial.memory_report();
+  expect_nonzero(report, {"factor"});
+  EXPECT_EQ(report.get_num_unknown(), 0);
+
+  // Only the upper triangle is assembled for SimplicialCholesky
+  EXPECT_LT(report.get_bytes("jacobian"), jac_bytes);
+}
@@ -71,3 +71,120 @@ void test_poisson_app() {
 }
 
 TEST(apps, Poisson) { test_poisson_app<2>(); }
+
+template <int Np_1d>
+void test_poisson_multigrid() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {64, 64};
+  T lxy[2] = {2.0, 2.0};
+  T xy0[2] = {-1.0, -1.0};
+  Grid grid(nxy, lxy, xy0);
+  Mesh mesh(grid);
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+
+  auto source_fun = [](const A2D::Vec<T, Basis::spatial_dim> &xloc) {
+    return xloc[0] * xloc[1];
+  };
+  using Poisson = PoissonApp<T, Mesh, Quadrature, Basis, typeof(source_fun)>;
+  Poisson poisson(mesh, quadrature, basis, source_fun);
+
+  std::vector<int> dof_bcs;
+  std::vector<T> dof_vals;
+  double tol = 1e-6;
+  for (int i = 0; i < mesh.get_num_nodes(); i++) {
+    T xloc[Basis::spatial_dim];
+    mesh.get_node_xloc(i, xloc);
+    if (xloc[0] < -1.0 + tol or xloc[1] < -1.0 + tol or xloc[0] > 1.0 - tol or
+        xloc[1] > 1.0 - tol) {
+      dof_bcs.push_back(i);
+      dof_vals.push_back(xloc[0] + 0.5 * xloc[1]);
+    }
+  }
+
+  std::vector<T> sol_chol = poisson.solve(dof_bcs, dof_vals);
+  std::vector<T> sol_mg =
+      poisson.solve_multigrid(dof_bcs, dof_vals, 1e-12, 200);
+
+  T err = 0.0, norm = 0.0;
+  for (int i = 0; i < sol_chol.size(); i++) {
+    err += (sol_mg[i] - sol_chol[i]) * (sol_mg[i] - sol_chol[i]);
+    norm += sol_chol[i] * sol_chol[i];
+  }
+  EXPECT_NEAR(sqrt(err / norm), 0.0, 1e-8);
+}
+
+TEST(apps, PoissonMultigridNp2) { test_poisson_multigrid<2>(); }
+TEST(apps, PoissonMultigridNp4) { test_poisson_multigrid<4>(); }
+
+// A bar narrower than a coarse cell vanishes on the coarse grids, its nodes are
+// prolongated from the nearest active coarse elements
+template <int Np_1d>
+void test_poisson_multigrid_thin_feature() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+  using Mesh = CutMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+  int nxy[2] = {64, 64};
+  T lxy[2] = {1.0, 1.0};
+  Grid grid(nxy, lxy);
+
+  // Disk with a bar of width 1.2 h centered at the odd vert row 33, the bar is
+  // missed by the level set injected to the even verts
+  T h = lxy[1] / nxy[1], yc = 33.0 * h;
+  Mesh mesh(grid, [h, yc](const T* x) {
+    T disk = sqrt((x[0] - 0.3) * (x[0] - 0.3) + (x[1] - 0.5) * (x[1] - 0.5)) -
+             0.2;
+    T bar = std::max({fabs(x[1] - yc) - 0.6 * h, x[0] - 0.9, 0.3 - x[0]});
+    return std::min(disk, bar);
+  });
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+
+  auto source_fun = [](const A2D::Vec<T, Basis::spatial_dim> &xloc) {
+    return T(1.0);
+  };
+  using Poisson = PoissonApp<T, Mesh, Quadrature, Basis, typeof(source_fun)>;
+  Poisson poisson(mesh, quadrature, basis, source_fun);
+
+  std::vector<int> dof_bcs;
+  std::vector<T> dof_vals;
+  for (int i = 0; i < mesh.get_num_nodes(); i++) {
+    T xloc[Basis::spatial_dim];
+    mesh.get_node_xloc(i, xloc);
+    if (xloc[0] < 0.15) {
+      dof_bcs.push_back(i);
+      dof_vals.push_back(0.0);
+    }
+  }
+
+  // The bar tip is far from any active coarse element
+  GalerkinBSRMat<T, 1> *jac = poisson.jacobian(dof_bcs);
+  GDMultigrid<T, Mesh> mg(mesh);
+  mg.setup(jac, dof_bcs);
+  EXPECT_GT(mg.get_num_levels(), 1);
+  delete jac;
+
+  std::vector<T> sol_chol = poisson.solve(dof_bcs, dof_vals);
+  std::vector<T> sol_mg =
+      poisson.solve_multigrid(dof_bcs, dof_vals, 1e-12, 500);
+
+  T err = 0.0, norm = 0.0;
+  for (int i = 0; i < sol_chol.size(); i++) {
+    err += (sol_mg[i] - sol_chol[i]) * (sol_mg[i] - sol_chol[i]);
+    norm += sol_chol[i] * sol_chol[i];
+  }
+  EXPECT_NEAR(sqrt(err / norm), 0.0, 1e-8);
+}
+
+TEST(apps, PoissonMultigridThinFeatureNp2) {
+  test_poisson_multigrid_thin_feature<2>();
+}
+TEST(apps, PoissonMultigridThinFeatureNp4) {
+  test_poisson_multigrid_thin_feature<4>();
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "test_commons.h"
+#include "xcgd_capi.h"
+
+// LSF of a circle of radius r centered at (0.5 + dx, 0.5) in the unit square
+static std::vector<double> circle_lsf(int nx, int ny, double dx = 0.0,
+                                      double r = 0.4) {
+  std::vector<double> lsf((nx + 1) * (ny + 1));
+  for (int j = 0; j <= ny; j++) {
+    for (int i = 0; i <= nx; i++) {
+      double x = double(i) / nx - 0.5 - dx, y = double(j) / ny - 0.5;
+      lsf[i + (nx + 1) * j] = std::sqrt(x * x + y * y) - r;
+    }
+  }
+  return lsf;
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b) {
+  double s = 0.0;
+  for (std::size_t i = 0; i < a.size(); i++) s += a[i] * b[i];
+  return s;
+}
+
+// Solve the problem, check that the solution zeroes the residual and that
+// R(u) = J * u + R(0) with the exported CSR Jacobian, return the solution
+static std::vector<double> check_solve_and_jacobian(xcgd_problem* problem) {
+  int ndof, nnz;
+  EXPECT_EQ(xcgd_problem_get_sizes(problem, nullptr, nullptr, &ndof, &nnz),
+            XCGD_OK);
+
+  std::vector<double> sol(ndof), res(ndof), res0(ndof), zeros(ndof, 0.0);
+  EXPECT_EQ(xcgd_problem_solve(problem, sol.data()), XCGD_OK)
+      << xcgd_get_last_error();
+  EXPECT_EQ(xcgd_problem_residual(problem, sol.data(), res.data()), XCGD_OK);
+  EXPECT_EQ(xcgd_problem_residual(problem, zeros.data(), res0.data()),
+            XCGD_OK);
+  double res0_norm = std::sqrt(dot(res0, res0));
+  EXPECT_GT(res0_norm, 0.0);
+  EXPECT_LT(std::sqrt(dot(res, res)), 1e-10 * res0_norm);
+
+  std::vector<int> rowp(ndof + 1), cols(nnz);
+  std::vector<double> vals(nnz);
+  EXPECT_EQ(xcgd_problem_jacobian_csr(problem, rowp.data(), cols.data(),
+                                      vals.data()),
+            XCGD_OK);
+  EXPECT_EQ(rowp[ndof], nnz);
+  for (int i = 0; i < ndof; i++) {
+    double Ju = 0.0;
+    for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+      if (jp > rowp[i]) {
+        EXPECT_LT(cols[jp - 1], cols[jp]);
+      }
+      Ju += vals[jp] * sol[cols[jp]];
+    }
+    EXPECT_NEAR(Ju + res0[i], 0.0, 1e-10 * res0_norm);
+  }
+  return sol;
+}
+
+TEST(capi, PoissonSolveAndJacobian) {
+  int nx = 16, ny = 16;
+  std::vector<double> lsf = circle_lsf(nx, ny);
+  double params[3] = {-1.0, 0.0, 1e6};
+
+  xcgd_problem* problem = nullptr;
+  ASSERT_EQ(xcgd_problem_create(XCGD_PHYSICS_POISSON, 4, nx, ny, 1.0, 1.0,
+                                lsf.data(), params, 3, &problem),
+            XCGD_OK)
+      << xcgd_get_last_error();
+
+  int nverts, nnodes, ndof, nnz;
+  ASSERT_EQ(xcgd_problem_get_sizes(problem, &nverts, &nnodes, &ndof, &nnz),
+            XCGD_OK);
+  EXPECT_EQ(nverts, (nx + 1) * (ny + 1));
+  EXPECT_EQ(ndof, nnodes);
+  EXPECT_LT(nnodes, nverts);
+
+  std::vector<int> node_verts(nnodes);
+  ASSERT_EQ(xcgd_problem_get_node_verts(problem, node_verts.data()), XCGD_OK);
+  for (int v : node_verts) {
+    EXPECT_GE(v, 0);
+    EXPECT_LT(v, nverts);
+  }
+
+  check_solve_and_jacobian(problem);
+
+  // Moving and shrinking the circle recuts the mesh
+  std::vector<double> lsf2 = circle_lsf(nx, ny, 0.05, 0.3);
+  ASSERT_EQ(xcgd_problem_update_lsf(problem, lsf2.data()), XCGD_OK);
+  int ndof2;
+  ASSERT_EQ(xcgd_problem_get_sizes(problem, nullptr, nullptr, &ndof2, nullptr),
+            XCGD_OK);
+  EXPECT_LT(ndof2, ndof);
+  std::vector<double> sol2 = check_solve_and_jacobian(problem);
+
+  // psi^T dR/dphi against central differences of psi^T R(u; phi)
+  std::vector<double> psi(ndof2), p(nverts), dfdphi(nverts, 0.0);
+  for (int i = 0; i < ndof2; i++) psi[i] = 1.0 + 0.5 * std::sin(0.3 * i);
+  for (int i = 0; i < nverts; i++) p[i] = std::cos(0.7 * i);
+  ASSERT_EQ(xcgd_problem_lsf_adjoint_product(problem, sol2.data(), psi.data(),
+                                             dfdphi.data()),
+            XCGD_OK);
+  double exact = dot(dfdphi, p);
+
+  auto psi_res = [&](double h) {
+    std::vector<double> lsf_h(nverts);
+    for (int i = 0; i < nverts; i++) lsf_h[i] = lsf2[i] + h * p[i];
+    EXPECT_EQ(xcgd_problem_update_lsf(problem, lsf_h.data()), XCGD_OK);
+    int ndof_h;
+    xcgd_problem_get_sizes(problem, nullptr, nullptr, &ndof_h, nullptr);
+    EXPECT_EQ(ndof_h, ndof2);
+    std::vector<double> res(ndof_h);
+    xcgd_problem_residual(problem, sol2.data(), res.data());
+    return dot(psi, res);
+  };
+
+  double relerr_min = 1.0;
+  for (double h : {1e-4, 1e-5, 1e-6, 1e-7, 1e-8}) {
+    double fd = (psi_res(h) - psi_res(-h)) / (2.0 * h);
+    relerr_min = std::min(relerr_min, std::abs(fd - exact) / std::abs(exact));
+  }
+  EXPECT_LE(relerr_min, 1e-6);
+
+  xcgd_problem_destroy(problem);
+}
+
+TEST(capi, ElasticitySolveAndJacobian) {
+  int nx = 16, ny = 16;
+  std::vector<double> lsf = circle_lsf(nx, ny);
+  double params[7] = {1.0, 0.3, 0.0, -1.0, 0.0, 0.0, 1e6};
+
+  xcgd_problem* problem = nullptr;
+  ASSERT_EQ(xcgd_problem_create(XCGD_PHYSICS_LINEAR_ELASTICITY, 2, nx, ny, 1.0,
+                                1.0, lsf.data(), params, 7, &problem),
+            XCGD_OK)
+      << xcgd_get_last_error();
+
+  int nnodes, ndof;
+  ASSERT_EQ(xcgd_problem_get_sizes(problem, nullptr, &nnodes, &ndof, nullptr),
+            XCGD_OK);
+  EXPECT_EQ(ndof, 2 * nnodes);
+
+  std::vector<double> sol = check_solve_and_jacobian(problem);
+  EXPECT_GT(dot(sol, sol), 0.0);
+
+  xcgd_problem_destroy(problem);
+}
+
+TEST(capi, InvalidArguments) {
+  std::vector<double> lsf = circle_lsf(8, 8);
+  double params[7] = {1.0, 0.3, 0.0, -1.0, 0.0, 0.0, 1e6};
+  xcgd_problem* problem = nullptr;
+
+  EXPECT_EQ(xcgd_problem_create(XCGD_PHYSICS_LINEAR_ELASTICITY, 3, 8, 8, 1.0,
+                                1.0, lsf.data(), params, 7, &problem),
+            XCGD_ERROR_INVALID_ARGUMENT);
+  EXPECT_STREQ(xcgd_get_last_error(), "Np_1d must be 2, 4, 6 or 8, got 3");
+
+  EXPECT_EQ(xcgd_problem_create(XCGD_PHYSICS_LINEAR_ELASTICITY, 2, 8, 8, 1.0,
+                                1.0, lsf.data(), params, 3, &problem),
+            XCGD_ERROR_INVALID_ARGUMENT);
+  EXPECT_EQ(problem, nullptr);
+
+  EXPECT_EQ(xcgd_problem_residual(nullptr, lsf.data(), lsf.data()),
+            XCGD_ERROR_INVALID_ARGUMENT);
+}
+
+TEST(capi, FilterGradient) {
+  int nx = 8, ny = 8, nverts = (nx + 1) * (ny + 1);
+  xcgd_filter* filter = nullptr;
+  ASSERT_EQ(xcgd_filter_create(2, nx, ny, 1.0, 1.0, 0.1, &filter), XCGD_OK)
+      << xcgd_get_last_error();
+
+  std::vector<double> x(nverts), p(nverts), dfdphi(nverts), dfdx(nverts);
+  for (int i = 0; i < nverts; i++) {
+    x[i] = std::sin(0.3 * i);
+    p[i] = std::cos(0.7 * i);
+    dfdphi[i] = 1.0 + 0.01 * i;
+  }
+  ASSERT_EQ(
+      xcgd_filter_apply_gradient(filter, x.data(), dfdphi.data(), dfdx.data()),
+      XCGD_OK);
+
+  // The filter is linear, so the directional derivative is exact
+  std::vector<double> phi(nverts), phi_p(nverts);
+  ASSERT_EQ(xcgd_filter_apply(filter, p.data(), phi_p.data()), XCGD_OK);
+  double lhs = 0.0, rhs = 0.0;
+  for (int i = 0; i < nverts; i++) {
+    lhs += dfdphi[i] * phi_p[i];
+    rhs += dfdx[i] * p[i];
+  }
+  EXPECT_NEAR(lhs, rhs, 1e-10 * std::abs(lhs));
+
+  xcgd_filter_destroy(filter);
+}
@@ -120,3 +120,101 @@ TEST(quadrature, ComplexElementQuad) {
   test_complex_element_quad<4>(false);
   test_complex_element_quad<4>(true);
 }
+
+template <int Np_1d>
+void test_compressed_lsf_quad() {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d, Grid>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+
+  constexpr int p2 = 2 * (Np_1d - 1);
+
+  T lxy[2] = {1.0, 1.0};
+  int nxy[2] = {16, 16};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](T *x) {
+    return (x[0] - 0.5) * (x[0] - 0.5) + (x[1] - 0.45) * (x[1] - 0.45) -
+           0.33 * 0.33;
+  });
+
+  Quadrature quadrature(mesh);
+  Quadrature quadrature_c(mesh, true);
+
+  int npts = 0, npts_c = 0;
+  for (int elem : mesh.get_cut_elems()) {
+    std::vector<T> pts, wts, ns, pts_c, wts_c, ns_c;
+    npts += quadrature.get_quadrature_pts(elem, pts, wts, ns);
+    npts_c += quadrature_c.get_quadrature_pts(elem, pts_c, wts_c, ns_c);
+
+    EXPECT_LE(wts_c.size(), (p2 + 1) * (p2 + 1));
+    for (T w : wts_c) EXPECT_GT(w, 0.0);
+
+    // Moments of Q_{2p} are preserved
+    for (int i = 0; i <= p2; i++) {
+      for (int j = 0; j <= p2; j++) {
+        T m = 0.0, m_c = 0.0;
+        for (int q = 0; q < wts.size(); q++) {
+          m += wts[q] * pow(pts[2 * q], i) * pow(pts[2 * q + 1], j);
+        }
+        for (int q = 0; q < wts_c.size(); q++) {
+          m_c += wts_c[q] * pow(pts_c[2 * q], i) * pow(pts_c[2 * q + 1], j);
+        }
+        EXPECT_NEAR(m, m_c, 1e-13);
+      }
+    }
+
+    // Second query hits the cache and returns the same rule
+    std::vector<T> pts_c2, wts_c2, ns_c2;
+    quadrature_c.get_quadrature_pts(elem, pts_c2, wts_c2, ns_c2);
+    EXPECT_VEC_EQ(wts_c.size(), wts_c2, wts_c);
+  }
+  EXPECT_LE(npts_c, npts);
+}
+
+TEST(quadrature, CompressedLSFQuad) {
+  test_compressed_lsf_quad<2>();
+  test_compressed_lsf_quad<4>();
+}
+
+TEST(quadrature, PrecomputedLSFQuad) {
+  using T = double;
+  constexpr int Np_1d = 4;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, Np_1d, Grid>;
+  using Quadrature = GDLSFQuadrature2D<T, Np_1d>;
+
+  T lxy[2] = {1.0, 1.0};
+  int nxy[2] = {12, 12};
+  Grid grid(nxy, lxy);
+  Mesh mesh(grid, [](T *x) {
+    return (x[0] - 0.5) * (x[0] - 0.5) + (x[1] - 0.45) * (x[1] - 0.45) -
+           0.33 * 0.33;
+  });
+
+  Quadrature quadrature(mesh), quadrature_pre(mesh);
+  quadrature_pre.precompute(true);
+  EXPECT_TRUE(quadrature_pre.is_precomputed());
+
+  for (int elem = 0; elem < mesh.get_num_elements(); elem++) {
+    std::vector<T> pts, wts, ns, pts_grad, wts_grad;
+    std::vector<T> pts_p, wts_p, ns_p, pts_grad_p, wts_grad_p;
+    int nq = quadrature.get_quadrature_pts_grad(elem, pts, wts, ns, pts_grad,
+                                                wts_grad);
+    int nq_p = quadrature_pre.get_quadrature_pts_grad(
+        elem, pts_p, wts_p, ns_p, pts_grad_p, wts_grad_p);
+    EXPECT_EQ(nq, nq_p);
+    EXPECT_VEC_EQ(pts.size(), pts_p, pts);
+    EXPECT_VEC_EQ(wts.size(), wts_p, wts);
+    EXPECT_VEC_EQ(pts_grad.size(), pts_grad_p, pts_grad);
+    EXPECT_VEC_EQ(wts_grad.size(), wts_grad_p, wts_grad);
+  }
+
+  // A modified level set invalidates the affected entries
+  for (T &v : mesh.get_lsf_dof()) v -= 0.01;
+  int elem = *mesh.get_cut_elems().begin();
+  std::vector<T> pts, wts, ns, pts_p, wts_p, ns_p;
+  quadrature.get_quadrature_pts(elem, pts, wts, ns);
+  quadrature_pre.get_quadrature_pts(elem, pts_p, wts_p, ns_p);
+  EXPECT_VEC_EQ(wts.size(), wts_p, wts);
+}
@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <vector>
 
 #include "test_commons.h"
+#include "utils/cholesky.h"
+#include "utils/dense_lu.h"
+#include "utils/lanczos.h"
 #include "utils/linalg.h"
 
 TEST(linalg, matrix_norm_real) {
@@ -175,3 +180,374 @@ TEST(linalg, direct_inverse_complex) {
   direct_inverse(N, A_complex.data());
   EXPECT_CPLX_VEC_NEAR(N * N, A_complex, invA_complex, 1e-14);
 }
+
+TEST(linalg, dense_lu_real) {
+  constexpr static int N = 3;
+  std::vector<double> A_real = {
+      0.6128483560169078, 0.3411550443931325, 0.595417123046553,
+      0.2434199130278625, 0.2781149156388093, 0.3285230476819442,
+      0.4622183837010163, 0.1420136808581821, 0.2677995134802622};
+  std::vector<double> invA_real = {
+      -2.9788216009458655, 0.7284014421126703,  5.729453000363361,
+      -9.277857105765234,  11.893356698881258,  6.037924322763912,
+      10.061440025683329,  -7.5642404032057895, -9.356724852012928};
+  double Arcond_1 = 0.023720066942940154;
+
+  // Use a capacity larger than the actual size on purpose
+  DenseLU<double, 16> lu;
+  lu.factor(N, A_real.data());
+
+  std::vector<double> inv(N * N), invT(N * N);
+  for (int j = 0; j < N; j++) {
+    inv[j + N * j] = 1.0;
+    invT[j + N * j] = 1.0;
+    lu.solve(&inv[N * j]);
+    lu.solve_transpose(&invT[N * j]);
+  }
+
+  std::vector<double> invA_real_T(N * N);
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      invA_real_T[i + N * j] = invA_real[j + N * i];
+    }
+  }
+
+  EXPECT_VEC_NEAR(N * N, inv, invA_real, 1e-14);
+  EXPECT_VEC_NEAR(N * N, invT, invA_real_T, 1e-14);
+  EXPECT_NEAR(lu.rcond(), Arcond_1, 1e-15);
+}
+
+TEST(linalg, dense_lu_multi_rhs) {
+  constexpr static int N = 5;
+  constexpr static int nrhs = 3;
+  std::vector<double> A = {
+      0.706731212977905, 0.68769964262544,  0.0403897726979,
+      0.938114614228867, 0.634843691845117, 0.701326357373972,
+      0.949496362380056, 0.381210102344509, 0.620529103555476,
+      0.328581092257033, 0.916427131220972, 0.363038635033342,
+      0.888136365460139, 0.62235765962521,  0.726312010447533,
+      0.024358753608401, 0.299693362200554, 0.525309093242787,
+      0.172146044070358, 0.863963137178775, 0.541962310550557,
+      0.38973682118594,  0.026879405874587, 0.809411720646246,
+      0.151601808178256};
+
+  DenseLU<double, 25> lu;
+  lu.factor(N, A.data());
+
+  // All right hand sides at once match one at a time
+  std::vector<double> X(N * nrhs), X_ref(N * nrhs);
+  for (int k = 0; k < N * nrhs; k++) X[k] = X_ref[k] = 0.1 * k - 0.5;
+  lu.solve_transpose(nrhs, X.data());
+  for (int r = 0; r < nrhs; r++) lu.solve_transpose(&X_ref[r * N]);
+  EXPECT_VEC_NEAR(N * nrhs, X, X_ref, 1e-14);
+
+  // A^T x = b
+  for (int r = 0; r < nrhs; r++) {
+    for (int i = 0; i < N; i++) {
+      double bi = 0.0;
+      for (int j = 0; j < N; j++) bi += A[j + N * i] * X[r * N + j];
+      EXPECT_NEAR(bi, 0.1 * (r * N + i) - 0.5, 1e-13);
+    }
+  }
+}
+
+TEST(linalg, dense_lu_complex) {
+  constexpr static int N = 3;
+
+  std::vector<std::complex<double>> A_complex = {
+      std::complex<double>(0.2862329040974567, 0.4965586803311326),
+      std::complex<double>(0.3788716064341484, 0.5763470591857719),
+      std::complex<double>(0.4662159293548004, 0.0685092269706217),
+      std::complex<double>(0.1086360834430374, 0.7807212213919965),
+      std::complex<double>(0.7983815346915806, 0.2644385569400267),
+      std::complex<double>(0.9575083145537888, 0.479220244931871),
+      std::complex<double>(0.7336319429638741, 0.494972184818358),
+      std::complex<double>(0.8590125320426135, 0.2732431474400324),
+      std::complex<double>(0.9156859048461716, 0.2836910065179017)};
+
+  std::vector<std::complex<double>> invA_complex = {
+      std::complex<double>(-0.6678107987709528, +0.1332422409236903),
+      std::complex<double>(-1.4878523426213153, -0.6131323393520564),
+      std::complex<double>(1.8424002904065686, +0.8311227971159687),
+      std::complex<double>(0.2132381375706667, -1.9312741109944134),
+      std::complex<double>(0.850679591253277, +0.5915611018245559),
+      std::complex<double>(-0.7873118461104905, +0.1474825682472335),
+      std::complex<double>(0.4115722070343439, +1.874835538643437),
+      std::complex<double>(0.3557461759440042, +0.3764786950099526),
+      std::complex<double>(0.3311290513160524, -1.667793795720977)};
+
+  DenseLU<std::complex<double>, N * N> lu;
+  lu.factor(N, A_complex.data());
+
+  std::vector<std::complex<double>> inv(N * N);
+  for (int j = 0; j < N; j++) {
+    inv[j + N * j] = 1.0;
+    lu.solve(&inv[N * j]);
+  }
+  EXPECT_CPLX_VEC_NEAR(N * N, inv, invA_complex, 1e-14);
+}
+
+TEST(linalg, bsr_axpy) {
+  // 3 x 3 block rows of 2 x 2 blocks, block tridiagonal
+  constexpr int M = 2;
+  int nbrows = 3, nnz = 7;
+  std::vector<int> rowp = {0, 2, 5, 7};
+  std::vector<int> cols = {0, 1, 0, 1, 2, 1, 2};
+  std::vector<double> vals(M * M * nnz);
+  for (int i = 0; i < vals.size(); i++) vals[i] = 0.1 * (i + 1);
+  GalerkinBSRMat<double, M> bsr(nbrows, nnz, rowp.data(), cols.data(),
+                                vals.data());
+
+  // Dense reference
+  int n = M * nbrows;
+  std::vector<double> A(n * n, 0.0);
+  for (int i = 0; i < nbrows; i++) {
+    for (int jp = rowp[i]; jp < rowp[i + 1]; jp++) {
+      for (int ii = 0; ii < M; ii++) {
+        for (int jj = 0; jj < M; jj++) {
+          A[n * (M * i + ii) + M * cols[jp] + jj] =
+              vals[M * M * jp + M * ii + jj];
+        }
+      }
+    }
+  }
+
+  std::vector<double> x = {1.0, -2.0, 3.0, 0.5, -1.5, 2.5};
+  std::vector<double> y(n, 1.0), y_expect(n, 1.0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) y_expect[i] += A[n * i + j] * x[j];
+  }
+
+  bsr.axpy(x.data(), y.data());
+  EXPECT_VEC_NEAR(n, y, y_expect, 1e-14);
+}
+
+TEST(linalg, symmetric_bsr) {
+  // 2 x 3 grid of nodes, 2 quadrilateral elements with random SPD element
+  // matrices of 2 x 2 blocks
+  constexpr int M = 2, nnodes_per_elem = 4;
+  int nbrows = 6, n = M * nbrows;
+  int conn[2][nnodes_per_elem] = {{0, 1, 4, 3}, {1, 2, 5, 4}};
+  std::vector<int> rowp = {0, 4, 10, 14, 18, 24, 28};
+  std::vector<int> cols = {0, 1, 3, 4, 0, 1, 2, 3, 4, 5, 1, 2, 4, 5,
+                           0, 1, 3, 4, 0, 1, 2, 3, 4, 5, 1, 2, 4, 5};
+
+  GalerkinBSRMat<double, M> full(nbrows, cols.size(), rowp.data(),
+                                 cols.data());
+  full.zero();
+  SymmetricGalerkinBSRMat<double, M> sym(nbrows, rowp.data(), cols.data());
+  EXPECT_EQ(sym.nnz, (full.nnz + nbrows) / 2);
+
+  constexpr int ne = M * nnodes_per_elem;
+  srand(0);
+  for (int e = 0; e < 2; e++) {
+    double B[ne * ne], K[ne * ne] = {};
+    for (int i = 0; i < ne * ne; i++) B[i] = (double)rand() / RAND_MAX;
+    for (int i = 0; i < ne; i++) {
+      for (int j = 0; j < ne; j++) {
+        for (int k = 0; k < ne; k++) {
+          K[ne * i + j] += B[ne * k + i] * B[ne * k + j];
+        }
+      }
+      K[ne * i + i] += 1.0;
+    }
+    full.add_block_values<nnodes_per_elem>(nnodes_per_elem, conn[e], K);
+    sym.add_block_values<nnodes_per_elem>(nnodes_per_elem, conn[e], K);
+  }
+
+  std::vector<double> x(n), y(n, 1.0), y_expect(n, 1.0);
+  for (int i = 0; i < n; i++) x[i] = 0.5 * i - 2.0;
+  full.axpy(x.data(), y_expect.data());
+  sym.axpy(x.data(), y.data());
+  EXPECT_VEC_NEAR(n, y, y_expect, 1e-13);
+
+  // The exported upper triangle is factored directly
+  std::vector<double> b(n, 0.0);
+  sym.axpy(x.data(), b.data());
+  SparseUtils::CSCMat<double>* csc = sym.to_csc();
+  EXPECT_EQ(csc->colp[n], (M * M * full.nnz + n) / 2);
+  SimplicialCholesky<double> chol(csc, true);
+  chol.factor();
+  chol.solve(b.data());
+  EXPECT_VEC_NEAR(n, b, x, 1e-12);
+  delete csc;
+}
+
+TEST(linalg, lanczos_condition_number) {
+  // 1D Laplacian, eigenvalues are 2 - 2 cos(k pi / (n + 1)), k = 1, ..., n
+  int n = 500;
+  auto matvec = [n](const double* x, double* y) {
+    for (int i = 0; i < n; i++) {
+      y[i] = 2.0 * x[i] - (i > 0 ? x[i - 1] : 0.0) -
+             (i < n - 1 ? x[i + 1] : 0.0);
+    }
+  };
+
+  // Thomas algorithm
+  auto inv_solve = [n](double* x) {
+    std::vector<double> c(n), d(n);
+    c[0] = -0.5;
+    d[0] = 0.5 * x[0];
+    for (int i = 1; i < n; i++) {
+      double m = 2.0 + c[i - 1];
+      c[i] = -1.0 / m;
+      d[i] = (x[i] + d[i - 1]) / m;
+    }
+    x[n - 1] = d[n - 1];
+    for (int i = n - 2; i >= 0; i--) x[i] = d[i] - c[i] * x[i + 1];
+  };
+
+  double lambda_min = 2.0 - 2.0 * cos(M_PI / (n + 1));
+  double lambda_max = 2.0 - 2.0 * cos(n * M_PI / (n + 1));
+
+  EigenEstimate est = estimate_eigenvalues<double>(n, matvec, inv_solve);
+  EXPECT_NEAR(est.lambda_min / lambda_min, 1.0, 1e-8);
+  EXPECT_NEAR(est.lambda_max / lambda_max, 1.0, 1e-3);
+  EXPECT_NEAR(est.cond / (lambda_max / lambda_min), 1.0, 1e-3);
+}
+
+// Eigenvalues of a dense symmetric matrix by cyclic Jacobi rotations
+static std::vector<double> dense_symmetric_eigenvalues(int n,
+                                                       std::vector<double> A) {
+  for (int sweep = 0; sweep < 100; sweep++) {
+    double off = 0.0;
+    for (int i = 0; i < n; i++) {
+      for (int j = i + 1; j < n; j++) off += A[n * i + j] * A[n * i + j];
+    }
+    if (off < 1e-30) break;
+
+    for (int p = 0; p < n; p++) {
+      for (int q = p + 1; q < n; q++) {
+        if (A[n * p + q] == 0.0) continue;
+        double theta = (A[n * q + q] - A[n * p + p]) / (2.0 * A[n * p + q]);
+        double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                   (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+        for (int k = 0; k < n; k++) {
+          double akp = A[n * k + p], akq = A[n * k + q];
+          A[n * k + p] = c * akp - s * akq;
+          A[n * k + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; k++) {
+          double apk = A[n * p + k], aqk = A[n * q + k];
+          A[n * p + k] = c * apk - s * aqk;
+          A[n * q + k] = s * apk + c * aqk;
+        }
+      }
+    }
+  }
+
+  std::vector<double> eigs(n);
+  for (int i = 0; i < n; i++) eigs[i] = A[n * i + i];
+  std::sort(eigs.begin(), eigs.end());
+  return eigs;
+}
+
+TEST(linalg, lanczos_bsr_dirichlet) {
+  // Bilinear elements on a 4 x 4 grid, the element stiffness is the Laplacian
+  // coupled between the M = 2 dof of a node, the left edge is clamped
+  constexpr int M = 2, nnodes_per_elem = 4, ne = M * nnodes_per_elem;
+  constexpr int nx = 4, nnodes_x = nx + 1;
+  int nbrows = nnodes_x * nnodes_x, n = M * nbrows;
+
+  std::vector<int> rowp = {0}, cols;
+  for (int j = 0; j < nnodes_x; j++) {
+    for (int i = 0; i < nnodes_x; i++) {
+      for (int jj = std::max(j - 1, 0); jj <= std::min(j + 1, nx); jj++) {
+        for (int ii = std::max(i - 1, 0); ii <= std::min(i + 1, nx); ii++) {
+          cols.push_back(nnodes_x * jj + ii);
+        }
+      }
+      rowp.push_back(cols.size());
+    }
+  }
+
+  double Klap[nnodes_per_elem][nnodes_per_elem] = {{4.0, -1.0, -2.0, -1.0},
+                                                   {-1.0, 4.0, -1.0, -2.0},
+                                                   {-2.0, -1.0, 4.0, -1.0},
+                                                   {-1.0, -2.0, -1.0, 4.0}};
+  double C[M][M] = {{2.0, 1.0}, {1.0, 2.0}};
+  double K[ne * ne];
+  for (int a = 0; a < nnodes_per_elem; a++) {
+    for (int b = 0; b < nnodes_per_elem; b++) {
+      for (int ii = 0; ii < M; ii++) {
+        for (int jj = 0; jj < M; jj++) {
+          K[ne * (M * a + ii) + M * b + jj] = Klap[a][b] * C[ii][jj] / 6.0;
+        }
+      }
+    }
+  }
+
+  GalerkinBSRMat<double, M> bsr(nbrows, cols.size(), rowp.data(),
+                                cols.data());
+  SymmetricGalerkinBSRMat<double, M> sym(nbrows, rowp.data(), cols.data());
+  bsr.zero();
+  for (int j = 0; j < nx; j++) {
+    for (int i = 0; i < nx; i++) {
+      int conn[nnodes_per_elem] = {nnodes_x * j + i, nnodes_x * j + i + 1,
+                                   nnodes_x * (j + 1) + i + 1,
+                                   nnodes_x * (j + 1) + i};
+      bsr.add_block_values<nnodes_per_elem>(nnodes_per_elem, conn, K);
+      sym.add_block_values<nnodes_per_elem>(nnodes_per_elem, conn, K);
+    }
+  }
+
+  std::vector<int> bc_dof;
+  std::vector<char> is_bc(n, 0);
+  for (int j = 0; j < nnodes_x; j++) {
+    for (int d = 0; d < M; d++) {
+      bc_dof.push_back(M * nnodes_x * j + d);
+      is_bc[M * nnodes_x * j + d] = 1;
+    }
+  }
+
+  // Dense reference of the stiffness matrix without the bc dof
+  std::vector<double> A(n * n, 0.0);
+  std::vector<double> x(n), y(n);
+  for (int k = 0; k < n; k++) {
+    std::fill(x.begin(), x.end(), 0.0);
+    std::fill(y.begin(), y.end(), 0.0);
+    x[k] = 1.0;
+    bsr.axpy(x.data(), y.data());
+    for (int i = 0; i < n; i++) A[n * i + k] = y[i];
+  }
+  std::vector<int> free_dof;
+  for (int i = 0; i < n; i++) {
+    if (!is_bc[i]) free_dof.push_back(i);
+  }
+  int nfree = free_dof.size();
+  std::vector<double> A_free(nfree * nfree);
+  for (int i = 0; i < nfree; i++) {
+    for (int j = 0; j < nfree; j++) {
+      A_free[nfree * i + j] = A[n * free_dof[i] + free_dof[j]];
+    }
+  }
+  std::vector<double> eigs = dense_symmetric_eigenvalues(nfree, A_free);
+
+  // The identity rows of the bc dof add the eigenvalue 1, which lies inside
+  // the spectrum of the free dof here, so the extremal eigenvalues are the
+  // ones of the reduced matrix
+  double lambda_min = eigs.front(), lambda_max = eigs.back();
+  ASSERT_LT(lambda_min, 1.0);
+  ASSERT_GT(lambda_max, 1.0);
+
+  // Plain Lanczos for both ends, the Ritz values are accurate to about the
+  // default rtol = 1e-6
+  EigenEstimate est = estimate_eigenvalues(&bsr, bc_dof);
+  EXPECT_TRUE(est.converged);
+  EXPECT_NEAR(est.lambda_min / lambda_min, 1.0, 1e-5);
+  EXPECT_NEAR(est.lambda_max / lambda_max, 1.0, 1e-5);
+
+  // Shift-invert with the factor of the matrix the apps solve with
+  sym.zero_rows_and_columns(bc_dof.size(), bc_dof.data());
+  SparseUtils::CSCMat<double>* csc = sym.to_csc();
+  SimplicialCholesky<double> chol(csc, true);
+  chol.factor();
+  est = estimate_eigenvalues(&bsr, bc_dof,
+                             [&chol](double* x) { chol.solve(x); });
+  EXPECT_TRUE(est.converged);
+  EXPECT_NEAR(est.lambda_min / lambda_min, 1.0, 1e-5);
+  EXPECT_NEAR(est.lambda_max / lambda_max, 1.0, 1e-5);
+  EXPECT_NEAR(est.cond / (lambda_max / lambda_min), 1.0, 1e-5);
+  delete csc;
+}
@@ -166,3 +166,53 @@ void generate_lsf_mesh(bool flip = false) {
 
 TEST(mesh, LSFPositiveNp4) { generate_lsf_mesh<4>(true); }
 TEST(mesh, LSFNegativeNp4) { generate_lsf_mesh<4>(false); }
+
+TEST(mesh, CutMeshOrdering) {
+  using T = double;
+  using Grid = StructuredGrid2D<T>;
+  using Mesh = CutMesh<T, 4>;
+
+  int nxy[2] = {24, 17};
+  T lxy[2] = {3.0, 2.0};
+  Grid grid(nxy, lxy);
+  auto lsf = [](T x[]) {
+    return (x[0] - 1.5) * (x[0] - 1.5) + (x[1] - 1.0) * (x[1] - 1.0) - 0.7;
+  };
+  Mesh mesh0(grid, lsf);
+
+  for (auto ordering : {MeshOrdering::MORTON, MeshOrdering::HILBERT,
+                        MeshOrdering::RCM}) {
+    Mesh mesh(grid, lsf, ordering);
+    EXPECT_EQ(mesh.get_num_nodes(), mesh0.get_num_nodes());
+    EXPECT_EQ(mesh.get_num_elements(), mesh0.get_num_elements());
+
+    const auto& node_perm = mesh.get_node_perm();
+    const auto& elem_perm = mesh.get_elem_perm();
+    for (int i = 0; i < mesh.get_num_nodes(); i++) {
+      EXPECT_EQ(mesh.get_node_vert(i), mesh0.get_node_vert(node_perm[i]));
+      EXPECT_EQ(mesh.get_node_iperm()[node_perm[i]], i);
+    }
+
+    // Same elements with the same stencils, only numbered differently
+    for (int e = 0; e < mesh.get_num_elements(); e++) {
+      int e0 = elem_perm[e];
+      EXPECT_EQ(mesh.get_elem_cell(e), mesh0.get_elem_cell(e0));
+      EXPECT_EQ(mesh.is_cut_elem(e), mesh0.is_cut_elem(e0));
+      EXPECT_EQ(mesh.is_regular_stencil_elem(e),
+                mesh0.is_regular_stencil_elem(e0));
+
+      int nodes[Mesh::max_nnodes_per_element];
+      int nodes0[Mesh::max_nnodes_per_element];
+      int nnodes = mesh.get_elem_dof_nodes(e, nodes);
+      EXPECT_EQ(nnodes, mesh0.get_elem_dof_nodes(e0, nodes0));
+      for (int j = 0; j < nnodes; j++) {
+        EXPECT_EQ(node_perm[nodes[j]], nodes0[j]);
+      }
+    }
+
+    std::vector<T> vals(2 * mesh.get_num_nodes());
+    for (int i = 0; i < vals.size(); i++) vals[i] = T(i);
+    std::vector<T> vals_natural = mesh.to_natural_node_order(vals.data(), 2);
+    EXPECT_EQ(mesh.from_natural_node_order(vals_natural.data(), 2), vals);
+  }
+}
@@ -68,8 +68,9 @@ void write_vtk(const Mesh& mesh, const char* vtkname, const std::vector<T>& sol,
 
   // Write condition numbers of Vandermonde matrices
   std::vector<double> conds(mesh.get_num_elements());
+  std::map<int, double> logged_conds = VandermondeCondLogger::get_conds();
   for (int elem = 0; elem < mesh.get_num_elements(); elem++) {
-    conds[elem] = VandermondeCondLogger::get_conds().at(elem);
+    conds[elem] = logged_conds.at(elem);
   }
   vtk.write_cell_sol("cond", conds.data());
 }
@@ -6,6 +6,7 @@
 #include "elements/gd_vandermonde.h"
 #include "sparse_utils/sparse_utils.h"
 #include "test_commons.h"
+#include "utils/cholesky.h"
 #include "utils/json.h"
 #include "utils/linalg.h"
 #include "utils/misc.h"
@@ -136,3 +137,105 @@ TEST(sparse_utils, Poisson) {
     csc = nullptr;
   }
 }
+
+TEST(sparse_utils, MixedPrecisionPoisson) {
+  using T = double;
+  int constexpr Np_1d = 4;
+  using Grid = StructuredGrid2D<T>;
+  using Quadrature = GDGaussQuadrature2D<T, Np_1d>;
+  using Mesh = GridMesh<T, Np_1d>;
+  using Basis = GDBasis2D<T, Mesh>;
+
+  auto source_fun = [](const A2D::Vec<T, Basis::spatial_dim>& xloc) {
+    return T(1.0);
+  };
+  using Poisson = PoissonApp<T, Mesh, Quadrature, Basis, typeof(source_fun)>;
+
+  using BSRMat = GalerkinBSRMat<T, Poisson::Physics::dof_per_node>;
+  using CSCMat = SparseUtils::CSCMat<T>;
+
+  int nxy[2] = {32, 32};
+  T lxy[2] = {2.0, 2.0};
+  T xy0[2] = {-1.0, -1.0};
+  Grid grid(nxy, lxy, xy0);
+  Mesh mesh(grid);
+  Quadrature quadrature(mesh);
+  Basis basis(mesh);
+
+  Poisson poisson(mesh, quadrature, basis, source_fun);
+
+  std::vector<int> dof_bcs;
+  double tol = 1e-6, xmin = -1.0, xmax = 1.0, ymin = -1.0, ymax = 1.0;
+
+  for (int i = 0; i < mesh.get_num_nodes(); i++) {
+    T xloc[Basis::spatial_dim];
+    mesh.get_node_xloc(i, xloc);
+    if (freal(xloc[0]) < xmin + tol or freal(xloc[1]) < ymin + tol or
+        freal(xloc[0]) > freal(xmax) - tol or
+        freal(xloc[1]) > freal(ymax) - tol) {
+      dof_bcs.push_back(i);
+    }
+  }
+
+  BSRMat* bsr = poisson.jacobian(dof_bcs);
+  CSCMat* csc = SparseUtils::bsr_to_csc(bsr);
+  csc->zero_columns(dof_bcs.size(), dof_bcs.data());
+
+  std::vector<T> sol_expected(csc->ncols, 0.0), rhs(csc->ncols, 0.0);
+  for (int i = 0; i < csc->ncols; i++) {
+    sol_expected[i] = T(rand()) / RAND_MAX;
+  }
+  for (int dof : dof_bcs) {
+    sol_expected[dof] = 0.0;
+  }
+  bsr->axpy(sol_expected.data(), rhs.data());
+
+  // The single precision factor alone is only accurate to ~1e-6
+  MixedPrecisionCholesky<T> chol(csc);
+  chol.factor();
+  std::vector<T> sol = rhs;
+  chol.solve(sol.data());
+
+  EXPECT_FALSE(chol.is_fallback());
+  EXPECT_EQ(chol.get_num_fallbacks(), 0);
+  EXPECT_GT(chol.get_num_refinements(), 1);
+  EXPECT_VEC_NEAR(sol.size(), sol, sol_expected, 1e-10);
+
+  // A single refinement step can't reach the tolerance, the solve falls back
+  // to the factor in double precision and counts it
+  MixedPrecisionCholesky<T> chol_fallback(csc, 1e-12, 1);
+  chol_fallback.factor();
+  sol = rhs;
+  chol_fallback.solve(sol.data());
+  EXPECT_TRUE(chol_fallback.is_fallback());
+  EXPECT_EQ(chol_fallback.get_num_fallbacks(), 1);
+  EXPECT_VEC_NEAR(sol.size(), sol, sol_expected, 1e-10);
+
+  // Solve again in double precision only
+  SimplicialCholesky<T> chol_double(csc);
+  chol_double.factor();
+  sol = rhs;
+  chol_double.solve(sol.data());
+  EXPECT_VEC_NEAR(sol.size(), sol, sol_expected, 1e-12);
+
+  // Block solve of several right hand sides against the same factor
+  int n = csc->ncols, nrhs = 3;
+  std::vector<T> rhs_block(n * nrhs), sol_block_expected(n * nrhs);
+  for (int r = 0; r < nrhs; r++) {
+    for (int i = 0; i < n; i++) {
+      rhs_block[r * n + i] = (r + 1.0) * rhs[i];
+      sol_block_expected[r * n + i] = (r + 1.0) * sol_expected[i];
+    }
+  }
+  std::vector<T> sol_block = rhs_block;
+  chol_double.solve(sol_block.data(), nrhs);
+  EXPECT_VEC_NEAR(sol_block.size(), sol_block, sol_block_expected, 1e-11);
+
+  // Factors without a block solve fall back to one solve per right hand side
+  sol_block = rhs_block;
+  solve_multiple_rhs(chol, sol_block.data(), n, nrhs);
+  EXPECT_VEC_NEAR(sol_block.size(), sol_block, sol_block_expected, 1e-9);
+
+  delete bsr;
+  delete csc;
+}
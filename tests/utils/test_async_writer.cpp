@@ -0,0 +1,56 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/async_writer.h"
+
+TEST(utils, AsyncWriterOrderAndFlush) {
+  std::vector<int> order;
+  {
+    AsyncWriter writer(2);
+    for (int i = 0; i < 10; i++) {
+      writer.submit([&order, i]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        order.push_back(i);
+      });
+    }
+    writer.flush();
+    EXPECT_EQ(order.size(), 10);
+
+    // The destructor runs the remaining tasks
+    writer.submit([&order]() { order.push_back(10); });
+  }
+  ASSERT_EQ(order.size(), 11);
+  for (int i = 0; i < 11; i++) EXPECT_EQ(order[i], i);
+}
+
+TEST(utils, AsyncWriterBackPressure) {
+  std::atomic<int> submitted{0}, done{0};
+  AsyncWriter writer(1);
+  for (int i = 0; i < 5; i++) {
+    writer.submit([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      done++;
+    });
+    submitted++;
+
+    // At most one task waits in the queue and one is being executed
+    EXPECT_LE(submitted - done, 2);
+  }
+  writer.flush();
+  EXPECT_EQ(done, 5);
+  EXPECT_GT(writer.get_blocked_time(), 0.0);
+}
+
+TEST(utils, AsyncWriterRethrows) {
+  AsyncWriter writer(4);
+  writer.submit([]() { throw std::runtime_error("disk full"); });
+  EXPECT_THROW(writer.flush(), std::runtime_error);
+
+  // The error is reported once
+  writer.submit([]() {});
+  EXPECT_NO_THROW(writer.flush());
+}
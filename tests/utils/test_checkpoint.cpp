@@ -0,0 +1,106 @@
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/checkpoint.h"
+
+TEST(utils, CheckpointRoundTrip) {
+  std::vector<double> dvs(1001);
+  std::vector<int> dof(37);
+  std::vector<std::complex<double>> z(5);
+  for (int i = 0; i < dvs.size(); i++) dvs[i] = 0.1 * i - 3.0;
+  for (int i = 0; i < dof.size(); i++) dof[i] = 7 * i;
+  for (int i = 0; i < z.size(); i++) z[i] = {1.0 * i, -2.0 * i};
+
+  CheckpointWriter writer;
+  writer.add("dvs", dvs);
+  writer.add("dof", dof);
+  writer.add("z", z);
+  writer.add("empty", std::vector<double>{});
+  writer.add_scalar<std::int64_t>("iter", 42);
+  writer.add_string("cfg", "{\"nx\": 64}");
+  writer.write("checkpoint_roundtrip.xcgd");
+
+  CheckpointReader reader("checkpoint_roundtrip.xcgd");
+  EXPECT_EQ(reader.get_version(), checkpoint_version);
+  EXPECT_TRUE(reader.has("dvs"));
+  EXPECT_FALSE(reader.has("phi"));
+
+  EXPECT_EQ(reader.get<double>("dvs"), dvs);
+  EXPECT_EQ(reader.get<int>("dof"), dof);
+  EXPECT_EQ(reader.get<std::complex<double>>("z"), z);
+  EXPECT_TRUE(reader.get<double>("empty").empty());
+  EXPECT_EQ(reader.get_scalar<std::int64_t>("iter"), 42);
+  EXPECT_EQ(reader.get_string("cfg"), "{\"nx\": 64}");
+
+  // Arrays are used in place from the mapping
+  std::size_t count = 0;
+  const double* ptr = reader.view<double>("dvs", &count);
+  EXPECT_EQ(count, dvs.size());
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % checkpoint_alignment, 0);
+
+  EXPECT_THROW(reader.get<float>("dvs"), std::runtime_error);
+  EXPECT_THROW(reader.get<double>("phi"), std::runtime_error);
+  EXPECT_THROW(reader.get_scalar<double>("dvs"), std::runtime_error);
+}
+
+TEST(utils, CheckpointInvalidFile) {
+  EXPECT_THROW(CheckpointReader("checkpoint_nonexistent.xcgd"),
+               std::runtime_error);
+
+  {
+    std::ofstream out("checkpoint_invalid.xcgd", std::ios::binary);
+    out << std::string(128, 'x');
+  }
+  EXPECT_THROW(CheckpointReader("checkpoint_invalid.xcgd"), std::runtime_error);
+
+  // A checkpoint from a newer version is rejected
+  CheckpointWriter writer;
+  writer.add_scalar<std::int64_t>("iter", 1);
+  writer.write("checkpoint_newer.xcgd");
+  {
+    std::fstream f("checkpoint_newer.xcgd",
+                   std::ios::binary | std::ios::in | std::ios::out);
+    std::uint32_t version = checkpoint_version + 1;
+    f.seekp(8);
+    f.write(reinterpret_cast<const char*>(&version), 4);
+  }
+  EXPECT_THROW(CheckpointReader("checkpoint_newer.xcgd"), std::runtime_error);
+}
+
+TEST(utils, CheckpointLittleEndian) {
+  CheckpointWriter writer;
+  writer.add_scalar<double>("one", 1.0);
+  writer.add_scalar<std::int32_t>("n", 0x0a0b0c0d);
+  writer.write("checkpoint_le.xcgd");
+
+  std::ifstream in("checkpoint_le.xcgd", std::ios::binary);
+  std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                                  std::istreambuf_iterator<char>());
+
+  // Version and byte order mark
+  EXPECT_EQ(std::vector<std::uint8_t>(bytes.begin() + 8, bytes.begin() + 16),
+            std::vector<std::uint8_t>({1, 0, 0, 0, 4, 3, 2, 1}));
+
+  // Entries are written in name order, "n" then "one"
+  EXPECT_EQ(std::vector<std::uint8_t>(bytes.begin() + 64, bytes.begin() + 68),
+            std::vector<std::uint8_t>({0x0d, 0x0c, 0x0b, 0x0a}));
+  EXPECT_EQ(std::vector<std::uint8_t>(bytes.begin() + 128, bytes.begin() + 136),
+            std::vector<std::uint8_t>({0, 0, 0, 0, 0, 0, 0xf0, 0x3f}));
+
+  CheckpointReader reader("checkpoint_le.xcgd");
+  EXPECT_EQ(reader.get_scalar<double>("one"), 1.0);
+  EXPECT_EQ(reader.get_scalar<std::int32_t>("n"), 0x0a0b0c0d);
+
+  // The conversion of a big-endian machine
+  std::vector<std::uint8_t> words = {1, 2, 3, 4, 5, 6, 7, 8};
+  checkpoint_byteswap(words.data(), words.size(), 4);
+  EXPECT_EQ(words, std::vector<std::uint8_t>({4, 3, 2, 1, 8, 7, 6, 5}));
+  checkpoint_byteswap(words.data(), words.size(), 4);
+  EXPECT_EQ(words, std::vector<std::uint8_t>({1, 2, 3, 4, 5, 6, 7, 8}));
+}
@@ -0,0 +1,82 @@
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/memory.h"
+
+TEST(utils, MemoryBytes) {
+  std::vector<double> v(100);
+  v.reserve(200);
+  EXPECT_EQ(memory_bytes(v), 200 * sizeof(double));
+
+  std::vector<std::vector<int>> vv(3, std::vector<int>(10));
+  EXPECT_EQ(memory_bytes(vv),
+            3 * sizeof(std::vector<int>) + 3 * 10 * sizeof(int));
+
+  std::set<int> s = {1, 2, 3};
+  std::map<int, int> m = {{1, 2}, {3, 4}};
+  EXPECT_EQ(memory_bytes(s), 3 * (sizeof(int) + 4 * sizeof(void*)));
+  EXPECT_EQ(memory_bytes(m),
+            2 * (sizeof(std::pair<const int, int>) + 4 * sizeof(void*)));
+
+  // The vectors held by the map are counted
+  std::unordered_map<int, std::vector<int>> um;
+  um[0] = std::vector<int>(1000);
+  EXPECT_GE(memory_bytes(um), 1000 * sizeof(int));
+}
+
+TEST(utils, MemoryReport) {
+  MemoryReport mesh;
+  mesh.add("elem_nodes", 1000);
+  mesh.add("cut_elems", 200);
+
+  MemoryReport report;
+  report.merge("mesh", mesh);
+  report.add("rhs", 300);
+  report.add_transient("jacobian", 5000);
+  report.add_transient("solve.factor", 2000);
+  report.add_transient("solve", 8000);
+
+  EXPECT_EQ(report.get_bytes("mesh.elem_nodes"), 1000);
+  EXPECT_EQ(report.get_bytes("none"), 0);
+  EXPECT_EQ(report.get_persistent_bytes(), 1500);
+  EXPECT_EQ(report.get_peak_transient_bytes(), 8000);
+  EXPECT_EQ(report.get_peak_bytes(), 9500);
+  EXPECT_EQ(report.get_num_unknown(), 0);
+
+  // Entries of unknown size are left out of the totals
+  report.add("factor", MemoryReport::unknown);
+  report.add_transient("factor_solve", MemoryReport::unknown);
+  EXPECT_EQ(report.get_bytes("factor"), MemoryReport::unknown);
+  EXPECT_EQ(report.get_num_unknown(), 2);
+  EXPECT_EQ(report.get_persistent_bytes(), 1500);
+  EXPECT_EQ(report.get_peak_transient_bytes(), 8000);
+}
+
+TEST(utils, MemoryTracker) {
+  static std::ptrdiff_t hooked = 0;
+  MemoryTracker::set_hook(
+      [](std::ptrdiff_t delta, std::size_t) { hooked += delta; });
+  MemoryTracker::reset_peak();
+  std::size_t base = MemoryTracker::get_current_bytes();
+
+  {
+    TrackedVector<double> a(1000);
+    EXPECT_EQ(MemoryTracker::get_current_bytes(), base + 8000);
+    {
+      TrackedVector<int> b(500);
+      EXPECT_EQ(MemoryTracker::get_current_bytes(), base + 10000);
+    }
+    EXPECT_EQ(MemoryTracker::get_current_bytes(), base + 8000);
+    EXPECT_EQ(memory_bytes(a), 8000);
+  }
+  EXPECT_EQ(MemoryTracker::get_current_bytes(), base);
+  EXPECT_EQ(MemoryTracker::get_peak_bytes(), base + 10000);
+  EXPECT_EQ(hooked, 0);
+
+  MemoryTracker::set_hook(nullptr);
+  MemoryTracker::reset_peak();
+  EXPECT_EQ(MemoryTracker::get_peak_bytes(), base);
+}
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/mesher.h"
+
+TEST(utils, AbaqusInpReader) {
+  std::ofstream out("mesher_test.inp");
+  out << "*Heading\n"
+         "** Job name: test\n"
+         "*Part, name=Part-1\n"
+         "*NODE\n"
+         "      2,   1.5,  -2.25e-1, 3\r\n"
+         "** comment within a block\n"
+         "\n"
+         "      1, 0.1 , .5 ,   -1.E+2\n"
+         "3, 0.30000000000000004, 1.7976931348623157e308, 4.9e-324\n"
+         "*Element, type=C3D10\n"
+         "2, 1, 2, 3, 1, 2, 3, 1, 2, 3, 1\n"
+         "1, 3, 2, 1, 3, 2, 1, 3, 2, 1, 3\n"
+         "*Nset, nset=Set-1\n"
+         " 1, 2\n"
+         "*Node Output\n"
+         "U, RF\n";
+  out.close();
+
+  int num_elements, num_nodes, *element_nodes;
+  double* xloc;
+  load_mesh<double>("mesher_test.inp", &num_elements, &num_nodes,
+                    &element_nodes, &xloc);
+
+  EXPECT_EQ(num_nodes, 3);
+  EXPECT_EQ(num_elements, 2);
+  std::vector<double> x(xloc, xloc + 3 * num_nodes);
+  std::vector<double> x_expect = {0.1,    0.5, -100.0, 1.5,
+                                  -0.225, 3.0, 0.30000000000000004,
+                                  1.7976931348623157e308, 4.9e-324};
+  EXPECT_EQ(x, x_expect);
+
+  std::vector<int> conn(element_nodes, element_nodes + 10 * num_elements);
+  std::vector<int> conn_expect = {2, 1, 0, 2, 1, 0, 2, 1, 0, 2,
+                                  0, 1, 2, 0, 1, 2, 0, 1, 2, 0};
+  EXPECT_EQ(conn, conn_expect);
+
+  delete[] element_nodes;
+  delete[] xloc;
+}
+
+TEST(utils, AbaqusInpReaderChunks) {
+  int nnodes = 5000, nelems = 3000;
+  std::vector<double> x(3 * nnodes);
+  std::vector<int> conn(10 * nelems);
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> dist(-1e3, 1e3);
+  for (double& v : x) v = dist(rng);
+  for (int i = 0; i < conn.size(); i++) conn[i] = rng() % nnodes;
+
+  // Labels in reverse order, x and y in round-trip precision, z in short
+  // format that is parsed by strtod as reference
+  FILE* fp = std::fopen("mesher_test_chunks.inp", "w");
+  std::fprintf(fp, "*Node\n");
+  char z[32];
+  for (int i = nnodes - 1; i >= 0; i--) {
+    std::snprintf(z, 32, "%.6e", x[3 * i + 2]);
+    x[3 * i + 2] = std::strtod(z, nullptr);
+    std::fprintf(fp, "%d, %.17g, %.17g, %s\n", i + 1, x[3 * i], x[3 * i + 1],
+                 z);
+  }
+  std::fprintf(fp, "*Element, type=C3D10\n");
+  for (int e = nelems - 1; e >= 0; e--) {
+    std::fprintf(fp, "%d", e + 1);
+    for (int j = 0; j < 10; j++) std::fprintf(fp, ", %d", conn[10 * e + j] + 1);
+    std::fprintf(fp, "\n");
+  }
+  std::fclose(fp);
+
+  // Small chunks to exercise the splitting of the blocks
+  for (std::size_t chunk_bytes : {std::size_t(1) << 20, std::size_t(97)}) {
+    AbaqusInpReader reader("mesher_test_chunks.inp", chunk_bytes);
+    EXPECT_EQ(reader.get_num_nodes(), nnodes);
+    EXPECT_EQ(reader.get_num_elements(), nelems);
+
+    std::vector<double> xr(3 * nnodes);
+    std::vector<int> connr(10 * nelems);
+    reader.read(connr.data(), xr.data());
+    EXPECT_EQ(connr, conn);
+    EXPECT_EQ(xr, x);
+  }
+}
+
+TEST(utils, AbaqusInpReaderErrors) {
+  int num_elements, num_nodes, *element_nodes;
+  double* xloc;
+  EXPECT_THROW(load_mesh<double>("does_not_exist.inp", &num_elements,
+                                 &num_nodes, &element_nodes, &xloc),
+               std::runtime_error);
+
+  std::ofstream("mesher_test_bad_label.inp") << "*Node\n1, 0, 0, 0\n"
+                                                "3, 1, 0, 0\n";
+  EXPECT_THROW(load_mesh<double>("mesher_test_bad_label.inp", &num_elements,
+                                 &num_nodes, &element_nodes, &xloc),
+               std::runtime_error);
+
+  // Node label 1 twice, node 2 would be left uninitialized
+  std::ofstream("mesher_test_dup_node.inp") << "*Node\n1, 0, 0, 0\n"
+                                               "1, 1, 0, 0\n";
+  AbaqusInpReader dup_node("mesher_test_dup_node.inp");
+  std::vector<double> x(3 * dup_node.get_num_nodes());
+  try {
+    dup_node.read<double>(nullptr, x.data());
+    ADD_FAILURE() << "duplicated node label not detected";
+  } catch (const std::runtime_error& e) {
+    EXPECT_NE(std::string(e.what()).find("duplicated node label 1"),
+              std::string::npos);
+  }
+
+  // Element label 2 twice, in different chunks
+  {
+    std::ofstream out("mesher_test_dup_elem.inp");
+    out << "*Element, type=C3D10\n";
+    for (int e : {1, 2, 3, 2}) {
+      out << e << ", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10\n";
+    }
+  }
+  for (std::size_t chunk_bytes : {std::size_t(1) << 20, std::size_t(16)}) {
+    AbaqusInpReader dup_elem("mesher_test_dup_elem.inp", chunk_bytes);
+    std::vector<int> conn(10 * dup_elem.get_num_elements());
+    EXPECT_THROW(dup_elem.read<double>(conn.data(), nullptr),
+                 std::runtime_error);
+  }
+
+  std::ofstream("mesher_test_bad_line.inp") << "*Element\n1, 1, 2, 3, 4\n";
+  EXPECT_THROW(load_mesh<double>("mesher_test_bad_line.inp", &num_elements,
+                                 &num_nodes, &element_nodes, &xloc),
+               std::runtime_error);
+}
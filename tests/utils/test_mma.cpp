@@ -0,0 +1,116 @@
+#include <cmath>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/checkpoint.h"
+#include "utils/mma.h"
+
+// Svanberg's toy problem, min x1^2 + x2^2 + x3^2 s.t. the design is in two
+// balls of radius 3 and 0 <= x <= 5
+struct MMAToyProblem {
+  static constexpr int n = 3, m = 2;
+
+  void eval(const std::vector<double>& x, double* f0, double* df0dx,
+            double* fval, double* dfdx) const {
+    const double c[m][n] = {{5.0, 2.0, 1.0}, {3.0, 4.0, 3.0}};
+    *f0 = 0.0;
+    for (int j = 0; j < n; j++) {
+      *f0 += x[j] * x[j];
+      df0dx[j] = 2.0 * x[j];
+    }
+    for (int i = 0; i < m; i++) {
+      fval[i] = -9.0;
+      for (int j = 0; j < n; j++) {
+        fval[i] += (x[j] - c[i][j]) * (x[j] - c[i][j]);
+        dfdx[i * n + j] = 2.0 * (x[j] - c[i][j]);
+      }
+    }
+  }
+
+  // Take niter MMA steps from x, the designs are appended to history
+  void run(MMAOptimizer& mma, std::vector<double>& x, int niter,
+           std::vector<std::vector<double>>& history) const {
+    double f0, df0dx[n], fval[m], dfdx[m * n];
+    for (int k = 0; k < niter; k++) {
+      eval(x, &f0, df0dx, fval, dfdx);
+      mma.update(x.data(), df0dx, fval, dfdx);
+      history.push_back(x);
+    }
+  }
+};
+
+TEST(utils, MMAToyProblem) {
+  MMAToyProblem prob;
+  std::vector<double> xmin(3, 0.0), xmax(3, 5.0), x = {4.0, 3.0, 2.0};
+  MMAOptimizer mma(3, 2, xmin, xmax);
+
+  std::vector<std::vector<double>> history;
+  prob.run(mma, x, 50, history);
+  EXPECT_EQ(mma.get_iter(), 50);
+
+  std::vector<double> x_opt = {2.0175, 1.7800, 1.2375};
+  for (int j = 0; j < 3; j++) EXPECT_NEAR(x[j], x_opt[j], 1e-4);
+
+  // Both constraints are active, and the KKT conditions hold with the
+  // multipliers of the last subproblem
+  double f0, df0dx[3], fval[2], dfdx[6];
+  prob.eval(x, &f0, df0dx, fval, dfdx);
+  EXPECT_NEAR(fval[0], 0.0, 1e-6);
+  EXPECT_NEAR(fval[1], 0.0, 1e-6);
+  EXPECT_GT(mma.get_multipliers()[0], 0.0);
+  EXPECT_GT(mma.get_multipliers()[1], 0.0);
+  EXPECT_LT(mma.kkt_residual(x.data(), df0dx, fval, dfdx), 1e-5);
+}
+
+TEST(utils, MMARestartFromCheckpoint) {
+  MMAToyProblem prob;
+  std::vector<double> xmin(3, 0.0), xmax(3, 5.0), x0 = {4.0, 3.0, 2.0};
+  int niter = 20, nstop = 7;
+
+  // Uninterrupted run
+  std::vector<std::vector<double>> history;
+  std::vector<double> x = x0;
+  {
+    MMAOptimizer mma(3, 2, xmin, xmax, 0.2, 0.1);
+    prob.run(mma, x, niter, history);
+  }
+
+  // Interrupted after nstop iterations and restarted from a checkpoint by a
+  // new optimizer
+  std::vector<std::vector<double>> history_restart;
+  x = x0;
+  {
+    MMAOptimizer mma(3, 2, xmin, xmax, 0.2, 0.1);
+    prob.run(mma, x, nstop, history_restart);
+    CheckpointWriter ckpt;
+    ckpt.add("dvs", x);
+    mma.save(ckpt);
+    ckpt.write("checkpoint_mma.xcgd");
+  }
+  {
+    CheckpointReader ckpt("checkpoint_mma.xcgd");
+    MMAOptimizer mma(3, 2, xmin, xmax, 0.2, 0.1);
+    mma.load(ckpt);
+    EXPECT_EQ(mma.get_iter(), nstop);
+    x = ckpt.get<double>("dvs");
+    prob.run(mma, x, niter - nstop, history_restart);
+  }
+
+  // The restarted run follows the same iterates, to the last bit
+  ASSERT_EQ(history_restart.size(), history.size());
+  for (int k = 0; k < niter; k++) EXPECT_EQ(history_restart[k], history[k]);
+
+  // A restart from the design alone reinitializes the asymptotes and takes
+  // different steps
+  std::vector<std::vector<double>> history_cold;
+  x = history[nstop - 1];
+  MMAOptimizer mma(3, 2, xmin, xmax, 0.2, 0.1);
+  prob.run(mma, x, 2, history_cold);
+  EXPECT_NE(history_cold[1], history[nstop + 1]);
+
+  // Checkpointed state of a different size is rejected
+  CheckpointReader ckpt("checkpoint_mma.xcgd");
+  std::vector<double> xmin4(4, 0.0), xmax4(4, 5.0);
+  MMAOptimizer mma4(4, 2, xmin4, xmax4);
+  EXPECT_THROW(mma4.load(ckpt), std::runtime_error);
+}
@@ -0,0 +1,114 @@
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/sweep.h"
+
+TEST(utils, SweepSpecCases) {
+  std::ofstream spec("test_sweep.spec");
+  spec << "# a comment\n"
+       << "Np_1d = 2 4  # trailing comment\n"
+       << "\n"
+       << "nxy = 8 16 32\n"
+       << "instance = circle\n";
+  spec.close();
+
+  SweepSpec sweep("test_sweep.spec");
+  std::vector<SweepCase> cases = sweep.get_cases();
+  EXPECT_EQ(cases.size(), 6);
+
+  // The first parameter varies the slowest
+  std::vector<int> Np_1d_expect = {2, 2, 2, 4, 4, 4};
+  std::vector<int> nxy_expect = {8, 16, 32, 8, 16, 32};
+  for (int i = 0; i < cases.size(); i++) {
+    EXPECT_EQ(cases[i].get<int>("Np_1d"), Np_1d_expect[i]);
+    EXPECT_EQ(cases[i].get<int>("nxy"), nxy_expect[i]);
+    EXPECT_EQ(cases[i].get_str("instance"), "circle");
+    EXPECT_EQ(cases[i].get<double>("nitsche_eta", 1e6), 1e6);
+  }
+  EXPECT_THROW(cases[0].get<int>("instance"), std::runtime_error);
+  EXPECT_THROW(cases[0].get_str("nitsche_eta"), std::runtime_error);
+}
+
+TEST(utils, SweepRunInProcess) {
+  SweepSpec sweep;
+  sweep.add_axis("n", {"1", "2", "3", "4", "5", "6", "7"});
+  sweep.add_axis("a", {"0.5", "2.0"});
+  std::vector<SweepCase> cases = sweep.get_cases();
+
+  SweepTable table = run_sweep(
+      cases, 3,
+      [](const SweepCase& c) {
+        int n = c.get<int>("n");
+        if (n == 4) throw std::runtime_error("n == 4");
+        return std::map<std::string, double>{{"y", c.get<double>("a") * n}};
+      },
+      false);
+
+  // Rows are in the case order regardless of the scheduling
+  const auto& rows = table.get_rows();
+  EXPECT_EQ(rows.size(), cases.size());
+  EXPECT_EQ(table.get_num_failed(), 2);
+  for (int i = 0; i < rows.size(); i++) {
+    int n = i / 2 + 1;
+    double a = i % 2 ? 2.0 : 0.5;
+    EXPECT_EQ(rows[i].c.get<int>("n"), n);
+    EXPECT_EQ(rows[i].ok, n != 4);
+    if (n != 4) {
+      EXPECT_DOUBLE_EQ(rows[i].results.at("y"), a * n);
+    }
+  }
+
+  table.write_csv("test_sweep.csv");
+  std::ifstream csv("test_sweep.csv");
+  std::string header, row0, row6;
+  std::getline(csv, header);
+  std::getline(csv, row0);
+  for (int i = 0; i < 6; i++) std::getline(csv, row6);
+  EXPECT_EQ(header, "n,a,status,time,y");
+  EXPECT_EQ(row0.substr(0, 10), "1,0.5,ok,0");
+  EXPECT_EQ(row6.substr(0, 15), "4,0.5,failed,0.");
+  EXPECT_EQ(row6.back(), ',');
+}
+
+TEST(utils, SweepCacheSharedObjects) {
+  SweepSpec sweep;
+  sweep.add_axis("nxy", {"8", "16"});
+  sweep.add_axis("eta", {"1", "2", "3", "4"});
+  std::vector<SweepCase> cases = sweep.get_cases();
+
+  // The object of a key is built once, even if concurrent cases ask for it
+  SweepCache cache;
+  std::atomic<int> nbuilds{0};
+  SweepTable table = run_sweep(
+      cases, 4,
+      [&](const SweepCase& c) {
+        int nxy = c.get<int>("nxy");
+        std::shared_ptr<std::vector<double>> grid =
+            cache.get<std::vector<double>>(std::to_string(nxy), [&]() {
+              nbuilds++;
+              std::this_thread::sleep_for(std::chrono::milliseconds(10));
+              return std::make_shared<std::vector<double>>(nxy, 1.0);
+            });
+        if (c.get<int>("eta") == 4) {
+          cache.get<int>("bad", []() -> std::shared_ptr<int> {
+            throw std::runtime_error("failed to build");
+          });
+        }
+        return std::map<std::string, double>{{"size", double(grid->size())}};
+      },
+      false);
+
+  EXPECT_EQ(nbuilds, 2);
+  EXPECT_EQ(cache.size(), 3);
+  EXPECT_EQ(table.get_num_failed(), 2);
+  for (const auto& row : table.get_rows()) {
+    if (row.c.get<int>("eta") == 4) {
+      EXPECT_EQ(row.error, "failed to build");
+    } else {
+      EXPECT_EQ(row.results.at("size"), row.c.get<int>("nxy"));
+    }
+  }
+}
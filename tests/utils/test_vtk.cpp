@@ -0,0 +1,89 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test_commons.h"
+#include "utils/vtk.h"
+
+TEST(utils, LZ4RoundTrip) {
+  std::mt19937 gen(0);
+  for (int trial = 0; trial < 200; trial++) {
+    int n = gen() % 5000;
+    std::vector<std::uint8_t> src(n);
+    for (int i = 0; i < n; i++) {
+      switch (trial % 3) {
+        case 0:  // incompressible
+          src[i] = gen();
+          break;
+        case 1:  // short runs
+          src[i] = gen() % 3;
+          break;
+        default:  // periodic
+          src[i] = i % 7;
+      }
+    }
+
+    std::vector<std::uint8_t> compressed, decompressed(n);
+    lz4_compress_block(src.data(), n, compressed);
+    lz4_decompress_block(compressed.data(), compressed.size(),
+                         decompressed.data(), n);
+    EXPECT_EQ(src, decompressed);
+  }
+
+  // Constant doubles compress well
+  std::vector<double> vals(4096, 1.5);
+  std::vector<std::uint8_t> compressed;
+  lz4_compress_block(reinterpret_cast<const std::uint8_t*>(vals.data()),
+                     vals.size() * sizeof(double), compressed);
+  EXPECT_LT(compressed.size(), vals.size() * sizeof(double) / 100);
+}
+
+TEST(utils, VTUAppendedData) {
+  // Two quads
+  std::vector<double> xyz = {0, 0, 0, 1, 0, 0, 2, 0, 0,
+                             0, 1, 0, 1, 1, 0, 2, 1, 0};
+  std::vector<std::int64_t> conn = {0, 1, 4, 3, 1, 2, 5, 4}, offsets = {4, 8};
+  std::vector<std::uint8_t> types(2, VTKID::QUAD);
+  std::vector<double> sol = {0.5, 1.5, 2.5, 3.5, 4.5, 5.5};
+
+  for (auto compression : {VTUCompression::NONE, VTUCompression::LZ4}) {
+    VTUWriter writer(compression);
+    writer.set_points(xyz);
+    writer.set_cells(conn, offsets, types);
+    writer.add_point_data("sol", 1, sol);
+    writer.write("test_vtu.vtu");
+
+    std::ifstream in("test_vtu.vtu", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("NumberOfPoints=\"6\" NumberOfCells=\"2\""),
+              std::string::npos);
+    EXPECT_EQ(content.find("vtkLZ4DataCompressor") != std::string::npos,
+              compression == VTUCompression::LZ4);
+
+    // The first appended array is sol
+    std::size_t start = content.find('_', content.find("<AppendedData")) + 1;
+    const char* data = content.data() + start;
+    std::vector<double> sol_read(sol.size());
+    if (compression == VTUCompression::NONE) {
+      std::uint64_t nbytes;
+      std::memcpy(&nbytes, data, 8);
+      EXPECT_EQ(nbytes, sol.size() * sizeof(double));
+      std::memcpy(sol_read.data(), data + 8, nbytes);
+    } else {
+      std::uint64_t header[4];
+      std::memcpy(header, data, sizeof(header));
+      EXPECT_EQ(header[0], 1);                               // blocks
+      EXPECT_EQ(header[1], VTUWriter::block_size);           // block size
+      EXPECT_EQ(header[2], sol.size() * sizeof(double));     // last block
+      lz4_decompress_block(
+          reinterpret_cast<const std::uint8_t*>(data + sizeof(header)),
+          header[3], reinterpret_cast<std::uint8_t*>(sol_read.data()),
+          sol.size() * sizeof(double));
+    }
+    EXPECT_EQ(sol, sol_read);
+  }
+}